@@ -0,0 +1,347 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+/* sedutil-bench: time sedutil operations against a device or a simulated
+ * device (sim:name[:latency_us[:busy_polls]]) and report the results as JSON.
+ */
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "os.h"
+#include "DtaDevGeneric.h"
+#include "DtaDevOpal1.h"
+#include "DtaDevOpal2.h"
+#include "DtaDevEnterprise.h"
+#include "DtaDevLinuxSim.h"
+#include "DtaSession.h"
+#include "DtaStats.h"
+
+using namespace std;
+
+/* Default to output that includes timestamps and goes to stderr*/
+sedutiloutput outputFormat = sedutilNormal;
+
+/** Options that apply to every workload */
+typedef struct _BENCH_OPTIONS {
+	uint32_t iterations;	/**< timed operations per workload */
+	uint32_t warmup;		/**< untimed operations run first */
+	uint32_t mbrsize;		/**< bytes written per mbrwrite operation */
+	char * password;		/**< Admin1/SID password, NULL if none given */
+	char * device;			/**< device reference */
+	bool sim;				/**< device is a simulated TPer */
+} BENCH_OPTIONS;
+
+/** Results of one workload */
+typedef struct _BENCH_RESULT {
+	string workload;
+	uint32_t errors;
+	uint64_t sends;
+	uint64_t recvs;
+	uint64_t bytes;
+	double total;			/**< wall time of the timed operations in us */
+	vector<double> latency;	/**< per operation latency in us */
+	string stats;			/**< DtaStats JSON for the timed operations */
+} BENCH_RESULT;
+
+static const char * allWorkloads[] = { "discovery0", "session", "lockingranges", "mbrwrite", "unlockall", "rekeyall", "initialsetup" };
+#define BENCH_WORKLOADS (sizeof(allWorkloads) / sizeof(allWorkloads[0]))
+
+static void benchUsage()
+{
+	printf("sedutil-bench [-n iterations] [-w warmup] [-p password] [-s mbrbytes] [-v] <workload>[,<workload>...] <device>\n");
+	printf("workloads:\n");
+	printf("    discovery0     Level 0 discovery (one IF_RECV)\n");
+	printf("    session        StartSession/EndSession, AdminSP anonymous or LockingSP Admin1 if -p\n");
+	printf("    lockingranges  Get of every locking range in one Admin1 session (needs -p)\n");
+	printf("    mbrwrite       write mbrbytes (default 1048576) to the shadow MBR (needs -p)\n");
+	printf("    unlockall      --setAllLockingRanges RW, every range and MBRDone (needs -p)\n");
+	printf("    rekeyall       --rekeyAllLockingRanges, ERASES the ranges (sim: devices only)\n");
+	printf("    initialsetup   full --initialSetup from factory state (sim: devices only)\n");
+	printf("    all            every workload that applies to the device\n");
+	printf("device:\n");
+	printf("    /dev/sdX, /dev/nvmeX or sim:name[:latency_us[:busy_polls]]\n");
+	printf("Simulated devices are taken through --initialSetup with the password\n");
+	printf("(default sedutil-bench) before the Locking SP workloads are run.\n");
+}
+
+static double benchNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((double)ts.tv_sec * 1000000.0) + ((double)ts.tv_nsec / 1000.0);
+}
+
+/** Open the device the way sedutil-cli does, probe then pick the SSC */
+static DtaDev * benchOpen(char * devref)
+{
+	DtaDev * tempDev, *d = NULL;
+	tempDev = new DtaDevGeneric(devref);
+	if ((!tempDev->isPresent()) || (!tempDev->isAnySSC())) {
+		LOG(E) << "Invalid or unsupported disk " << devref;
+		delete tempDev;
+		return NULL;
+	}
+	if (tempDev->isOpal2())
+		d = new DtaDevOpal2(devref);
+	else if (tempDev->isOpal1())
+		d = new DtaDevOpal1(devref);
+	else if (tempDev->isEprise())
+		d = new DtaDevEnterprise(devref);
+	delete tempDev;
+	if (NULL != d) d->no_hash_passwords = false;
+	return d;
+}
+
+/** Run one operation of a workload, returns the sedutil return code */
+static uint8_t benchOp(const string &workload, DtaDev * d, BENCH_OPTIONS * opts,
+	char * pbafile, DtaDev ** setup)
+{
+	if ("discovery0" == workload) {
+		uint8_t rc = d->discovery0();
+		if (rc) return rc;
+		return d->isAnySSC() ? 0 : DTAERROR_COMMAND_ERROR;
+	}
+	if ("session" == workload) {
+		uint8_t rc;
+		DtaSession * session = new DtaSession(d);
+		if (NULL == opts->password)
+			rc = session->start(d->isEprise() ? OPAL_UID::ENTERPRISE_LOCKINGSP_UID : OPAL_UID::OPAL_ADMINSP_UID);
+		else if (d->isEprise())
+			rc = session->start(OPAL_UID::ENTERPRISE_LOCKINGSP_UID, opts->password, OPAL_UID::ENTERPRISE_BANDMASTER0_UID);
+		else
+			rc = session->start(OPAL_UID::OPAL_LOCKINGSP_UID, opts->password, OPAL_UID::OPAL_ADMIN1_UID);
+		if (rc) session->expectAbort();
+		delete session;
+		return rc;
+	}
+	if ("lockingranges" == workload)
+		return d->listLockingRanges(opts->password, -1);
+	if ("mbrwrite" == workload)
+		return d->loadPBA(opts->password, pbafile);
+	if ("unlockall" == workload)
+		return d->setAllLockingRanges(OPAL_LOCKINGSTATE::READWRITE, opts->password, NULL);
+	if ("rekeyall" == workload)
+		return d->rekeyAllLockingRanges(opts->password);
+	if ("initialsetup" == workload) {
+		/* the device object is rebuilt for each pass so it sees factory state */
+		return (*setup)->initialSetup(opts->password);
+	}
+	return DTAERROR_INVALID_PARAMETER;
+}
+
+static BENCH_RESULT benchRun(const string &workload, DtaDev * d, BENCH_OPTIONS * opts, char * pbafile)
+{
+	BENCH_RESULT r;
+	DtaDevOS * os = (DtaDevOS *)d;
+	DtaDev * setup = NULL;
+	double start, begin;
+	r.workload = workload;
+	r.errors = 0;
+	r.sends = r.recvs = r.bytes = 0;
+	r.total = 0;
+	for (uint32_t i = 0; i < opts->warmup + opts->iterations; i++) {
+		if (i == opts->warmup) DtaStats::reset();
+		if ("initialsetup" == workload) {
+			DtaDevLinuxSim::reset(opts->device);
+			setup = benchOpen(opts->device);
+			if (NULL == setup) {
+				r.errors++;
+				continue;
+			}
+			os = (DtaDevOS *)setup;
+		}
+		uint64_t sends = os->sendCount, recvs = os->recvCount;
+		begin = benchNow();
+		uint8_t rc = benchOp(workload, d, opts, pbafile, &setup);
+		start = benchNow() - begin;
+		if (i >= opts->warmup) {
+			if (rc) r.errors++;
+			r.latency.push_back(start);
+			r.total += start;
+			r.sends += os->sendCount - sends;
+			r.recvs += os->recvCount - recvs;
+			if ("mbrwrite" == workload) r.bytes += opts->mbrsize;
+		}
+		if (NULL != setup) {
+			delete setup;
+			setup = NULL;
+		}
+	}
+	char * buf = NULL;
+	size_t len = 0;
+	FILE * stats = open_memstream(&buf, &len);
+	if (NULL != stats) {
+		DtaStats::print(stats, true);
+		fclose(stats);
+		r.stats.assign(buf, len);
+		if (!r.stats.empty() && ('\n' == r.stats.back())) r.stats.erase(r.stats.size() - 1);
+		free(buf);
+	}
+	return r;
+}
+
+static double benchPercentile(vector<double> &sorted, double p)
+{
+	if (sorted.empty()) return 0;
+	size_t idx = (size_t)((p / 100.0) * (double)(sorted.size() - 1) + 0.5);
+	return sorted[idx];
+}
+
+static void benchPrint(BENCH_RESULT &r, bool last)
+{
+	vector<double> sorted(r.latency);
+	double ops = (double)sorted.size();
+	double mean = 0;
+	sort(sorted.begin(), sorted.end());
+	if (ops > 0) mean = r.total / ops;
+	printf("    {\"workload\": \"%s\", \"iterations\": %u, \"errors\": %u,\n",
+		r.workload.c_str(), (uint32_t)sorted.size(), r.errors);
+	printf("     \"total_us\": %.1f, \"ops_per_sec\": %.2f,\n", r.total,
+		(r.total > 0) ? ops * 1000000.0 / r.total : 0.0);
+	printf("     \"round_trips_per_op\": %.2f, \"if_send_per_op\": %.2f, \"if_recv_per_op\": %.2f,\n",
+		(ops > 0) ? (double)(r.sends + r.recvs) / ops : 0.0,
+		(ops > 0) ? (double)r.sends / ops : 0.0,
+		(ops > 0) ? (double)r.recvs / ops : 0.0);
+	if (r.bytes)
+		printf("     \"bytes_per_sec\": %.0f,\n", (r.total > 0) ? (double)r.bytes * 1000000.0 / r.total : 0.0);
+	if (!r.stats.empty())
+		printf("     \"stats\": %s,\n", r.stats.c_str());
+	printf("     \"latency_us\": {\"min\": %.1f, \"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f}}%s\n",
+		sorted.empty() ? 0.0 : sorted.front(), mean,
+		benchPercentile(sorted, 50), benchPercentile(sorted, 90), benchPercentile(sorted, 99),
+		sorted.empty() ? 0.0 : sorted.back(), last ? "" : ",");
+}
+
+int main(int argc, char * argv[])
+{
+	BENCH_OPTIONS opts;
+	vector<string> workloads;
+	vector<BENCH_RESULT> results;
+	char pbafile[] = "/tmp/sedutil-bench-XXXXXX";
+	char defaultPassword[] = "sedutil-bench";
+	int loglevel = 0, c;
+	DtaDev * d;
+
+	opts.iterations = 100;
+	opts.warmup = 1;
+	opts.mbrsize = 1024 * 1024;
+	opts.password = NULL;
+	while ((c = getopt(argc, argv, "n:w:p:s:vh")) != -1) {
+		switch (c) {
+		case 'n': opts.iterations = (uint32_t)atol(optarg); break;
+		case 'w': opts.warmup = (uint32_t)atol(optarg); break;
+		case 'p': opts.password = optarg; break;
+		case 's': opts.mbrsize = (uint32_t)atol(optarg); break;
+		case 'v': loglevel++; break;
+		default: benchUsage(); return DTAERROR_INVALID_PARAMETER;
+		}
+	}
+	if (argc - optind != 2) {
+		benchUsage();
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	CLog::Level() = CLog::FromInt(loglevel);
+	RCLog::Level() = CLog::FromInt(loglevel);
+	/* debug output must not distort the timings */
+	if (loglevel > 2) DtaLogSink::start();
+	opts.device = argv[optind + 1];
+	opts.sim = !strncmp(opts.device, "sim:", 4);
+	if (opts.sim && (NULL == opts.password)) opts.password = defaultPassword;
+
+	stringstream list(argv[optind]);
+	string workload;
+	while (getline(list, workload, ',')) {
+		if ("all" == workload) {
+			for (uint32_t i = 0; i < BENCH_WORKLOADS; i++)
+				workloads.push_back(allWorkloads[i]);
+			continue;
+		}
+		if (allWorkloads + BENCH_WORKLOADS == find(allWorkloads, allWorkloads + BENCH_WORKLOADS, workload)) {
+			LOG(E) << "Unknown workload " << workload;
+			benchUsage();
+			return DTAERROR_INVALID_PARAMETER;
+		}
+		workloads.push_back(workload);
+	}
+
+	DtaStats::enabled() = true;
+	/* the Locking SP workloads need an owned, activated simulated TPer */
+	if (opts.sim) {
+		DtaDevLinuxSim::reset(opts.device);
+		if ((d = benchOpen(opts.device)) == NULL) return DTAERROR_OPEN_ERR;
+		if (d->initialSetup(opts.password)) {
+			LOG(E) << "Unable to set up simulated device " << opts.device;
+			delete d;
+			return DTAERROR_COMMAND_ERROR;
+		}
+		delete d;
+	}
+	if ((d = benchOpen(opts.device)) == NULL) return DTAERROR_OPEN_ERR;
+
+	int fd = mkstemp(pbafile);
+	if (fd < 0) {
+		LOG(E) << "Unable to create MBR image " << pbafile;
+		delete d;
+		return DTAERROR_OPEN_ERR;
+	}
+	vector<uint8_t> image(opts.mbrsize);
+	for (uint32_t i = 0; i < opts.mbrsize; i++) image[i] = (uint8_t)i;
+	if (write(fd, image.data(), image.size()) != (ssize_t)image.size()) {
+		LOG(E) << "Short write to MBR image " << pbafile;
+	}
+	close(fd);
+
+	/* loadPBA and friends report progress on cout, keep stdout for the JSON */
+	streambuf * coutbuf = cout.rdbuf();
+	ofstream devnull("/dev/null");
+	for (uint32_t i = 0; i < workloads.size(); i++) {
+		if ((("lockingranges" == workloads[i]) || ("mbrwrite" == workloads[i]) ||
+			("unlockall" == workloads[i])) && (NULL == opts.password)) {
+			LOG(E) << workloads[i] << " skipped, it needs a password (-p)";
+			continue;
+		}
+		if ((("initialsetup" == workloads[i]) || ("rekeyall" == workloads[i])) && (!opts.sim)) {
+			LOG(E) << workloads[i] << " skipped, it is only run on sim: devices";
+			continue;
+		}
+		cout.rdbuf(devnull.rdbuf());
+		results.push_back(benchRun(workloads[i], d, &opts, pbafile));
+		cout.rdbuf(coutbuf);
+	}
+	unlink(pbafile);
+
+	printf("{\"device\": \"%s\", \"model\": \"%s\", \"firmware\": \"%s\",\n", opts.device,
+		d->getModelNum(), d->getFirmwareRev());
+	printf(" \"ssc\": \"%s\", \"iterations\": %u, \"warmup\": %u,\n",
+		d->isOpal2() ? "Opal 2" : d->isOpal1() ? "Opal 1" : d->isEprise() ? "Enterprise" : "unknown",
+		opts.iterations, opts.warmup);
+	printf(" \"results\": [\n");
+	for (uint32_t i = 0; i < results.size(); i++)
+		benchPrint(results[i], i + 1 == results.size());
+	printf(" ]}\n");
+	delete d;
+	return 0;
+}
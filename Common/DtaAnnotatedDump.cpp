@@ -342,11 +342,11 @@ int DtaToken::printAscii(FILE *stream, uint8_t * buf, uint32_t buflen)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-uint8_t DtaAnnotatedDump(ATACOMMAND cmd, void * buffer, uint32_t bufferlen)
+uint8_t DtaAnnotatedDump(ATACOMMAND cmd, void * buffer, uint32_t bufferlen, FILE * stream)
 ////////////////////////////////////////////////////////////////////////////////
 {
-    FILE * stream = stderr;
-
+    // queued debug output belongs ahead of the dump
+    if (DtaLogSink::active()) DtaLogSink::flush();
     // hello
     if (cmd == IF_RECV)
         fprintf(stream, "<< IF_RECV >>\n");
@@ -141,5 +141,5 @@ private:
 };
 
 ////////////////////////////////////////////////////////////////////////////////
-extern uint8_t DtaAnnotatedDump(ATACOMMAND cmd, void * buffer, uint32_t bufferlen);
+extern uint8_t DtaAnnotatedDump(ATACOMMAND cmd, void * buffer, uint32_t bufferlen, FILE * stream = stderr);
 ////////////////////////////////////////////////////////////////////////////////
@@ -53,6 +53,7 @@ DtaCommand::reset()
     memset(cmdbuf, 0, MAX_BUFFER_LENGTH);
 	memset(respbuf, 0, MIN_BUFFER_LENGTH);
     bufferpos = sizeof (OPALHeader);
+	overrun = 0;
 }
 void 
 DtaCommand::reset(OPAL_UID InvokingUid, vector<uint8_t> method){
@@ -88,6 +89,7 @@ DtaCommand::addToken(uint64_t number)
 {
     int startat = 0;
     LOG(D1) << "Entering DtaCommand::addToken(uint64_t)";
+	if (!room(9)) return;
     if (number < 64) {
         cmdbuf[bufferpos++] = (uint8_t) number & 0x000000000000003f;
     }
@@ -118,6 +120,7 @@ void
 DtaCommand::addToken(vector<uint8_t> token)
 {
     LOG(D1) << "Entering addToken(vector<uint8_t>)";
+	if (!room((uint32_t)token.size())) return;
     for (uint32_t i = 0; i < token.size(); i++) {
         cmdbuf[bufferpos++] = token[i];
     }
@@ -127,7 +130,14 @@ void
 DtaCommand::addToken(const char * bytestring)
 {
     LOG(D1) << "Entering DtaCommand::addToken(const char * )";
-    uint16_t length = (uint16_t) strlen(bytestring);
+    size_t length = strlen(bytestring);
+    if (length >= 2048) {
+        /* Use Large Atom */
+        LOG(E) << "FAIL -- can't send LARGE ATOM size bytestring in 2048 Packet";
+		overrun = 1;
+		return;
+    }
+	if (!room((uint32_t)length + 2)) return;
     if (length == 0) {
         /* null token e.g. default password */
         cmdbuf[bufferpos++] = (uint8_t)0xa1;
@@ -137,16 +147,11 @@ DtaCommand::addToken(const char * bytestring)
         /* use tiny atom */
         cmdbuf[bufferpos++] = (uint8_t) length | 0xa0;
     }
-    else if (length < 2048) {
+    else {
         /* Use Medium Atom */
         cmdbuf[bufferpos++] = 0xd0 | (uint8_t) ((length >> 8) & 0x07);
         cmdbuf[bufferpos++] = (uint8_t) (length & 0x00ff);
     }
-    else {
-        /* Use Large Atom */
-        LOG(E) << "FAIL -- can't send LARGE ATOM size bytestring in 2048 Packet";
-		exit(EXIT_FAILURE);
-    }
     memcpy(&cmdbuf[bufferpos], bytestring, length);
     bufferpos += length;
 
@@ -156,6 +161,7 @@ void
 DtaCommand::addToken(OPAL_TOKEN token)
 {
     LOG(D1) << "Entering DtaCommand::addToken(OPAL_TOKEN)";
+	if (!room(1)) return;
     cmdbuf[bufferpos++] = (uint8_t) token;
 }
 
@@ -163,6 +169,7 @@ void
 DtaCommand::addToken(OPAL_SHORT_ATOM token)
 {
     LOG(D1) << "Entering DtaCommand::addToken(OPAL_SHORT_ATOM)";
+	if (!room(1)) return;
     cmdbuf[bufferpos++] = (uint8_t)token;
 }
 
@@ -170,6 +177,7 @@ void
 DtaCommand::addToken(OPAL_TINY_ATOM token)
 {
     LOG(D1) << "Entering DtaCommand::addToken(OPAL_TINY_ATOM)";
+	if (!room(1)) return;
     cmdbuf[bufferpos++] = (uint8_t) token;
 }
 
@@ -177,6 +185,7 @@ void
 DtaCommand::addToken(OPAL_UID token)
 {
     LOG(D1) << "Entering DtaCommand::addToken(OPAL_UID)";
+	if (!room(9)) return;
     cmdbuf[bufferpos++] = OPAL_SHORT_ATOM::BYTESTRING8;
     memcpy(&cmdbuf[bufferpos], &OPALUID[token][0], 8);
     bufferpos += 8;
@@ -186,6 +195,8 @@ void
 DtaCommand::complete(uint8_t EOD)
 {
     LOG(D1) << "Entering DtaCommand::complete(uint8_t EOD)";
+	/* room for the EOD, method status list and padding */
+	if (!room(9)) return;
     if (EOD) {
         cmdbuf[bufferpos++] = OPAL_TOKEN::ENDOFDATA;
         cmdbuf[bufferpos++] = OPAL_TOKEN::STARTLIST;
@@ -204,10 +215,24 @@ DtaCommand::complete(uint8_t EOD)
     hdr->pkt.length = SWAP32((bufferpos - sizeof (OPALComPacket))
                              - sizeof (OPALPacket));
     hdr->cp.length = SWAP32(bufferpos - sizeof (OPALComPacket));
-	if (bufferpos > MAX_BUFFER_LENGTH) {
-		LOG(D1) << " Standard Buffer Overrun " << bufferpos;
-		exit(EXIT_FAILURE);
+}
+
+uint8_t
+DtaCommand::room(uint32_t length)
+{
+	if ((!overrun) && (bufferpos + length <= MAX_BUFFER_LENGTH))
+		return 1;
+	if (!overrun) {
+		LOG(E) << " Standard Buffer Overrun " << bufferpos + length;
 	}
+	overrun = 1;
+	return 0;
+}
+
+uint8_t
+DtaCommand::isOverrun()
+{
+	return overrun;
 }
 
 void
@@ -221,6 +246,26 @@ DtaCommand::changeInvokingUid(std::vector<uint8_t> Invoker)
 
 }
 
+void
+DtaCommand::call(vector<uint8_t> InvokingUid, OPAL_METHOD method)
+{
+    LOG(D1) << "Entering DtaCommand::call()";
+	/* EOD, status list and CALL, addToken checks the invoker */
+	if (!room(7)) return;
+    cmdbuf[bufferpos++] = OPAL_TOKEN::ENDOFDATA;
+    cmdbuf[bufferpos++] = OPAL_TOKEN::STARTLIST;
+    cmdbuf[bufferpos++] = 0x00;
+    cmdbuf[bufferpos++] = 0x00;
+    cmdbuf[bufferpos++] = 0x00;
+    cmdbuf[bufferpos++] = OPAL_TOKEN::ENDLIST;
+    cmdbuf[bufferpos++] = OPAL_TOKEN::CALL;
+	addToken(InvokingUid);
+	if (!room(9)) return;
+    cmdbuf[bufferpos++] = OPAL_SHORT_ATOM::BYTESTRING8;
+    memcpy(&cmdbuf[bufferpos], &OPALMETHOD[method][0], 8);
+    bufferpos += 8;
+}
+
 void *
 DtaCommand::getCmdBuffer()
 {
@@ -253,15 +298,15 @@ DtaCommand::outputBufferSize() {
 		return((uint16_t)(bufferpos / 512) * 512);
 }
 void
-DtaCommand::setcomID(uint16_t comID)
+DtaCommand::setcomID(uint16_t comID, uint16_t extension)
 {
     OPALHeader * hdr;
     hdr = (OPALHeader *) cmdbuf;
     LOG(D1) << "Entering DtaCommand::setcomID()";
     hdr->cp.extendedComID[0] = ((comID & 0xff00) >> 8);
     hdr->cp.extendedComID[1] = (comID & 0x00ff);
-    hdr->cp.extendedComID[2] = 0x00;
-    hdr->cp.extendedComID[3] = 0x00;
+    hdr->cp.extendedComID[2] = ((extension & 0xff00) >> 8);
+    hdr->cp.extendedComID[3] = (extension & 0x00ff);
 }
 
 void
@@ -65,8 +65,11 @@ public:
     void addToken(std::vector<uint8_t> token);
     /** Add a Token to the bytstream of type uint64. */
     void addToken(uint64_t number);
-    /** Set the commid to be used in the command. */
-    void setcomID(uint16_t comID);
+    /** Set the commid to be used in the command.
+     * @param comID the comID
+     * @param extension comID extension, non zero only for dynamic comIDs
+     */
+    void setcomID(uint16_t comID, uint16_t extension = 0);
     /** set the Host session number to be used in the command. */
     void setHSN(uint32_t HSN);
     /** Set the TPer session number to be used for the command. */
@@ -114,13 +117,28 @@ public:
      *   @param Invoker  The UID used to call the SSC method
      */
     void changeInvokingUid(vector<uint8_t> Invoker);
+    /** End the method call being built with its EOD and status list and
+     * start another one in the same subpacket.  Only for TPers that take
+     * more than one method per packet, see DtaDev::maxMethods().
+     *
+     *   @param InvokingUid  The UID used to call the SSC method
+     *   @param method The SSC method to be called
+     */
+    void call(vector<uint8_t> InvokingUid, OPAL_METHOD method);
     /** Produce a hexdump of the response.  Typically used in debugging and tracing */
 	void dumpResponse();
     /** Produce a hexdump of the command.  Typically used in debugging and tracing */
 	void dumpCommand();
 	/** Return the space used in the command buffer (rounded to 512 bytes) */
 	uint16_t outputBufferSize();
+	/** Did a token or the trailer not fit in the command buffer.
+	 * The command is incomplete and must not be sent.
+	 */
+	uint8_t isOverrun();
 private:
+	/** Check that length more bytes fit in the command buffer,
+	 * flag the command as overrun if they do not */
+	uint8_t room(uint32_t length);
     /** return a pointer to the command buffer */
 	void * getCmdBuffer();
     /** return a pointer to the response buffer. */
@@ -130,4 +148,5 @@ private:
 	uint8_t *cmdbuf;  /**< Pointer to the command buffer */
     uint8_t *respbuf;  /**< pointer to the response buffer */
     uint32_t bufferpos = 0;  /**< position of the next byte in the command buffer */
+	uint8_t overrun = 0; /**< the command did not fit in the buffer */
 };
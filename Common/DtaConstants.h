@@ -27,6 +27,9 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 * things I tried to make it work.
 */
 #define IO_BUFFER_ALIGNMENT 1024
+/** Method calls the host accepts in one ComPacket (MaxMethods host
+ * property), small enough that their results fit MIN_BUFFER_LENGTH */
+#define DTA_HOST_MAXMETHODS 16
 /** maximum number of disks to be scanned */
 #define MAX_DISKS 20
 /** iomanip commands to hexdump a field */
@@ -44,6 +47,10 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #define DTAERROR_COMMAND_ERROR				0x88
 #define DTAERROR_NO_METHOD_STATUS			0x89
 #define DTAERROR_NO_LOCKING_INFO			0x8a
+#define DTAERROR_NO_COMID					0x8b
+#define DTAERROR_INTERRUPTED				0x8c
+#define DTAERROR_DEVICE_LOCKED				0x8d
+#define DTAERROR_BAD_RESPONSE				0x8e
 /** Locking Range Configurations */
 #define DTA_DISABLELOCKING		0x00
 #define DTA_READLOCKINGENABLED		0x01
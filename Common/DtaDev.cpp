@@ -23,15 +23,21 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
  * specific to the IO requirements of that OS
  */
 #include "os.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <iostream>
 #include <iomanip>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
 #include "DtaOptions.h"
 #include "DtaDev.h"
 #include "DtaStructures.h"
 #include "DtaConstants.h"
 #include "DtaEndianFixup.h"
 #include "DtaHexDump.h"
+#include "DtaStats.h"
 
 using namespace std;
 
@@ -43,6 +49,200 @@ DtaDev::DtaDev()
 }
 DtaDev::~DtaDev()
 {
+	releaseComID();
+}
+
+/** static comIDs held by the DtaDev objects of this process, per drive */
+static std::mutex DtaComIDLock;
+static map<string, set<uint16_t> > DtaComIDs;
+
+/** key for DtaComIDs, objects for the same drive can have different devrefs */
+static string comIDKey(OPAL_DiskInfo & disk_info)
+{
+	return string((char *)disk_info.modelNum, sizeof(disk_info.modelNum)) +
+		string((char *)disk_info.serialNum, sizeof(disk_info.serialNum));
+}
+
+uint8_t DtaDev::rekeyAllLockingRanges(char * password)
+{
+	LOG(D1) << "Entering DtaDev::rekeyAllLockingRanges()";
+	(void)password;
+	LOG(E) << "rekeyAllLockingRanges is not supported on " << dev;
+	return DTAERROR_INVALID_COMMAND;
+}
+
+uint8_t DtaDev::setAllLockingRanges(uint8_t lockingstate, char * password,
+	uint32_t * elapsedUs)
+{
+	LOG(D1) << "Entering DtaDev::setAllLockingRanges()";
+	(void)lockingstate; (void)password; (void)elapsedUs;
+	LOG(E) << "setAllLockingRanges is not supported on " << dev;
+	return DTAERROR_INVALID_COMMAND;
+}
+
+uint8_t DtaDev::provision(const DtaProvisionPlan & plan, DtaProvisionProgress progress)
+{
+	LOG(D1) << "Entering DtaDev::provision()";
+	(void)plan;
+	(void)progress;
+	LOG(E) << "Provisioning is not supported on " << dev;
+	return DTAERROR_INVALID_COMMAND;
+}
+
+uint8_t DtaDev::acquireComID()
+{
+	LOG(D1) << "Entering DtaDev::acquireComID()";
+	uint16_t base, count;
+	if (ownComID) return 0;
+	if (disk_info.OPAL20) {
+		base = disk_info.OPAL20_basecomID;
+		count = disk_info.OPAL20_numcomIDs;
+	}
+	else if (disk_info.OPAL10) {
+		base = disk_info.OPAL10_basecomID;
+		count = disk_info.OPAL10_numcomIDs;
+	}
+	else {
+		base = disk_info.Enterprise_basecomID;
+		count = disk_info.Enterprise_numcomID;
+	}
+	if (disk_info.TPer_comIDMgt) {
+		/* GET_COMID, protocol 2 comID 0, returns comID and extension */
+		uint8_t buffer[MIN_BUFFER_LENGTH + IO_BUFFER_ALIGNMENT];
+		uint8_t * p = (uint8_t *)((uintptr_t)(buffer + IO_BUFFER_ALIGNMENT) &
+			(uintptr_t)~(IO_BUFFER_ALIGNMENT - 1));
+		memset(p, 0, MIN_BUFFER_LENGTH);
+		if ((0 == sendCmd(IF_RECV, 0x02, 0x0000, p, MIN_BUFFER_LENGTH)) &&
+			((p[0] << 8) | p[1])) {
+			ownComID = (uint16_t)((p[0] << 8) | p[1]);
+			ownComIDExtension = (uint16_t)((p[2] << 8) | p[3]);
+			LOG(D1) << "Dynamic comID " << HEXON(4) << ownComID << HEXOFF;
+			return 0;
+		}
+		LOG(D1) << "GET_COMID failed, using the static comIDs";
+	}
+	std::lock_guard<std::mutex> guard(DtaComIDLock);
+	set<uint16_t> & held = DtaComIDs[comIDKey(disk_info)];
+	for (uint16_t i = 1; i <= count; i++) {
+		uint16_t c = (uint16_t)(base + (i % count));
+		if (held.count(c)) continue;
+		held.insert(c);
+		ownComID = c;
+		ownComIDExtension = 0;
+		LOG(D1) << "Static comID " << HEXON(4) << ownComID << HEXOFF;
+		return 0;
+	}
+	LOG(D1) << "All " << count << " comIDs are in use";
+	return DTAERROR_NO_COMID;
+}
+
+void DtaDev::releaseComID()
+{
+	if (!ownComID) return;
+	LOG(D1) << "Entering DtaDev::releaseComID() " << HEXON(4) << ownComID << HEXOFF;
+	/* a dynamic comID is not in DtaComIDs, the TPer reclaims it */
+	{
+		std::lock_guard<std::mutex> guard(DtaComIDLock);
+		map<string, set<uint16_t> >::iterator it = DtaComIDs.find(comIDKey(disk_info));
+		if (DtaComIDs.end() != it) {
+			it->second.erase(ownComID);
+			if (it->second.empty()) DtaComIDs.erase(it);
+		}
+	}
+	ownComID = 0;
+	ownComIDExtension = 0;
+}
+
+uint16_t DtaDev::comIDExtension()
+{
+	return ownComIDExtension;
+}
+
+string DtaDev::driveKey()
+{
+	return comIDKey(disk_info);
+}
+uint32_t DtaDev::maxSessions()
+{
+	return tperMaxSessions;
+}
+uint32_t DtaDev::maxMethods()
+{
+	if (0 == tperMaxMethods) return 1;
+	return (DTA_HOST_MAXMETHODS < tperMaxMethods) ? DTA_HOST_MAXMETHODS : tperMaxMethods;
+}
+bool & DtaDev::lockDiscovery()
+{
+	static bool on = false;
+	return on;
+}
+bool & DtaDev::resetComID()
+{
+	static bool on = false;
+	return on;
+}
+
+uint8_t DtaDev::comIDRequest(uint32_t code, uint8_t * response)
+{
+	LOG(D1) << "Entering DtaDev::comIDRequest() " << code;
+	uint8_t buffer[MIN_BUFFER_LENGTH + IO_BUFFER_ALIGNMENT];
+	uint8_t * p = (uint8_t *)((uintptr_t)(buffer + IO_BUFFER_ALIGNMENT) &
+		(uintptr_t)~(IO_BUFFER_ALIGNMENT - 1));
+	uint16_t c = comID(), ext = comIDExtension();
+	uint8_t rc;
+	memset(p, 0, MIN_BUFFER_LENGTH);
+	p[0] = c >> 8;
+	p[1] = c & 0xff;
+	p[2] = ext >> 8;
+	p[3] = ext & 0xff;
+	p[4] = (code >> 24) & 0xff;
+	p[5] = (code >> 16) & 0xff;
+	p[6] = (code >> 8) & 0xff;
+	p[7] = code & 0xff;
+	if ((rc = sendCmd(IF_SEND, 0x02, c, p, MIN_BUFFER_LENGTH)) != 0) {
+		LOG(D1) << "comID request send failed " << (uint16_t)rc;
+		return rc;
+	}
+	/* the response is ready once the available data length is set */
+	for (int i = 0; i < 20; i++) {
+		memset(p, 0, MIN_BUFFER_LENGTH);
+		if ((rc = sendCmd(IF_RECV, 0x02, c, p, MIN_BUFFER_LENGTH)) != 0) {
+			LOG(D1) << "comID request receive failed " << (uint16_t)rc;
+			return rc;
+		}
+		if ((p[10] << 8) | p[11]) {
+			memcpy(response, p, MIN_BUFFER_LENGTH);
+			return 0;
+		}
+		osmsSleep(i < 10 ? 1 : 25);
+	}
+	LOG(D1) << "No response to comID request " << code;
+	return DTAERROR_COMMAND_ERROR;
+}
+
+uint8_t DtaDev::verifyComID(uint32_t & state)
+{
+	LOG(D1) << "Entering DtaDev::verifyComID()";
+	uint8_t response[MIN_BUFFER_LENGTH];
+	uint8_t rc;
+	state = 0;
+	if ((rc = comIDRequest(0x00000001, response)) != 0) return rc;
+	state = (response[12] << 24) | (response[13] << 16) | (response[14] << 8) | response[15];
+	LOG(D1) << "comID " << HEXON(4) << comID() << HEXOFF << " state " << state;
+	return 0;
+}
+
+uint8_t DtaDev::stackReset()
+{
+	LOG(D1) << "Entering DtaDev::stackReset()";
+	uint8_t response[MIN_BUFFER_LENGTH];
+	uint8_t rc;
+	if ((rc = comIDRequest(0x00000002, response)) != 0) return rc;
+	if (response[12] | response[13] | response[14] | response[15]) {
+		LOG(D1) << "STACK_RESET of comID " << HEXON(4) << comID() << HEXOFF << " failed";
+		return DTAERROR_COMMAND_ERROR;
+	}
+	return 0;
 }
 uint8_t DtaDev::isOpal2()
 {
@@ -106,7 +306,7 @@ DTA_DEVICE_TYPE DtaDev::getDevType()
 	{
 		return disk_info.devType;
 	}
-void DtaDev::discovery0()
+uint8_t DtaDev::discovery0()
 {
     LOG(D1) << "Entering DtaDev::discovery0()";
 	uint8_t lastRC;
@@ -117,13 +317,34 @@ void DtaDev::discovery0()
 	d0Response = discovery0buffer + IO_BUFFER_ALIGNMENT;
 	d0Response = (void *)((uintptr_t)d0Response & (uintptr_t)~(IO_BUFFER_ALIGNMENT - 1));
 	memset(d0Response, 0, MIN_BUFFER_LENGTH);
-    if ((lastRC = sendCmd(IF_RECV, 0x01, 0x0001, d0Response, MIN_BUFFER_LENGTH)) != 0) {
+	if (lockDiscovery() && ((lastRC = lockDrive(DTA_LOCK_SHARED)) != 0)) {
+		LOG(E) << "Unable to lock the drive for discovery " << (uint16_t)lastRC;
+		return lastRC;
+	}
+	uint64_t start = DtaStats::now();
+	lastRC = sendCmd(IF_RECV, 0x01, 0x0001, d0Response, MIN_BUFFER_LENGTH);
+	if (lockDiscovery()) unlockDrive(DTA_LOCK_SHARED);
+    if (lastRC != 0) {
         LOG(D) << "Send D0 request to device failed " << (uint16_t)lastRC;
-        return;
+        return lastRC;
     }
+	DtaStats::phase(DTASTATS_DISCOVERY, start, MIN_BUFFER_LENGTH);
 
     epos = cpos = (uint8_t *) d0Response;
     hdr = (Discovery0Header *) d0Response;
+    /* the length excludes its own 4 bytes, the header is 48; 0 is a
+     * drive without TCG features */
+    if ((0 != hdr->length) &&
+        ((SWAP32(hdr->length) < 44) || (SWAP32(hdr->length) > MIN_BUFFER_LENGTH - 4))) {
+        LOG(E) << "Level 0 Discovery length " << SWAP32(hdr->length) << " is not valid";
+        return DTAERROR_BAD_RESPONSE;
+    }
+    /* a feature the drive no longer reports must not keep its old state,
+     * everything up to the identify fields comes from discovery */
+    uint8_t properties = disk_info.Properties;
+    memset(&disk_info, 0, offsetof(OPAL_DiskInfo, devType));
+    disk_info.Properties = properties;
+    if (0 == hdr->length) return 0;
     LOG(D3) << "Dumping D0Response";
     IFLOG(D3) DtaHexDump(hdr, SWAP32(hdr->length));
     epos = epos + SWAP32(hdr->length);
@@ -209,7 +430,7 @@ void DtaDev::discovery0()
         cpos = cpos + (body->TPer.length + 4);
     }
     while (cpos < epos);
-
+    return 0;
 }
 void DtaDev::puke()
 {
@@ -219,6 +440,7 @@ void DtaDev::puke()
             disk_info.devType == DEVICE_TYPE_SAS ? " SAS " : 
             disk_info.devType == DEVICE_TYPE_USB ? " USB " :
             disk_info.devType == DEVICE_TYPE_NVME ? " NVMe " :
+            disk_info.devType == DEVICE_TYPE_SIM ? " SIM " :
                     " OTHER ");
 	cout << disk_info.modelNum << " " << disk_info.firmwareRev << " " << disk_info.serialNum << endl;
 	/* TPer */
@@ -20,13 +20,41 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 #include "DtaStructures.h"
 #include "DtaLexicon.h"
+#include <functional>
 #include <vector>
+#include <string>
 #include "DtaOptions.h"
 #include "DtaResponse.h"
 class DtaCommand;
 class DtaSession;
 
 using namespace std;
+/** A locking range to lay out while provisioning */
+typedef struct _DtaProvisionRange {
+	uint8_t range; /**< locking range number, 1 and up */
+	uint64_t start; /**< starting LBA */
+	uint64_t length; /**< number of blocks */
+} DtaProvisionRange;
+
+/** The state DtaDev::provision() brings a drive to.  Steps run in the order
+ * of the fields, those left false, empty or -1 are skipped.
+ */
+typedef struct _DtaProvisionPlan {
+	std::string password; /**< new SID password, also Admin1 once activated */
+	bool takeOwnership = false; /**< change the SID password from MSID */
+	bool activate = false; /**< activate the Locking SP */
+	std::vector<DtaProvisionRange> ranges; /**< set up and rekey these ranges */
+	std::string pba; /**< image to write to the shadow MBR */
+	int8_t mbrEnable = -1; /**< 0 or 1 to change MBREnable */
+	int8_t mbrDone = -1; /**< 0 or 1 to change MBRDone */
+} DtaProvisionPlan;
+
+/** Called by DtaDev::provision() as each step completes
+ * @param step name of the step, takeOwnership, activate, range, pba, mbrEnable, mbrDone
+ * @param rc return code of the step
+ */
+typedef std::function<void(const char * step, uint8_t rc)> DtaProvisionProgress;
+
 /** Base class for a disk device.
  * This is a virtual base class defining the minimum functionality of device
  * object.  The methods defined here are called by other parts of the program 
@@ -71,8 +99,11 @@ public:
 	 * that can be queried later as required.This code also takes care of
 	 * the endianess conversions either via a bitswap in the structure or executing
 	 * a macro when the input buffer is read.
+	 * @return 0, the sendCmd error, or DTAERROR_BAD_RESPONSE if the reply
+	 *         is not a Level 0 Discovery header; disk_info is left as it
+	 *         was unless 0 is returned
 	 */
-	void discovery0();
+	uint8_t discovery0();
 
 	/*
 	 * virtual methods required in the OS specific
@@ -104,6 +135,22 @@ public:
 	virtual void identify(OPAL_DiskInfo& disk_info) = 0;
 	/** OS specific routine to get size of the device */
 	virtual unsigned long long getSize() = 0;
+	/** OS specific routine to take an advisory lock on the drive that other
+	 * processes respect, keyed by driveKey() so every device name of the
+	 * drive shares it.  Without an OS implementation nothing is locked.
+	 * @param mode DTA_LOCK_SHARED or DTA_LOCK_EXCLUSIVE
+	 */
+	virtual uint8_t lockDrive(DTA_LOCK mode) { (void)mode; return 0; }
+	/** OS specific routine to give back a lock taken with lockDrive
+	 * @param mode the mode passed to lockDrive
+	 */
+	virtual void unlockDrive(DTA_LOCK mode) { (void)mode; }
+	/** flag that makes discovery0() hold a shared drive lock, so it waits
+	 * for the sessions of other processes to end */
+	static bool & lockDiscovery();
+	/** flag that lets a session start STACK_RESET a comID that has no
+	 * sessions available, see DtaSession::start */
+	static bool & resetComID();
 	/*
 	 * virtual functions required to be implemented
 	 * because they are called by sedutil.cpp
@@ -195,6 +242,18 @@ public:
 	* @param password password of the locking administrative authority
 	*/
 	virtual uint8_t rekeyLockingRange(uint8_t lockingrange, char * password) = 0;
+	/** Generate new encryption keys for every locking range in one session.
+	* @param password password of the locking administrative authority
+	*/
+	virtual uint8_t rekeyAllLockingRanges(char * password);
+	/** Lock or unlock every locking range, and set MBRDone to match, in one
+	* session, for the suspend and resume paths.
+	* @param lockingstate READWRITE, READONLY or LOCKED
+	* @param password password of the locking administrative authority
+	* @param elapsedUs if not NULL, set to the time taken in microseconds
+	*/
+	virtual uint8_t setAllLockingRanges(uint8_t lockingstate, char * password,
+		uint32_t * elapsedUs);
 	/** Enable bands using MSID.
 	* @param lockingrange locking range number
 	*/
@@ -271,6 +330,13 @@ public:
 	/** Read MSID
 	 */
 	virtual uint8_t printDefaultPassword() = 0;
+	/** Bring the drive to the state in a plan, reusing one session for
+	 * every step that needs the same SP and authority
+	 * @param plan what to do
+	 * @param progress called after each step
+	 * @return 0 or the return code of the first step that failed
+	 */
+	virtual uint8_t provision(const DtaProvisionPlan & plan, DtaProvisionProgress progress);
 	/*
 	* virtual functions required to be implemented
 	* because they are called by DtaSession.cpp
@@ -283,9 +349,43 @@ public:
 	virtual uint8_t exec(DtaCommand * cmd, DtaResponse & resp, uint8_t protocol = 0x01) = 0;
 	/** return the communications ID to be used for sessions to this device */
 	virtual uint16_t comID() = 0;
+	/** Take a comID for the sessions of this object alone, so they can run
+	 * next to the sessions of other objects on the same drive.  When the
+	 * TPer manages comIDs a dynamic one is requested with GET_COMID,
+	 * otherwise a static comID no other object in this process holds is
+	 * taken, the base comID (used by objects without one of their own) last.
+	 * @return 0 or DTAERROR_NO_COMID when every comID is taken
+	 */
+	virtual uint8_t acquireComID();
+	/** Give back the comID taken by acquireComID(), later sessions use the
+	 * base comID again */
+	void releaseComID();
+	/** comID extension to send with comID(), non zero for dynamic comIDs */
+	uint16_t comIDExtension();
+	/** Ask the TPer for the state of comID() with a protocol 2
+	 * VERIFY_COMID_VALID request
+	 * @param state 0 invalid, 1 inactive, 2 issued, 3 associated
+	 */
+	uint8_t verifyComID(uint32_t & state);
+	/** Reset the protocol stack of comID() with a protocol 2 STACK_RESET,
+	 * which aborts any session left open on it without waiting for the
+	 * session timeout */
+	uint8_t stackReset();
+	/** key that names the drive, the same for every object opened on it */
+	std::string driveKey();
+	/** sessions the TPer runs at once from its Properties, 0 if not reported */
+	uint32_t maxSessions();
+	/** method calls to put in one packet, the TPer's MaxMethods bounded by
+	 * DTA_HOST_MAXMETHODS, 1 unless the TPer reported more */
+	uint32_t maxMethods();
 	bool no_hash_passwords; /** disables hashing of passwords */
 	sedutiloutput output_format; /** standard, readable, JSON */
 protected:
+	/** Send a protocol 2 comID management request and poll for its response
+	 * @param code the request code
+	 * @param response buffer of MIN_BUFFER_LENGTH bytes for the response
+	 */
+	uint8_t comIDRequest(uint32_t code, uint8_t * response);
 	const char * dev;   /**< character string representing the device in the OS lexicon */
 	uint8_t isOpen = FALSE;  /**< The device has been opened */
 	OPAL_DiskInfo disk_info;  /**< Structure containing info from identify and discovery 0 */
@@ -293,6 +393,10 @@ protected:
 	DtaResponse propertiesResponse;  /**< response fron properties exchange */
 	DtaSession *session;  /**< shared session object pointer */
 	uint8_t discovery0buffer[MIN_BUFFER_LENGTH + IO_BUFFER_ALIGNMENT];
+	uint16_t ownComID = 0; /**< comID from acquireComID(), 0 uses the base comID */
+	uint16_t ownComIDExtension = 0; /**< extension of a dynamic ownComID */
 	uint32_t tperMaxPacket = 2048;
 	uint32_t tperMaxToken = 1950;
+	uint32_t tperMaxSessions = 0;
+	uint32_t tperMaxMethods = 1;
 };
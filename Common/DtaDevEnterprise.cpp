@@ -32,6 +32,7 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include "DtaSession.h"
 #include "DtaHexDump.h"
 #include "DtaAnnotatedDump.h"
+#include "DtaStats.h"
 #ifdef _MSC_VER
 #pragma warning(push)
 #pragma warning(disable:4100)
@@ -1412,29 +1413,44 @@ uint8_t DtaDevEnterprise::getTable(vector<uint8_t> table, const char * startcol,
 uint16_t DtaDevEnterprise::comID()
 {
     LOG(D1) << "Entering DtaDevEnterprise::comID()";
-    return disk_info.Enterprise_basecomID;
+    return ownComID ? ownComID : disk_info.Enterprise_basecomID;
 }
 uint8_t DtaDevEnterprise::exec(DtaCommand * cmd, DtaResponse & resp, uint8_t protocol)
 {
     uint8_t rc = 0;
+    uint32_t polls = 0;
+    uint64_t start, t;
+	if (cmd->isOverrun()) {
+		LOG(E) << "Command does not fit in the buffer, not sent";
+		return DTAERROR_COMMAND_ERROR;
+	}
     OPALHeader * hdr = (OPALHeader *) cmd->getCmdBuffer();
     LOG(D3) << endl << "Dumping command buffer";
     IFLOG(D) DtaAnnotatedDump(IF_SEND, cmd->getCmdBuffer(), cmd->outputBufferSize());
     IFLOG(D3) DtaHexDump(cmd->getCmdBuffer(), SWAP32(hdr->cp.length) + sizeof (OPALComPacket));
+    /* the timing starts at the transport, not before the debug dumps */
+    start = DtaStats::now();
     rc = sendCmd(IF_SEND, protocol, comID(), cmd->getCmdBuffer(), cmd->outputBufferSize());
     if (0 != rc) {
         LOG(E) << "Command failed on send " << (uint16_t) rc;
         return rc;
     }
+    DtaStats::phase(DTASTATS_SEND, start, cmd->outputBufferSize());
     hdr = (OPALHeader *) cmd->getRespBuffer();
     do {
         //LOG(I) << "read loop";
+        t = DtaStats::now();
         osmsSleep(25);
+        DtaStats::phase(DTASTATS_POLL, t);
         memset(cmd->getRespBuffer(), 0, MIN_BUFFER_LENGTH);
+        t = DtaStats::now();
         rc = sendCmd(IF_RECV, protocol, comID(), cmd->getRespBuffer(), MIN_BUFFER_LENGTH);
-
+        DtaStats::phase(DTASTATS_RECV, t, MIN_BUFFER_LENGTH);
+        polls++;
     }
     while ((0 != hdr->cp.outstandingData) && (0 == hdr->cp.minTransfer));
+    DtaStats::method(cmd->getCmdBuffer(), start, polls, cmd->outputBufferSize(),
+        SWAP32(hdr->cp.length) + sizeof (OPALComPacket));
     LOG(D3) << std::endl << "Dumping reply buffer";
     IFLOG(D) DtaAnnotatedDump(IF_RECV, cmd->getRespBuffer(), SWAP32(hdr->cp.length) + sizeof (OPALComPacket));
     IFLOG(D3) DtaHexDump(cmd->getRespBuffer(), SWAP32(hdr->cp.length) + sizeof (OPALComPacket));
@@ -1442,9 +1458,23 @@ uint8_t DtaDevEnterprise::exec(DtaCommand * cmd, DtaResponse & resp, uint8_t pro
         LOG(E) << "Command failed on recv, returned " << (uint16_t) rc;
         return rc;
     }
-    resp.init(cmd->getRespBuffer());
+    resp.init(cmd->getRespBuffer(), MIN_BUFFER_LENGTH);
     return 0;
 }
+uint8_t DtaDevEnterprise::acquireComID()
+{
+	LOG(D1) << "Entering DtaDevEnterprise::acquireComID()";
+	uint8_t lastRC;
+	if (ownComID) return 0;
+	if ((lastRC = DtaDev::acquireComID()) != 0) return lastRC;
+	/* host properties belong to the comID they were sent on */
+	if ((lastRC = properties()) != 0) {
+		LOG(E) << "Properties exchange on comID " << HEXON(4) << comID() << HEXOFF << " failed";
+		releaseComID();
+		return lastRC;
+	}
+	return 0;
+}
 uint8_t DtaDevEnterprise::properties()
 {
 	LOG(D1) << "Entering DtaDevEnterprise::properties()";
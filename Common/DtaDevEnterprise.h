@@ -47,6 +47,9 @@ public:
          * receive the TPer maximum values
          */
 	uint8_t properties();
+        /** Take a comID of its own, see DtaDev::acquireComID, and repeat
+         * the properties exchange on it */
+	uint8_t acquireComID();
          /** Send a command to the device and wait for the response
          * @param cmd the DtaCommand object containg the command
          * @param response the DtaResonse object containing the response
@@ -56,6 +56,11 @@ DtaDevGeneric::DtaDevGeneric(const char * devref)
 	DtaDevOS::init(devref);
 }
 
+DtaDevGeneric::DtaDevGeneric(const char * devref, const OPAL_DiskInfo & identity)
+{
+	DtaDevOS::init(devref, &identity);
+}
+
 DtaDevGeneric::~DtaDevGeneric()
 {
 }
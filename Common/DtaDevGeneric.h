@@ -40,6 +40,12 @@ public:
      * @param devref reference to device is OS specific lexicon 
      *  */
     DtaDevGeneric(const char * devref);
+    /** Constructor that skips identify where the OS layer can, see
+     * DtaDevOS::init(const char *, const OPAL_DiskInfo *).
+     * @param devref reference to device is OS specific lexicon
+     * @param identity results of an earlier identify of the device
+     */
+    DtaDevGeneric(const char * devref, const OPAL_DiskInfo & identity);
     /** Default constructor */
 	~DtaDevGeneric();
         /** OS specific initialization.
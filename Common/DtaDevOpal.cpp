@@ -25,6 +25,7 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include <iostream>
 #include <fstream>
 #include<iomanip>
+#include <chrono>
 #include "DtaDevOpal.h"
 #include "DtaHashPwd.h"
 #include "DtaEndianFixup.h"
@@ -33,6 +34,7 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include "DtaResponse.h"
 #include "DtaSession.h"
 #include "DtaHexDump.h"
+#include "DtaStats.h"
 
 using namespace std;
 
@@ -84,6 +86,115 @@ uint8_t DtaDevOpal::initialSetup(char * password)
 	return 0;
 }
 
+uint8_t DtaDevOpal::provision(const DtaProvisionPlan & plan, DtaProvisionProgress progress)
+{
+	LOG(D1) << "Entering DtaDevOpal::provision() " << dev;
+	uint8_t lastRC;
+	char * password = (char *)plan.password.c_str();
+	vector<uint8_t> mbrcontrol;
+	mbrcontrol.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
+	for (int i = 0; i < 8; i++) {
+		mbrcontrol.push_back(OPALUID[OPAL_UID::OPAL_MBRCONTROL][i]);
+	}
+	if (plan.takeOwnership || plan.activate) {
+		string msid;
+		if (plan.takeOwnership) {
+			if ((lastRC = getDefaultPassword()) != 0) {
+				LOG(E) << "Unable to read MSID password ";
+				progress("takeOwnership", lastRC);
+				return lastRC;
+			}
+			msid = response.getString(4);
+		}
+		session = new DtaSession(this);
+		if (NULL == session) {
+			LOG(E) << "Unable to create session object ";
+			return DTAERROR_OBJECT_CREATE_FAILED;
+		}
+		if (plan.takeOwnership) session->dontHashPwd();
+		if ((lastRC = session->start(OPAL_UID::OPAL_ADMINSP_UID,
+			plan.takeOwnership ? (char *)msid.c_str() : password, OPAL_UID::OPAL_SID_UID)) != 0) {
+			delete session;
+			progress(plan.takeOwnership ? "takeOwnership" : "activate", lastRC);
+			return lastRC;
+		}
+		if (plan.takeOwnership) {
+			lastRC = setSIDPinInSession(password);
+			progress("takeOwnership", lastRC);
+			if (lastRC) {
+				delete session;
+				return lastRC;
+			}
+		}
+		if (plan.activate) {
+			lastRC = activateInSession();
+			progress("activate", lastRC);
+			if (lastRC) {
+				delete session;
+				return lastRC;
+			}
+		}
+		delete session;
+	}
+	if (plan.ranges.empty() && plan.pba.empty() && (0 > plan.mbrEnable) && (0 > plan.mbrDone)) {
+		LOG(D1) << "Exiting DtaDevOpal::provision()";
+		return 0;
+	}
+	session = new DtaSession(this);
+	if (NULL == session) {
+		LOG(E) << "Unable to create session object ";
+		return DTAERROR_OBJECT_CREATE_FAILED;
+	}
+	if ((lastRC = session->start(OPAL_UID::OPAL_LOCKINGSP_UID, password, OPAL_UID::OPAL_ADMIN1_UID)) != 0) {
+		delete session;
+		progress(!plan.ranges.empty() ? "range" : !plan.pba.empty() ? "pba" :
+			(0 <= plan.mbrEnable) ? "mbrEnable" : "mbrDone", lastRC);
+		return lastRC;
+	}
+	for (size_t i = 0; i < plan.ranges.size(); i++) {
+		const DtaProvisionRange &r = plan.ranges[i];
+		if (0 == r.range) lastRC = DTAERROR_UNSUPORTED_LOCKING_RANGE;
+		else if ((lastRC = setRangeInSession(r.range, r.start, r.length)) == 0)
+			lastRC = genKeyInSession(r.range);
+		progress("range", lastRC);
+		if (lastRC) {
+			delete session;
+			return lastRC;
+		}
+	}
+	if (!plan.pba.empty()) {
+		lastRC = writeMBRInSession((char *)plan.pba.c_str(), false);
+		progress("pba", lastRC);
+		if (lastRC) {
+			delete session;
+			return lastRC;
+		}
+	}
+	if (0 <= plan.mbrEnable) {
+		// set MBRDone before changing MBREnable so the PBA isn't presented
+		if ((lastRC = setTable(mbrcontrol, OPAL_TOKEN::MBRDONE, OPAL_TOKEN::OPAL_TRUE)) == 0)
+			lastRC = setTable(mbrcontrol, OPAL_TOKEN::MBRENABLE,
+				plan.mbrEnable ? OPAL_TOKEN::OPAL_TRUE : OPAL_TOKEN::OPAL_FALSE);
+		progress("mbrEnable", lastRC);
+		if (lastRC) {
+			delete session;
+			return lastRC;
+		}
+	}
+	if (0 <= plan.mbrDone) {
+		lastRC = setTable(mbrcontrol, OPAL_TOKEN::MBRDONE,
+			plan.mbrDone ? OPAL_TOKEN::OPAL_TRUE : OPAL_TOKEN::OPAL_FALSE);
+		progress("mbrDone", lastRC);
+		if (lastRC) {
+			delete session;
+			return lastRC;
+		}
+	}
+	delete session;
+	LOG(D1) << "Exiting DtaDevOpal::provision()";
+	return 0;
+}
+
 uint8_t DtaDevOpal::setup_SUM(uint8_t lockingrange, uint64_t start, uint64_t length, char *Admin1Password, char * password)
 {
 	LOG(D1) << "Entering setup_SUM()";
@@ -271,13 +382,6 @@ uint8_t DtaDevOpal::setupLockingRange(uint8_t lockingrange, uint64_t start,
 		LOG(E) << "global locking range cannot be changed";
 		return DTAERROR_UNSUPORTED_LOCKING_RANGE;
 	}
-	vector<uint8_t> LR;
-	LR.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (int i = 0; i < 8; i++) {
-		LR.push_back(OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL][i]);
-	}
-	LR[6] = 0x03;
-	LR[8] = lockingrange;
 	session = new DtaSession(this);
 	if (NULL == session) {
 		LOG(E) << "Unable to create session object ";
@@ -287,58 +391,18 @@ uint8_t DtaDevOpal::setupLockingRange(uint8_t lockingrange, uint64_t start,
 		delete session;
 		return lastRC;
 	}
-	DtaCommand *set = new DtaCommand();
-	if (NULL == set) {
-		LOG(E) << "Unable to create command object ";
-		delete session;
-		return DTAERROR_OBJECT_CREATE_FAILED;
-	}
-	set->reset(OPAL_UID::OPAL_AUTHORITY_TABLE, OPAL_METHOD::SET);
-	set->changeInvokingUid(LR);
-	set->addToken(OPAL_TOKEN::STARTLIST);
-	set->addToken(OPAL_TOKEN::STARTNAME);
-	set->addToken(OPAL_TOKEN::VALUES); 
-	set->addToken(OPAL_TOKEN::STARTLIST);
-	set->addToken(OPAL_TOKEN::STARTNAME);
-	set->addToken(OPAL_TOKEN::RANGESTART);
-	set->addToken(start);
-	set->addToken(OPAL_TOKEN::ENDNAME);
-	set->addToken(OPAL_TOKEN::STARTNAME);
-	set->addToken(OPAL_TOKEN::RANGELENGTH);
-	set->addToken(length);
-	set->addToken(OPAL_TOKEN::ENDNAME);
-	set->addToken(OPAL_TOKEN::STARTNAME);
-	set->addToken(OPAL_TOKEN::READLOCKENABLED);
-	set->addToken(OPAL_TOKEN::OPAL_FALSE);
-	set->addToken(OPAL_TOKEN::ENDNAME);
-	set->addToken(OPAL_TOKEN::STARTNAME);
-	set->addToken(OPAL_TOKEN::WRITELOCKENABLED);
-	set->addToken(OPAL_TOKEN::OPAL_FALSE);
-	set->addToken(OPAL_TOKEN::ENDNAME);
-	set->addToken(OPAL_TOKEN::STARTNAME);
-	set->addToken(OPAL_TOKEN::READLOCKED);
-	set->addToken(OPAL_TOKEN::OPAL_FALSE);
-	set->addToken(OPAL_TOKEN::ENDNAME);
-	set->addToken(OPAL_TOKEN::STARTNAME);
-	set->addToken(OPAL_TOKEN::WRITELOCKED);
-	set->addToken(OPAL_TOKEN::OPAL_FALSE);
-	set->addToken(OPAL_TOKEN::ENDNAME);
-	set->addToken(OPAL_TOKEN::ENDLIST);
-	set->addToken(OPAL_TOKEN::ENDNAME);
-	set->addToken(OPAL_TOKEN::ENDLIST);
-	set->complete();
-	if ((lastRC = session->sendCommand(set, response)) != 0) {
+	if ((lastRC = setRangeInSession(lockingrange, start, length)) != 0) {
 		LOG(E) << "setupLockingRange Failed ";
-		delete set;
 		delete session;
 		return lastRC;
 	}
-	delete set;
-	delete session;
-	if ((lastRC = rekeyLockingRange(lockingrange, password)) != 0) {
+	/* the new key is generated in the same session */
+	if ((lastRC = genKeyInSession(lockingrange)) != 0) {
 		LOG(E) << "setupLockingRange Unable to reKey Locking range -- Possible security issue ";
+		delete session;
 		return lastRC;
 	}
+	delete session;
 	LOG(I) << "LockingRange" << (uint16_t)lockingrange << " starting block " << start <<
 		" for " << length << " blocks configured as unlocked range";
 	LOG(D1) << "Exiting DtaDevOpal:setupLockingRange()";
@@ -499,15 +563,31 @@ uint8_t DtaDevOpal::rekeyLockingRange(uint8_t lockingrange, char * password)
 {
 	LOG(D1) << "Entering DtaDevOpal::rekeyLockingRange()";
 	uint8_t lastRC;
-	vector<uint8_t> LR;
-	LR.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (int i = 0; i < 8; i++) {
-		LR.push_back(OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL][i]);
+	session = new DtaSession(this);
+	if (NULL == session) {
+		LOG(E) << "Unable to create session object ";
+		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
-	if (lockingrange != 0) {
-		LR[6] = 0x03;
-		LR[8] = lockingrange;
+	if ((lastRC = session->start(OPAL_UID::OPAL_LOCKINGSP_UID, password, OPAL_UID::OPAL_ADMIN1_UID)) != 0) {
+		delete session;
+		return lastRC;
 	}
+	if ((lastRC = genKeyInSession(lockingrange)) != 0) {
+		LOG(E) << "rekeyLockingRange Failed ";
+		delete session;
+		return lastRC;
+	}
+	delete session;
+	LOG(I) << "LockingRange" << (uint16_t)lockingrange << " reKeyed ";
+	LOG(D1) << "Exiting DtaDevOpal::rekeyLockingRange()";
+	return 0;
+}
+uint8_t DtaDevOpal::rekeyAllLockingRanges(char * password)
+{
+	LOG(D1) << "Entering DtaDevOpal::rekeyAllLockingRanges()";
+	uint8_t lastRC;
+	uint32_t numRanges;
+	vector<vector<uint8_t> > ranges, keys;
 	session = new DtaSession(this);
 	if (NULL == session) {
 		LOG(E) << "Unable to create session object ";
@@ -517,14 +597,291 @@ uint8_t DtaDevOpal::rekeyLockingRange(uint8_t lockingrange, char * password)
 		delete session;
 		return lastRC;
 	}
-	if ((lastRC = getTable(LR, OPAL_TOKEN::ACTIVEKEY, OPAL_TOKEN::ACTIVEKEY)) != 0) {
+	if ((lastRC = rangeCountInSession(numRanges)) != 0) {
 		delete session;
 		return lastRC;
 	}
+	ranges.resize(numRanges);
+	for (uint32_t i = 0; i < numRanges; i++)
+		rangeUID((uint8_t)i, ranges[i]);
+	/* one Get of the ActiveKey column per range */
+	lastRC = batchInSession(ranges, OPAL_METHOD::GET,
+		[](DtaCommand * cmd, size_t i) {
+			(void)i;
+			cmd->addToken(OPAL_TOKEN::STARTLIST);
+			cmd->addToken(OPAL_TOKEN::STARTLIST);
+			cmd->addToken(OPAL_TOKEN::STARTNAME);
+			cmd->addToken(OPAL_TOKEN::STARTCOLUMN);
+			cmd->addToken(OPAL_TOKEN::ACTIVEKEY);
+			cmd->addToken(OPAL_TOKEN::ENDNAME);
+			cmd->addToken(OPAL_TOKEN::STARTNAME);
+			cmd->addToken(OPAL_TOKEN::ENDCOLUMN);
+			cmd->addToken(OPAL_TOKEN::ACTIVEKEY);
+			cmd->addToken(OPAL_TOKEN::ENDNAME);
+			cmd->addToken(OPAL_TOKEN::ENDLIST);
+			cmd->addToken(OPAL_TOKEN::ENDLIST);
+		},
+		[&](size_t first, size_t count) {
+			(void)first;
+			size_t found = 0;
+			for (uint32_t t = 0; t + 2 < response.getTokenCount(); t++) {
+				if ((OPAL_TOKEN::STARTNAME == response.tokenIs(t)) &&
+					(OPAL_TOKEN::DTA_TOKENID_UINT == response.tokenIs(t + 1)) &&
+					(OPAL_TOKEN::ACTIVEKEY == response.getUint8(t + 1))) {
+					keys.push_back(response.getRawToken(t + 2));
+					found++;
+				}
+			}
+			if (found != count) {
+				LOG(E) << "ActiveKey missing for " << count - found << " locking ranges";
+				return (uint8_t)DTAERROR_NO_LOCKING_INFO;
+			}
+			return (uint8_t)0;
+		});
+	if (lastRC) {
+		delete session;
+		return lastRC;
+	}
+	lastRC = batchInSession(keys, OPAL_METHOD::GENKEY,
+		[](DtaCommand * cmd, size_t i) {
+			(void)i;
+			cmd->addToken(OPAL_TOKEN::STARTLIST);
+			cmd->addToken(OPAL_TOKEN::ENDLIST);
+		});
+	if (lastRC) {
+		LOG(E) << "rekeyAllLockingRanges Failed ";
+		delete session;
+		return lastRC;
+	}
+	delete session;
+	LOG(I) << numRanges << " locking ranges reKeyed, " << maxMethods() << " calls per packet";
+	LOG(D1) << "Exiting DtaDevOpal::rekeyAllLockingRanges()";
+	return 0;
+}
+uint8_t DtaDevOpal::setAllLockingRanges(uint8_t lockingstate, char * password,
+	uint32_t * elapsedUs)
+{
+	LOG(D1) << "Entering DtaDevOpal::setAllLockingRanges()";
+	uint8_t lastRC;
+	uint32_t numRanges = 0;
+	OPAL_TOKEN readlocked, writelocked, mbrdone;
+	const char *msg;
+	vector<vector<uint8_t> > invokers;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	switch (lockingstate) {
+	case OPAL_LOCKINGSTATE::READWRITE:
+		readlocked = writelocked = OPAL_TOKEN::OPAL_FALSE;
+		mbrdone = OPAL_TOKEN::OPAL_TRUE;
+		msg = "RW";
+		break;
+	case OPAL_LOCKINGSTATE::READONLY:
+		readlocked = OPAL_TOKEN::OPAL_FALSE;
+		writelocked = OPAL_TOKEN::OPAL_TRUE;
+		mbrdone = OPAL_TOKEN::OPAL_TRUE;
+		msg = "RO";
+		break;
+	case OPAL_LOCKINGSTATE::LOCKED:
+		readlocked = writelocked = OPAL_TOKEN::OPAL_TRUE;
+		mbrdone = OPAL_TOKEN::OPAL_FALSE;
+		msg = "LK";
+		break;
+	default:
+		LOG(E) << "Invalid locking state for setAllLockingRanges";
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	session = new DtaSession(this);
+	if (NULL == session) {
+		LOG(E) << "Unable to create session object ";
+		return DTAERROR_OBJECT_CREATE_FAILED;
+	}
+	if ((lastRC = session->start(OPAL_UID::OPAL_LOCKINGSP_UID, password, OPAL_UID::OPAL_ADMIN1_UID)) != 0) {
+		delete session;
+		return lastRC;
+	}
+	/* Level 0 already counts the Locking table rows, saves a Get */
+	if (disk_info.SingleUser && (0 != disk_info.SingleUser_lockingObjects))
+		numRanges = disk_info.SingleUser_lockingObjects;
+	else if ((lastRC = rangeCountInSession(numRanges)) != 0) {
+		delete session;
+		return lastRC;
+	}
+	invokers.resize(numRanges + 1);
+	for (uint32_t i = 0; i < numRanges; i++)
+		rangeUID((uint8_t)i, invokers[i]);
+	invokers[numRanges].push_back(OPAL_SHORT_ATOM::BYTESTRING8);
+	for (int i = 0; i < 8; i++) {
+		invokers[numRanges].push_back(OPALUID[OPAL_UID::OPAL_MBRCONTROL][i]);
+	}
+	lastRC = batchInSession(invokers, OPAL_METHOD::SET,
+		[&](DtaCommand * cmd, size_t i) {
+			cmd->addToken(OPAL_TOKEN::STARTLIST);
+			cmd->addToken(OPAL_TOKEN::STARTNAME);
+			cmd->addToken(OPAL_TOKEN::VALUES);
+			cmd->addToken(OPAL_TOKEN::STARTLIST);
+			if (i == numRanges) {
+				cmd->addToken(OPAL_TOKEN::STARTNAME);
+				cmd->addToken(OPAL_TOKEN::MBRDONE);
+				cmd->addToken(mbrdone);
+				cmd->addToken(OPAL_TOKEN::ENDNAME);
+			}
+			else {
+				cmd->addToken(OPAL_TOKEN::STARTNAME);
+				cmd->addToken(OPAL_TOKEN::READLOCKED);
+				cmd->addToken(readlocked);
+				cmd->addToken(OPAL_TOKEN::ENDNAME);
+				cmd->addToken(OPAL_TOKEN::STARTNAME);
+				cmd->addToken(OPAL_TOKEN::WRITELOCKED);
+				cmd->addToken(writelocked);
+				cmd->addToken(OPAL_TOKEN::ENDNAME);
+			}
+			cmd->addToken(OPAL_TOKEN::ENDLIST);
+			cmd->addToken(OPAL_TOKEN::ENDNAME);
+			cmd->addToken(OPAL_TOKEN::ENDLIST);
+		});
+	if (lastRC) {
+		LOG(E) << "setAllLockingRanges Failed ";
+		delete session;
+		return lastRC;
+	}
+	delete session;
+	uint32_t us = (uint32_t)chrono::duration_cast<chrono::microseconds>(
+		chrono::steady_clock::now() - start).count();
+	if (NULL != elapsedUs)
+		*elapsedUs = us;
+	LOG(I) << numRanges << " locking ranges set to " << msg << ", MBRDone " <<
+		((OPAL_TOKEN::OPAL_TRUE == mbrdone) ? "on" : "off") << " in " <<
+		(us / 1000) << "." << setw(3) << setfill('0') << (us % 1000) << setfill(' ') << " ms";
+	LOG(D1) << "Exiting DtaDevOpal::setAllLockingRanges()";
+	return 0;
+}
+uint8_t DtaDevOpal::batchInSession(const vector<vector<uint8_t> > & invokers, OPAL_METHOD method,
+	std::function<void(DtaCommand * cmd, size_t i)> params,
+	std::function<uint8_t(size_t first, size_t count)> results)
+{
+	LOG(D1) << "Entering DtaDevOpal::batchInSession()";
+	uint8_t lastRC;
+	size_t batch = maxMethods();
+	DtaCommand *cmd = new DtaCommand();
+	if (NULL == cmd) {
+		LOG(E) << "Unable to create command object ";
+		return DTAERROR_OBJECT_CREATE_FAILED;
+	}
+	for (size_t first = 0; first < invokers.size(); first += batch) {
+		size_t count = ((invokers.size() - first) < batch) ? invokers.size() - first : batch;
+		for (size_t i = first; i < first + count; i++) {
+			if (i == first) {
+				cmd->reset(OPAL_UID::OPAL_AUTHORITY_TABLE, method);
+				cmd->changeInvokingUid(invokers[i]);
+			}
+			else
+				cmd->call(invokers[i], method);
+			params(cmd, i);
+		}
+		cmd->complete();
+		if ((lastRC = session->sendCommand(cmd, response)) != 0) {
+			delete cmd;
+			return lastRC;
+		}
+		if (results && ((lastRC = results(first, count)) != 0)) {
+			delete cmd;
+			return lastRC;
+		}
+	}
+	delete cmd;
+	return 0;
+}
+uint8_t DtaDevOpal::rangeCountInSession(uint32_t & ranges)
+{
+	LOG(D1) << "Entering DtaDevOpal::rangeCountInSession()";
+	uint8_t lastRC;
+	vector<uint8_t> table;
+	table.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
+	for (int i = 0; i < 8; i++) {
+		table.push_back(OPALUID[OPAL_UID::OPAL_LOCKING_INFO_TABLE][i]);
+	}
+	if ((lastRC = getTable(table, OPAL_TOKEN::MAXRANGES, OPAL_TOKEN::MAXRANGES)) != 0)
+		return lastRC;
+	if (response.tokenIs(4) != OPAL_TOKEN::DTA_TOKENID_UINT) {
+		LOG(E) << "Unable to determine number of ranges ";
+		return DTAERROR_NO_LOCKING_INFO;
+	}
+	ranges = response.getUint32(4) + 1;
+	return 0;
+}
+void DtaDevOpal::rangeUID(uint8_t lockingrange, vector<uint8_t> &LR)
+{
+	LR.clear();
+	LR.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
+	for (int i = 0; i < 8; i++) {
+		LR.push_back(OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL][i]);
+	}
+	if (lockingrange != 0) {
+		LR[6] = 0x03;
+		LR[8] = lockingrange;
+	}
+}
+uint8_t DtaDevOpal::setRangeInSession(uint8_t lockingrange, uint64_t start,
+	uint64_t length)
+{
+	LOG(D1) << "Entering DtaDevOpal::setRangeInSession()";
+	uint8_t lastRC;
+	vector<uint8_t> LR;
+	rangeUID(lockingrange, LR);
+	DtaCommand *set = new DtaCommand();
+	if (NULL == set) {
+		LOG(E) << "Unable to create command object ";
+		return DTAERROR_OBJECT_CREATE_FAILED;
+	}
+	set->reset(OPAL_UID::OPAL_AUTHORITY_TABLE, OPAL_METHOD::SET);
+	set->changeInvokingUid(LR);
+	set->addToken(OPAL_TOKEN::STARTLIST);
+	set->addToken(OPAL_TOKEN::STARTNAME);
+	set->addToken(OPAL_TOKEN::VALUES); 
+	set->addToken(OPAL_TOKEN::STARTLIST);
+	set->addToken(OPAL_TOKEN::STARTNAME);
+	set->addToken(OPAL_TOKEN::RANGESTART);
+	set->addToken(start);
+	set->addToken(OPAL_TOKEN::ENDNAME);
+	set->addToken(OPAL_TOKEN::STARTNAME);
+	set->addToken(OPAL_TOKEN::RANGELENGTH);
+	set->addToken(length);
+	set->addToken(OPAL_TOKEN::ENDNAME);
+	set->addToken(OPAL_TOKEN::STARTNAME);
+	set->addToken(OPAL_TOKEN::READLOCKENABLED);
+	set->addToken(OPAL_TOKEN::OPAL_FALSE);
+	set->addToken(OPAL_TOKEN::ENDNAME);
+	set->addToken(OPAL_TOKEN::STARTNAME);
+	set->addToken(OPAL_TOKEN::WRITELOCKENABLED);
+	set->addToken(OPAL_TOKEN::OPAL_FALSE);
+	set->addToken(OPAL_TOKEN::ENDNAME);
+	set->addToken(OPAL_TOKEN::STARTNAME);
+	set->addToken(OPAL_TOKEN::READLOCKED);
+	set->addToken(OPAL_TOKEN::OPAL_FALSE);
+	set->addToken(OPAL_TOKEN::ENDNAME);
+	set->addToken(OPAL_TOKEN::STARTNAME);
+	set->addToken(OPAL_TOKEN::WRITELOCKED);
+	set->addToken(OPAL_TOKEN::OPAL_FALSE);
+	set->addToken(OPAL_TOKEN::ENDNAME);
+	set->addToken(OPAL_TOKEN::ENDLIST);
+	set->addToken(OPAL_TOKEN::ENDNAME);
+	set->addToken(OPAL_TOKEN::ENDLIST);
+	set->complete();
+	lastRC = session->sendCommand(set, response);
+	delete set;
+	return lastRC;
+}
+uint8_t DtaDevOpal::genKeyInSession(uint8_t lockingrange)
+{
+	LOG(D1) << "Entering DtaDevOpal::genKeyInSession()";
+	uint8_t lastRC;
+	vector<uint8_t> LR;
+	rangeUID(lockingrange, LR);
+	if ((lastRC = getTable(LR, OPAL_TOKEN::ACTIVEKEY, OPAL_TOKEN::ACTIVEKEY)) != 0) {
+		return lastRC;
+	}
 	DtaCommand *rekey = new DtaCommand();
 	if (NULL == rekey) {
 		LOG(E) << "Unable to create command object ";
-		delete session;
 		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
 	rekey->reset(OPAL_UID::OPAL_AUTHORITY_TABLE, OPAL_METHOD::GENKEY);
@@ -532,17 +889,9 @@ uint8_t DtaDevOpal::rekeyLockingRange(uint8_t lockingrange, char * password)
 	rekey->addToken(OPAL_TOKEN::STARTLIST);
 	rekey->addToken(OPAL_TOKEN::ENDLIST);
 	rekey->complete();
-	if ((lastRC = session->sendCommand(rekey, response)) != 0) {
-		LOG(E) << "rekeyLockingRange Failed ";
-		delete rekey;
-		delete session;
-		return lastRC;
-	}
+	lastRC = session->sendCommand(rekey, response);
 	delete rekey;
-	delete session;
-	LOG(I) << "LockingRange" << (uint16_t)lockingrange << " reKeyed ";
-	LOG(D1) << "Exiting DtaDevOpal::rekeyLockingRange()";
-	return 0;
+	return lastRC;
 }
 uint8_t DtaDevOpal::rekeyLockingRange_SUM(vector<uint8_t> LR, vector<uint8_t>  UID, char * password)
 {
@@ -1125,6 +1474,27 @@ uint8_t DtaDevOpal::revertTPer(char * password, uint8_t PSID, uint8_t AdminSP)
 uint8_t DtaDevOpal::loadPBA(char * password, char * filename) {
 	LOG(D1) << "Entering DtaDevOpal::loadPBAimage()" << filename << " " << dev;
 	uint8_t lastRC;
+	session = new DtaSession(this);
+	if (NULL == session) {
+		LOG(E) << "Unable to create session object ";
+		return DTAERROR_OBJECT_CREATE_FAILED;
+	}
+	if ((lastRC = session->start(OPAL_UID::OPAL_LOCKINGSP_UID, password, OPAL_UID::OPAL_ADMIN1_UID)) != 0) {
+		delete session;
+		return lastRC;
+	}
+	lastRC = writeMBRInSession(filename, true);
+	delete session;
+	if (lastRC) return lastRC;
+	LOG(I) << "PBA image  " << filename << " written to " << dev;
+	LOG(D1) << "Exiting DtaDevOpal::loadPBAimage()";
+	return 0;
+}
+
+uint8_t DtaDevOpal::writeMBRInSession(char * filename, bool progress)
+{
+	LOG(D1) << "Entering DtaDevOpal::writeMBRInSession() " << filename;
+	uint8_t lastRC;
 	uint32_t blockSize;
 	uint32_t filepos = 0;
 	uint32_t eofpos;
@@ -1148,18 +1518,6 @@ uint8_t DtaDevOpal::loadPBA(char * password, char * filename) {
 		LOG(E) << "Unable to create command object ";
 		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
-
-	session = new DtaSession(this);
-	if (NULL == session) {
-		LOG(E) << "Unable to create session object ";
-		return DTAERROR_OBJECT_CREATE_FAILED;
-	}
-	if ((lastRC = session->start(OPAL_UID::OPAL_LOCKINGSP_UID, password, OPAL_UID::OPAL_ADMIN1_UID)) != 0) {
-		delete cmd;
-		delete session;
-		pbafile.close();
-		return lastRC;
-	}
 	LOG(I) << "Writing PBA to " << dev;
 	
 	while (!pbafile.eof()) {
@@ -1189,19 +1547,17 @@ uint8_t DtaDevOpal::loadPBA(char * password, char * filename) {
 		cmd->complete();
 		if ((lastRC = session->sendCommand(cmd, response)) != 0) {
 			delete cmd;
-			delete session;
 			pbafile.close();
 			return lastRC;
 		}
 		filepos += blockSize;
-		cout << filepos << " of " << eofpos << " " << (uint16_t) (((float)filepos/(float)eofpos) * 100) << "% blk=" << blockSize << " \r";
+		if (progress)
+			cout << filepos << " of " << eofpos << " " << (uint16_t) (((float)filepos/(float)eofpos) * 100) << "% blk=" << blockSize << " \r";
 	}
-	cout << "\n";
+	if (progress) cout << "\n";
 	delete cmd;
-	delete session;
 	pbafile.close();
-	LOG(I) << "PBA image  " << filename << " written to " << dev;
-	LOG(D1) << "Exiting DtaDevOpal::loadPBAimage()";
+	LOG(D1) << "Exiting DtaDevOpal::writeMBRInSession()";
 	return 0;
 }
 
@@ -1209,55 +1565,57 @@ uint8_t DtaDevOpal::activateLockingSP(char * password)
 {
 	LOG(D1) << "Entering DtaDevOpal::activateLockingSP()";
 	uint8_t lastRC;
-	vector<uint8_t> table;
-	table. push_back(OPAL_SHORT_ATOM::BYTESTRING8);
-	for (int i = 0; i < 8; i++) {
-		table.push_back(OPALUID[OPAL_UID::OPAL_LOCKINGSP_UID][i]);
-	}
-	DtaCommand *cmd = new DtaCommand();
-	if (NULL == cmd) {
-		LOG(E) << "Unable to create command object ";
-		return DTAERROR_OBJECT_CREATE_FAILED;
-	}
 	session = new DtaSession(this);
 	if (NULL == session) {
 		LOG(E) << "Unable to create session object ";
 		return DTAERROR_OBJECT_CREATE_FAILED;
 	}
 	if ((lastRC = session->start(OPAL_UID::OPAL_ADMINSP_UID, password, OPAL_UID::OPAL_SID_UID)) != 0) {
-		delete cmd;
 		delete session;
 		return lastRC;
 	}
+	if ((lastRC = activateInSession()) != 0) {
+		delete session;
+		return lastRC;
+	}
+	LOG(I) << "Locking SP Activate Complete";
+
+	delete session;
+	LOG(D1) << "Exiting DtaDevOpal::activatLockingSP()";
+	return 0;
+}
+
+uint8_t DtaDevOpal::activateInSession()
+{
+	LOG(D1) << "Entering DtaDevOpal::activateInSession()";
+	uint8_t lastRC;
+	vector<uint8_t> table;
+	table. push_back(OPAL_SHORT_ATOM::BYTESTRING8);
+	for (int i = 0; i < 8; i++) {
+		table.push_back(OPALUID[OPAL_UID::OPAL_LOCKINGSP_UID][i]);
+	}
 	if ((lastRC = getTable(table, 0x06, 0x06)) != 0) {
 		LOG(E) << "Unable to determine LockingSP Lifecycle state";
-		delete cmd;
-		delete session;
 		return lastRC;
 	}
 	if ((0x06 != response.getUint8(3)) || // getlifecycle
 		(0x08 != response.getUint8(4))) // Manufactured-Inactive
 	{
 		LOG(E) << "Locking SP lifecycle is not Manufactured-Inactive";
-		delete cmd;
-		delete session;
 		return DTAERROR_INVALID_LIFECYCLE;
 	}
+	DtaCommand *cmd = new DtaCommand();
+	if (NULL == cmd) {
+		LOG(E) << "Unable to create command object ";
+		return DTAERROR_OBJECT_CREATE_FAILED;
+	}
 	cmd->reset(OPAL_UID::OPAL_LOCKINGSP_UID, OPAL_METHOD::ACTIVATE);
 	cmd->addToken(OPAL_TOKEN::STARTLIST);
 	cmd->addToken(OPAL_TOKEN::ENDLIST);
 	cmd->complete();
-	if ((lastRC = session->sendCommand(cmd, response)) != 0) {
-		delete cmd;
-		delete session;
-		return lastRC;
-	}
-	LOG(I) << "Locking SP Activate Complete";
-
+	lastRC = session->sendCommand(cmd, response);
 	delete cmd;
-	delete session;
-	LOG(D1) << "Exiting DtaDevOpal::activatLockingSP()";
-	return 0;
+	return lastRC;
 }
 
 uint8_t DtaDevOpal::activateLockingSP_SUM(uint8_t lockingrange, char * password)
@@ -1449,7 +1807,6 @@ uint8_t DtaDevOpal::printDefaultPassword()
 uint8_t DtaDevOpal::setSIDPassword(char * oldpassword, char * newpassword,
 	uint8_t hasholdpwd, uint8_t hashnewpwd)
 {
-	vector<uint8_t> hash, table;
 	LOG(D1) << "Entering DtaDevOpal::setSIDPassword()";
 	uint8_t lastRC;
 	session = new DtaSession(this);
@@ -1463,12 +1820,24 @@ uint8_t DtaDevOpal::setSIDPassword(char * oldpassword, char * newpassword,
 		delete session;
 		return lastRC;
 	}
-	table.clear();
+	if ((lastRC = setSIDPinInSession(newpassword, hashnewpwd)) != 0) {
+		LOG(E) << "Unable to set new SID password ";
+		delete session;
+		return lastRC;
+	}
+	delete session;
+	LOG(D1) << "Exiting DtaDevOpal::setSIDPassword()";
+	return 0;
+}
+
+uint8_t DtaDevOpal::setSIDPinInSession(char * newpassword, uint8_t hashnewpwd)
+{
+	LOG(D1) << "Entering DtaDevOpal::setSIDPinInSession()";
+	vector<uint8_t> hash, table;
 	table. push_back(OPAL_SHORT_ATOM::BYTESTRING8);
 	for (int i = 0; i < 8; i++) {
 		table.push_back(OPALUID[OPAL_UID::OPAL_C_PIN_SID][i]);
 	}
-	hash.clear();
 	if (hashnewpwd) {
 		DtaHashPwd(hash, newpassword, this);
 	}
@@ -1479,14 +1848,7 @@ uint8_t DtaDevOpal::setSIDPassword(char * oldpassword, char * newpassword,
 			hash.push_back(newpassword[i]);
 		}
 	}
-	if ((lastRC = setTable(table, OPAL_TOKEN::PIN, hash)) != 0) {
-		LOG(E) << "Unable to set new SID password ";
-		delete session;
-		return lastRC;
-	}
-	delete session;
-	LOG(D1) << "Exiting DtaDevOpal::setSIDPassword()";
-	return 0;
+	return setTable(table, OPAL_TOKEN::PIN, hash);
 }
 
 uint8_t DtaDevOpal::setTable(vector<uint8_t> table, OPAL_TOKEN name,
@@ -1565,32 +1927,61 @@ uint8_t DtaDevOpal::getTable(vector<uint8_t> table, uint16_t startcol,
 uint8_t DtaDevOpal::exec(DtaCommand * cmd, DtaResponse & resp, uint8_t protocol)
 {
 	uint8_t lastRC;
+	uint32_t polls = 0;
+	uint64_t start, t;
+	if (cmd->isOverrun()) {
+		LOG(E) << "Command does not fit in the buffer, not sent";
+		return DTAERROR_COMMAND_ERROR;
+	}
     OPALHeader * hdr = (OPALHeader *) cmd->getCmdBuffer();
     LOG(D3) << endl << "Dumping command buffer";
     IFLOG(D3) DtaHexDump(cmd->getCmdBuffer(), SWAP32(hdr->cp.length) + sizeof (OPALComPacket));
+	/* the timing starts at the transport, not before the debug dumps */
+	start = DtaStats::now();
     if((lastRC = sendCmd(IF_SEND, protocol, comID(), cmd->getCmdBuffer(), cmd->outputBufferSize())) != 0) {
 		LOG(E) << "Command failed on send " << (uint16_t) lastRC;
         return lastRC;
     }
+	DtaStats::phase(DTASTATS_SEND, start, cmd->outputBufferSize());
     hdr = (OPALHeader *) cmd->getRespBuffer();
     do {
+		t = DtaStats::now();
         osmsSleep(25);
+		DtaStats::phase(DTASTATS_POLL, t);
         memset(cmd->getRespBuffer(), 0, MIN_BUFFER_LENGTH);
+		t = DtaStats::now();
         lastRC = sendCmd(IF_RECV, protocol, comID(), cmd->getRespBuffer(), MIN_BUFFER_LENGTH);
-
+		DtaStats::phase(DTASTATS_RECV, t, MIN_BUFFER_LENGTH);
+		polls++;
     }
     while ((0 != hdr->cp.outstandingData) && (0 == hdr->cp.minTransfer));
+	DtaStats::method(cmd->getCmdBuffer(), start, polls, cmd->outputBufferSize(),
+		SWAP32(hdr->cp.length) + sizeof (OPALComPacket));
     LOG(D3) << std::endl << "Dumping reply buffer";
     IFLOG(D3) DtaHexDump(cmd->getRespBuffer(), SWAP32(hdr->cp.length) + sizeof (OPALComPacket));
 	if (0 != lastRC) {
         LOG(E) << "Command failed on recv, returned " << (uint16_t) lastRC;
         return lastRC;
     }
-    resp.init(cmd->getRespBuffer());
+    resp.init(cmd->getRespBuffer(), MIN_BUFFER_LENGTH);
     return 0;
 }
 
 
+uint8_t DtaDevOpal::acquireComID()
+{
+	LOG(D1) << "Entering DtaDevOpal::acquireComID()";
+	uint8_t lastRC;
+	if (ownComID) return 0;
+	if ((lastRC = DtaDev::acquireComID()) != 0) return lastRC;
+	/* host properties belong to the comID they were sent on */
+	if ((lastRC = properties()) != 0) {
+		LOG(E) << "Properties exchange on comID " << HEXON(4) << comID() << HEXOFF << " failed";
+		releaseComID();
+		return lastRC;
+	}
+	return 0;
+}
 uint8_t DtaDevOpal::properties()
 {
 	LOG(D1) << "Entering DtaDevOpal::properties()";
@@ -1632,7 +2023,7 @@ uint8_t DtaDevOpal::properties()
 	props->addToken(OPAL_TOKEN::ENDNAME);
 	props->addToken(OPAL_TOKEN::STARTNAME);
 	props->addToken("MaxMethods");
-	props->addToken(1);
+	props->addToken(DTA_HOST_MAXMETHODS);
 	props->addToken(OPAL_TOKEN::ENDNAME);
 	props->addToken(OPAL_TOKEN::ENDLIST);
 	props->addToken(OPAL_TOKEN::ENDNAME);
@@ -1651,11 +2042,12 @@ uint8_t DtaDevOpal::properties()
 			else
 				if(!strcasecmp("MaxComPacketSize",propertiesResponse.getString(i + 1).c_str()))
 					tperMaxPacket = propertiesResponse.getUint32(i + 2);
-				else
-					if (!strcasecmp("MaxIndTokenSize", propertiesResponse.getString(i + 1).c_str())) {
-						tperMaxToken = propertiesResponse.getUint32(i + 2);
-						break;
-					}
+				else if (!strcasecmp("MaxIndTokenSize", propertiesResponse.getString(i + 1).c_str()))
+					tperMaxToken = propertiesResponse.getUint32(i + 2);
+				else if (!strcasecmp("MaxSessions", propertiesResponse.getString(i + 1).c_str()))
+					tperMaxSessions = propertiesResponse.getUint32(i + 2);
+				else if (!strcasecmp("MaxMethods", propertiesResponse.getString(i + 1).c_str()))
+					tperMaxMethods = propertiesResponse.getUint32(i + 2);
 
 			i += 2;
 		}
@@ -51,6 +51,9 @@ public:
         /** Notify the device of the host properties and receive the
          * properties of the device as a reply */
 	uint8_t properties();
+        /** Take a comID of its own, see DtaDev::acquireComID, and repeat
+         * the properties exchange on it */
+	uint8_t acquireComID();
          /** Send a command to the device and wait for the response
          * @param cmd the MswdCommand object containg the command
          * @param response the DtaResonse object containing the response
@@ -200,6 +203,22 @@ public:
 	* @param password password of the locking administrative authority
 	*/
 	uint8_t rekeyLockingRange(uint8_t lockingrange, char * password);
+	/** Generate new encryption keys for every locking range, global included,
+	* in one session: the ActiveKey of each range is read, then GenKey is
+	* called on each key, as many calls per packet as the TPer takes.
+	* @param password password of the locking administrative authority
+	*/
+	uint8_t rekeyAllLockingRanges(char * password);
+	/** Set ReadLocked/WriteLocked on every locking range, global included,
+	* and MBRDone (on unless LOCKED) in one session. The range count comes
+	* from Level 0 discovery when the TPer reports it, and the Sets are sent
+	* as many per packet as the TPer takes.
+	* @param lockingstate READWRITE, READONLY or LOCKED
+	* @param password password of the locking administrative authority
+	* @param elapsedUs if not NULL, set to the time taken in microseconds
+	*/
+	uint8_t setAllLockingRanges(uint8_t lockingstate, char * password,
+		uint32_t * elapsedUs);
 	/** Generate a new encryption key for a Single User Mode locking range.
         * @param LR locking range UID in vector format
 	* @param UID user UID in vector format
@@ -231,6 +250,13 @@ public:
          * @param password the password that is to be assigned to the SSC master entities 
          */
 	uint8_t initialSetup(char * password);
+	/** Take ownership, activate, lay out ranges, load the PBA and set the
+	 * MBR flags in three sessions: anonymous for MSID, SID in the Admin SP
+	 * and Admin1 in the Locking SP, see DtaDev::provision
+	 * @param plan what to do
+	 * @param progress called after each step
+	 */
+	uint8_t provision(const DtaProvisionPlan & plan, DtaProvisionProgress progress);
 	/** User command to prepare the drive for Single User Mode and rekey a SUM locking range.
          * @param lockingrange locking range number to enable
          * @param start LBA to start locking range
@@ -288,5 +314,40 @@ protected:
 	 *  @param password Admin1 Password for TPer
 	 */
 	lrStatus_t getLockingRange_status(uint8_t lockingrange, char * password);
+	/** Build the UID of a locking range, 0 is the global range */
+	void rangeUID(uint8_t lockingrange, vector<uint8_t> &LR);
+	/* The InSession primitives below act in the session the caller has
+	 * already started so that several steps can share one StartSession */
+	/** Set start and length of a locking range, unlocked with locking disabled
+	 *  (Admin1 session in the Locking SP) */
+	uint8_t setRangeInSession(uint8_t lockingrange, uint64_t start, uint64_t length);
+	/** Generate a new media encryption key for a locking range
+	 *  (Admin1 session in the Locking SP) */
+	uint8_t genKeyInSession(uint8_t lockingrange);
+	/** Activate the Locking SP if it is Manufactured-Inactive (SID session) */
+	uint8_t activateInSession();
+	/** Set the SID PIN (SID session)
+	 * @param newpassword the new password
+	 * @param hashnewpwd is the new password to be hashed */
+	uint8_t setSIDPinInSession(char * newpassword, uint8_t hashnewpwd = 1);
+	/** Write a disk image to the shadow MBR table (Admin1 session in the Locking SP)
+	 * @param filename the filename of the disk image
+	 * @param progress show a progress line on stdout */
+	uint8_t writeMBRInSession(char * filename, bool progress);
+	/** Call one method on several objects in the current session, packing
+	 * up to maxMethods() calls into each packet
+	 * @param invokers the objects, called in this order
+	 * @param method the method
+	 * @param params adds the parameter list of the call on invokers[i]
+	 * @param results optional, checks the response of the packet holding
+	 *        the calls first to first + count - 1
+	 */
+	uint8_t batchInSession(const vector<vector<uint8_t> > & invokers, OPAL_METHOD method,
+		std::function<void(DtaCommand * cmd, size_t i)> params,
+		std::function<uint8_t(size_t first, size_t count)> results = nullptr);
+	/** Number of locking ranges, global included, from the Locking Info table
+	 * (session in the Locking SP)
+	 * @param ranges set to MaxRanges + 1 */
+	uint8_t rangeCountInSession(uint32_t & ranges);
 
 };
@@ -32,4 +32,4 @@ DtaDevOpal1::DtaDevOpal1 (const char * devref)
 DtaDevOpal1::~DtaDevOpal1()
 {
 }
-uint16_t DtaDevOpal1::comID() { return disk_info.OPAL10_basecomID; }
+uint16_t DtaDevOpal1::comID() { return ownComID ? ownComID : disk_info.OPAL10_basecomID; }
@@ -32,4 +32,4 @@ DtaDevOpal2::DtaDevOpal2 (const char * devref)
 DtaDevOpal2::~DtaDevOpal2()
 {
 }
-uint16_t DtaDevOpal2::comID() { return disk_info.OPAL20_basecomID; }
+uint16_t DtaDevOpal2::comID() { return ownComID ? ownComID : disk_info.OPAL20_basecomID; }
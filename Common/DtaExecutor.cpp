@@ -0,0 +1,128 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include "DtaExecutor.h"
+
+using namespace std;
+
+DtaExecutor::DtaExecutor(unsigned workers) : outstanding(0), stopping(false)
+{
+	LOG(D1) << "Creating DtaExecutor " << workers;
+	if (0 == workers) {
+		workers = std::thread::hardware_concurrency();
+		if (0 == workers) workers = 1;
+		if (8 < workers) workers = 8;
+	}
+	for (unsigned i = 0; i < workers; i++)
+		threads.push_back(std::thread(&DtaExecutor::worker, this));
+}
+
+DtaExecutor::~DtaExecutor()
+{
+	LOG(D1) << "Destroying DtaExecutor";
+	wait();
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	ready.notify_all();
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+unsigned DtaExecutor::workers()
+{
+	return (unsigned)threads.size();
+}
+
+void DtaExecutor::push(const void * queue, std::function<void()> task)
+{
+	DtaExecutorQueue &q = queues[queue];
+	/* a queue with a running task is made runnable again when it finishes */
+	if (q.tasks.empty() && !q.running) {
+		runnable.push_back(queue);
+		ready.notify_one();
+	}
+	q.tasks.push_back(task);
+	outstanding++;
+}
+
+std::future<uint8_t> DtaExecutor::submit(const void * queue, std::function<uint8_t()> op)
+{
+	LOG(D1) << "Entering DtaExecutor::submit";
+	/* std::function needs a copyable target, packaged_task is move only */
+	std::shared_ptr<std::packaged_task<uint8_t()>> task =
+		std::make_shared<std::packaged_task<uint8_t()>>(op);
+	std::future<uint8_t> result = task->get_future();
+	std::lock_guard<std::mutex> guard(lock);
+	push(queue, [task] { (*task)(); });
+	return result;
+}
+
+void DtaExecutor::submit(const void * queue, std::function<uint8_t()> op, DtaExecutorDone done)
+{
+	LOG(D1) << "Entering DtaExecutor::submit(done)";
+	std::lock_guard<std::mutex> guard(lock);
+	push(queue, [op, done] {
+		uint8_t rc;
+		try {
+			rc = op();
+		}
+		catch (...) {
+			done(DTAERROR_COMMAND_ERROR, std::current_exception());
+			return;
+		}
+		done(rc, nullptr);
+	});
+}
+
+void DtaExecutor::wait()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	idle.wait(guard, [this] { return 0 == outstanding; });
+}
+
+void DtaExecutor::worker()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	for (;;) {
+		ready.wait(guard, [this] { return stopping || !runnable.empty(); });
+		if (runnable.empty()) return;
+		const void * key = runnable.front();
+		runnable.pop_front();
+		DtaExecutorQueue &q = queues[key];
+		std::function<void()> task = q.tasks.front();
+		q.tasks.pop_front();
+		q.running = true;
+		guard.unlock();
+		task();
+		task = nullptr;
+		guard.lock();
+		q.running = false;
+		if (q.tasks.empty())
+			queues.erase(key);
+		else {
+			runnable.push_back(key);
+			ready.notify_one();
+		}
+		if (0 == --outstanding)
+			idle.notify_all();
+	}
+}
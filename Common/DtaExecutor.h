@@ -0,0 +1,92 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Completion callback, gets the return code of the operation, or
+ * DTAERROR_COMMAND_ERROR and the exception it threw */
+typedef std::function<void(uint8_t, std::exception_ptr)> DtaExecutorDone;
+
+/** Runs blocking sedutil operations as tasks on a small worker pool.
+ *
+ * Tasks are queued on a serial queue named by a key, normally the DtaDev
+ * (or sedutil_dev) they use: the TCG sessions of one drive share its comID
+ * so a queue runs one task at a time in submission order, while the
+ * queues of different drives run in parallel on the workers.
+ *
+ *     DtaExecutor pool(4);
+ *     std::future<uint8_t> rc = pool.submit(d, [=] {
+ *         return d->setLockingRange(0, OPAL_LOCKINGSTATE::LOCKED, password); });
+ *
+ * Two DtaDev objects for the same drive need the same key, unless each
+ * has a comID of its own (DtaDev::acquireComID).
+ */
+class DtaExecutor {
+public:
+	/** Start the pool
+	 * @param workers number of threads, 0 picks one per CPU up to 8 */
+	DtaExecutor(unsigned workers = 0);
+	/** Run the tasks already queued, then stop the workers */
+	~DtaExecutor();
+	/** Queue an operation and return a future for its return code
+	 * @param queue key of the serial queue
+	 * @param op the operation */
+	std::future<uint8_t> submit(const void * queue, std::function<uint8_t()> op);
+	/** Queue an operation and call done on the worker when it finishes,
+	 * an exception from op is caught and handed to done like the future
+	 * variant stores it, done itself must not throw
+	 * @param queue key of the serial queue
+	 * @param op the operation
+	 * @param done called with the return code and exception */
+	void submit(const void * queue, std::function<uint8_t()> op, DtaExecutorDone done);
+	/** Block until every queued task has finished */
+	void wait();
+	/** Number of worker threads */
+	unsigned workers();
+private:
+	/** Take runnable queues and run their next task until stopped */
+	void worker();
+	/** Add a task to a queue, caller holds lock */
+	void push(const void * queue, std::function<void()> task);
+
+	/** Tasks of one key */
+	typedef struct _DtaExecutorQueue {
+		std::deque<std::function<void()>> tasks;
+		bool running = false; /**< a worker is running its front task */
+	} DtaExecutorQueue;
+
+	std::mutex lock; /**< guards everything below */
+	std::condition_variable ready; /**< a queue became runnable or stopping was set */
+	std::condition_variable idle; /**< outstanding dropped to 0 */
+	std::map<const void *, DtaExecutorQueue> queues;
+	std::deque<const void *> runnable; /**< queues with tasks and no running task */
+	std::vector<std::thread> threads;
+	size_t outstanding; /**< tasks queued or running */
+	bool stopping;
+};
@@ -20,11 +20,16 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include "os.h"
 #include <iostream>
 #include <iomanip>
+#include <mutex>
+#ifdef __gnu_linux__
+#include <sys/mman.h>
+#endif
 #include "DtaHashPwd.h"
 #include "DtaLexicon.h"
 #include "DtaOptions.h"
 #include "DtaDev.h"
 #include "log.h"
+#include "DtaStats.h"
 
 extern "C" {
 #include "pbkdf2.h"
@@ -63,6 +68,87 @@ exit:	// add the token overhead
 	hash.insert(hash.begin(), 0xd0);
 }
 
+/** A derived key remembered between DtaHashPwd calls */
+typedef struct _DtaHashCacheEntry {
+	uint8_t id[CF_SHA1_HASHSZ]; /**< SHA-1 of the salt and password */
+	uint64_t used; /**< cacheClock at the last lookup, 0 if free */
+	uint8_t len; /**< bytes in key */
+	uint8_t key[36]; /**< the hash with its token overhead */
+} DtaHashCacheEntry;
+
+static std::mutex cacheLock;
+static DtaHashCacheEntry * cache = NULL;
+static size_t cacheEntries = 0;
+static uint64_t cacheClock = 0;
+
+void DtaHashCache(size_t entries)
+{
+	LOG(D1) << "Entering DtaHashCache " << entries;
+	std::lock_guard<std::mutex> guard(cacheLock);
+	if (NULL != cache) {
+		SECUREZERO(cache, cacheEntries * sizeof (DtaHashCacheEntry));
+#ifdef __gnu_linux__
+		munlock(cache, cacheEntries * sizeof (DtaHashCacheEntry));
+#endif
+		free(cache);
+		cache = NULL;
+		cacheEntries = 0;
+	}
+	if (0 == entries) return;
+	cache = (DtaHashCacheEntry *)calloc(entries, sizeof (DtaHashCacheEntry));
+	if (NULL == cache) {
+		LOG(E) << "Unable to allocate the derived key cache";
+		return;
+	}
+	cacheEntries = entries;
+#ifdef __gnu_linux__
+	/* keep the keys out of swap and core dumps */
+	if (mlock(cache, entries * sizeof (DtaHashCacheEntry))) {
+		LOG(W) << "Unable to lock the derived key cache in memory " << strerror(errno);
+	}
+	madvise((void *)((uintptr_t)cache & ~(uintptr_t)(getpagesize() - 1)),
+		entries * sizeof (DtaHashCacheEntry) + ((uintptr_t)cache & (getpagesize() - 1)),
+		MADV_DONTDUMP);
+#endif
+}
+
+/** Look up or remember the hash of password with salt.
+ * @param store 0 to look up, 1 to add hash
+ * @return 1 if hash was found (look up) or stored
+ */
+static uint8_t hashCache(vector<uint8_t> &hash, char * password, vector<uint8_t> &salt,
+	uint8_t store)
+{
+	uint8_t id[CF_SHA1_HASHSZ];
+	cf_sha1_context ctx;
+	DtaHashCacheEntry * e, * victim;
+	std::lock_guard<std::mutex> guard(cacheLock);
+	if ((NULL == cache) || (hash.size() > sizeof (e->key))) return 0;
+	cf_sha1_init(&ctx);
+	cf_sha1_update(&ctx, salt.data(), salt.size());
+	cf_sha1_update(&ctx, password, strnlen(password, 256));
+	cf_sha1_digest_final(&ctx, id);
+	victim = cache;
+	for (e = cache; e < cache + cacheEntries; e++) {
+		if (e->used && !memcmp(e->id, id, sizeof (id))) {
+			e->used = ++cacheClock;
+			if (!store)
+				hash.assign(e->key, e->key + e->len);
+			SECUREZERO(id, sizeof (id));
+			return 1;
+		}
+		if (e->used < victim->used) victim = e;
+	}
+	if (store) {
+		memcpy(victim->id, id, sizeof (id));
+		memcpy(victim->key, hash.data(), hash.size());
+		victim->len = (uint8_t)hash.size();
+		victim->used = ++cacheClock;
+	}
+	SECUREZERO(id, sizeof (id));
+	return store;
+}
+
 void DtaHashPwd(vector<uint8_t> &hash, char * password, DtaDev * d)
 {
     LOG(D1) << " Entered DtaHashPwd";
@@ -81,7 +167,12 @@ void DtaHashPwd(vector<uint8_t> &hash, char * password, DtaDev * d)
     serNum = d->getSerialNum();
     vector<uint8_t> salt(serNum, serNum + 20);
     //	vector<uint8_t> salt(DEFAULTSALT);
-    DtaHashPassword(hash, password, salt);
+    uint64_t start = DtaStats::now();
+    if (!hashCache(hash, password, salt, 0)) {
+        DtaHashPassword(hash, password, salt);
+        hashCache(hash, password, salt, 1);
+    }
+    DtaStats::phase(DTASTATS_HASH, start);
     LOG(D1) << " Exit DtaHashPwd"; // log for hash timing
 }
 
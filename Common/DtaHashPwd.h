@@ -33,6 +33,12 @@ using namespace std;
  * @param device the device where the password is to be used
  */
 void DtaHashPwd(vector<uint8_t> &hash, char * password, DtaDev * device);
+/** Remember derived keys so repeated DtaHashPwd calls skip PBKDF2.
+ * For long running processes (sedutild), the cache is held in locked
+ * memory where the OS allows it.
+ * @param entries number of keys to keep, 0 wipes and frees the cache
+ */
+void DtaHashCache(size_t entries);
 /** Hash a passwor using the PBDKF2<SHA1> function 
  *
  * @param hash Field where hash returned
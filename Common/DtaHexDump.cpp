@@ -20,35 +20,37 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include "os.h"
 #include <stdio.h>
 #include <ctype.h>
-void DtaHexDump(void * address, int length) {
+void DtaHexDump(void * address, int length, FILE * stream) {
 	uint8_t display[17];
 	uint8_t * cpos = (uint8_t *)address;
 	uint8_t * epos = cpos + length;
 	LOG(D1) << "Entering hexDump";
+	/* queued debug output belongs ahead of the dump */
+	if (DtaLogSink::active()) DtaLogSink::flush();
 	int rpos = 0;
 	int dpos = 0;
-	fprintf( stderr,"%04x ",rpos);
+	fprintf(stream,"%04x ",rpos);
 	while (cpos < epos){
-		fprintf( stderr,"%02x", cpos[0]);
-		if (!((++rpos) % 4))fprintf( stderr," ");
+		fprintf(stream,"%02x", cpos[0]);
+		if (!((++rpos) % 4))fprintf(stream," ");
 		display[dpos++] = (isprint(cpos[0]) ? cpos[0] : 0x2e );
 		cpos += 1;
 		if (16 == dpos) {
 			dpos = 0;
 			display[16] = 0x00;
-			fprintf( stderr," %s \n", display);
-			if(cpos < epos) fprintf( stderr,"%04x ", rpos);
+			fprintf(stream," %s \n", display);
+			if(cpos < epos) fprintf(stream,"%04x ", rpos);
 			memset(&display,0,sizeof(display));
 		}
 	}
 	if (dpos != 0) {
-		if (dpos % 4) fprintf( stderr," ");
-			fprintf( stderr,"  ");
+		if (dpos % 4) fprintf(stream," ");
+			fprintf(stream,"  ");
 		for (int i = dpos ; i < 15; i++) {
-			if (!(i % 4)) fprintf( stderr," ");
-			fprintf( stderr,"  ");
+			if (!(i % 4)) fprintf(stream," ");
+			fprintf(stream,"  ");
 		}
 		display[dpos] = 0x00;
-		fprintf( stderr," %s\n", display);
+		fprintf(stream," %s\n", display);
 	}
 }
\ No newline at end of file
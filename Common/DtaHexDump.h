@@ -19,8 +19,10 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
  * C:E********************************************************************** */
 
 #pragma once 
+#include <stdio.h>
 /** Print a hexdump of an area of memory
  * @param address Starting address for the dump
  * @param length  Length of the area to be dumped
+ * @param stream  where to print the dump
  */
-void DtaHexDump(void * address, int length);
\ No newline at end of file
+void DtaHexDump(void * address, int length, FILE * stream = stderr);
\ No newline at end of file
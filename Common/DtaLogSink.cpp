@@ -0,0 +1,266 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "DtaLogSink.h"
+
+using namespace std;
+
+/** bytes in each thread's ring, a message longer than a quarter of it is cut */
+#define DTALOG_RING (256 * 1024)
+/** how often the writer wakes up on its own, in ms */
+#define DTALOG_INTERVAL 5
+/** record level marking the unused end of the ring */
+#define DTALOG_WRAP 0xff
+
+/** header of a message in a ring, followed by the text */
+typedef struct _DtaLogRecord {
+	uint32_t length;	/**< bytes including this header, multiple of 8 */
+	uint8_t level;		/**< TLogLevel or DTALOG_WRAP */
+	uint8_t reserved[3];
+	uint64_t timestamp;
+} DtaLogRecord;
+
+/** one producer (the owning thread), one consumer (the writer) */
+class DtaLogRing {
+public:
+	DtaLogRing() : head(0), tail(0), retired(false), dropped(0) {}
+	atomic<uint64_t> head;		/**< written by the owning thread */
+	atomic<uint64_t> tail;		/**< written by the writer */
+	atomic<bool> retired;		/**< owning thread has exited */
+	atomic<uint64_t> dropped;	/**< messages lost to a full ring */
+	uint8_t data[DTALOG_RING];
+};
+
+/** the calling thread's ring, NULL until its first message */
+static thread_local DtaLogRing * logRing = NULL;
+/** set once the thread's ring has been handed back, late messages are written directly */
+static thread_local bool logRingGone = false;
+
+/** registers the calling thread's ring on first use and retires it on exit */
+class DtaLogRingOwner {
+public:
+	DtaLogRingOwner();
+	~DtaLogRingOwner()
+	{
+		logRing->retired.store(true, memory_order_release);
+		logRing = NULL;
+		logRingGone = true;
+	}
+};
+
+static mutex logRegistryLock;
+static vector<DtaLogRing *> logRings;
+static mutex logDrainLock;	/**< one drain at a time, writer thread or flush() */
+static mutex logWakeLock;
+static condition_variable logWake;
+static thread * logWriter = NULL;
+static atomic<bool> logActive(false);
+static bool logStopping = false;
+static uint64_t logBase = 0;
+
+DtaLogRingOwner::DtaLogRingOwner()
+{
+	logRing = new DtaLogRing;
+	lock_guard<mutex> guard(logRegistryLock);
+	logRings.push_back(logRing);
+}
+
+std::string DtaLogSink::prefix(uint8_t level, uint64_t timestamp)
+{
+	static const char * const names[] = { "ERR ", "WARN", "INFO", "DBG ", "DBG1", "DBG2", "DBG3", "DBG4" };
+	char buf[48];
+	uint64_t t = (timestamp > logBase) ? timestamp - logBase : 0;
+	snprintf(buf, sizeof(buf), "- %llu.%06llu %s: ", (unsigned long long)(t / 1000000000),
+		(unsigned long long)(t % 1000000000 / 1000), names[level & 7]);
+	return buf;
+}
+
+/** write one message with the prefix log.h would have given it */
+static void logOutput(FILE * stream, uint8_t level, uint64_t timestamp, const char * text)
+{
+	if (sedutilNormal == outputFormat)
+		fputs(DtaLogSink::prefix(level, timestamp).c_str(), stream);
+	fputs(text, stream);
+}
+
+uint64_t DtaLogSink::now()
+{
+	return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+		chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool DtaLogSink::active()
+{
+	return logActive.load(memory_order_relaxed);
+}
+
+void DtaLogSink::write(uint8_t level, uint64_t timestamp, const string &msg)
+{
+	if (logRingGone) {
+		FILE * stream = Output2FILE::Stream();
+		if (NULL == stream) return;
+		logOutput(stream, level, timestamp, msg.c_str());
+		fflush(stream);
+		return;
+	}
+	if (NULL == logRing) {
+		static thread_local DtaLogRingOwner owner;
+	}
+	DtaLogRing * r = logRing;
+	size_t text = msg.size();
+	if (text > DTALOG_RING / 4 - sizeof(DtaLogRecord)) text = DTALOG_RING / 4 - sizeof(DtaLogRecord);
+	uint32_t length = (uint32_t)((sizeof(DtaLogRecord) + text + 7) & ~(size_t)7);
+	uint64_t head = r->head.load(memory_order_relaxed);
+	uint64_t tail = r->tail.load(memory_order_acquire);
+	uint32_t off = (uint32_t)(head % DTALOG_RING);
+	uint32_t pad = (DTALOG_RING - off < length) ? DTALOG_RING - off : 0;
+	if (DTALOG_RING - (head - tail) < (uint64_t)pad + length) {
+		r->dropped.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+	if (pad) {
+		DtaLogRecord * w = (DtaLogRecord *)(r->data + off);
+		w->length = pad;
+		w->level = DTALOG_WRAP;
+		off = 0;
+	}
+	DtaLogRecord * rec = (DtaLogRecord *)(r->data + off);
+	rec->length = length;
+	rec->level = level;
+	rec->timestamp = timestamp;
+	memcpy(rec + 1, msg.data(), text);
+	if (text && ('\n' != msg[text - 1])) ((char *)(rec + 1))[text - 1] = '\n';
+	memset((uint8_t *)(rec + 1) + text, 0, length - sizeof(DtaLogRecord) - text);
+	r->head.store(head + pad + length, memory_order_release);
+}
+
+/** a message taken out of a ring */
+typedef struct _DtaLogLine {
+	uint64_t timestamp;
+	uint8_t level;
+	string text;
+} DtaLogLine;
+
+static bool logOrder(const DtaLogLine &a, const DtaLogLine &b)
+{
+	return a.timestamp < b.timestamp;
+}
+
+/** move every queued message to the output stream, oldest first */
+static void logDrain()
+{
+	lock_guard<mutex> drain(logDrainLock);
+	vector<DtaLogLine> lines;
+	uint64_t dropped = 0;
+	{
+		lock_guard<mutex> guard(logRegistryLock);
+		for (size_t i = 0; i < logRings.size(); i++) {
+			DtaLogRing * r = logRings[i];
+			bool retired = r->retired.load(memory_order_acquire);
+			uint64_t tail = r->tail.load(memory_order_relaxed);
+			uint64_t head = r->head.load(memory_order_acquire);
+			while (tail < head) {
+				DtaLogRecord * rec = (DtaLogRecord *)(r->data + tail % DTALOG_RING);
+				if (DTALOG_WRAP != rec->level) {
+					DtaLogLine l;
+					l.timestamp = rec->timestamp;
+					l.level = rec->level;
+					l.text.assign((char *)(rec + 1), strnlen((char *)(rec + 1), rec->length - sizeof(DtaLogRecord)));
+					lines.push_back(l);
+				}
+				tail += rec->length;
+			}
+			r->tail.store(tail, memory_order_release);
+			dropped += r->dropped.exchange(0, memory_order_relaxed);
+			if (retired) {
+				delete r;
+				logRings.erase(logRings.begin() + i--);
+			}
+		}
+	}
+	if (lines.empty() && !dropped) return;
+	stable_sort(lines.begin(), lines.end(), logOrder);
+	FILE * stream = Output2FILE::Stream();
+	if (NULL == stream) return;
+	for (size_t i = 0; i < lines.size(); i++)
+		logOutput(stream, lines[i].level, lines[i].timestamp, lines[i].text.c_str());
+	if (dropped)
+		fprintf(stream, "- %llu log messages dropped, the writer could not keep up\n", (unsigned long long)dropped);
+	fflush(stream);
+}
+
+static void logWriterLoop()
+{
+	unique_lock<mutex> wake(logWakeLock);
+	while (!logStopping) {
+		logWake.wait_for(wake, chrono::milliseconds(DTALOG_INTERVAL));
+		wake.unlock();
+		logDrain();
+		wake.lock();
+	}
+}
+
+static void logAtExit()
+{
+	DtaLogSink::stop();
+}
+
+void DtaLogSink::start()
+{
+	lock_guard<mutex> guard(logWakeLock);
+	if (NULL != logWriter) return;
+	logBase = now();
+	logStopping = false;
+	logWriter = new thread(logWriterLoop);
+	logActive.store(true, memory_order_release);
+	static bool registered = false;
+	if (!registered) atexit(logAtExit);
+	registered = true;
+}
+
+void DtaLogSink::stop()
+{
+	thread * writer;
+	{
+		lock_guard<mutex> guard(logWakeLock);
+		if (NULL == logWriter) return;
+		logActive.store(false, memory_order_release);
+		logStopping = true;
+		writer = logWriter;
+		logWriter = NULL;
+	}
+	logWake.notify_one();
+	writer->join();
+	delete writer;
+	logDrain();
+}
+
+void DtaLogSink::flush()
+{
+	logDrain();
+}
@@ -0,0 +1,58 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include <stdint.h>
+#include <string>
+
+/** Asynchronous sink for the debug levels of log.h.
+ *
+ * Once started, messages at level D and above are copied into a buffer
+ * owned by the logging thread and written out by a background thread,
+ * so debug logging costs the caller a formatted string and a copy rather
+ * than a localtime/strftime call and a flushed write. The per thread
+ * buffers are single producer/single consumer rings, the logging thread
+ * never takes a lock or blocks; when its ring is full the message is
+ * dropped and counted. Messages carry a monotonic timestamp and are
+ * written in timestamp order. E, W and I messages stay synchronous and
+ * drain the pending debug messages first so the output keeps its order.
+ */
+class DtaLogSink {
+public:
+	/** start the background writer, stopped by an atexit handler */
+	static void start();
+	/** drain everything and stop the background writer */
+	static void stop();
+	/** true while the background writer is running */
+	static bool active();
+	/** monotonic ns for the message timestamp */
+	static uint64_t now();
+	/** queue a message
+	 * @param level TLogLevel of the message
+	 * @param timestamp value of now() when the message was started
+	 * @param msg message text including the trailing newline
+	 */
+	static void write(uint8_t level, uint64_t timestamp, const std::string &msg);
+	/** "- seconds.microseconds LEVEL: " prefix for the sedutilNormal format,
+	 * the seconds count from start()
+	 */
+	static std::string prefix(uint8_t level, uint64_t timestamp);
+	/** write out all queued messages now */
+	static void flush();
+};
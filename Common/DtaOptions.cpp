@@ -27,18 +27,47 @@ void usage()
     printf("a utility to manage self encrypting drives that conform\n");
     printf("to the Trusted Computing Group OPAL 2.0 SSC specification\n");
     printf("General Usage:                     (see readme for extended commandset)\n");
-    printf("sedutil-cli <-v> <-n> <action> <options> <device>\n");
+    printf("sedutil-cli <-v> <-n> <-l> <-j> <--stats> <--daemon> <-t tracefile> <-f filter> <--noSpinUp> <--lockDiscovery> <--resetComID> <action> <options> <device>\n");
     printf("-v (optional)                       increase verbosity, one to five v's\n");
     printf("-n (optional)                       no password hashing. Passwords will be sent in clear text!\n");
     printf("-l (optional)                       log style output to stderr only\n");
+    printf("-j (optional)                       JSON output where supported (--stats)\n");
+    printf("--stats (optional)                  print command timing statistics to stderr\n");
+    printf("-t <tracefile> (optional)           record IF_SEND/IF_RECV traffic to a binary trace file\n");
+    printf("-f <filter> (optional)              limit --scan/--watch/--collect to disks matching transport=,vendor=,model=\n");
+    printf("                                    patterns, e.g. -f transport=nvme,model=Samsung*\n");
+    printf("--noSpinUp (optional)               --scan reports disks in standby from the scan cache\n");
+    printf("                                    instead of spinning them up\n");
+    printf("--lockDiscovery (optional)          wait for other processes' sessions on a drive before\n");
+    printf("                                    Level 0 Discovery (shared lock, sessions always lock)\n");
+    printf("--resetComID (optional)             when a drive has no sessions available, reset the comID\n");
+    printf("                                    (aborts the session holding it, whoever owns it)\n");
+    printf("--daemon (optional)                 run --scan, --query, --setLockingRange, --setAllLockingRanges,\n");
+    printf("                                    --setMBRDone, --setMBREnable or --loadPBAimage through sedutild\n");
     printf("actions \n");
     printf("--scan \n");
     printf("                                Scans the devices on the system \n");
     printf("                                identifying Opal compliant devices \n");
+    printf("--watch \n");
+    printf("                                Report disks as they are added, changed or removed,\n");
+    printf("                                one JSON object per line (Linux only)\n");
     printf("--query <device>\n");
     printf("                                Display the Discovery 0 response of a device\n");
+    printf("--status <device>[,<device>...]|all\n");
+    printf("                                Print the locking flags of each device as one JSON line,\n");
+    printf("                                Level 0 Discovery only, the devices are probed in parallel\n");
+    printf("--collect <textfile>\n");
+    printf("                                Write the locking flags of every disk (-f to filter) as\n");
+    printf("                                Prometheus metrics for the node_exporter textfile collector\n");
     printf("--isValidSED <device>\n");
     printf("                                Verify whether the given device is SED or not\n");
+    printf("--traceDump <tracefile>\n");
+    printf("                                Decode a trace recorded with -t\n");
+    printf("--traceAnalyze <tracefile>\n");
+    printf("                                Break down the time in a trace by method, SP and authority\n");
+    printf("--provision <manifest>\n");
+    printf("                                Take ownership, activate, set up ranges, load the PBA and\n");
+    printf("                                set the MBR flags of the drives in a manifest, in parallel\n");
     printf("--listLockingRanges <password> <device>\n");
 	printf("                                List all Locking Ranges\n");
     printf("--listLockingRange <0...n> <password> <device>\n");
@@ -47,6 +76,8 @@ void usage()
     printf("--rekeyLockingRange <0...n> <password> <device>\n");
 	printf("                                0 = GLobal 1..n  = LRn \n");
 	printf("                                Rekey Locking Range\n");
+    printf("--rekeyAllLockingRanges <password> <device>\n");
+	printf("                                Rekey every Locking Range in one session\n");
     printf("--setBandsEnabled <password> <device>\n");
 	printf("                                Set Enabled for all Locking Ranges\n");
 	printf("                                (passwort = \"\" for MSID) \n");
@@ -72,6 +103,9 @@ void usage()
 	printf("--setLockingRange <0...n> <RW|RO|LK> <Admin1password> <device> \n");
 	printf("                                Set the status of a Locking Range\n");
 	printf("                                0 = GLobal 1..n  = LRn \n");
+	printf("--setAllLockingRanges <RW|RO|LK> <Admin1password> <device> \n");
+	printf("                                Set every Locking Range and MBRDone in one session\n");
+	printf("                                (MBRDone on for RW|RO, off for LK) \n");
 	printf("--enableLockingRange <0...n> <Admin1password> <device> \n");
 	printf("                                Enable a Locking Range\n");
 	printf("                                0 = GLobal 1..n  = LRn \n");
@@ -127,6 +161,11 @@ uint8_t DtaOptions(int argc, char * argv[], DTA_OPTIONS * opts)
 			if (loggingLevel > 7) loggingLevel = 7;
 			CLog::Level() = CLog::FromInt(loggingLevel);
 			RCLog::Level() = RCLog::FromInt(loggingLevel);
+			/* debug output goes through the async sink so it does not change the timing */
+			DtaLogSink::start();
+			if (CLog::FromInt(loggingLevel) > CLOG_MAX_LEVEL) {
+				LOG(W) << "This build only logs up to " << CLog::ToString(CLOG_MAX_LEVEL);
+			}
 			LOG(D) << "Log level set to " << CLog::ToString(CLog::FromInt(loggingLevel));
 			LOG(D) << "sedutil version : " << GIT_VERSION;
 		}
@@ -140,6 +179,47 @@ uint8_t DtaOptions(int argc, char * argv[], DTA_OPTIONS * opts)
 			opts->output_format = sedutilNormal;
 			outputFormat = sedutilNormal;
 		}
+		else if (!strcmp("-j", argv[i])) {
+			baseOptions += 1;
+			opts->output_format = sedutilJSON;
+			outputFormat = sedutilJSON;
+		}
+		else if (!strcmp("--stats", argv[i])) {
+			baseOptions += 1;
+			opts->stats = true;
+		}
+		else if (!strcmp("--noSpinUp", argv[i])) {
+			baseOptions += 1;
+			opts->noSpinUp = true;
+		}
+		else if (!strcmp("--lockDiscovery", argv[i])) {
+			baseOptions += 1;
+			opts->lockDiscovery = true;
+		}
+		else if (!strcmp("--resetComID", argv[i])) {
+			baseOptions += 1;
+			opts->resetComID = true;
+		}
+		else if (!strcmp("--daemon", argv[i])) {
+			baseOptions += 1;
+			opts->daemon = true;
+		}
+		else if (!strcmp("-t", argv[i])) {
+			if (i + 1 >= argc) {
+				LOG(E) << "-t needs a trace file name";
+				return DTAERROR_INVALID_COMMAND;
+			}
+			baseOptions += 2;
+			opts->tracefile = ++i;
+		}
+		else if (!strcmp("-f", argv[i])) {
+			if (i + 1 >= argc) {
+				LOG(E) << "-f needs a filter";
+				return DTAERROR_INVALID_COMMAND;
+			}
+			baseOptions += 2;
+			opts->filter = ++i;
+		}
 		else if (!(('-' == argv[i][0]) && ('-' == argv[i][1])) && 
 			(0 == opts->action))
 		{
@@ -242,7 +322,10 @@ uint8_t DtaOptions(int argc, char * argv[], DTA_OPTIONS * opts)
 			OPTION_IS(password) OPTION_IS(device) END_OPTION
 		BEGIN_OPTION(query, 1) OPTION_IS(device) END_OPTION
 		BEGIN_OPTION(scan, 0)  END_OPTION
+		BEGIN_OPTION(watch, 0)  END_OPTION
 		BEGIN_OPTION(isValidSED, 1) OPTION_IS(device) END_OPTION
+		BEGIN_OPTION(status, 1) OPTION_IS(device) END_OPTION
+		BEGIN_OPTION(collect, 1) OPTION_IS(device) END_OPTION
 		BEGIN_OPTION(eraseLockingRange, 3)
 			TESTARG(0, lockingrange, 0)
 			TESTARG(1, lockingrange, 1)
@@ -704,6 +787,21 @@ uint8_t DtaOptions(int argc, char * argv[], DTA_OPTIONS * opts)
 		BEGIN_OPTION(objDump, 5) i += 4; OPTION_IS(device) END_OPTION
         BEGIN_OPTION(printDefaultPassword, 1) OPTION_IS(device) END_OPTION
 		BEGIN_OPTION(rawCmd, 7) i += 6; OPTION_IS(device) END_OPTION
+		BEGIN_OPTION(traceDump, 1) OPTION_IS(device) END_OPTION
+		BEGIN_OPTION(traceAnalyze, 1) OPTION_IS(device) END_OPTION
+		BEGIN_OPTION(provision, 1) OPTION_IS(device) END_OPTION
+		BEGIN_OPTION(rekeyAllLockingRanges, 2) OPTION_IS(password) OPTION_IS(device) END_OPTION
+		BEGIN_OPTION(setAllLockingRanges, 3)
+			TESTARG(RW, lockingstate, OPAL_LOCKINGSTATE::READWRITE)
+			TESTARG(rw, lockingstate, OPAL_LOCKINGSTATE::READWRITE)
+			TESTARG(RO, lockingstate, OPAL_LOCKINGSTATE::READONLY)
+			TESTARG(ro, lockingstate, OPAL_LOCKINGSTATE::READONLY)
+			TESTARG(LK, lockingstate, OPAL_LOCKINGSTATE::LOCKED)
+			TESTARG(lk, lockingstate, OPAL_LOCKINGSTATE::LOCKED)
+			TESTFAIL("Invalid locking state <ro|rw|lk>")
+			OPTION_IS(password)
+			OPTION_IS(device)
+			END_OPTION
 		else {
             LOG(E) << "Invalid command line argument " << argv[i];
 			return DTAERROR_INVALID_COMMAND;
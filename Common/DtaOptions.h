@@ -45,6 +45,13 @@ typedef struct _DTA_OPTIONS {
 
 	bool no_hash_passwords; /** global parameter, disables hashing of passwords */
 	sedutiloutput output_format;
+	bool stats; /** global parameter, print command statistics on exit */
+	uint8_t tracefile; /** global parameter, record IF_SEND/IF_RECV traffic to this file */
+	bool daemon; /** global parameter, send the action to sedutild */
+	uint8_t filter; /** global parameter, transport/vendor/model filter for --scan and --watch */
+	bool noSpinUp; /** global parameter, --scan serves disks in standby from the cache */
+	bool lockDiscovery; /** global parameter, take shared drive locks for Level 0 Discovery */
+	bool resetComID; /** global parameter, STACK_RESET a comID with no sessions available */
 } DTA_OPTIONS;
 /** Print a usage message */
 void usage();
@@ -90,6 +97,7 @@ typedef enum _sedutiloption {
 	eraseLockingRange_SUM,
 	query,
 	scan,
+	watch,
 	isValidSED,
     eraseLockingRange,
 	takeOwnership,
@@ -97,6 +105,13 @@ typedef enum _sedutiloption {
 	objDump,
     printDefaultPassword,
 	rawCmd,
+	traceDump,
+	traceAnalyze,
+	provision,
+	rekeyAllLockingRanges,
+	setAllLockingRanges,
+	status,
+	collect,
 
 } sedutiloption;
 /** verify the number of arguments passed */
@@ -0,0 +1,160 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "DtaProbe.h"
+#include "DtaJson.h"
+#include "DtaDevGeneric.h"
+#ifdef __gnu_linux__
+#include "DtaDiskEnum.h"
+#endif
+
+using namespace std;
+
+/** an identify field without its trailing blanks */
+static string probeField(const char * src)
+{
+	string s(src);
+	s.erase(s.find_last_not_of(' ') + 1);
+	return s;
+}
+
+void DtaProbeDrive(DtaProbeResult & r)
+{
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	/* DtaDevGeneric stops at identify and discovery0, no Properties */
+	DtaDev * d;
+	if (r.cached) {
+		OPAL_DiskInfo identity;
+		memset(&identity, 0, sizeof (identity));
+		identity.devType = r.devType;
+		r.model.copy((char *)identity.modelNum, sizeof (identity.modelNum));
+		r.serial.copy((char *)identity.serialNum, sizeof (identity.serialNum));
+		r.firmware.copy((char *)identity.firmwareRev, sizeof (identity.firmwareRev));
+		d = new DtaDevGeneric(r.device.c_str(), identity);
+	}
+	else
+		d = new DtaDevGeneric(r.device.c_str());
+	if (!d->isPresent()) {
+		r.rc = DTAERROR_OPEN_ERR;
+	}
+	else {
+		r.opal1 = d->isOpal1() ? true : false;
+		r.opal2 = d->isOpal2() ? true : false;
+		r.enterprise = d->isEprise() ? true : false;
+		r.lockingEnabled = d->LockingEnabled() ? true : false;
+		r.locked = d->Locked() ? true : false;
+		r.mbrEnabled = d->MBREnabled() ? true : false;
+		r.mbrDone = d->MBRDone() ? true : false;
+		r.devType = d->getDevType();
+		r.model = probeField(d->getModelNum());
+		r.serial = probeField(d->getSerialNum());
+		r.firmware = probeField(d->getFirmwareRev());
+	}
+	delete d;
+	r.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void DtaProbe(vector<DtaProbeResult> & drives, unsigned threads)
+{
+	LOG(D1) << "Entering DtaProbe " << drives.size() << " drives";
+	atomic<size_t> next(0);
+	vector<thread> workers;
+	if (0 == threads) threads = DTA_PROBE_THREADS;
+	if (threads > drives.size()) threads = (unsigned)drives.size();
+	for (unsigned t = 0; t < threads; t++) {
+		workers.push_back(thread([&]() {
+			for (size_t i = next++; i < drives.size(); i = next++)
+				DtaProbeDrive(drives[i]);
+		}));
+	}
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+}
+
+void DtaProbe(const vector<string> & devices, vector<DtaProbeResult> & results,
+	unsigned threads)
+{
+	results.assign(devices.size(), DtaProbeResult());
+	for (size_t i = 0; i < devices.size(); i++)
+		results[i].device = devices[i];
+	DtaProbe(results, threads);
+}
+
+static void probeBool(const char * key, bool value)
+{
+	printf(",\"%s\":%s", key, value ? "true" : "false");
+}
+
+uint8_t DtaProbeStatus(const char * devices)
+{
+	LOG(D1) << "Entering DtaProbeStatus " << devices;
+	vector<string> list;
+	vector<DtaProbeResult> results;
+	uint8_t rc = 0;
+	if (!strcmp(devices, "all")) {
+#ifdef __gnu_linux__
+		vector<DtaDiskEntry> disks;
+		DtaDiskEnum(disks);
+		for (size_t i = 0; i < disks.size(); i++)
+			list.push_back(disks[i].devref);
+#else
+		LOG(E) << "--status all is not supported on this platform, list the devices";
+		return DTAERROR_INVALID_PARAMETER;
+#endif
+	}
+	else {
+		string s(devices);
+		for (size_t start = 0, comma; start <= s.length(); start = comma + 1) {
+			comma = s.find(',', start);
+			if (string::npos == comma) comma = s.length();
+			if (comma > start) list.push_back(s.substr(start, comma - start));
+		}
+	}
+	DtaProbe(list, results);
+	for (size_t i = 0; i < results.size(); i++) {
+		DtaProbeResult & r = results[i];
+		printf("{\"device\":");
+		DtaJsonQuote(r.device);
+		printf(",\"rc\":%u", r.rc);
+		if (0 == r.rc) {
+			/* the names --watch uses */
+			DtaJsonString("ssc", r.opal2 ? "opal2" : r.opal1 ? "opal1" :
+				r.enterprise ? "enterprise" : "none");
+			if (r.opal1 || r.opal2 || r.enterprise) {
+				probeBool("locking_enabled", r.lockingEnabled);
+				probeBool("locked", r.locked);
+				probeBool("mbr_enabled", r.mbrEnabled);
+				probeBool("mbr_done", r.mbrDone);
+			}
+			DtaJsonString("model", r.model);
+			DtaJsonString("serial", r.serial);
+			DtaJsonString("firmware", r.firmware);
+		}
+		else if (0 == rc) rc = r.rc;
+		printf(",\"ms\":%.3f}\n", r.ms);
+	}
+	fflush(stdout);
+	return rc;
+}
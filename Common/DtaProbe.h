@@ -0,0 +1,77 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "DtaStructures.h"
+
+/** Drives probed at once by DtaProbe() */
+#define DTA_PROBE_THREADS 16
+
+/** The state of a drive as one Level 0 Discovery reports it */
+typedef struct _DtaProbeResult {
+	std::string device;
+	uint8_t rc = 0; /**< DTAERROR_OPEN_ERR if the drive could not be opened */
+	bool opal1 = false;
+	bool opal2 = false;
+	bool enterprise = false;
+	bool lockingEnabled = false;
+	bool locked = false;
+	bool mbrEnabled = false;
+	bool mbrDone = false;
+	DTA_DEVICE_TYPE devType = DEVICE_TYPE_OTHER;
+	std::string model; /**< from identify, trailing blanks dropped */
+	std::string serial;
+	std::string firmware;
+	bool cached = false; /**< devType, model, serial and firmware were filled in
+				by the caller, identify is not sent */
+	double ms = 0; /**< time taken to open and probe the drive */
+} DtaProbeResult;
+
+/** Probe one drive in the calling thread, see DtaProbe()
+ * @param r device, and the identity if cached is set, filled in by the caller
+ */
+void DtaProbeDrive(DtaProbeResult & r);
+
+/** Probe drives without a session: each drive gets its identify and one
+ * IF_RECV of Level 0 Discovery, there is no Properties exchange.
+ * Up to threads drives are probed at once.
+ * @param devices device references
+ * @param results one result per device, in the same order
+ * @param threads drives probed at once, 0 for DTA_PROBE_THREADS
+ */
+void DtaProbe(const std::vector<std::string> & devices,
+	std::vector<DtaProbeResult> & results, unsigned threads = 0);
+
+/** DtaProbe() for results the caller filled in: device, and for drives
+ * whose identity is cached, cached with devType, model, serial and firmware.
+ * @param drives probed in place
+ * @param threads drives probed at once, 0 for DTA_PROBE_THREADS
+ */
+void DtaProbe(std::vector<DtaProbeResult> & drives, unsigned threads = 0);
+
+/** sedutil-cli --status: probe the drives and print one compact JSON
+ * object per drive to stdout.
+ * @param devices comma separated device references, or "all" for every
+ *        disk the system has (Linux only)
+ * @return 0, or the rc of the first drive that could not be probed
+ */
+uint8_t DtaProbeStatus(const char * devices);
@@ -0,0 +1,378 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "DtaProvision.h"
+#include "DtaDevGeneric.h"
+#include "DtaDevOpal1.h"
+#include "DtaDevOpal2.h"
+#include "DtaDevEnterprise.h"
+#include "DtaJson.h"
+#ifdef __gnu_linux__
+#include "DtaDiskEnum.h"
+#endif
+
+using namespace std;
+
+/** Concurrency bounds from the limits line, 0 is unbounded */
+typedef struct _DtaProvisionLimits {
+	unsigned total = 4;
+	unsigned hba = 0;
+	unsigned expander = 0;
+} DtaProvisionLimits;
+
+/** One drive line of the manifest and its outcome */
+typedef struct _DtaProvisionDrive {
+	string device;
+	string hba; /**< empty when unknown, the drive counts against no adapter */
+	string expander;
+	DtaProvisionPlan plan;
+	uint8_t rc = 0;
+	string failed; /**< step that failed */
+} DtaProvisionDrive;
+
+static mutex provisionOutput; /**< keeps the events of concurrent drives whole */
+
+static double provisionMs(chrono::steady_clock::time_point since)
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - since).count();
+}
+
+/** Start an event, the caller adds its fields, then provisionEnd() */
+static void provisionBegin(const char * event)
+{
+	chrono::milliseconds now = chrono::duration_cast<chrono::milliseconds>(
+		chrono::system_clock::now().time_since_epoch());
+	printf("{\"event\":\"%s\",\"time\":%lld.%03d", event,
+		(long long)(now.count() / 1000), (int)(now.count() % 1000));
+}
+
+static void provisionEnd()
+{
+	printf("}\n");
+	fflush(stdout);
+}
+
+static bool provisionOnOff(const string & value, bool & state)
+{
+	if (("on" == value) || value.empty()) state = true;
+	else if ("off" == value) state = false;
+	else return false;
+	return true;
+}
+
+/** Apply one key=value item of a defaults or drive line */
+static bool provisionItem(const string & item, DtaProvisionDrive & drive, bool & ranges)
+{
+	size_t eq = item.find('=');
+	string key = item.substr(0, eq);
+	string value = (string::npos == eq) ? "" : item.substr(eq + 1);
+	bool state;
+	if ("password" == key) drive.plan.password = value;
+	else if ("passwordFile" == key) {
+		ifstream file(value.c_str());
+		if (!file || !getline(file, drive.plan.password)) {
+			LOG(E) << "Unable to read password from " << value;
+			return false;
+		}
+		drive.plan.password.erase(drive.plan.password.find_last_not_of("\r\n") + 1);
+	}
+	else if ("takeOwnership" == key) {
+		if (!provisionOnOff(value, state)) return false;
+		drive.plan.takeOwnership = state;
+	}
+	else if ("activate" == key) {
+		if (!provisionOnOff(value, state)) return false;
+		drive.plan.activate = state;
+	}
+	else if (("mbrEnable" == key) || ("mbrDone" == key)) {
+		if (value.empty() || !provisionOnOff(value, state)) return false;
+		(("mbrEnable" == key) ? drive.plan.mbrEnable : drive.plan.mbrDone) = state ? 1 : 0;
+	}
+	else if ("range" == key) {
+		DtaProvisionRange r;
+		unsigned long n;
+		unsigned long long start, length;
+		char tail;
+		if ((3 != sscanf(value.c_str(), "%lu:%llu:%llu%c", &n, &start, &length, &tail)) ||
+			(0 == n) || (255 < n)) {
+			LOG(E) << "range must be <1...n>:<start>:<length>, not " << value;
+			return false;
+		}
+		r.range = (uint8_t)n;
+		r.start = start;
+		r.length = length;
+		/* the ranges of a drive line replace the ones from defaults */
+		if (!ranges) drive.plan.ranges.clear();
+		ranges = true;
+		drive.plan.ranges.push_back(r);
+	}
+	else if ("pba" == key) drive.plan.pba = value;
+	else if ("hba" == key) drive.hba = value;
+	else if ("expander" == key) drive.expander = value;
+	else {
+		LOG(E) << "Unknown manifest item " << item;
+		return false;
+	}
+	return true;
+}
+
+/** Read the manifest */
+static uint8_t provisionParse(const char * filename, DtaProvisionLimits & limits,
+	vector<DtaProvisionDrive> & drives)
+{
+	LOG(D1) << "Entering provisionParse " << filename;
+	ifstream manifest(filename);
+	if (!manifest) {
+		LOG(E) << "Unable to open manifest " << filename;
+		return DTAERROR_OPEN_ERR;
+	}
+	DtaProvisionDrive defaults;
+	string line;
+	unsigned lineno = 0;
+	while (getline(manifest, line)) {
+		lineno++;
+		istringstream words(line);
+		string first, item;
+		if (!(words >> first) || ('#' == first[0])) continue;
+		if ("limits" == first) {
+			while (words >> item) {
+				unsigned long value;
+				char tail;
+				size_t eq = item.find('=');
+				if ((string::npos == eq) ||
+					(1 != sscanf(item.c_str() + eq + 1, "%lu%c", &value, &tail))) {
+					LOG(E) << filename << ":" << lineno << " limits item " << item << " is not key=number";
+					return DTAERROR_INVALID_PARAMETER;
+				}
+				string key = item.substr(0, eq);
+				if (("total" == key) && value) limits.total = (unsigned)value;
+				else if ("hba" == key) limits.hba = (unsigned)value;
+				else if ("expander" == key) limits.expander = (unsigned)value;
+				else {
+					LOG(E) << filename << ":" << lineno << " invalid limits item " << item;
+					return DTAERROR_INVALID_PARAMETER;
+				}
+			}
+			continue;
+		}
+		DtaProvisionDrive drive = defaults;
+		bool ranges = false;
+		while (words >> item) {
+			if (!provisionItem(item, drive, ranges)) {
+				LOG(E) << filename << ":" << lineno << " invalid item " << item;
+				return DTAERROR_INVALID_PARAMETER;
+			}
+		}
+		if ("defaults" == first) {
+			defaults = drive;
+			continue;
+		}
+		drive.device = first;
+		if (drive.plan.password.empty()) {
+			LOG(E) << filename << ":" << lineno << " no password for " << first;
+			return DTAERROR_INVALID_PARAMETER;
+		}
+#ifdef __gnu_linux__
+		DtaDiskEntry disk;
+		string name = first;
+		if (0 == name.compare(0, 5, "/dev/")) name.erase(0, 5);
+		if (DtaDiskLookup(name.c_str(), disk)) {
+			if (drive.hba.empty()) drive.hba = disk.hba;
+			if (drive.expander.empty()) drive.expander = disk.expander;
+		}
+#endif
+		drives.push_back(drive);
+	}
+	LOG(D1) << "Manifest " << filename << " lists " << drives.size() << " drives";
+	return 0;
+}
+
+/** Open the device the way sedutil-cli does, probe then pick the SSC */
+static DtaDev * provisionOpen(const char * devref)
+{
+	DtaDev * tempDev, *d = NULL;
+	tempDev = new DtaDevGeneric(devref);
+	if ((!tempDev->isPresent()) || (!tempDev->isAnySSC())) {
+		LOG(E) << "Invalid or unsupported disk " << devref;
+		delete tempDev;
+		return NULL;
+	}
+	if (tempDev->isOpal2())
+		d = new DtaDevOpal2(devref);
+	else if (tempDev->isOpal1())
+		d = new DtaDevOpal1(devref);
+	else if (tempDev->isEprise())
+		d = new DtaDevEnterprise(devref);
+	delete tempDev;
+	return d;
+}
+
+/** Provision one drive and report its events */
+static void provisionDrive(DtaProvisionDrive & drive, bool no_hash_passwords)
+{
+	LOG(D1) << "Entering provisionDrive " << drive.device;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	chrono::steady_clock::time_point last = start;
+	size_t range = 0;
+	{
+		lock_guard<mutex> guard(provisionOutput);
+		provisionBegin("start");
+		DtaJsonString("device", drive.device);
+		if (!drive.hba.empty()) DtaJsonString("hba", drive.hba);
+		if (!drive.expander.empty()) DtaJsonString("expander", drive.expander);
+		provisionEnd();
+	}
+	DtaProvisionProgress progress = [&](const char * step, uint8_t rc) {
+		lock_guard<mutex> guard(provisionOutput);
+		provisionBegin("step");
+		DtaJsonString("device", drive.device);
+		DtaJsonString("step", step);
+		if (!strcmp("range", step) && (range < drive.plan.ranges.size()))
+			printf(",\"range\":%u", drive.plan.ranges[range++].range);
+		printf(",\"rc\":%u,\"ms\":%.3f", rc, provisionMs(last));
+		provisionEnd();
+		last = chrono::steady_clock::now();
+		if (rc && drive.failed.empty()) drive.failed = step;
+	};
+	DtaDev * d = provisionOpen(drive.device.c_str());
+	if (NULL == d) {
+		drive.rc = DTAERROR_OPEN_ERR;
+		progress("open", drive.rc);
+	}
+	else {
+		d->no_hash_passwords = no_hash_passwords;
+		d->output_format = sedutilNormal;
+		drive.rc = d->provision(drive.plan, progress);
+		if (drive.rc && drive.failed.empty()) drive.failed = "provision";
+		delete d;
+	}
+	lock_guard<mutex> guard(provisionOutput);
+	provisionBegin("done");
+	DtaJsonString("device", drive.device);
+	printf(",\"rc\":%u", drive.rc);
+	if (drive.rc) DtaJsonString("failed", drive.failed);
+	printf(",\"ms\":%.3f", provisionMs(start));
+	provisionEnd();
+}
+
+/** Drives waiting and the slots in use, shared by the workers */
+typedef struct _DtaProvisionQueue {
+	mutex lock;
+	condition_variable slotFree; /**< a drive finished */
+	size_t next = 0; /**< drives before this one have all been started */
+	vector<bool> started;
+	map<string, unsigned> hbaBusy;
+	map<string, unsigned> expanderBusy;
+} DtaProvisionQueue;
+
+/** Take the first waiting drive whose adapter and expander have a free slot */
+static bool provisionTake(DtaProvisionQueue & q, const DtaProvisionLimits & limits,
+	vector<DtaProvisionDrive> & drives, size_t & taken)
+{
+	unique_lock<mutex> guard(q.lock);
+	for (;;) {
+		while ((q.next < drives.size()) && q.started[q.next]) q.next++;
+		if (q.next >= drives.size()) return false;
+		for (size_t i = q.next; i < drives.size(); i++) {
+			if (q.started[i]) continue;
+			DtaProvisionDrive & drive = drives[i];
+			if (limits.hba && !drive.hba.empty() &&
+				(q.hbaBusy[drive.hba] >= limits.hba)) continue;
+			if (limits.expander && !drive.expander.empty() &&
+				(q.expanderBusy[drive.expander] >= limits.expander)) continue;
+			q.started[i] = true;
+			q.hbaBusy[drive.hba]++;
+			q.expanderBusy[drive.expander]++;
+			taken = i;
+			return true;
+		}
+		q.slotFree.wait(guard);
+	}
+}
+
+static void provisionWorker(DtaProvisionQueue & q, const DtaProvisionLimits & limits,
+	vector<DtaProvisionDrive> & drives, bool no_hash_passwords)
+{
+	size_t i;
+	while (provisionTake(q, limits, drives, i)) {
+		provisionDrive(drives[i], no_hash_passwords);
+		{
+			lock_guard<mutex> guard(q.lock);
+			q.hbaBusy[drives[i].hba]--;
+			q.expanderBusy[drives[i].expander]--;
+		}
+		q.slotFree.notify_all();
+	}
+}
+
+uint8_t DtaProvision(const char * filename, bool no_hash_passwords)
+{
+	LOG(D1) << "Entering DtaProvision " << filename;
+	DtaProvisionLimits limits;
+	vector<DtaProvisionDrive> drives;
+	uint8_t lastRC;
+	if ((lastRC = provisionParse(filename, limits, drives)) != 0)
+		return lastRC;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	DtaProvisionQueue q;
+	q.started.resize(drives.size(), false);
+	size_t workers = (limits.total < drives.size()) ? limits.total : drives.size();
+	vector<thread> threads;
+	for (size_t i = 0; i < workers; i++)
+		threads.push_back(thread(provisionWorker, ref(q), cref(limits), ref(drives),
+			no_hash_passwords));
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	size_t failed = 0;
+	lastRC = 0;
+	for (size_t i = 0; i < drives.size(); i++) {
+		if (!drives[i].rc) continue;
+		if (!failed++) lastRC = drives[i].rc;
+	}
+	provisionBegin("summary");
+	printf(",\"drives\":%zu,\"succeeded\":%zu,\"failed\":%zu,\"ms\":%.3f",
+		drives.size(), drives.size() - failed, failed, provisionMs(start));
+	printf(",\"limits\":{\"total\":%u,\"hba\":%u,\"expander\":%u}",
+		limits.total, limits.hba, limits.expander);
+	printf(",\"failures\":[");
+	for (size_t i = 0, n = 0; i < drives.size(); i++) {
+		if (!drives[i].rc) continue;
+		printf("%s{\"device\":", n++ ? "," : "");
+		DtaJsonQuote(drives[i].device);
+		DtaJsonString("step", drives[i].failed);
+		printf(",\"rc\":%u}", drives[i].rc);
+	}
+	printf("]");
+	provisionEnd();
+	LOG(D1) << "Exiting DtaProvision";
+	return lastRC;
+}
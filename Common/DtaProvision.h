@@ -0,0 +1,53 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include <stdint.h>
+
+/** Provision the drives listed in a manifest.
+ *
+ * The manifest is a text file with one drive per line, blank lines and
+ * lines starting with # are ignored:
+ *
+ *     limits total=8 hba=4 expander=2
+ *     defaults passwordFile=/root/sid.txt takeOwnership activate mbrEnable=on
+ *     /dev/sda range=1:0:2097152 pba=/usr/share/sedutil/UEFI64.img
+ *     /dev/nvme0 password=other mbrEnable=off
+ *
+ * A drive line is the device followed by key=value items, it starts from
+ * the last defaults line:
+ *   password=, passwordFile=  SID password, Admin1 once activated
+ *   takeOwnership, activate   steps, also takeOwnership=on|off
+ *   range=<n>:<start>:<length> locking range to set up and rekey, the
+ *                             ranges of a drive line replace the defaults'
+ *   pba=<file>                image to write to the shadow MBR
+ *   mbrEnable=on|off, mbrDone=on|off
+ *   hba=, expander=           override the topology read from sysfs
+ *
+ * limits bounds the drives provisioned at once in total, behind one host
+ * adapter and behind one SAS expander, 0 leaves hba and expander unbounded.
+ * Each drive runs its steps in the order above with one session per SP
+ * (DtaDev::provision).  Progress is written to stdout as one JSON object
+ * per line: start and done for each drive, step after each step, and a
+ * summary at the end.
+ * @param filename the manifest
+ * @param no_hash_passwords send the passwords in clear text
+ * @return 0 when every drive succeeded, else the first failure in manifest order
+ */
+uint8_t DtaProvision(const char * filename, bool no_hash_passwords);
@@ -27,25 +27,46 @@ DtaResponse::DtaResponse()
     LOG(D1) << "Creating  DtaResponse()";
 }
 
-DtaResponse::DtaResponse(void * buffer)
+DtaResponse::DtaResponse(void * buffer, uint32_t bufferlen)
 {
     LOG(D1) << "Creating  DtaResponse(buffer)";
-    init(buffer);
+    init(buffer, bufferlen);
 }
 
 void
-DtaResponse::init(void * buffer)
+DtaResponse::init(void * buffer, uint32_t bufferlen)
 {
     LOG(D1) << "Entering  DtaResponse::init";
     std::vector<uint8_t> bytestring, empty_atom(1, 0xff);
     uint8_t * reply = (uint8_t *) buffer;
     uint32_t cpos = 0;
     uint32_t tokenLength;
-    memcpy(&h, buffer, sizeof (OPALHeader));
+    uint32_t length;
     response.clear();
+    error = false;
+    if (bufferlen < sizeof (OPALHeader)) {
+        LOG(E) << "Response buffer shorter than the header";
+        error = true;
+        return;
+    }
+    memcpy(&h, buffer, sizeof (OPALHeader));
     reply += sizeof (OPALHeader);
-    while (cpos < SWAP32(h.subpkt.length)) {
+    length = SWAP32(h.subpkt.length);
+    if (length > bufferlen - sizeof (OPALHeader)) {
+        LOG(E) << "Response subpacket length " << length << " exceeds the buffer";
+        length = bufferlen - sizeof (OPALHeader);
+        error = true;
+    }
+    while (cpos < length) {
         bytestring.clear();
+        /* the length of medium and long atoms is in the bytes after the first */
+        uint32_t headerLength = ((reply[cpos] & 0xf0) == 0xe0) ? 4 :
+            ((reply[cpos] & 0xe0) == 0xc0) ? 2 : 1;
+        if (cpos + headerLength > length) {
+            LOG(E) << "Response atom header at " << cpos << " overruns the subpacket";
+            error = true;
+            break;
+        }
         if (!(reply[cpos] & 0x80)) //tiny atom
             tokenLength = 1;
         else if (!(reply[cpos] & 0x40)) // short atom
@@ -57,6 +78,11 @@ DtaResponse::init(void * buffer)
         else // TOKEN
             tokenLength = 1;
 
+        if (cpos + tokenLength > length) {
+            LOG(E) << "Response token at " << cpos << " overruns the subpacket";
+            error = true;
+            break;
+        }
         for (uint32_t i = 0; i < tokenLength; i++) {
             bytestring.push_back(reply[cpos++]);
         }
@@ -68,6 +94,7 @@ DtaResponse::init(void * buffer)
 OPAL_TOKEN DtaResponse::tokenIs(uint32_t tokenNum)
 {
     LOG(D1) << "Entering  DtaResponse::tokenIs";
+    if (!valid(tokenNum)) return OPAL_TOKEN::EMPTYATOM;
     if (!(response[tokenNum][0] & 0x80)) { //tiny atom
         if ((response[tokenNum][0] & 0x40))
             return OPAL_TOKEN::DTA_TOKENID_SINT;
@@ -104,16 +131,19 @@ OPAL_TOKEN DtaResponse::tokenIs(uint32_t tokenNum)
 
 uint32_t DtaResponse::getLength(uint32_t tokenNum)
 {
+    if (!valid(tokenNum)) return 0;
     return (uint32_t) response[tokenNum].size();
 }
 
 uint64_t DtaResponse::getUint64(uint32_t tokenNum)
 {
     LOG(D1) << "Entering  DtaResponse::getUint64";
+    if (!valid(tokenNum)) return 0;
     if (!(response[tokenNum][0] & 0x80)) { //tiny atom
         if ((response[tokenNum][0] & 0x40)) {
             LOG(E) << "unsigned int requested for signed tiny atom";
-			exit(EXIT_FAILURE);
+            error = true;
+			return 0;
         }
         else {
             return (uint64_t) (response[tokenNum][0] & 0x3f);
@@ -122,11 +152,12 @@ uint64_t DtaResponse::getUint64(uint32_t tokenNum)
     else if (!(response[tokenNum][0] & 0x40)) { // short atom
         if ((response[tokenNum][0] & 0x10)) {
             LOG(E) << "unsigned int requested for signed short atom";
-			exit(EXIT_FAILURE);
+            error = true;
+			return 0;
         }
         else {
             uint64_t whatever = 0;
-            if (response[tokenNum].size() > 9) { LOG(E) << "UINT64 with greater than 8 bytes"; }
+            if (response[tokenNum].size() > 9) { LOG(E) << "UINT64 with greater than 8 bytes"; error = true; }
             int b = 0;
             for (uint32_t i = (uint32_t) response[tokenNum].size() - 1; i > 0; i--) {
 				whatever |= ((uint64_t)response[tokenNum][i] << (8 * b));
@@ -138,15 +169,18 @@ uint64_t DtaResponse::getUint64(uint32_t tokenNum)
     }
     else if (!(response[tokenNum][0] & 0x20)) { // medium atom
         LOG(E) << "unsigned int requested for medium atom is unsupported";
-		exit(EXIT_FAILURE);
+        error = true;
+		return 0;
     }
     else if (!(response[tokenNum][0] & 0x10)) { // long atom
         LOG(E) << "unsigned int requested for long atom is unsupported";
-		exit(EXIT_FAILURE);
+        error = true;
+		return 0;
     }
     else { // TOKEN
         LOG(E) << "unsigned int requested for token is unsupported";
-		exit(EXIT_FAILURE);
+        error = true;
+		return 0;
     }
 }
 
@@ -154,7 +188,7 @@ uint32_t DtaResponse::getUint32(uint32_t tokenNum)
 {
     LOG(D1) << "Entering  DtaResponse::getUint32";
     uint64_t i = getUint64(tokenNum);
-    if (i > 0xffffffff) { LOG(E) << "UINT32 truncated "; }
+    if (i > 0xffffffff) { LOG(E) << "UINT32 truncated "; error = true; }
     return (uint32_t) i;
 
 }
@@ -163,7 +197,7 @@ uint16_t DtaResponse::getUint16(uint32_t tokenNum)
 {
     LOG(D1) << "Entering  DtaResponse::getUint16";
     uint64_t i = getUint64(tokenNum);
-    if (i > 0xffff) { LOG(E) << "UINT16 truncated "; }
+    if (i > 0xffff) { LOG(E) << "UINT16 truncated "; error = true; }
     return (uint16_t) i;
 }
 
@@ -171,7 +205,7 @@ uint8_t DtaResponse::getUint8(uint32_t tokenNum)
 {
 	LOG(D1) << "Entering  DtaResponse::getUint8";
     uint64_t i = getUint64(tokenNum);
-    if (i > 0xff) { LOG(E) << "UINT8 truncated "; }
+    if (i > 0xff) { LOG(E) << "UINT8 truncated "; error = true; }
     return (uint8_t) i;
 }
 //int64_t DtaResponse::getSint(uint32_t tokenNum) {
@@ -180,6 +214,7 @@ uint8_t DtaResponse::getUint8(uint32_t tokenNum)
 
 std::vector<uint8_t> DtaResponse::getRawToken(uint32_t tokenNum)
 {
+    if (!valid(tokenNum)) return std::vector<uint8_t>();
     return response[tokenNum];
 }
 
@@ -189,9 +224,11 @@ std::string DtaResponse::getString(uint32_t tokenNum)
     std::string s;
     s.erase();
     int overhead = 0;
+    if (!valid(tokenNum)) return s;
     if (!(response[tokenNum][0] & 0x80)) { //tiny atom
         LOG(E) << "Cannot get a string from a tiny atom";
-		exit(EXIT_FAILURE);
+        error = true;
+		return s;
     }
     else if (!(response[tokenNum][0] & 0x40)) { // short atom
         overhead = 1;
@@ -204,6 +241,7 @@ std::string DtaResponse::getString(uint32_t tokenNum)
     }
     else {
         LOG(E) << "Cannot get a string from a TOKEN";
+        error = true;
         return s;
     }
     for (uint32_t i = overhead; i < response[tokenNum].size(); i++) {
@@ -216,9 +254,11 @@ void DtaResponse::getBytes(uint32_t tokenNum, uint8_t bytearray[])
 {
     LOG(D1) << "Entering  DtaResponse::getBytes";
     int overhead = 0;
+    if (!valid(tokenNum)) return;
     if (!(response[tokenNum][0] & 0x80)) { //tiny atom
         LOG(E) << "Cannot get a bytestring from a tiny atom";
-		exit(EXIT_FAILURE);
+        error = true;
+		return;
     }
     else if (!(response[tokenNum][0] & 0x40)) { // short atom
         overhead = 1;
@@ -231,7 +271,8 @@ void DtaResponse::getBytes(uint32_t tokenNum, uint8_t bytearray[])
     }
     else {
         LOG(E) << "Cannot get a bytestring from a TOKEN";
-		exit(EXIT_FAILURE);
+        error = true;
+		return;
     }
 
     for (uint32_t i = overhead; i < response[tokenNum].size(); i++) {
@@ -239,6 +280,21 @@ void DtaResponse::getBytes(uint32_t tokenNum, uint8_t bytearray[])
     }
 }
 
+bool DtaResponse::valid(uint32_t tokenNum)
+{
+    if (tokenNum < response.size())
+        return true;
+    LOG(E) << "Token " << tokenNum << " requested from a response of "
+        << response.size() << " tokens";
+    error = true;
+    return false;
+}
+
+bool DtaResponse::failed()
+{
+    return error;
+}
+
 uint32_t DtaResponse::getTokenCount()
 {
     LOG(D1) << "Entering  DtaResponse::getTokenCount()";
@@ -20,6 +20,7 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 #include <vector>
 #include <string>
+#include "DtaConstants.h"
 #include "DtaStructures.h"
 #include "DtaLexicon.h"
 
@@ -32,12 +33,14 @@ class DtaResponse {
 public:
     DtaResponse();
     /** constructor
-     * @param buffer the response returned by a TCG command */
-    DtaResponse(void * buffer);
+     * @param buffer the response returned by a TCG command
+     * @param bufferlen size of buffer, the parse stops at its end */
+    DtaResponse(void * buffer, uint32_t bufferlen = MAX_BUFFER_LENGTH);
     ~DtaResponse();
     /** (re)initialize the object using a new buffer
-     * @param buffer the response returned by a TCG command */
-    void init(void * buffer);
+     * @param buffer the response returned by a TCG command
+     * @param bufferlen size of buffer, the parse stops at its end */
+    void init(void * buffer, uint32_t bufferlen = MAX_BUFFER_LENGTH);
     /** return the type of token 
      * @param tokenNum the 0 based number of the token*/
     OPAL_TOKEN tokenIs(uint32_t tokenNum);
@@ -58,6 +61,10 @@ public:
     uint8_t getUint8(uint32_t tokenNum);
     /** return the number of tokens in the response */
     uint32_t getTokenCount();
+    /** true if the response could not be parsed whole, or a getter was
+     * asked for a token that is missing or of the wrong type, since the
+     * last init().  The getters return 0 or an empty value in that case. */
+    bool failed();
     /** return a string of the token 
      * @param tokenNum the 0 based number of the token*/
     std::string getString(uint32_t tokenNum);
@@ -72,8 +79,12 @@ public:
     OPALHeader h; /**< TCG Header fields of the response */
 
 private:
+    /** log and return false if the response has no such token
+    * @param tokenNum the 0 based number of the token*/
+    bool valid(uint32_t tokenNum);
 
     std::vector<std::vector<uint8_t>> response;   /**< tokenized resonse  */
+    bool error = false; /**< see failed() */
 };
 
 
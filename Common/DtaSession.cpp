@@ -28,9 +28,65 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include "DtaHexDump.h"
 #include "DtaHashPwd.h"
 #include "DtaStructures.h"
+#include "DtaStats.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
 
 using namespace std;
 
+/** Attempts for a command answered SP_BUSY or NO_SESSIONS_AVAILABLE */
+#define DTA_SESSION_ATTEMPTS 8
+/** First backoff in ms, doubled for each retry */
+#define DTA_SESSION_BACKOFF_MS 2U
+/** Largest backoff in ms */
+#define DTA_SESSION_BACKOFF_MAX_MS 250U
+/** How long admit() waits for a session slot */
+#define DTA_SESSION_ADMIT_MS 30000
+
+/** Session slots of one drive */
+typedef struct _DtaSessionDrive {
+	uint32_t open;  /**< sessions admitted */
+	set<uint16_t> comIDs;  /**< comIDs of the admitted sessions */
+} DtaSessionDrive;
+static mutex DtaSessionSlotLock;
+static condition_variable DtaSessionSlotFree;
+static map<string, DtaSessionDrive> DtaSessionDrives;
+
+/** Sessions that may be open on a TPer, the signal handler only defers
+ * while there are any */
+static std::atomic<int> DtaSessionsOpen(0);
+/** Signal deferred until the open sessions have ended, 0 if none */
+static volatile sig_atomic_t DtaSessionSignal = 0;
+/** catchSignals() has installed the handler */
+static bool DtaSessionCatching = false;
+
+static void DtaSessionSignalHandler(int sig)
+{
+	signal(sig, SIG_DFL);
+	if (0 == DtaSessionsOpen.load()) {
+		raise(sig);
+		return;
+	}
+	DtaSessionSignal = sig;
+}
+
+void DtaSession::catchSignals()
+{
+	DtaSessionCatching = true;
+	signal(SIGINT, DtaSessionSignalHandler);
+	signal(SIGTERM, DtaSessionSignalHandler);
+#ifdef SIGHUP
+	signal(SIGHUP, DtaSessionSignalHandler);
+#endif
+}
+
 DtaSession::DtaSession(DtaDev * device)
 {
     LOG(D1) << "Creating DtaSsession()";
@@ -128,9 +184,10 @@ DtaSession::start(OPAL_UID SP, char * HostChallenge, vector<uint8_t> SignAuthori
 		cmd->addToken(OPAL_TOKEN::ENDNAME);
 	}
  
-	// w/o the timeout the session may wedge and require a power-cycle,
-	// e.g., when interrupted by ^C. 60 seconds is inconveniently long,
-	// but revert may require that long to complete.
+	// w/o the timeout a session left open, e.g. by a crash, would wedge
+	// until a power-cycle. 60 seconds is inconveniently long, but revert
+	// may require that long to complete; with --resetComID a busy comID
+	// at start is cleared with STACK_RESET below instead of waiting for it.
 	if (d->isEprise()) {
 		cmd->addToken(OPAL_TOKEN::STARTNAME);
 		cmd->addToken("SessionTimeout");
@@ -140,7 +197,32 @@ DtaSession::start(OPAL_UID SP, char * HostChallenge, vector<uint8_t> SignAuthori
 
     cmd->addToken(OPAL_TOKEN::ENDLIST); // ]  (Close Bracket)
     cmd->complete();
-	if ((lastRC = sendCommand(cmd, response)) != 0) {
+	if (!counted) {
+		counted = 1;
+		DtaSessionsOpen++;
+	}
+	if (!admitted && ((lastRC = admit()) != 0)) {
+		delete cmd;
+		return lastRC;
+	}
+	lastRC = sendCommand(cmd, response);
+	if ((OPALSTATUSCODE::NO_SESSIONS_AVAILABLE == lastRC) && !DtaDev::resetComID()) {
+		LOG(E) << "No sessions available on comID " << HEXON(4) << d->comID() << HEXOFF <<
+			", --resetComID aborts the session holding it";
+	}
+	else if (OPALSTATUSCODE::NO_SESSIONS_AVAILABLE == lastRC) {
+		/* admit() keeps the other sessions of this process off our comID,
+		 * but the holder may be the kernel, a PBA or another program as
+		 * well as a crashed process, so this only runs on request */
+		uint32_t state;
+		LOG(W) << "No sessions available on comID " << HEXON(4) << d->comID() << HEXOFF <<
+			", resetting it";
+		if ((0 == d->verifyComID(state)) && (state >= 2) && (0 == d->stackReset())) {
+			DtaStats::count(DTASTATS_STACK_RESETS);
+			lastRC = sendCommand(cmd, response);
+		}
+	}
+	if (lastRC != 0) {
 		LOG(E) << "Session start failed rc = " << (int)lastRC;
 		delete cmd;
 		return lastRC;
@@ -150,6 +232,10 @@ DtaSession::start(OPAL_UID SP, char * HostChallenge, vector<uint8_t> SignAuthori
     HSN = SWAP32(response.getUint32(4));
     TSN = SWAP32(response.getUint32(5));
 	delete cmd;
+	if (response.failed()) {
+		LOG(E) << "Session start response has no session numbers";
+		return (lastRC = DTAERROR_BAD_RESPONSE);
+	}
 	if ((NULL != HostChallenge) && (d->isEprise())) {
 		return(authenticate(SignAuthority, HostChallenge));
 	}
@@ -206,9 +292,132 @@ uint8_t
 DtaSession::sendCommand(DtaCommand * cmd, DtaResponse & response)
 {
     LOG(D1) << "Entering DtaSession::sendCommand()";
+	uint8_t rc;
+	if (!counted) {
+		/* outside a session (Properties) the comID is only held for the
+		 * one exchange */
+		if ((rc = admit()) != 0) return rc;
+		rc = send(cmd, response);
+		release();
+		return rc;
+	}
+	return send(cmd, response);
+}
+
+uint8_t
+DtaSession::send(DtaCommand * cmd, DtaResponse & response)
+{
+	uint8_t rc, status;
+	for (uint32_t attempt = 1;; attempt++) {
+		if (DtaSessionSignal && !ending) {
+			LOG(D1) << "Session command skipped, signal " << (int)DtaSessionSignal;
+			return DTAERROR_INTERRUPTED;
+		}
+		if ((rc = exchange(cmd, response, status)) != 0)
+			return rc;
+		if ((OPALSTATUSCODE::SP_BUSY != status) &&
+			(OPALSTATUSCODE::NO_SESSIONS_AVAILABLE != status))
+			break;
+		DtaStats::count((OPALSTATUSCODE::SP_BUSY == status) ?
+			DTASTATS_SP_BUSY : DTASTATS_NO_SESSIONS);
+		if ((attempt >= DTA_SESSION_ATTEMPTS) || ending) {
+			DtaStats::count(DTASTATS_EXHAUSTED);
+			break;
+		}
+		LOG(D1) << methodStatus(status) << " on attempt " << attempt << ", retrying";
+		backoff(attempt);
+		DtaStats::count(DTASTATS_RETRIES);
+	}
+	if (OPALSTATUSCODE::SUCCESS != status) {
+		LOG(E) << "method status code " << methodStatus(status);
+	}
+	return status;
+}
+
+void
+DtaSession::backoff(uint32_t attempt)
+{
+	/* half the delay is fixed and half random, so sessions that collided
+	 * do not retry in step */
+	static thread_local minstd_rand jitter((uint32_t)
+		chrono::steady_clock::now().time_since_epoch().count());
+	uint32_t ms = DTA_SESSION_BACKOFF_MAX_MS;
+	if ((attempt < 16) && ((DTA_SESSION_BACKOFF_MS << (attempt - 1)) < ms))
+		ms = DTA_SESSION_BACKOFF_MS << (attempt - 1);
+	ms = ms / 2 + jitter() % (ms / 2 + 1);
+	uint64_t start = DtaStats::now();
+	d->osmsSleep(ms);
+	DtaStats::phase(DTASTATS_BACKOFF, start);
+}
+
+uint8_t
+DtaSession::admit()
+{
+	LOG(D1) << "Entering DtaSession::admit()";
+	uint64_t start = DtaStats::now();
+	uint32_t limit = d->maxSessions();
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::now() +
+		chrono::milliseconds(DTA_SESSION_ADMIT_MS);
+	uint8_t rc;
+	slotDrive = d->driveKey();
+	slotComID = d->comID();
+	/* other processes first, then the sessions of this one */
+	if ((rc = d->lockDrive(DTA_LOCK_EXCLUSIVE)) != 0)
+		return rc;
+	unique_lock<mutex> lock(DtaSessionSlotLock);
+	for (;;) {
+		DtaSessionDrive & drive = DtaSessionDrives[slotDrive];
+		if (!drive.comIDs.count(slotComID) && (!limit || (drive.open < limit))) {
+			drive.open++;
+			drive.comIDs.insert(slotComID);
+			break;
+		}
+		if (DtaSessionSignal) {
+			lock.unlock();
+			d->unlockDrive(DTA_LOCK_EXCLUSIVE);
+			return DTAERROR_INTERRUPTED;
+		}
+		if (chrono::steady_clock::now() >= deadline) {
+			LOG(E) << "No session slot on comID " << HEXON(4) << slotComID << HEXOFF <<
+				" within " << DTA_SESSION_ADMIT_MS << "ms";
+			lock.unlock();
+			d->unlockDrive(DTA_LOCK_EXCLUSIVE);
+			return OPALSTATUSCODE::NO_SESSIONS_AVAILABLE;
+		}
+		DtaSessionSlotFree.wait_for(lock, chrono::milliseconds(100));
+	}
+	admitted = 1;
+	lock.unlock();
+	DtaStats::phase(DTASTATS_ADMIT, start);
+	return 0;
+}
+
+void
+DtaSession::release()
+{
+	if (!admitted) return;
+	LOG(D1) << "Entering DtaSession::release()";
+	{
+		lock_guard<mutex> guard(DtaSessionSlotLock);
+		map<string, DtaSessionDrive>::iterator it = DtaSessionDrives.find(slotDrive);
+		if (DtaSessionDrives.end() != it) {
+			it->second.open--;
+			it->second.comIDs.erase(slotComID);
+			if (0 == it->second.open) DtaSessionDrives.erase(it);
+		}
+	}
+	admitted = 0;
+	DtaSessionSlotFree.notify_all();
+	d->unlockDrive(DTA_LOCK_EXCLUSIVE);
+}
+
+uint8_t
+DtaSession::exchange(DtaCommand * cmd, DtaResponse & response, uint8_t & status)
+{
+	status = OPALSTATUSCODE::SUCCESS;
     cmd->setHSN(HSN);
     cmd->setTSN(TSN);
-    cmd->setcomID(d->comID());
+    cmd->setcomID(d->comID(), d->comIDExtension());
 
     uint8_t exec_rc = d->exec(cmd, response, SecurityProtocol);
     if (0 != exec_rc)
@@ -216,6 +425,11 @@ DtaSession::sendCommand(DtaCommand * cmd, DtaResponse & response)
         LOG(E) << "Command failed on exec " << (uint16_t) exec_rc;
         return exec_rc;
     }
+    /* a reply that could not be tokenized whole has no trustworthy status */
+    if (response.failed()) {
+        LOG(E) << "Malformed response";
+        return DTAERROR_BAD_RESPONSE;
+    }
     /*
      * Check out the basics that so that we know we
      * have a sane reply to work with
@@ -227,7 +441,7 @@ DtaSession::sendCommand(DtaCommand * cmd, DtaResponse & response)
         LOG(E) << "One or more header fields have 0 length";
 		return DTAERROR_COMMAND_ERROR;
     }
-    // if we get an endsession response return 0
+    // if we get an endsession response the status is SUCCESS
     if (OPAL_TOKEN::ENDOFSESSION == response.tokenIs(0)) {
         return 0;
     }
@@ -238,11 +452,20 @@ DtaSession::sendCommand(DtaCommand * cmd, DtaResponse & response)
         LOG(E) << "Method Status missing";
 		return DTAERROR_NO_METHOD_STATUS;
     }
-    if (OPALSTATUSCODE::SUCCESS != response.getUint8(response.getTokenCount() - 4)) {
-        LOG(E) << "method status code " <<
-                methodStatus(response.getUint8(response.getTokenCount() - 4));
+    status = response.getUint8(response.getTokenCount() - 4);
+    /* a multi-method packet has a status list after each method, the TPer
+     * stops at the first that fails but check them all */
+    for (uint32_t i = 0; (OPALSTATUSCODE::SUCCESS == status) &&
+        (i + 6 < response.getTokenCount()); i++) {
+        if ((OPAL_TOKEN::ENDOFDATA == response.tokenIs(i)) &&
+            (OPAL_TOKEN::STARTLIST == response.tokenIs(i + 1)))
+            status = response.getUint8(i + 2);
     }
-    return response.getUint8(response.getTokenCount() - 4);
+    if (response.failed()) {
+        LOG(E) << "Malformed response";
+        return DTAERROR_BAD_RESPONSE;
+    }
+    return 0;
 }
 
 void
@@ -316,6 +539,7 @@ DtaSession::~DtaSession()
 {
     LOG(D1) << "Destroying DtaSession";
 	DtaResponse response;
+	ending = 1;
     if (!willAbort) {
         DtaCommand *cmd = new DtaCommand();
 		if (NULL == cmd) {
@@ -331,4 +555,9 @@ DtaSession::~DtaSession()
 			delete cmd;
 		}
     }
+	release();
+	if (counted && (0 == --DtaSessionsOpen) && DtaSessionCatching && DtaSessionSignal) {
+		LOG(D1) << "Sessions ended, raising signal " << (int)DtaSessionSignal;
+		raise(DtaSessionSignal);
+	}
 }
@@ -23,6 +23,7 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "DtaLexicon.h"
 #include <vector>
+#include <string>
 class DtaCommand;
 class DtaDev;
 class DtaResponse;
@@ -82,10 +83,19 @@ public:
 	/** return the authorization the session has started under */
 	uint8_t authuser();
     /** send a command to the device in this session 
+     * SP_BUSY and NO_SESSIONS_AVAILABLE are retried with a jittered
+     * exponential backoff before they are returned.
      * @param cmd  The DtaCommand object 
      * @param response The MesdResponse object 
      */
     uint8_t sendCommand(DtaCommand * cmd, DtaResponse & response);
+	/** Defer SIGINT, SIGTERM and SIGHUP while sessions are open.
+	 * The signal makes further session commands fail with
+	 * DTAERROR_INTERRUPTED, so the callers unwind and the session
+	 * destructors send their EndSession; the signal is raised again once
+	 * the last session has ended.  Without sessions it acts at once.
+	 */
+	static void catchSignals();
 private:
     /** Default constructor, private should never be called */
     DtaSession();
@@ -93,11 +103,33 @@ private:
      * @param status the method status code returned 
      */
     char * methodStatus(uint8_t status);
+	/** send a command, retrying SP_BUSY and NO_SESSIONS_AVAILABLE */
+	uint8_t send(DtaCommand * cmd, DtaResponse & response);
+	/** send a command once
+	 * @param cmd the DtaCommand object
+	 * @param response the DtaResponse object
+	 * @param status where the method status is returned
+	 * @return 0 or the transport or response error
+	 */
+	uint8_t exchange(DtaCommand * cmd, DtaResponse & response, uint8_t & status);
+	/** sleep before retry attempt+1 of a busy command */
+	void backoff(uint32_t attempt);
+	/** Lock the drive against other processes (DtaDev::lockDrive), then
+	 * wait for a session slot on it, at most MaxSessions sessions and one
+	 * per comID run at once in this process */
+	uint8_t admit();
+	/** give back the slot taken by admit() */
+	void release();
     DtaDev * d;   /**< Pointer to device this session is with */
     uint32_t bufferpos = 0;   /**< psooition in the response buffer the parser is at */
     uint32_t TSN = 0;   /**< TPer session number */
     uint32_t HSN = 0;  /**< Host session number */
     uint8_t willAbort = 0;   /**< Command is expected to abort */
+	uint8_t ending = 0;  /**< EndSession is being sent */
+	uint8_t counted = 0;  /**< StartSession was sent, counted as open */
+	uint8_t admitted = 0;  /**< holds a session slot from admit() */
+	uint16_t slotComID = 0;  /**< comID of the session slot */
+	std::string slotDrive;  /**< DtaDev::driveKey() of the session slot */
 	uint8_t hashPwd = 1;  /**< hash the password when authenticating */
     uint8_t SecurityProtocol = 0x01;  /**< The seurity protocol to be used */
 	uint8_t lastRC;  /**< last return code */
@@ -0,0 +1,252 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <chrono>
+#include <mutex>
+#include <map>
+#include "DtaStats.h"
+#include "DtaStructures.h"
+#include "DtaLexicon.h"
+
+using namespace std;
+
+/** names of the entries in OPALMETHOD, same order as OPAL_METHOD */
+static const char * DtaStatsMethodName[] = {
+	"Properties", "StartSession", "Revert", "Activate", "EGet", "ESet",
+	"Next", "EAuthenticate", "GetACL", "GenKey", "RevertSP", "Get",
+	"Set", "Authenticate", "Random", "Erase",
+};
+static const char * DtaStatsPhaseName[DTASTATS_PHASES] = {
+	"send", "recv", "poll", "hash", "discovery0", "backoff", "admit",
+};
+static const char * DtaStatsCounterName[DTASTATS_COUNTERS] = {
+	"sp_busy", "no_sessions", "retries", "retries_exhausted", "stack_resets",
+};
+/** key used for calls that are not method invocations (EndSession) */
+#define DTASTATS_ENDSESSION 0xfaULL
+
+/** log2 latency histogram */
+class DtaStatsHist {
+public:
+	DtaStatsHist() : count(0), total(0), min(0), max(0), bucket() {}
+	void add(uint64_t us)
+	{
+		uint8_t b = 0;
+		while ((b < DTASTATS_BUCKETS - 1) && ((1ULL << b) <= us)) b++;
+		bucket[b]++;
+		if ((0 == count) || (us < min)) min = us;
+		if (us > max) max = us;
+		total += us;
+		count++;
+	}
+	/** upper bound of the bucket holding the given percentile */
+	uint64_t percentile(uint8_t pct)
+	{
+		uint64_t seen = 0, want = (count * pct + 99) / 100;
+		for (uint8_t b = 0; b < DTASTATS_BUCKETS - 1; b++) {
+			seen += bucket[b];
+			if (seen >= want) {
+				uint64_t upper = b ? (1ULL << b) - 1 : 0;
+				return (upper < max) ? upper : max;
+			}
+		}
+		return max;
+	}
+	uint64_t count;
+	uint64_t total;
+	uint64_t min;
+	uint64_t max;
+	uint64_t bucket[DTASTATS_BUCKETS];
+};
+/** counters for one method UID */
+typedef struct _DtaStatsMethod {
+	DtaStatsHist latency;
+	uint64_t polls;
+	uint64_t sent;
+	uint64_t received;
+} DtaStatsMethod;
+
+static mutex DtaStatsLock;
+static DtaStatsHist DtaStatsPhase[DTASTATS_PHASES];
+static uint64_t DtaStatsBytes[DTASTATS_PHASES];
+static map<uint64_t, DtaStatsMethod> DtaStatsMethods;
+static uint64_t DtaStatsCounter[DTASTATS_COUNTERS];
+
+bool & DtaStats::enabled()
+{
+	static bool on = false;
+	return on;
+}
+uint64_t DtaStats::now()
+{
+	if (!enabled()) return 0;
+	return (uint64_t)chrono::duration_cast<chrono::microseconds>(
+		chrono::steady_clock::now().time_since_epoch()).count();
+}
+void DtaStats::phase(DTA_STATS_PHASE phase, uint64_t start, uint64_t bytes)
+{
+	if (!enabled()) return;
+	uint64_t us = now() - start;
+	lock_guard<mutex> guard(DtaStatsLock);
+	DtaStatsPhase[phase].add(us);
+	DtaStatsBytes[phase] += bytes;
+}
+void DtaStats::count(DTA_STATS_COUNTER counter)
+{
+	if (!enabled()) return;
+	lock_guard<mutex> guard(DtaStatsLock);
+	DtaStatsCounter[counter]++;
+}
+uint64_t DtaStats::counted(DTA_STATS_COUNTER counter)
+{
+	lock_guard<mutex> guard(DtaStatsLock);
+	return DtaStatsCounter[counter];
+}
+void DtaStats::method(void * cmd, uint64_t start, uint32_t polls, uint64_t sent, uint64_t received)
+{
+	if (!enabled()) return;
+	uint64_t us = now() - start;
+	uint64_t key = methodKey(cmd);
+	if (0 == key) return;
+	lock_guard<mutex> guard(DtaStatsLock);
+	DtaStatsMethod & m = DtaStatsMethods[key];
+	m.latency.add(us);
+	m.polls += polls;
+	m.sent += sent;
+	m.received += received;
+}
+uint64_t DtaStats::methodKey(void * cmd)
+{
+	uint8_t * token = (uint8_t *)cmd + sizeof(OPALHeader);
+	uint64_t key = 0;
+	/* CALL, invoking UID, method UID */
+	if ((OPAL_TOKEN::CALL == token[0]) && (OPAL_SHORT_ATOM::BYTESTRING8 == token[1]) &&
+		(OPAL_SHORT_ATOM::BYTESTRING8 == token[10])) {
+		for (uint8_t i = 0; i < 8; i++)
+			key = (key << 8) | token[11 + i];
+	}
+	else if (OPAL_TOKEN::ENDOFSESSION == token[0])
+		key = DTASTATS_ENDSESSION;
+	return key;
+}
+void DtaStats::reset()
+{
+	lock_guard<mutex> guard(DtaStatsLock);
+	for (uint8_t i = 0; i < DTASTATS_PHASES; i++) {
+		DtaStatsPhase[i] = DtaStatsHist();
+		DtaStatsBytes[i] = 0;
+	}
+	DtaStatsMethods.clear();
+	for (uint8_t i = 0; i < DTASTATS_COUNTERS; i++)
+		DtaStatsCounter[i] = 0;
+}
+void DtaStats::methodName(uint64_t key, char * name, size_t len)
+{
+	if (DTASTATS_ENDSESSION == key) {
+		snprintf(name, len, "EndSession");
+		return;
+	}
+	for (uint8_t i = 0; i < sizeof(DtaStatsMethodName) / sizeof(DtaStatsMethodName[0]); i++) {
+		uint64_t uid = 0;
+		for (uint8_t j = 0; j < 8; j++)
+			uid = (uid << 8) | OPALMETHOD[i][j];
+		if (uid == key) {
+			snprintf(name, len, "%s", DtaStatsMethodName[i]);
+			return;
+		}
+	}
+	snprintf(name, len, "%016llx", (unsigned long long)key);
+}
+static void DtaStatsJSON(FILE * stream, DtaStatsHist & h)
+{
+	fprintf(stream, "\"count\":%llu,\"total_us\":%llu,\"mean_us\":%llu,\"min_us\":%llu,"
+		"\"max_us\":%llu,\"p50_us\":%llu,\"p90_us\":%llu,\"p99_us\":%llu,\"histogram\":[",
+		(unsigned long long)h.count, (unsigned long long)h.total,
+		(unsigned long long)(h.count ? h.total / h.count : 0),
+		(unsigned long long)h.min, (unsigned long long)h.max,
+		(unsigned long long)h.percentile(50), (unsigned long long)h.percentile(90),
+		(unsigned long long)h.percentile(99));
+	bool first = true;
+	for (uint8_t b = 0; b < DTASTATS_BUCKETS; b++) {
+		if (!h.bucket[b]) continue;
+		/* [upper bound us, count], the open ended last bucket reports -1 */
+		fprintf(stream, "%s[%lld,%llu]", first ? "" : ",",
+			(b == DTASTATS_BUCKETS - 1) ? -1LL : (long long)((1ULL << b) - 1),
+			(unsigned long long)h.bucket[b]);
+		first = false;
+	}
+	fprintf(stream, "]");
+}
+static void DtaStatsRow(FILE * stream, const char * name, DtaStatsHist & h)
+{
+	fprintf(stream, "%-14s %8llu %10.3f %9llu %9llu %9llu %9llu %9llu",
+		name, (unsigned long long)h.count, (double)h.total / 1000.0,
+		(unsigned long long)(h.count ? h.total / h.count : 0),
+		(unsigned long long)h.min, (unsigned long long)h.max,
+		(unsigned long long)h.percentile(50), (unsigned long long)h.percentile(99));
+}
+void DtaStats::print(FILE * stream, bool json)
+{
+	char name[24];
+	lock_guard<mutex> guard(DtaStatsLock);
+	if (json) {
+		fprintf(stream, "{\"phases\":{");
+		for (uint8_t i = 0; i < DTASTATS_PHASES; i++) {
+			fprintf(stream, "%s\"%s\":{", i ? "," : "", DtaStatsPhaseName[i]);
+			DtaStatsJSON(stream, DtaStatsPhase[i]);
+			fprintf(stream, ",\"bytes\":%llu}", (unsigned long long)DtaStatsBytes[i]);
+		}
+		fprintf(stream, "},\"counters\":{");
+		for (uint8_t i = 0; i < DTASTATS_COUNTERS; i++)
+			fprintf(stream, "%s\"%s\":%llu", i ? "," : "", DtaStatsCounterName[i],
+				(unsigned long long)DtaStatsCounter[i]);
+		fprintf(stream, "},\"methods\":{");
+		for (map<uint64_t, DtaStatsMethod>::iterator it = DtaStatsMethods.begin();
+			it != DtaStatsMethods.end(); it++) {
+			methodName(it->first, name, sizeof(name));
+			fprintf(stream, "%s\"%s\":{", (it == DtaStatsMethods.begin()) ? "" : ",", name);
+			DtaStatsJSON(stream, it->second.latency);
+			fprintf(stream, ",\"polls\":%llu,\"bytes_sent\":%llu,\"bytes_received\":%llu}",
+				(unsigned long long)it->second.polls, (unsigned long long)it->second.sent,
+				(unsigned long long)it->second.received);
+		}
+		fprintf(stream, "}}\n");
+		return;
+	}
+	fprintf(stream, "%-14s %8s %10s %9s %9s %9s %9s %9s %12s\n", "Phase", "count",
+		"total ms", "mean us", "min us", "max us", "~p50 us", "~p99 us", "bytes");
+	for (uint8_t i = 0; i < DTASTATS_PHASES; i++) {
+		DtaStatsRow(stream, DtaStatsPhaseName[i], DtaStatsPhase[i]);
+		fprintf(stream, " %12llu\n", (unsigned long long)DtaStatsBytes[i]);
+	}
+	fprintf(stream, "\n%-17s %8s\n", "Counter", "count");
+	for (uint8_t i = 0; i < DTASTATS_COUNTERS; i++)
+		fprintf(stream, "%-17s %8llu\n", DtaStatsCounterName[i],
+			(unsigned long long)DtaStatsCounter[i]);
+	fprintf(stream, "\n%-14s %8s %10s %9s %9s %9s %9s %9s %7s %10s %10s\n", "Method", "calls",
+		"total ms", "mean us", "min us", "max us", "~p50 us", "~p99 us", "polls", "sent", "received");
+	for (map<uint64_t, DtaStatsMethod>::iterator it = DtaStatsMethods.begin();
+		it != DtaStatsMethods.end(); it++) {
+		methodName(it->first, name, sizeof(name));
+		DtaStatsRow(stream, name, it->second.latency);
+		fprintf(stream, " %7llu %10llu %10llu\n", (unsigned long long)it->second.polls,
+			(unsigned long long)it->second.sent, (unsigned long long)it->second.received);
+	}
+}
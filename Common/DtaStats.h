@@ -0,0 +1,101 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+/** Transport phases timed by DtaStats */
+typedef enum _DTA_STATS_PHASE {
+	DTASTATS_SEND,      /**< IF_SEND of a method call */
+	DTASTATS_RECV,      /**< each IF_RECV, including ones that return no data yet */
+	DTASTATS_POLL,      /**< host sleep between IF_RECV polls */
+	DTASTATS_HASH,      /**< PBKDF2 password hashing */
+	DTASTATS_DISCOVERY, /**< Level 0 discovery */
+	DTASTATS_BACKOFF,   /**< host sleep before retrying SP_BUSY or NO_SESSIONS_AVAILABLE */
+	DTASTATS_ADMIT,     /**< wait for a session slot on the device */
+	DTASTATS_PHASES
+} DTA_STATS_PHASE;
+
+/** Events counted by DtaStats */
+typedef enum _DTA_STATS_COUNTER {
+	DTASTATS_SP_BUSY,      /**< SP_BUSY method status */
+	DTASTATS_NO_SESSIONS,  /**< NO_SESSIONS_AVAILABLE method status */
+	DTASTATS_RETRIES,      /**< commands resent after one of the above */
+	DTASTATS_EXHAUSTED,    /**< commands that were still busy after the last retry */
+	DTASTATS_STACK_RESETS, /**< STACK_RESET sent to clear a busy comID */
+	DTASTATS_COUNTERS
+} DTA_STATS_COUNTER;
+
+/** Number of log2 latency buckets, the last one collects everything above 2^30us */
+#define DTASTATS_BUCKETS 32
+
+/** Process wide counters and latency histograms for the TCG command path.
+ *
+ * Collection is off until enabled() is set, every entry point returns
+ * immediately when it is off so the instrumented paths cost one branch.
+ * Times are in microseconds from a monotonic clock.
+ */
+class DtaStats {
+public:
+	/** flag that turns collection on */
+	static bool & enabled();
+	/** timestamp to pass back as start, 0 when collection is off */
+	static uint64_t now();
+	/** record one transport phase
+	 * @param phase the phase being recorded
+	 * @param start value returned by now() when the phase began
+	 * @param bytes payload bytes moved by the phase
+	 */
+	static void phase(DTA_STATS_PHASE phase, uint64_t start, uint64_t bytes = 0);
+	/** count an event
+	 * @param counter the event
+	 */
+	static void count(DTA_STATS_COUNTER counter);
+	/** events counted so far
+	 * @param counter the event
+	 */
+	static uint64_t counted(DTA_STATS_COUNTER counter);
+	/** record one complete method call (send, polls and final receive)
+	 * @param cmd the command buffer, used to find the method UID
+	 * @param start value returned by now() before the IF_SEND
+	 * @param polls number of IF_RECV issued
+	 * @param sent bytes sent
+	 * @param received bytes of the final response ComPacket
+	 */
+	static void method(void * cmd, uint64_t start, uint32_t polls, uint64_t sent, uint64_t received);
+	/** key of the method called by a command buffer, the big endian method
+	 * UID, 0xfa for EndSession and 0 when the buffer is not a method call
+	 * @param cmd the command buffer
+	 */
+	static uint64_t methodKey(void * cmd);
+	/** name of a method key, the hex UID for methods not in OPALMETHOD
+	 * @param key value returned by methodKey
+	 * @param name where the name is returned
+	 * @param len size of name
+	 */
+	static void methodName(uint64_t key, char * name, size_t len);
+	/** clear all counters */
+	static void reset();
+	/** print the counters
+	 * @param stream where to print
+	 * @param json print a JSON object instead of tables
+	 */
+	static void print(FILE * stream, bool json);
+};
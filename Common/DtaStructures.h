@@ -276,9 +276,17 @@ typedef enum _DTA_DEVICE_TYPE {
     DEVICE_TYPE_SAS,
     DEVICE_TYPE_NVME,
 	DEVICE_TYPE_USB,
+    DEVICE_TYPE_SIM,
     DEVICE_TYPE_OTHER,
 } DTA_DEVICE_TYPE;
 
+/** Advisory drive lock held by a process, see DtaDev::lockDrive */
+typedef enum _DTA_LOCK {
+    DTA_LOCK_NONE,
+    DTA_LOCK_SHARED,    /**< read only Level 0 Discovery, other readers may run */
+    DTA_LOCK_EXCLUSIVE, /**< sessions and other comID traffic, nobody else may */
+} DTA_LOCK;
+
 /** structure to store Disk information. */
 typedef struct _OPAL_DiskInfo {
     // parsed the Function block?
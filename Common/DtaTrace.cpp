@@ -0,0 +1,385 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <stdio.h>
+#include <chrono>
+#include <mutex>
+#include <fstream>
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#endif
+#include "DtaTrace.h"
+#include "DtaEndianFixup.h"
+#include "DtaLexicon.h"
+#include "DtaAnnotatedDump.h"
+#include "DtaHexDump.h"
+
+using namespace std;
+
+static mutex traceLock;
+static DTA_TRACE_HEADER * traceHeader = NULL;	/**< mapped trace file, NULL when not recording */
+static uint8_t * traceRing = NULL;
+static size_t traceMapSize = 0;
+static int traceFd = -1;
+
+/** round up to the record alignment */
+#define DTATRACE_ALIGN(x) (((x) + 7) & ~(uint64_t)7)
+
+/** skip to the start of the ring when a record header does not fit before its end */
+static uint64_t traceNext(DTA_TRACE_HEADER * h, uint8_t * ring, uint64_t pos)
+{
+	uint64_t off = pos % h->capacity;
+	if ((h->capacity - off < sizeof(DTA_TRACE_RECORD)) ||
+		(0 == ((DTA_TRACE_RECORD *)(ring + off))->length))
+		return pos - off + h->capacity;
+	return pos;
+}
+
+bool DtaTrace::open(const char * path, uint32_t megabytes)
+{
+	LOG(D1) << "Entering DtaTrace::open " << path;
+#ifdef _MSC_VER
+	LOG(E) << "Trace recording is not supported on this platform";
+	return false;
+#else
+	struct stat st;
+	DTA_TRACE_HEADER h;
+	close();
+	int fd = ::open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		LOG(E) << "Unable to open trace file " << path;
+		return false;
+	}
+	/* the responses carry table contents, keep an old file private too */
+	if (fchmod(fd, 0600)) {
+		LOG(W) << "Unable to make trace file " << path << " private";
+	}
+	/* one writer at a time, a second sedutil just runs without a trace */
+	if (flock(fd, LOCK_EX | LOCK_NB) || fstat(fd, &st)) {
+		LOG(E) << "Trace file " << path << " is in use";
+		::close(fd);
+		return false;
+	}
+	memset(&h, 0, sizeof(h));
+	if ((st.st_size >= DTATRACE_HEADER_SIZE) &&
+		(pread(fd, &h, sizeof(h), 0) == sizeof(h)) &&
+		!memcmp(h.magic, DTATRACE_MAGIC, sizeof(h.magic)) &&
+		(DTATRACE_VERSION == h.version) && (DTATRACE_HEADER_SIZE == h.headerSize) &&
+		((uint64_t)st.st_size == h.headerSize + h.capacity)) {
+		LOG(D1) << "Appending to trace with " << h.records << " records";
+	}
+	else {
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, DTATRACE_MAGIC, sizeof(h.magic));
+		h.version = DTATRACE_VERSION;
+		h.headerSize = DTATRACE_HEADER_SIZE;
+		h.capacity = (uint64_t)(megabytes ? megabytes : DTATRACE_DEFAULT_MB) * 1024 * 1024;
+		if (ftruncate(fd, 0) || ftruncate(fd, h.headerSize + h.capacity) ||
+			(pwrite(fd, &h, sizeof(h), 0) != sizeof(h))) {
+			LOG(E) << "Unable to create trace file " << path;
+			::close(fd);
+			return false;
+		}
+	}
+	void * map = mmap(NULL, h.headerSize + h.capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (MAP_FAILED == map) {
+		LOG(E) << "Unable to map trace file " << path;
+		::close(fd);
+		return false;
+	}
+	lock_guard<mutex> guard(traceLock);
+	traceFd = fd;
+	traceMapSize = h.headerSize + h.capacity;
+	traceRing = (uint8_t *)map + h.headerSize;
+	traceHeader = (DTA_TRACE_HEADER *)map;
+	return true;
+#endif
+}
+
+void DtaTrace::close()
+{
+#ifndef _MSC_VER
+	lock_guard<mutex> guard(traceLock);
+	if (NULL == traceHeader) return;
+	munmap(traceHeader, traceMapSize);
+	::close(traceFd);
+	traceHeader = NULL;
+	traceRing = NULL;
+	traceFd = -1;
+#endif
+}
+
+uint64_t DtaTrace::now()
+{
+	if (NULL == traceHeader) return 0;
+	return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+		chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/** the atom at buffer[i], false when it runs past len or is not an atom */
+static bool traceAtom(uint8_t * buffer, uint32_t len, uint32_t i,
+	uint32_t & header, uint32_t & length, bool & bytes)
+{
+	uint8_t b = buffer[i];
+	if (b < 0x80) {
+		header = 1;
+		length = 0;
+		bytes = false;
+	}
+	else if (b < 0xc0) {
+		header = 1;
+		length = b & 0x0f;
+		bytes = (b & 0x20) != 0;
+	}
+	else if (b < 0xe0) {
+		if (i + 2 > len) return false;
+		header = 2;
+		length = ((b & 0x07) << 8) | buffer[i + 1];
+		bytes = (b & 0x10) != 0;
+	}
+	else if (b < 0xe4) {
+		if (i + 4 > len) return false;
+		header = 4;
+		length = ((uint32_t)buffer[i + 1] << 16) | ((uint32_t)buffer[i + 2] << 8) | buffer[i + 3];
+		bytes = (b & 0x02) != 0;
+	}
+	else
+		return false;
+	return (uint64_t)i + header + length <= len;
+}
+
+void DtaTrace::redact(ATACOMMAND cmd, uint8_t protocol, uint8_t * buffer, uint32_t len)
+{
+	if ((IF_SEND != cmd) || ((0x01 != protocol) && (0x02 != protocol)) || (len < sizeof(OPALHeader)))
+		return;
+	/* walk the tokens, remembering the invoking and method UIDs of the
+	 * last call and the name of the last STARTNAME */
+	uint8_t invoker[8] = { 0 }, method[8] = { 0 };
+	int uids = 2; /* UIDs still to come after a CALL */
+	int name = -1; /* tiny atom name, 0x100 for "PIN" or "Challenge", -1 for none */
+	bool named = false; /* the next atom is a name */
+	uint32_t i = sizeof(OPALHeader);
+	while (i < len) {
+		uint8_t b = buffer[i];
+		if (b >= 0xe4) {
+			i++;
+			if (OPAL_TOKEN::CALL == b) uids = 0;
+			named = (OPAL_TOKEN::STARTNAME == b);
+			name = -1;
+			continue;
+		}
+		uint32_t header, length;
+		bool bytes;
+		if (!traceAtom(buffer, len, i, header, length, bytes)) {
+			/* a cut off or garbled atom may be a secret, keep nothing past it */
+			memset(buffer + i, 0, len - i);
+			return;
+		}
+		uint8_t * value = buffer + i + header;
+		if (uids < 2) {
+			if (bytes && (8 == length)) memcpy(uids ? method : invoker, value, 8);
+			uids++;
+		}
+		else if (named) {
+			named = false;
+			if (!bytes && (1 == header)) name = b & 0x3f;
+			else if (bytes && (((3 == length) && !memcmp(value, "PIN", 3)) ||
+				((9 == length) && !memcmp(value, "Challenge", 9))))
+				name = 0x100;
+		}
+		else if (name >= 0) {
+			bool cpin = !memcmp(invoker, OPALUID[OPAL_UID::OPAL_C_PIN_TABLE], 4);
+			bool challenge = !memcmp(method, OPALMETHOD[OPAL_METHOD::STARTSESSION], 8) ||
+				!memcmp(method, OPALMETHOD[OPAL_METHOD::AUTHENTICATE], 8) ||
+				!memcmp(method, OPALMETHOD[OPAL_METHOD::EAUTHENTICATE], 8);
+			bool secret = (cpin && ((OPAL_TOKEN::PIN == name) || (0x100 == name))) ||
+				(challenge && ((0 == name) || (0x100 == name)));
+			if (bytes && secret)
+				memset(value, 0, length);
+			name = -1;
+		}
+		i += header + length;
+	}
+}
+
+uint32_t DtaTrace::captureLength(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+	void * buffer, uint32_t bufferlen)
+{
+	uint8_t * b = (uint8_t *)buffer;
+	uint64_t len = bufferlen;
+	if ((0x01 == protocol) && (0x0001 == comID) && (IF_RECV == cmd) && (bufferlen >= 4))
+		/* Level 0 discovery, the length excludes itself */
+		len = 4 + (((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3]);
+	else if (((0x01 == protocol) || (0x02 == protocol)) && (bufferlen >= sizeof(OPALComPacket)))
+		len = sizeof(OPALComPacket) + SWAP32(((OPALComPacket *)buffer)->length);
+	return (uint32_t)((len < bufferlen) ? len : bufferlen);
+}
+
+void DtaTrace::record(ATACOMMAND cmd, uint8_t protocol, uint16_t comID, uint8_t status,
+	uint64_t start, void * buffer, uint32_t bufferlen)
+{
+	if (NULL == traceHeader) return;
+	DTA_TRACE_RECORD rec;
+	memset(&rec, 0, sizeof(rec));
+	rec.timestamp = start;
+	rec.duration = now() - start;
+	rec.bufferLength = bufferlen;
+#ifndef _MSC_VER
+	rec.pid = (uint32_t)getpid();
+#endif
+	rec.comID = comID;
+	rec.command = (uint8_t)cmd;
+	rec.protocol = protocol;
+	rec.status = status;
+	rec.dataLength = captureLength(cmd, protocol, comID, buffer, bufferlen);
+	/* the ring is a shared mapping of a file, credentials are zeroed in a
+	 * private copy so they never reach the page cache */
+	vector<uint8_t> data((uint8_t *)buffer, (uint8_t *)buffer + rec.dataLength);
+	redact(cmd, protocol, data.data(), rec.dataLength);
+
+	lock_guard<mutex> guard(traceLock);
+	DTA_TRACE_HEADER * h = traceHeader;
+	if (NULL == h) return;
+	/* a single record may use at most half the ring */
+	if (sizeof(rec) + rec.dataLength > h->capacity / 2)
+		rec.dataLength = (uint32_t)(h->capacity / 2 - sizeof(rec));
+	rec.length = (uint32_t)DTATRACE_ALIGN(sizeof(rec) + rec.dataLength);
+	uint64_t pos = h->head;
+	uint64_t off = pos % h->capacity;
+	if (h->capacity - off < rec.length) {
+		pos += h->capacity - off;
+		off = 0;
+	}
+	/* drop the oldest records until the new one fits */
+	while ((h->tail < h->head) && (pos + rec.length - h->tail > h->capacity)) {
+		uint64_t tail = traceNext(h, traceRing, h->tail);
+		if (tail != h->tail) {
+			h->tail = tail;
+			continue;
+		}
+		h->tail += ((DTA_TRACE_RECORD *)(traceRing + tail % h->capacity))->length;
+		h->dropped++;
+	}
+	if (h->tail >= h->head) h->tail = pos;
+	if ((pos != h->head) && (h->capacity - h->head % h->capacity >= sizeof(uint32_t)))
+		*(uint32_t *)(traceRing + h->head % h->capacity) = 0;
+	memcpy(traceRing + off + sizeof(rec), data.data(), rec.dataLength);
+	memcpy(traceRing + off, &rec, sizeof(rec));
+	h->head = pos + rec.length;
+	h->records++;
+}
+
+void DtaTrace::identity(uint64_t start, OPAL_DiskInfo & disk_info)
+{
+	if (NULL == traceHeader) return;
+	DTA_TRACE_IDENTITY id;
+	id.devType = (uint32_t)disk_info.devType;
+	memcpy(id.serialNum, disk_info.serialNum, sizeof(id.serialNum));
+	memcpy(id.firmwareRev, disk_info.firmwareRev, sizeof(id.firmwareRev));
+	memcpy(id.modelNum, disk_info.modelNum, sizeof(id.modelNum));
+	record(IDENTIFY, 0, 0, 0, start, &id, sizeof(id));
+}
+
+uint8_t DtaTraceRead(const char * path, vector<DtaTraceEntry> & entries, DTA_TRACE_HEADER * header)
+{
+	LOG(D1) << "Entering DtaTraceRead " << path;
+	DTA_TRACE_HEADER h;
+	ifstream file(path, ios::in | ios::binary);
+	if (!file) {
+		LOG(E) << "Unable to open trace file " << path;
+		return DTAERROR_OPEN_ERR;
+	}
+	file.read((char *)&h, sizeof(h));
+	if (!file || memcmp(h.magic, DTATRACE_MAGIC, sizeof(h.magic)) ||
+		(DTATRACE_VERSION != h.version) || (h.headerSize < sizeof(h)) || (0 == h.capacity)) {
+		LOG(E) << path << " is not a sedutil trace file";
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	vector<uint8_t> ring((size_t)h.capacity);
+	file.seekg(h.headerSize);
+	file.read((char *)ring.data(), ring.size());
+	if (!file) {
+		LOG(E) << "Trace file " << path << " is truncated";
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	if (NULL != header) *header = h;
+	entries.clear();
+	uint64_t pos = h.tail;
+	while (pos < h.head) {
+		pos = traceNext(&h, ring.data(), pos);
+		if (pos >= h.head) break;
+		DtaTraceEntry e;
+		uint64_t off = pos % h.capacity;
+		memcpy(&e.rec, ring.data() + off, sizeof(e.rec));
+		if ((e.rec.length < sizeof(e.rec)) || (e.rec.length > h.capacity - off) ||
+			(sizeof(e.rec) + e.rec.dataLength > e.rec.length)) {
+			LOG(E) << "Corrupt trace record at " << pos;
+			return DTAERROR_INVALID_PARAMETER;
+		}
+		e.data.assign(ring.data() + off + sizeof(e.rec), ring.data() + off + sizeof(e.rec) + e.rec.dataLength);
+		entries.push_back(e);
+		pos += e.rec.length;
+	}
+	return 0;
+}
+
+uint8_t DtaTraceDump(const char * path)
+{
+	LOG(D1) << "Entering DtaTraceDump " << path;
+	DTA_TRACE_HEADER h;
+	vector<DtaTraceEntry> entries;
+	uint8_t lastRC;
+	if ((lastRC = DtaTraceRead(path, entries, &h)) != 0)
+		return lastRC;
+	printf("%s: %llu records, %llu shown, %llu dropped, ring %llu bytes\n", path,
+		(unsigned long long)h.records, (unsigned long long)entries.size(),
+		(unsigned long long)h.dropped, (unsigned long long)h.capacity);
+	uint64_t base = entries.empty() ? 0 : entries[0].rec.timestamp;
+	for (size_t i = 0; i < entries.size(); i++) {
+		DTA_TRACE_RECORD & r = entries[i].rec;
+		uint8_t * data = entries[i].data.data();
+		printf("\n#%u %+.6fs pid %u %s protocol %02x comID %04x %u/%u bytes status %u %.1fus\n",
+			(uint32_t)i, (double)(r.timestamp - base) / 1e9, r.pid,
+			(IF_SEND == r.command) ? "IF_SEND" : (IF_RECV == r.command) ? "IF_RECV" : "IDENTIFY",
+			r.protocol, r.comID, r.dataLength, r.bufferLength, r.status, (double)r.duration / 1e3);
+		if ((IDENTIFY == r.command) && (r.dataLength >= sizeof(DTA_TRACE_IDENTITY))) {
+			DTA_TRACE_IDENTITY * id = (DTA_TRACE_IDENTITY *)data;
+			printf("Model %.40s Firmware %.8s Serial %.20s\n", id->modelNum, id->firmwareRev, id->serialNum);
+		}
+		else if ((0x01 == r.protocol) && (0x0001 == r.comID) && (IF_RECV == r.command)) {
+			printf("Level 0 discovery response\n");
+			DtaHexDump(data, r.dataLength, stdout);
+		}
+		else if (((0x01 == r.protocol) || (0x02 == r.protocol)) && (r.dataLength >= sizeof(OPALHeader))) {
+			OPALHeader * hdr = (OPALHeader *)data;
+			printf("TSN %08x HSN %08x outstandingData %u minTransfer %u\n",
+				SWAP32(hdr->pkt.TSN), SWAP32(hdr->pkt.HSN),
+				SWAP32(hdr->cp.outstandingData), SWAP32(hdr->cp.minTransfer));
+			DtaAnnotatedDump((ATACOMMAND)r.command, data, r.dataLength, stdout);
+		}
+		else if (r.dataLength) {
+			DtaHexDump(data, r.dataLength, stdout);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,147 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "DtaStructures.h"
+
+/** Binary trace of the IF_SEND/IF_RECV traffic.
+ *
+ * The trace file is a fixed size header followed by a ring of records.
+ * Records are 8 byte aligned and never wrap around the end of the ring,
+ * a record length of 0 (or less room than a record header) at the end
+ * of the ring means the next record is at the start of the ring.
+ * Positions in the header are logical byte offsets that only grow, the
+ * ring offset is the position modulo the capacity. When the ring is
+ * full the oldest records are dropped. An existing trace file keeps its
+ * capacity and new records are appended to it. Credentials are zeroed
+ * before an IF_SEND is recorded, the rest of the traffic is kept as is.
+ */
+#define DTATRACE_MAGIC "SEDTRACE"
+#define DTATRACE_VERSION 1
+/** bytes reserved for the header, the ring starts on the next page */
+#define DTATRACE_HEADER_SIZE 4096
+/** ring size used when a new trace file is created */
+#define DTATRACE_DEFAULT_MB 16
+
+/** Trace file header */
+typedef struct _DTA_TRACE_HEADER {
+	char magic[8];			/**< DTATRACE_MAGIC, not NUL terminated */
+	uint32_t version;		/**< DTATRACE_VERSION */
+	uint32_t headerSize;	/**< offset of the ring in the file */
+	uint64_t capacity;		/**< bytes in the ring */
+	uint64_t head;			/**< position of the next record */
+	uint64_t tail;			/**< position of the oldest record */
+	uint64_t records;		/**< records ever written */
+	uint64_t dropped;		/**< records overwritten by newer ones */
+} DTA_TRACE_HEADER;
+
+/** One IF_SEND or IF_RECV, followed by dataLength bytes of the buffer */
+typedef struct _DTA_TRACE_RECORD {
+	uint32_t length;		/**< bytes in the record including this header and padding */
+	uint32_t dataLength;	/**< bytes of the buffer captured */
+	uint64_t timestamp;		/**< monotonic clock in ns when the command was issued */
+	uint64_t duration;		/**< ns spent in the transport */
+	uint32_t bufferLength;	/**< buffer length passed to sendCmd */
+	uint32_t pid;			/**< process that issued the command */
+	uint16_t comID;			/**< comID of the command */
+	uint8_t command;		/**< ATACOMMAND, IF_SEND or IF_RECV */
+	uint8_t protocol;		/**< security protocol */
+	uint8_t status;			/**< return code of the transport */
+	uint8_t reserved[3];
+} DTA_TRACE_RECORD;
+
+/** Payload of an IDENTIFY record, the device identity seen at open */
+typedef struct _DTA_TRACE_IDENTITY {
+	uint32_t devType;		/**< DTA_DEVICE_TYPE */
+	uint8_t serialNum[20];
+	uint8_t firmwareRev[8];
+	uint8_t modelNum[40];
+} DTA_TRACE_IDENTITY;
+
+/** Process wide recorder.
+ * Every entry point is a single test when no trace file is open.
+ */
+class DtaTrace {
+public:
+	/** open or create a trace file and start recording into it
+	 * @param path trace file
+	 * @param megabytes ring size if the file has to be created
+	 */
+	static bool open(const char * path, uint32_t megabytes = DTATRACE_DEFAULT_MB);
+	/** stop recording and unmap the trace file */
+	static void close();
+	/** monotonic time in ns to pass to record(), 0 when not recording */
+	static uint64_t now();
+	/** append one command to the trace
+	 * @param cmd IF_SEND or IF_RECV
+	 * @param protocol security protocol
+	 * @param comID comID of the command
+	 * @param status return code of the transport
+	 * @param start value of now() before the command was issued
+	 * @param buffer command or response buffer
+	 * @param bufferlen length of buffer
+	 */
+	static void record(ATACOMMAND cmd, uint8_t protocol, uint16_t comID, uint8_t status,
+		uint64_t start, void * buffer, uint32_t bufferlen);
+	/** record the identity of a device as an IDENTIFY record so a replay
+	 * presents the same serial number (the password salt) and model
+	 * @param start value of now() before the identify was issued
+	 * @param disk_info identify results
+	 */
+	static void identity(uint64_t start, OPAL_DiskInfo & disk_info);
+	/** zero the credentials in an IF_SEND buffer: the StartSession
+	 * HostChallenge, the Authenticate proof and the PIN of a Set on a
+	 * C_PIN row. The tokens keep their length so a replay still lines up,
+	 * an atom that cannot be parsed and everything after it are zeroed.
+	 * @param cmd IF_SEND or IF_RECV, only IF_SEND is touched
+	 * @param protocol security protocol
+	 * @param buffer captured bytes
+	 * @param len length of buffer
+	 */
+	static void redact(ATACOMMAND cmd, uint8_t protocol, uint8_t * buffer, uint32_t len);
+	/** number of buffer bytes worth keeping, the rest of a TCG buffer is padding */
+	static uint32_t captureLength(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+		void * buffer, uint32_t bufferlen);
+};
+
+/** A record read back from a trace file */
+typedef struct _DtaTraceEntry {
+	DTA_TRACE_RECORD rec;
+	std::vector<uint8_t> data;
+} DtaTraceEntry;
+
+/** Read a trace file, oldest record first
+ * @param path trace file
+ * @param entries where the records are returned
+ * @param header where the file header is returned, may be NULL
+ */
+uint8_t DtaTraceRead(const char * path, std::vector<DtaTraceEntry> & entries,
+	DTA_TRACE_HEADER * header = NULL);
+/** Print a trace file as text, TCG payloads are decoded with DtaAnnotatedDump
+ * @param path trace file
+ */
+uint8_t DtaTraceDump(const char * path);
+/** Print where the time in a trace file went: per method, SP and
+ * authority totals, IF_RECV poll counts and the host side gaps between
+ * commands (password hashing, buffer setup)
+ * @param path trace file
+ */
+uint8_t DtaTraceAnalyze(const char * path);
@@ -0,0 +1,326 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "DtaTrace.h"
+#include "DtaStats.h"
+#include "DtaEndianFixup.h"
+#include "DtaLexicon.h"
+#include "DtaAnnotatedDump.h"
+
+using namespace std;
+
+/** Time attributed to one method, SP or authority, in ns */
+typedef struct _AnalyzeBucket {
+	uint64_t calls;
+	uint64_t total;		/**< IF_SEND to end of the final IF_RECV */
+	uint64_t device;	/**< time inside the transport */
+	uint64_t polls;		/**< IF_RECVs issued */
+	uint64_t gap;		/**< host time between the previous command and this one */
+	uint64_t maxGap;
+} AnalyzeBucket;
+
+/** A host side gap between two commands */
+typedef struct _AnalyzeGap {
+	uint64_t length;
+	size_t record;		/**< record that ended the gap */
+	string before;		/**< call that ended the gap */
+	string after;		/**< call that preceded the gap */
+} AnalyzeGap;
+
+/** An open session, by TSN */
+typedef struct _AnalyzeSession {
+	string sp;
+	string authority;
+} AnalyzeSession;
+
+/** A method call waiting for its final IF_RECV */
+typedef struct _AnalyzeCall {
+	bool open;
+	uint64_t key;		/**< DtaStats::methodKey */
+	string method;
+	string sp;
+	string authority;
+	uint32_t TSN;
+	uint64_t start;
+	uint64_t device;
+	uint64_t polls;
+	uint64_t gap;
+} AnalyzeCall;
+
+static uint64_t analyzeUid(DtaToken &t)
+{
+	uint64_t uid = 0;
+	if ((NULL == t.m_data) || (8 != t.m_DataLength)) return 0;
+	for (uint8_t i = 0; i < 8; i++)
+		uid = (uid << 8) | t.m_data[i];
+	return uid;
+}
+
+static string analyzeSP(uint64_t uid)
+{
+	char name[24];
+	switch (uid) {
+	case 0x0000020500000001ULL: return "AdminSP";
+	case 0x0000020500000002ULL: return "LockingSP";
+	case 0x0000020500010001ULL: return "EnterpriseLockingSP";
+	}
+	snprintf(name, sizeof(name), "SP %016llx", (unsigned long long)uid);
+	return name;
+}
+
+static string analyzeAuthority(uint64_t uid)
+{
+	char name[32];
+	uint32_t n = (uint32_t)(uid & 0xffff);
+	switch (uid) {
+	case 0: return "Anybody";
+	case 0x0000000900000001ULL: return "Anybody";
+	case 0x0000000900000006ULL: return "SID";
+	case 0x000000090001ff01ULL: return "PSID";
+	case 0x0000000900008401ULL: return "EraseMaster";
+	}
+	if ((uid & ~0xffffULL) == 0x0000000900010000ULL)
+		snprintf(name, sizeof(name), "Admin%u", n);
+	else if ((uid & ~0xffffULL) == 0x0000000900030000ULL)
+		snprintf(name, sizeof(name), "User%u", n);
+	else if ((uid & ~0xffULL) == 0x0000000900008000ULL)
+		snprintf(name, sizeof(name), "BandMaster%u", n - 0x8001);
+	else
+		snprintf(name, sizeof(name), "Authority %016llx", (unsigned long long)uid);
+	return name;
+}
+
+/** split the data subpacket of a ComPacket into tokens */
+static void analyzeTokens(vector<uint8_t> &data, vector<DtaToken> &tokens)
+{
+	tokens.clear();
+	if (data.size() < sizeof(OPALHeader)) return;
+	OPALHeader * h = (OPALHeader *)data.data();
+	uint8_t * p = data.data() + sizeof(OPALHeader);
+	uint8_t * q = p + SWAP32(h->subpkt.length);
+	if (q > data.data() + data.size()) q = data.data() + data.size();
+	while (p < q) {
+		DtaToken t;
+		t.parse(p, (uint32_t)(q - p));
+		if ((0 == t.m_TokenLength) || (p + t.m_TokenLength > q)) break;
+		tokens.push_back(t);
+		p += t.m_TokenLength;
+	}
+}
+
+static bool analyzeIsToken(DtaToken &t, uint8_t token)
+{
+	return (DtaToken::TOKEN == t.m_TokenType) && (token == t.m_token[0]);
+}
+
+static void analyzeAdd(map<string, AnalyzeBucket> &buckets, const string &name, AnalyzeCall &c, uint64_t total)
+{
+	AnalyzeBucket &b = buckets[name];
+	b.calls++;
+	b.total += total;
+	b.device += c.device;
+	b.polls += c.polls;
+	b.gap += c.gap;
+	if (c.gap > b.maxGap) b.maxGap = c.gap;
+}
+
+static void analyzePrint(const char * title, map<string, AnalyzeBucket> &buckets)
+{
+	vector<pair<uint64_t, string> > order;
+	for (map<string, AnalyzeBucket>::iterator it = buckets.begin(); it != buckets.end(); it++)
+		order.push_back(make_pair(it->second.total + it->second.gap, it->first));
+	sort(order.rbegin(), order.rend());
+	printf("\n%-22s %7s %10s %10s %10s %7s %6s %10s %10s\n", title, "calls", "total ms",
+		"device ms", "wait ms", "polls", "/call", "gap ms", "max gap");
+	for (size_t i = 0; i < order.size(); i++) {
+		AnalyzeBucket &b = buckets[order[i].second];
+		printf("%-22.22s %7llu %10.3f %10.3f %10.3f %7llu %6.2f %10.3f %10.3f\n",
+			order[i].second.c_str(), (unsigned long long)b.calls, (double)b.total / 1e6,
+			(double)b.device / 1e6, (double)(b.total - b.device) / 1e6,
+			(unsigned long long)b.polls, b.calls ? (double)b.polls / (double)b.calls : 0.0,
+			(double)b.gap / 1e6, (double)b.maxGap / 1e6);
+	}
+}
+
+uint8_t DtaTraceAnalyze(const char * path)
+{
+	LOG(D1) << "Entering DtaTraceAnalyze " << path;
+	vector<DtaTraceEntry> entries;
+	vector<DtaToken> tokens;
+	map<string, AnalyzeBucket> methods, sps, authorities;
+	map<uint32_t, AnalyzeSession> sessions;
+	map<uint16_t, AnalyzeCall> calls;
+	map<uint16_t, AnalyzeSession> starting;	/**< StartSession in flight, by comID */
+	vector<AnalyzeGap> gaps;
+	uint64_t lastEnd = 0, runStart = 0, elapsed = 0, device = 0, idle = 0, nsessions = 0, ncalls = 0;
+	uint32_t pid = 0, runs = 0;
+	string lastMethod;
+	char name[24];
+	uint8_t lastRC;
+
+	if ((lastRC = DtaTraceRead(path, entries)) != 0)
+		return lastRC;
+	for (size_t i = 0; i < entries.size(); i++) {
+		DTA_TRACE_RECORD &r = entries[i].rec;
+		vector<uint8_t> &data = entries[i].data;
+		uint64_t end = r.timestamp + r.duration;
+		/* each sedutil run is analyzed on its own */
+		if ((0 == runs) || (r.pid != pid)) {
+			if (runs) elapsed += lastEnd - runStart;
+			runs++;
+			pid = r.pid;
+			runStart = r.timestamp;
+			lastEnd = 0;
+			lastMethod.clear();
+			sessions.clear();
+			calls.clear();
+			starting.clear();
+		}
+		if (IDENTIFY == r.command) continue;
+		device += r.duration;
+		uint64_t gap = (lastEnd && (r.timestamp > lastEnd)) ? r.timestamp - lastEnd : 0;
+		bool tcg = ((0x01 == r.protocol) || (0x02 == r.protocol)) && !((0x01 == r.protocol) && (0x0001 == r.comID))
+			&& (data.size() >= sizeof(OPALHeader));
+		AnalyzeCall c;
+		c.open = false;
+		c.TSN = 0;
+		c.start = r.timestamp;
+		c.device = r.duration;
+		c.polls = 0;
+		c.gap = gap;
+		c.key = 0;
+		if ((IF_SEND == r.command) && tcg) {
+			OPALHeader * h = (OPALHeader *)data.data();
+			c.open = true;
+			c.key = DtaStats::methodKey(data.data());
+			DtaStats::methodName(c.key, name, sizeof(name));
+			c.method = c.key ? name : "(no method)";
+			c.TSN = SWAP32(h->pkt.TSN);
+			c.sp = "SessionManager";
+			c.authority = "-";
+			if (c.TSN) {
+				if (sessions.count(c.TSN)) {
+					c.sp = sessions[c.TSN].sp;
+					c.authority = sessions[c.TSN].authority;
+				}
+				else {
+					snprintf(name, sizeof(name), "TSN %08x", c.TSN);
+					c.sp = name;
+				}
+			}
+			analyzeTokens(data, tokens);
+			if ((c.method == "StartSession") && (tokens.size() > 6)) {
+				/* CALL SMUID StartSession [ HSN SPID Write ... 3 = HostSigningAuthority ] */
+				AnalyzeSession s;
+				s.sp = analyzeSP(analyzeUid(tokens[5]));
+				s.authority = analyzeAuthority(0);
+				for (size_t t = 7; t + 2 < tokens.size(); t++)
+					if (analyzeIsToken(tokens[t], OPAL_TOKEN::STARTNAME) && (NULL == tokens[t + 1].m_data) &&
+						(3 == tokens[t + 1].m_value) && (8 == tokens[t + 2].m_DataLength))
+						s.authority = analyzeAuthority(analyzeUid(tokens[t + 2]));
+				c.sp = s.sp;
+				c.authority = s.authority;
+				starting[r.comID] = s;
+			}
+			else if (((c.method == "Authenticate") || (c.method == "EAuthenticate")) &&
+				(tokens.size() > 4) && c.TSN && sessions.count(c.TSN))
+				/* CALL ThisSP Authenticate [ Authority ... ] */
+				sessions[c.TSN].authority = analyzeAuthority(analyzeUid(tokens[4]));
+			calls[r.comID] = c;
+			if (gap) {
+				AnalyzeGap g = { gap, i, c.method, lastMethod };
+				gaps.push_back(g);
+				idle += gap;
+			}
+			lastEnd = end;
+			continue;
+		}
+		if ((IF_RECV == r.command) && tcg && calls.count(r.comID) && calls[r.comID].open) {
+			AnalyzeCall &o = calls[r.comID];
+			OPALHeader * h = (OPALHeader *)data.data();
+			o.polls++;
+			o.device += r.duration;
+			/* host time between polls is part of the call, not a gap */
+			lastEnd = end;
+			if ((0 != h->cp.outstandingData) && (0 == h->cp.minTransfer))
+				continue;
+			o.open = false;
+			if ((o.method == "StartSession") && starting.count(r.comID)) {
+				/* CALL SMUID SyncSession [ HSN TSN ... ] */
+				analyzeTokens(data, tokens);
+				if ((tokens.size() > 5) && (NULL == tokens[5].m_data) && tokens[5].m_value) {
+					sessions[(uint32_t)tokens[5].m_value] = starting[r.comID];
+					nsessions++;
+				}
+				starting.erase(r.comID);
+			}
+			if (o.method == "EndSession") sessions.erase(o.TSN);
+			analyzeAdd(methods, o.method, o, end - o.start);
+			analyzeAdd(sps, o.sp, o, end - o.start);
+			analyzeAdd(authorities, o.authority, o, end - o.start);
+			lastMethod = o.method;
+			ncalls++;
+			continue;
+		}
+		/* discovery, protocol 0 and anything else is a single command call */
+		if ((0x01 == r.protocol) && (0x0001 == r.comID))
+			c.method = "Discovery0";
+		else {
+			snprintf(name, sizeof(name), "%s protocol %02x", (IF_SEND == r.command) ? "IF_SEND" : "IF_RECV", r.protocol);
+			c.method = name;
+		}
+		c.polls = (IF_RECV == r.command) ? 1 : 0;
+		c.sp = "-";
+		c.authority = "-";
+		if (gap) {
+			AnalyzeGap g = { gap, i, c.method, lastMethod };
+			gaps.push_back(g);
+			idle += gap;
+		}
+		analyzeAdd(methods, c.method, c, r.duration);
+		analyzeAdd(sps, c.sp, c, r.duration);
+		analyzeAdd(authorities, c.authority, c, r.duration);
+		lastMethod = c.method;
+		lastEnd = end;
+		ncalls++;
+	}
+	if (runs) elapsed += lastEnd - runStart;
+	uint64_t wait = (elapsed > device + idle) ? elapsed - device - idle : 0;
+
+	printf("%s: %llu records, %u runs, %llu calls, %llu sessions\n", path,
+		(unsigned long long)entries.size(), runs, (unsigned long long)ncalls, (unsigned long long)nsessions);
+	printf("elapsed %.3f ms, in the transport %.3f ms, waiting between polls %.3f ms, host gaps %.3f ms\n",
+		(double)elapsed / 1e6, (double)device / 1e6, (double)wait / 1e6, (double)idle / 1e6);
+	analyzePrint("Method", methods);
+	analyzePrint("SP", sps);
+	analyzePrint("Authority", authorities);
+	sort(gaps.begin(), gaps.end(), [](const AnalyzeGap &a, const AnalyzeGap &b) { return a.length > b.length; });
+	printf("\nLargest host gaps between commands\n");
+	for (size_t i = 0; (i < gaps.size()) && (i < 10); i++)
+		printf("%10.3f ms before %s (record #%u) after %s\n", (double)gaps[i].length / 1e6,
+			gaps[i].before.c_str(), (uint32_t)gaps[i].record,
+			gaps[i].after.empty() ? "start of run" : gaps[i].after.c_str());
+	return 0;
+}
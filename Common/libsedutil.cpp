@@ -0,0 +1,312 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <mutex>
+#include <string>
+#include "libsedutil.h"
+#include "DtaHashPwd.h"
+#include "DtaDevGeneric.h"
+#include "DtaDevOpal1.h"
+#include "DtaDevOpal2.h"
+#include "DtaDevEnterprise.h"
+#include "DtaProbe.h"
+
+using namespace std;
+
+/* the public codes are the internal ones */
+static_assert(SEDUTIL_E_NOT_AUTHORIZED == NOT_AUTHORIZED, "SEDUTIL_E_*");
+static_assert(SEDUTIL_E_AUTHORITY_LOCKED_OUT == AUTHORITY_LOCKED_OUT, "SEDUTIL_E_*");
+static_assert(SEDUTIL_E_FAIL == FAIL, "SEDUTIL_E_*");
+static_assert(SEDUTIL_E_UNSUPPORTED_RANGE == DTAERROR_UNSUPORTED_LOCKING_RANGE, "SEDUTIL_E_*");
+static_assert(SEDUTIL_E_OPEN == DTAERROR_OPEN_ERR, "SEDUTIL_E_*");
+static_assert(SEDUTIL_E_DEVICE_LOCKED == DTAERROR_DEVICE_LOCKED, "SEDUTIL_E_*");
+static_assert(SEDUTIL_E_BAD_RESPONSE == DTAERROR_BAD_RESPONSE, "SEDUTIL_E_*");
+
+/* library builds have no command line, messages go out unadorned */
+sedutiloutput outputFormat = sedutilNormal;
+
+/** An open drive.
+ * The DtaDev keeps the session and response of the method in progress,
+ * lock serializes the calls made through one handle.
+ */
+struct sedutil_dev {
+	DtaDev * d;
+	std::mutex lock;
+};
+
+/** A writable copy of a caller's password, the DtaDev methods take char *,
+ * wiped when the call returns */
+class sedutil_arg {
+public:
+	sedutil_arg(const char * s) : str(s ? s : "") {}
+	~sedutil_arg() { SECUREZERO(&str[0], str.size()); }
+	operator char *() { return &str[0]; }
+private:
+	std::string str;
+};
+
+unsigned sedutil_api_version(void)
+{
+	return SEDUTIL_API_VERSION;
+}
+
+void sedutil_set_log_level(int level)
+{
+	CLog::Level() = CLog::FromInt(level);
+	RCLog::Level() = RCLog::FromInt(level);
+}
+
+void sedutil_cache_keys(unsigned entries)
+{
+	DtaHashCache(entries);
+}
+
+int sedutil_open(const char * devref, unsigned flags, sedutil_dev ** dev)
+{
+	LOG(D1) << "Entering sedutil_open " << (devref ? devref : "(null)");
+	if ((NULL == devref) || (NULL == dev))
+		return DTAERROR_INVALID_PARAMETER;
+	*dev = NULL;
+	DtaDevGeneric * tempDev = new DtaDevGeneric(devref);
+	if ((!tempDev->isPresent()) || (!tempDev->isAnySSC())) {
+		LOG(E) << "Invalid or unsupported disk " << devref;
+		delete tempDev;
+		return DTAERROR_COMMAND_ERROR;
+	}
+	DtaDev * d;
+	if (tempDev->isOpal2())
+		d = new DtaDevOpal2(devref);
+	else if (tempDev->isOpal1())
+		d = new DtaDevOpal1(devref);
+	else if (tempDev->isEprise())
+		d = new DtaDevEnterprise(devref);
+	else {
+		LOG(E) << "Unknown OPAL SSC ";
+		delete tempDev;
+		return DTAERROR_INVALID_COMMAND;
+	}
+	delete tempDev;
+	if (!d->isPresent()) {
+		LOG(E) << "Unable to reopen " << devref;
+		delete d;
+		return DTAERROR_OPEN_ERR;
+	}
+	if (flags & SEDUTIL_OPEN_OWN_COMID) {
+		uint8_t rc = d->acquireComID();
+		if (rc) {
+			LOG(E) << "No free comID on " << devref;
+			delete d;
+			return rc;
+		}
+	}
+	d->no_hash_passwords = (flags & SEDUTIL_OPEN_NO_HASH) ? true : false;
+	d->output_format = sedutilNormal;
+	*dev = new sedutil_dev;
+	(*dev)->d = d;
+	return 0;
+}
+
+void sedutil_close(sedutil_dev * dev)
+{
+	LOG(D1) << "Entering sedutil_close";
+	if (NULL == dev) return;
+	delete dev->d;
+	delete dev;
+}
+
+/** copy an identify field, dropping the trailing blanks */
+static void sedutil_field(char * dst, const char * src, size_t len)
+{
+	memcpy(dst, src, len);
+	dst[len] = 0;
+	while ((len > 0) && ((' ' == dst[len - 1]) || (0 == dst[len - 1])))
+		dst[--len] = 0;
+}
+
+int sedutil_get_info(sedutil_dev * dev, sedutil_info * info)
+{
+	LOG(D1) << "Entering sedutil_get_info";
+	if ((NULL == dev) || (NULL == info))
+		return DTAERROR_INVALID_PARAMETER;
+	std::lock_guard<std::mutex> guard(dev->lock);
+	DtaDev * d = dev->d;
+	uint8_t rc = d->discovery0();
+	if (rc) return rc;
+	memset(info, 0, sizeof (sedutil_info));
+	if (d->isOpal1()) info->ssc |= SEDUTIL_SSC_OPAL1;
+	if (d->isOpal2()) info->ssc |= SEDUTIL_SSC_OPAL2;
+	if (d->isEprise()) info->ssc |= SEDUTIL_SSC_ENTERPRISE;
+	info->locking_enabled = d->LockingEnabled();
+	info->locked = d->Locked();
+	info->mbr_enabled = d->MBREnabled();
+	info->mbr_done = d->MBRDone();
+	sedutil_field(info->model, d->getModelNum(), sizeof (info->model) - 1);
+	sedutil_field(info->serial, d->getSerialNum(), sizeof (info->serial) - 1);
+	sedutil_field(info->firmware, d->getFirmwareRev(), sizeof (info->firmware) - 1);
+	return 0;
+}
+
+int sedutil_probe(const char * const * devrefs, unsigned count, sedutil_info * info,
+	int * rc)
+{
+	LOG(D1) << "Entering sedutil_probe " << count;
+	if ((NULL == devrefs) || (NULL == info) || (NULL == rc))
+		return DTAERROR_INVALID_PARAMETER;
+	vector<string> devices;
+	vector<DtaProbeResult> results;
+	for (unsigned i = 0; i < count; i++) {
+		if (NULL == devrefs[i])
+			return DTAERROR_INVALID_PARAMETER;
+		devices.push_back(devrefs[i]);
+	}
+	DtaProbe(devices, results);
+	for (unsigned i = 0; i < count; i++) {
+		DtaProbeResult & r = results[i];
+		memset(&info[i], 0, sizeof (sedutil_info));
+		rc[i] = r.rc;
+		if (r.rc) continue;
+		if (r.opal1) info[i].ssc |= SEDUTIL_SSC_OPAL1;
+		if (r.opal2) info[i].ssc |= SEDUTIL_SSC_OPAL2;
+		if (r.enterprise) info[i].ssc |= SEDUTIL_SSC_ENTERPRISE;
+		info[i].locking_enabled = r.lockingEnabled;
+		info[i].locked = r.locked;
+		info[i].mbr_enabled = r.mbrEnabled;
+		info[i].mbr_done = r.mbrDone;
+		snprintf(info[i].model, sizeof (info[i].model), "%s", r.model.c_str());
+		snprintf(info[i].serial, sizeof (info[i].serial), "%s", r.serial.c_str());
+		snprintf(info[i].firmware, sizeof (info[i].firmware), "%s", r.firmware.c_str());
+	}
+	return 0;
+}
+
+int sedutil_set_locking_range(sedutil_dev * dev, uint8_t range, uint8_t state,
+	const char * password)
+{
+	LOG(D1) << "Entering sedutil_set_locking_range";
+	if ((NULL == dev) || (NULL == password))
+		return DTAERROR_INVALID_PARAMETER;
+	if ((SEDUTIL_LOCK_RW != state) && (SEDUTIL_LOCK_RO != state) && (SEDUTIL_LOCK_LK != state))
+		return DTAERROR_INVALID_PARAMETER;
+	sedutil_arg pw(password);
+	std::lock_guard<std::mutex> guard(dev->lock);
+	return dev->d->setLockingRange(range, state, pw);
+}
+
+int sedutil_set_mbr_done(sedutil_dev * dev, uint8_t done, const char * password)
+{
+	LOG(D1) << "Entering sedutil_set_mbr_done";
+	if ((NULL == dev) || (NULL == password))
+		return DTAERROR_INVALID_PARAMETER;
+	sedutil_arg pw(password);
+	std::lock_guard<std::mutex> guard(dev->lock);
+	return dev->d->setMBRDone(done ? 1 : 0, pw);
+}
+
+int sedutil_set_mbr_enable(sedutil_dev * dev, uint8_t enable, const char * password)
+{
+	LOG(D1) << "Entering sedutil_set_mbr_enable";
+	if ((NULL == dev) || (NULL == password))
+		return DTAERROR_INVALID_PARAMETER;
+	sedutil_arg pw(password);
+	std::lock_guard<std::mutex> guard(dev->lock);
+	return dev->d->setMBREnable(enable ? 1 : 0, pw);
+}
+
+int sedutil_load_pba(sedutil_dev * dev, const char * password, const char * filename)
+{
+	LOG(D1) << "Entering sedutil_load_pba";
+	if ((NULL == dev) || (NULL == password) || (NULL == filename))
+		return DTAERROR_INVALID_PARAMETER;
+	sedutil_arg pw(password), file(filename);
+	std::lock_guard<std::mutex> guard(dev->lock);
+	return dev->d->loadPBA(pw, file);
+}
+
+int sedutil_rekey_locking_range(sedutil_dev * dev, uint8_t range, const char * password)
+{
+	LOG(D1) << "Entering sedutil_rekey_locking_range";
+	if ((NULL == dev) || (NULL == password))
+		return DTAERROR_INVALID_PARAMETER;
+	sedutil_arg pw(password);
+	std::lock_guard<std::mutex> guard(dev->lock);
+	return dev->d->rekeyLockingRange(range, pw);
+}
+
+int sedutil_rekey_all_ranges(sedutil_dev * dev, const char * password)
+{
+	LOG(D1) << "Entering sedutil_rekey_all_ranges";
+	if ((NULL == dev) || (NULL == password))
+		return DTAERROR_INVALID_PARAMETER;
+	sedutil_arg pw(password);
+	std::lock_guard<std::mutex> guard(dev->lock);
+	return dev->d->rekeyAllLockingRanges(pw);
+}
+
+int sedutil_set_all_ranges(sedutil_dev * dev, uint8_t state, const char * password,
+	uint32_t * elapsed_us)
+{
+	LOG(D1) << "Entering sedutil_set_all_ranges";
+	if ((NULL == dev) || (NULL == password))
+		return DTAERROR_INVALID_PARAMETER;
+	if ((SEDUTIL_LOCK_RW != state) && (SEDUTIL_LOCK_RO != state) && (SEDUTIL_LOCK_LK != state))
+		return DTAERROR_INVALID_PARAMETER;
+	sedutil_arg pw(password);
+	std::lock_guard<std::mutex> guard(dev->lock);
+	return dev->d->setAllLockingRanges(state, pw, elapsed_us);
+}
+
+const char * sedutil_strerror(int rc)
+{
+	switch (rc) {
+	case SUCCESS: return "success";
+	case NOT_AUTHORIZED: return "not authorized";
+	case SP_BUSY: return "SP busy";
+	case SP_FAILED: return "SP failed";
+	case SP_DISABLED: return "SP disabled";
+	case SP_FROZEN: return "SP frozen";
+	case NO_SESSIONS_AVAILABLE: return "no sessions available";
+	case UNIQUENESS_CONFLICT: return "uniqueness conflict";
+	case INSUFFICIENT_SPACE: return "insufficient space";
+	case INSUFFICIENT_ROWS: return "insufficient rows";
+	case INVALID_FUNCTION: return "invalid function";
+	case INVALID_PARAMETER: return "invalid parameter";
+	case INVALID_REFERENCE: return "invalid reference";
+	case TPER_MALFUNCTION: return "TPer malfunction";
+	case TRANSACTION_FAILURE: return "transaction failure";
+	case RESPONSE_OVERFLOW: return "response overflow";
+	case AUTHORITY_LOCKED_OUT: return "authority locked out";
+	case FAIL: return "method failed";
+	case DTAERROR_UNSUPORTED_LOCKING_RANGE: return "unsupported locking range";
+	case DTAERROR_OBJECT_CREATE_FAILED: return "object create failed";
+	case DTAERROR_INVALID_PARAMETER: return "invalid parameter";
+	case DTAERROR_OPEN_ERR: return "open failed";
+	case DTAERROR_INVALID_LIFECYCLE: return "invalid lifecycle state";
+	case DTAERROR_INVALID_COMMAND: return "invalid command";
+	case DTAERROR_AUTH_FAILED: return "authentication failed";
+	case DTAERROR_COMMAND_ERROR: return "command error";
+	case DTAERROR_NO_METHOD_STATUS: return "no method status";
+	case DTAERROR_NO_LOCKING_INFO: return "no locking info";
+	case DTAERROR_NO_COMID: return "no free comID";
+	case DTAERROR_INTERRUPTED: return "interrupted by a signal";
+	case DTAERROR_DEVICE_LOCKED: return "device locked by another process";
+	case DTAERROR_BAD_RESPONSE: return "malformed response from the drive";
+	default: return "unknown error";
+	}
+}
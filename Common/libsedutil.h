@@ -0,0 +1,152 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+/** The libsedutil C API.
+ * A stable C interface to the sedutil Opal/Enterprise support for
+ * programs that embed it rather than run sedutil-cli.  Each open drive
+ * is a sedutil_dev handle; calls on one handle are serialized, calls on
+ * different handles may run concurrently from any thread.
+ *
+ * Unless noted the functions return 0 on success, or one of the
+ * SEDUTIL_E_* codes below: the TCG method status of a failed method call
+ * (below 0x40) or an error found by the library (0x80 and up).
+ */
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Bumped when a function or structure changes incompatibly */
+#define SEDUTIL_API_VERSION 1
+
+/** Method status codes from the TPer */
+#define SEDUTIL_E_NOT_AUTHORIZED		0x01
+#define SEDUTIL_E_SP_BUSY			0x03
+#define SEDUTIL_E_SP_FAILED			0x04
+#define SEDUTIL_E_SP_DISABLED			0x05
+#define SEDUTIL_E_SP_FROZEN			0x06
+#define SEDUTIL_E_NO_SESSIONS_AVAILABLE	0x07
+#define SEDUTIL_E_UNIQUENESS_CONFLICT		0x08
+#define SEDUTIL_E_INSUFFICIENT_SPACE		0x09
+#define SEDUTIL_E_INSUFFICIENT_ROWS		0x0a
+#define SEDUTIL_E_INVALID_FUNCTION		0x0b
+#define SEDUTIL_E_INVALID_PARAMETER		0x0c
+#define SEDUTIL_E_INVALID_REFERENCE		0x0d
+#define SEDUTIL_E_TPER_MALFUNCTION		0x0f
+#define SEDUTIL_E_TRANSACTION_FAILURE		0x10
+#define SEDUTIL_E_RESPONSE_OVERFLOW		0x11
+#define SEDUTIL_E_AUTHORITY_LOCKED_OUT		0x12
+#define SEDUTIL_E_FAIL				0x3f
+/** Errors found by the library */
+#define SEDUTIL_E_UNSUPPORTED_RANGE		0x81 /**< no such locking range */
+#define SEDUTIL_E_OBJECT_CREATE_FAILED		0x82
+#define SEDUTIL_E_BAD_PARAMETER		0x83 /**< an argument is not valid */
+#define SEDUTIL_E_OPEN			0x84 /**< the device could not be opened */
+#define SEDUTIL_E_INVALID_LIFECYCLE		0x85
+#define SEDUTIL_E_INVALID_COMMAND		0x86
+#define SEDUTIL_E_AUTH_FAILED			0x87
+#define SEDUTIL_E_COMMAND			0x88 /**< the transport failed */
+#define SEDUTIL_E_NO_METHOD_STATUS		0x89
+#define SEDUTIL_E_NO_LOCKING_INFO		0x8a
+#define SEDUTIL_E_NO_COMID			0x8b
+#define SEDUTIL_E_INTERRUPTED			0x8c
+#define SEDUTIL_E_DEVICE_LOCKED		0x8d /**< another process holds the drive */
+#define SEDUTIL_E_BAD_RESPONSE			0x8e /**< the drive's reply could not be parsed */
+
+/** sedutil_open() flags */
+#define SEDUTIL_OPEN_NO_HASH	0x01 /**< pass passwords to the drive unhashed */
+#define SEDUTIL_OPEN_OWN_COMID	0x02 /**< sessions on a comID of this handle alone, so
+					 handles for the same drive can be used in parallel */
+
+/** sedutil_set_locking_range() states */
+#define SEDUTIL_LOCK_RW	0x01 /**< read write */
+#define SEDUTIL_LOCK_RO	0x02 /**< read only */
+#define SEDUTIL_LOCK_LK	0x03 /**< locked */
+
+/** sedutil_info.ssc bits */
+#define SEDUTIL_SSC_OPAL1		0x01
+#define SEDUTIL_SSC_OPAL2		0x02
+#define SEDUTIL_SSC_ENTERPRISE	0x04
+
+/** An open drive */
+typedef struct sedutil_dev sedutil_dev;
+
+/** Drive state from the last Level 0 Discovery */
+typedef struct sedutil_info {
+	uint8_t ssc; /**< SEDUTIL_SSC_* bits */
+	uint8_t locking_enabled; /**< the Locking SP is active */
+	uint8_t locked; /**< a locking range is locked */
+	uint8_t mbr_enabled; /**< the shadow MBR is enabled */
+	uint8_t mbr_done; /**< the shadow MBR is hidden */
+	char model[41]; /**< from identify, NUL terminated */
+	char serial[21];
+	char firmware[9];
+	uint8_t reserved[32]; /**< room to grow without an API version bump */
+} sedutil_info;
+
+/** Return the SEDUTIL_API_VERSION the library was built with */
+unsigned sedutil_api_version(void);
+/** Set the library wide log level, 0 (errors) to 7 (DEBUG4) */
+void sedutil_set_log_level(int level);
+/** Keep up to entries derived keys in locked memory so repeated calls
+ * with the same password skip PBKDF2, 0 wipes the cache */
+void sedutil_cache_keys(unsigned entries);
+/** Open a drive and identify its SSC
+ * @param devref OS device name, sim: or replay: transport
+ * @param flags SEDUTIL_OPEN_* flags
+ * @param dev receives the handle
+ */
+int sedutil_open(const char * devref, unsigned flags, sedutil_dev ** dev);
+/** Close a drive opened by sedutil_open(), NULL is ignored */
+void sedutil_close(sedutil_dev * dev);
+/** Rerun Level 0 Discovery and return the drive state, info is only
+ * filled in when 0 is returned */
+int sedutil_get_info(sedutil_dev * dev, sedutil_info * info);
+/** Probe drives without opening them for sessions: each gets its identify
+ * and a single Level 0 Discovery, up to 16 at a time. info[i] and rc[i]
+ * receive the state of devrefs[i], rc[i] is nonzero if it could not be
+ * opened, info[i].ssc is 0 for a drive that is not a TCG drive */
+int sedutil_probe(const char * const * devrefs, unsigned count, sedutil_info * info,
+	int * rc);
+/** Set a locking range to one of the SEDUTIL_LOCK_* states as Admin1 */
+int sedutil_set_locking_range(sedutil_dev * dev, uint8_t range, uint8_t state,
+	const char * password);
+/** Set or clear MBRDone as Admin1 */
+int sedutil_set_mbr_done(sedutil_dev * dev, uint8_t done, const char * password);
+/** Set or clear MBREnable as Admin1 */
+int sedutil_set_mbr_enable(sedutil_dev * dev, uint8_t enable, const char * password);
+/** Write a PBA image to the shadow MBR as Admin1 */
+int sedutil_load_pba(sedutil_dev * dev, const char * password, const char * filename);
+/** Generate a new media encryption key for a locking range as Admin1 */
+int sedutil_rekey_locking_range(sedutil_dev * dev, uint8_t range, const char * password);
+/** Generate new media encryption keys for every locking range in one Admin1 session */
+int sedutil_rekey_all_ranges(sedutil_dev * dev, const char * password);
+/** Set every locking range to a SEDUTIL_LOCK_* state, and MBRDone on unless
+ * SEDUTIL_LOCK_LK, in one Admin1 session; elapsed_us, if not NULL, receives
+ * the time taken */
+int sedutil_set_all_ranges(sedutil_dev * dev, uint8_t state, const char * password,
+	uint32_t * elapsed_us);
+/** Describe a return code, the string is static */
+const char * sedutil_strerror(int rc);
+
+#ifdef __cplusplus
+}
+#endif
@@ -38,11 +38,13 @@
 #ifndef __LOG_H__
 #define __LOG_H__
 
+#include <atomic>
 #include <sstream>
 #include <string>
 #include <stdio.h>
 #include <stdlib.h>
 #include "DtaOptions.h"
+#include "DtaLogSink.h"
 
 inline std::string NowTime();
 
@@ -57,7 +59,7 @@ public:
     virtual ~Log();
     std::ostringstream& Get(TLogLevel level = I);
 public:
-    static TLogLevel& Level();
+    static std::atomic<TLogLevel>& Level();
     static std::string ToString(TLogLevel level);
     static TLogLevel FromString(const std::string& level);
     static TLogLevel FromInt(const int level);
@@ -87,8 +89,8 @@ Log<T>::~Log() {
 }
 
 template <typename T>
-TLogLevel& Log<T>::Level() {
-    static TLogLevel Level = D4;
+std::atomic<TLogLevel>& Log<T>::Level() {
+    static std::atomic<TLogLevel> Level(I);
     return Level;
 }
 
@@ -149,7 +151,7 @@ public:
     virtual ~RLog();
     std::ostringstream& Get(TLogLevel level = I, sedutiloutput format = sedutilReadable);
 public:
-    static TLogLevel& Level();
+    static std::atomic<TLogLevel>& Level();
     static std::string ToString(TLogLevel level);
     static TLogLevel FromString(const std::string& level);
     static TLogLevel FromInt(const int level);
@@ -160,6 +162,8 @@ private:
     RLog& operator =(const RLog&);
     TLogLevel curlevel;
     sedutiloutput outputformat;
+    bool queued; /**< message goes to the DtaLogSink */
+    uint64_t stamp; /**< DtaLogSink timestamp of a queued message */
 };
 
 template <typename T>
@@ -170,7 +174,12 @@ template <typename T>
 std::ostringstream& RLog<T>::Get(TLogLevel level, sedutiloutput output_format) {
 	curlevel = level;
 	outputformat = output_format;
-	if (output_format == sedutilNormal) {
+	queued = (level >= D) && DtaLogSink::active();
+	if (queued)
+		stamp = DtaLogSink::now();
+	else if ((output_format == sedutilNormal) && DtaLogSink::active())
+		os << DtaLogSink::prefix((uint8_t)level, DtaLogSink::now());
+	else if (output_format == sedutilNormal) {
 		os << "- " << NowTime();
 		os << " " << ToString(level) << ": ";
 	}
@@ -181,6 +190,13 @@ std::ostringstream& RLog<T>::Get(TLogLevel level, sedutiloutput output_format) {
 template <typename T>
 RLog<T>::~RLog() {
     os << std::endl;
+	if (queued) {
+		DtaLogSink::write((uint8_t)curlevel, stamp, os.str());
+		return;
+	}
+	/* keep the queued debug output ahead of this message */
+	if (DtaLogSink::active())
+		DtaLogSink::flush();
 	if ((curlevel == I) && (outputformat != sedutilNormal))
 		T::Output(os.str());
 	else
@@ -188,8 +204,9 @@ RLog<T>::~RLog() {
 }
 
 template <typename T>
-TLogLevel& RLog<T>::Level() {
-    static TLogLevel Level = D4;
+std::atomic<TLogLevel>& RLog<T>::Level() {
+    /* atomic, library callers log from several threads */
+    static std::atomic<TLogLevel> Level(I);
     return Level;
 }
 
@@ -297,6 +314,8 @@ class FILELOG_DECLSPEC CLog : public Log<Output2FILE> {
 class FILELOG_DECLSPEC RCLog : public RLog<Output2FILE> {
 };
 
+/* LOG and IFLOG statements above CLOG_MAX_LEVEL are compiled out,
+ * release builds set it with configure --with-max-log-level */
 #ifndef CLOG_MAX_LEVEL
 #define CLOG_MAX_LEVEL D4
 #endif
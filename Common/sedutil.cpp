@@ -26,6 +26,16 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include "DtaDevOpal1.h"
 #include "DtaDevOpal2.h"
 #include "DtaDevEnterprise.h"
+#include "DtaSession.h"
+#include "DtaStats.h"
+#include "DtaTrace.h"
+#include "DtaProvision.h"
+#include "DtaProbe.h"
+#ifdef __gnu_linux__
+#include "DtaDaemon.h"
+#include "DtaDiskWatch.h"
+#include "DtaCollect.h"
+#endif
 
 using namespace std;
 
@@ -50,6 +60,12 @@ int isValidSEDDisk(char *devname)
 	return 0;
 }
 
+/** atexit handler for --stats, every action returns straight out of main */
+static void printStats()
+{
+	DtaStats::print(stderr, (sedutilJSON == outputFormat));
+}
+
 int main(int argc, char * argv[])
 {
 	DTA_OPTIONS opts;
@@ -57,10 +73,35 @@ int main(int argc, char * argv[])
 	if (DtaOptions(argc, argv, &opts)) {
 		return DTAERROR_COMMAND_ERROR;
 	}
+	if (opts.stats) {
+		DtaStats::enabled() = true;
+		atexit(printStats);
+	}
+	if (opts.daemon) {
+#ifdef __gnu_linux__
+		return DtaDaemonForward(opts, argv);
+#else
+		LOG(E) << "--daemon is not supported on this platform";
+		return DTAERROR_INVALID_COMMAND;
+#endif
+	}
+	/* ^C ends the open sessions before it takes effect */
+	DtaSession::catchSignals();
+	DtaDev::lockDiscovery() = opts.lockDiscovery;
+	DtaDev::resetComID() = opts.resetComID;
+	/* a trace that cannot be opened is reported but does not stop the command */
+	if (opts.tracefile)
+		DtaTrace::open(argv[opts.tracefile]);
 	
 	if ((opts.action != sedutiloption::scan) && 
+		(opts.action != sedutiloption::watch) &&
 		(opts.action != sedutiloption::validatePBKDF2) &&
-		(opts.action != sedutiloption::isValidSED)) {
+		(opts.action != sedutiloption::isValidSED) &&
+		(opts.action != sedutiloption::traceDump) &&
+		(opts.action != sedutiloption::traceAnalyze) &&
+		(opts.action != sedutiloption::provision) &&
+		(opts.action != sedutiloption::status) &&
+		(opts.action != sedutiloption::collect)) {
 		if (opts.device > (argc - 1)) opts.device = 0;
 		tempDev = new DtaDevGeneric(argv[opts.device]);
 		if (NULL == tempDev) {
@@ -126,6 +167,10 @@ int main(int argc, char * argv[])
 		LOG(D) << "Setting Locking Range " << (uint16_t)opts.lockingrange << " " << (uint16_t)opts.lockingstate << " in Single User Mode";
 		return d->setLockingRange_SUM(opts.lockingrange, opts.lockingstate, argv[opts.password]);
 		break;
+	case sedutiloption::setAllLockingRanges:
+		LOG(D) << "Setting all Locking Ranges " << (uint16_t)opts.lockingstate;
+		return d->setAllLockingRanges(opts.lockingstate, argv[opts.password], NULL);
+		break;
 	case sedutiloption::enableLockingRange:
         LOG(D) << "Enabling Locking Range " << (uint16_t) opts.lockingrange;
         return (d->configureLockingRange(opts.lockingrange,
@@ -163,6 +208,10 @@ int main(int argc, char * argv[])
 		LOG(D) << "Rekey Locking Range[" << opts.lockingrange << "]";
 		return (d->rekeyLockingRange(opts.lockingrange, argv[opts.password]));
         break;
+    case sedutiloption::rekeyAllLockingRanges:
+		LOG(D) << "Rekey all Locking Ranges";
+		return (d->rekeyAllLockingRanges(argv[opts.password]));
+        break;
     case sedutiloption::setBandsEnabled:
         LOG(D) << "Set bands Enabled";
         return (d->setBandsEnabled(-1, argv[opts.password]));
@@ -200,14 +249,56 @@ int main(int argc, char * argv[])
         d->puke();
         return 0;
         break;
+	case sedutiloption::status:
+		LOG(D) << "Probing the status of " << argv[opts.device];
+		return DtaProbeStatus(argv[opts.device]);
+		break;
 	case sedutiloption::scan:
         LOG(D) << "Performing diskScan() ";
-        return(DtaDevOS::diskScan());
+        return(DtaDevOS::diskScan(opts.filter ? argv[opts.filter] : NULL, opts.noSpinUp));
         break;
+	case sedutiloption::watch:
+        LOG(D) << "Performing diskWatch() ";
+#ifdef __gnu_linux__
+		{
+			DtaDiskFilter filter;
+			if (opts.filter && !DtaDiskFilterParse(argv[opts.filter], filter))
+				return DTAERROR_INVALID_PARAMETER;
+			return DtaDiskWatch(opts.filter ? &filter : NULL);
+		}
+#else
+		LOG(E) << "--watch is not supported on this platform";
+		return DTAERROR_INVALID_COMMAND;
+#endif
+	case sedutiloption::collect:
+		LOG(D) << "Collecting metrics to " << argv[opts.device];
+#ifdef __gnu_linux__
+		{
+			DtaDiskFilter filter;
+			if (opts.filter && !DtaDiskFilterParse(argv[opts.filter], filter))
+				return DTAERROR_INVALID_PARAMETER;
+			return DtaCollect(argv[opts.device], opts.filter ? &filter : NULL);
+		}
+#else
+		LOG(E) << "--collect is not supported on this platform";
+		return DTAERROR_INVALID_COMMAND;
+#endif
 	case sedutiloption::isValidSED:
 		LOG(D) << "Verify whether " << argv[opts.device] << "is valid SED or not";
         return isValidSEDDisk(argv[opts.device]);
         break;
+	case sedutiloption::traceDump:
+		LOG(D) << "Decoding trace file " << argv[opts.device];
+		return DtaTraceDump(argv[opts.device]);
+		break;
+	case sedutiloption::traceAnalyze:
+		LOG(D) << "Analyzing trace file " << argv[opts.device];
+		return DtaTraceAnalyze(argv[opts.device]);
+		break;
+	case sedutiloption::provision:
+		LOG(D) << "Provisioning the drives in " << argv[opts.device];
+		return DtaProvision(argv[opts.device], opts.no_hash_passwords);
+		break;
 	case sedutiloption::takeOwnership:
 		LOG(D) << "Taking Ownership of the drive at" << argv[opts.device];
         return d->takeOwnership(argv[opts.password]);
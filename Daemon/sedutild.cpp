@@ -0,0 +1,361 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+/* sedutild: keep the SEDs open and serve lock, unlock, status and PBA
+ * requests from sedutil-cli --daemon over a UNIX domain socket.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "os.h"
+#include "libsedutil.h"
+#include "DtaDaemon.h"
+#include "DtaExecutor.h"
+#include "DtaDiskEnum.h"
+
+using namespace std;
+
+/** A drive held open by the daemon */
+typedef struct _DaemonDrive {
+	string name; /**< device as given on the command line */
+	string path; /**< name with the symlinks resolved */
+	std::mutex openLock; /**< guards dev */
+	sedutil_dev * dev; /**< NULL if the open failed */
+	uint8_t rc; /**< sedutil_open() result */
+	std::mutex statusLock; /**< guards info */
+	sedutil_info info; /**< drive state after the last discovery */
+} DaemonDrive;
+
+static vector<DaemonDrive *> drives;
+static unsigned openFlags = 0;
+static volatile sig_atomic_t stopping = 0;
+static int listenFd = -1;
+static DtaExecutor * pool; /**< refreshes the drives in parallel */
+
+static void daemonUsage()
+{
+	printf("sedutild <-v> <-n> <-s socket> <-k keys> <-f filter> <device> ...\n");
+	printf("-v (optional)       increase verbosity, one to five v's\n");
+	printf("-n (optional)       no password hashing\n");
+	printf("-s <socket>         socket to listen on (default %s)\n", DTA_DAEMON_SOCKET);
+	printf("-k <keys>           derived keys kept in locked memory (default 16, 0 disables)\n");
+	printf("-f <filter>         with no devices, serve the disks matching transport=,vendor=,model=\n");
+	printf("                    (default all disks found in sysfs)\n");
+}
+
+/** Return the drive handle, opening it first if asked
+ * @param open try to open a drive that is not open
+ * @param rc set to the sedutil_open() result when it is tried
+ */
+static sedutil_dev * daemonDev(DaemonDrive * drive, bool open, uint8_t &rc)
+{
+	std::lock_guard<std::mutex> guard(drive->openLock);
+	if ((NULL == drive->dev) && open) {
+		rc = (uint8_t)sedutil_open(drive->name.c_str(), openFlags, &drive->dev);
+		if (rc) drive->dev = NULL;
+	}
+	return drive->dev;
+}
+
+/** (Re)open a drive if needed and rerun discovery into the status cache */
+static void daemonRefresh(DaemonDrive * drive)
+{
+	sedutil_info info;
+	uint8_t rc = 0;
+	LOG(D1) << "Entering daemonRefresh " << drive->name;
+	sedutil_dev * dev = daemonDev(drive, true, rc);
+	memset(&info, 0, sizeof (info));
+	if (NULL != dev)
+		rc = (uint8_t)sedutil_get_info(dev, &info);
+	std::lock_guard<std::mutex> guard(drive->statusLock);
+	drive->rc = rc;
+	drive->info = info;
+}
+
+static void daemonStatus(DaemonDrive * drive, DtaDaemonStatus &status)
+{
+	memset(&status, 0, sizeof (status));
+	snprintf(status.device, sizeof (status.device), "%s", drive->name.c_str());
+	std::lock_guard<std::mutex> guard(drive->statusLock);
+	status.rc = drive->rc;
+	status.info = drive->info;
+}
+
+static DaemonDrive * daemonFind(const char * device)
+{
+	char path[PATH_MAX];
+	const char * resolved = realpath(device, path) ? path : device;
+	for (size_t i = 0; i < drives.size(); i++) {
+		if ((drives[i]->name == device) || (drives[i]->path == resolved))
+			return drives[i];
+	}
+	return NULL;
+}
+
+/** Refresh every drive, one task per drive on the pool */
+static void daemonRefreshAll()
+{
+	vector<std::future<uint8_t>> done;
+	for (size_t i = 0; i < drives.size(); i++) {
+		DaemonDrive * drive = drives[i];
+		done.push_back(pool->submit(drive, [drive] {
+			daemonRefresh(drive);
+			return drive->rc; }));
+	}
+	for (size_t i = 0; i < done.size(); i++)
+		done[i].get();
+}
+
+/** Carry out one request, status records for the reply go in status and
+ * the time DTA_DAEMON_SETALL took in elapsed_us */
+static uint8_t daemonRequest(DtaDaemonRequest &req, vector<DtaDaemonStatus> &status,
+	uint32_t &elapsed_us)
+{
+	DaemonDrive * drive = NULL;
+	sedutil_dev * dev;
+	uint8_t rc = 0;
+	LOG(D1) << "Entering daemonRequest " << (uint16_t)req.op << " " << req.device;
+	if (DTA_DAEMON_LIST == req.op) {
+		status.resize(drives.size());
+		for (size_t i = 0; i < drives.size(); i++)
+			daemonStatus(drives[i], status[i]);
+		return 0;
+	}
+	if ((DTA_DAEMON_RESCAN == req.op) && (0 == req.device[0])) {
+		daemonRefreshAll();
+		return 0;
+	}
+	if (NULL == (drive = daemonFind(req.device))) {
+		LOG(E) << "sedutild does not hold " << req.device;
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	switch (req.op) {
+	case DTA_DAEMON_STATUS:
+		status.resize(1);
+		daemonStatus(drive, status[0]);
+		return 0;
+	case DTA_DAEMON_RESCAN:
+		daemonRefresh(drive);
+		return drive->rc;
+	default:
+		break;
+	}
+	if (NULL == (dev = daemonDev(drive, false, rc))) return DTAERROR_OPEN_ERR;
+	/* the drives are opened with the daemon's -n, a password meant for
+	 * the other mode would fail and use up one of the drive's tries */
+	if (((req.flags & DTA_DAEMON_NO_HASH) ? 1 : 0) != ((openFlags & SEDUTIL_OPEN_NO_HASH) ? 1 : 0)) {
+		LOG(E) << "sedutild runs " << ((openFlags & SEDUTIL_OPEN_NO_HASH) ? "with" : "without") <<
+			" -n, the request " << ((req.flags & DTA_DAEMON_NO_HASH) ? "has" : "does not have") << " it";
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	switch (req.op) {
+	case DTA_DAEMON_SETLR:
+		rc = (uint8_t)sedutil_set_locking_range(dev, req.range, req.state, req.password);
+		break;
+	case DTA_DAEMON_SETALL:
+		rc = (uint8_t)sedutil_set_all_ranges(dev, req.state, req.password, &elapsed_us);
+		break;
+	case DTA_DAEMON_MBRDONE:
+		rc = (uint8_t)sedutil_set_mbr_done(dev, req.state, req.password);
+		break;
+	case DTA_DAEMON_MBRENABLE:
+		rc = (uint8_t)sedutil_set_mbr_enable(dev, req.state, req.password);
+		break;
+	case DTA_DAEMON_LOADPBA:
+		rc = (uint8_t)sedutil_load_pba(dev, req.password, req.file);
+		break;
+	default:
+		LOG(E) << "Unknown sedutild request " << (uint16_t)req.op;
+		return DTAERROR_INVALID_COMMAND;
+	}
+	/* the locking state changed, keep the cached status current */
+	daemonRefresh(drive);
+	return rc;
+}
+
+/** read or write all of len bytes */
+static bool daemonIo(int fd, void * buffer, size_t len, bool out)
+{
+	uint8_t * p = (uint8_t *)buffer;
+	while (len) {
+		ssize_t n = out ? send(fd, p, len, MSG_NOSIGNAL) : recv(fd, p, len, 0);
+		if ((n < 0) && (EINTR == errno)) continue;
+		if (n <= 0) return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+/** Serve one connection, runs on its own thread */
+static void daemonServe(int fd)
+{
+	DtaDaemonRequest req;
+	DtaDaemonResponse resp;
+	vector<DtaDaemonStatus> status;
+	struct ucred cred;
+	socklen_t len = sizeof (cred);
+	struct timeval tv = { 10, 0 };
+
+	memset(&resp, 0, sizeof (resp));
+	resp.version = DTA_DAEMON_VERSION;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof (tv));
+	if (!daemonIo(fd, &req, sizeof (req), false)) {
+		close(fd);
+		return;
+	}
+	req.device[sizeof (req.device) - 1] = 0;
+	req.password[sizeof (req.password) - 1] = 0;
+	req.file[sizeof (req.file) - 1] = 0;
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) ||
+		((0 != cred.uid) && (geteuid() != cred.uid))) {
+		LOG(E) << "sedutild request refused for uid " << cred.uid;
+		resp.rc = DTAERROR_AUTH_FAILED;
+	}
+	else if (DTA_DAEMON_VERSION != req.version) {
+		LOG(E) << "sedutild request with protocol version " << (uint16_t)req.version;
+		resp.rc = DTAERROR_INVALID_COMMAND;
+	}
+	else
+		resp.rc = daemonRequest(req, status, resp.elapsed_us);
+	SECUREZERO(req.password, sizeof (req.password));
+	resp.count = (uint16_t)status.size();
+	if (daemonIo(fd, &resp, sizeof (resp), true) && resp.count)
+		daemonIo(fd, status.data(), status.size() * sizeof (DtaDaemonStatus), true);
+	close(fd);
+}
+
+static void daemonStop(int sig)
+{
+	(void)sig;
+	stopping = 1;
+	if (listenFd >= 0) shutdown(listenFd, SHUT_RDWR);
+}
+
+int main(int argc, char * argv[])
+{
+	const char * path = DtaDaemonSocket();
+	unsigned keys = 16;
+	int loglevel = 2, c, fd;
+	struct sockaddr_un addr;
+	vector<string> devices;
+	DtaDiskFilter filter;
+	bool filtered = false;
+
+	while ((c = getopt(argc, argv, "s:k:f:nvh")) != -1) {
+		switch (c) {
+		case 's': path = optarg; break;
+		case 'k': keys = (unsigned)atol(optarg); break;
+		case 'f':
+			if (!DtaDiskFilterParse(optarg, filter)) return DTAERROR_INVALID_PARAMETER;
+			filtered = true;
+			break;
+		case 'n': openFlags |= SEDUTIL_OPEN_NO_HASH; break;
+		case 'v': loglevel++; break;
+		default: daemonUsage(); return DTAERROR_INVALID_PARAMETER;
+		}
+	}
+	if (filtered && (optind < argc)) {
+		daemonUsage();
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	sedutil_set_log_level(loglevel > 7 ? 7 : loglevel);
+	for (int i = optind; i < argc; i++)
+		devices.push_back(argv[i]);
+	if (devices.empty()) {
+		vector<DtaDiskEntry> disks;
+		DtaDiskEnum(disks, filtered ? &filter : NULL);
+		for (size_t i = 0; i < disks.size(); i++)
+			devices.push_back(disks[i].devref);
+		if (devices.empty()) {
+			LOG(E) << "No disks found";
+			return DTAERROR_OPEN_ERR;
+		}
+	}
+	/* passwords and derived keys pass through this process */
+	prctl(PR_SET_DUMPABLE, 0);
+	sedutil_cache_keys(keys);
+
+	for (size_t i = 0; i < devices.size(); i++) {
+		char resolved[PATH_MAX];
+		DaemonDrive * drive = new DaemonDrive;
+		drive->name = devices[i];
+		drive->path = realpath(devices[i].c_str(), resolved) ? resolved : devices[i];
+		drive->dev = NULL;
+		drives.push_back(drive);
+	}
+	/* opening a drive runs discovery and the properties exchange,
+	 * do the drives in parallel */
+	pool = new DtaExecutor();
+	daemonRefreshAll();
+	for (size_t i = 0; i < drives.size(); i++) {
+		if (drives[i]->rc) {
+			LOG(W) << "Unable to open " << drives[i]->name << " rc = " << (uint16_t)drives[i]->rc;
+		}
+	}
+
+	memset(&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof (addr.sun_path)) {
+		LOG(E) << "Socket path too long " << path;
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	strcpy(addr.sun_path, path);
+	listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	unlink(path);
+	mode_t mask = umask(0077);
+	if ((listenFd < 0) || bind(listenFd, (struct sockaddr *)&addr, sizeof (addr)) ||
+		listen(listenFd, 16)) {
+		LOG(E) << "Unable to listen on " << path << " " << strerror(errno);
+		return DTAERROR_OPEN_ERR;
+	}
+	umask(mask);
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGTERM, daemonStop);
+	signal(SIGINT, daemonStop);
+	LOG(I) << "sedutild serving " << drives.size() << " drives on " << path;
+
+	while (!stopping) {
+		fd = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC);
+		if (fd < 0) {
+			if ((EINTR == errno) || (ECONNABORTED == errno)) continue;
+			if (!stopping) {
+				LOG(E) << "accept failed " << strerror(errno);
+			}
+			break;
+		}
+		std::thread(daemonServe, fd).detach();
+	}
+	close(listenFd);
+	unlink(path);
+	sedutil_cache_keys(0);
+	LOG(I) << "sedutild stopped";
+	return 0;
+}
@@ -23,44 +23,26 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include "DtaDevOpal1.h"
 #include "DtaDevOpal2.h"
 
-#include <dirent.h>
-#include <fnmatch.h>
-#include <algorithm>
+#include "DtaDiskEnum.h"
 
 using namespace std;
 
 uint8_t UnlockSEDs(char * password) {
 /* Loop through drives */
-    char devref[25];
+    const char * devref;
     int failed = 0;
     DtaDev *tempDev;
     DtaDev *d;
-    DIR *dir;
-    struct dirent *dirent;
-    vector<string> devices;
-     string tempstring;
+    vector<DtaDiskEntry> disks;
     LOG(D4) << "Enter UnlockSEDs";
-    dir = opendir("/dev");
-    if(dir!=NULL)
-    {
-        while((dirent=readdir(dir))!=NULL) {
-            if((!fnmatch("sd[a-z]",dirent->d_name,0)) || 
-                    (!fnmatch("nvme[0-9]",dirent->d_name,0)) ||
-                    (!fnmatch("nvme[0-9][0-9]",dirent->d_name,0))
-                    ) {
-                tempstring = dirent->d_name;
-                devices.push_back(tempstring);
-            }
-        }
-        closedir(dir);
-    }
-    std::sort(devices.begin(),devices.end());
+    DtaDiskEnum(disks);
     printf("\nScanning....\n");
-    for(uint16_t i = 0; i < devices.size(); i++) {
-                snprintf(devref,23,"/dev/%s",devices[i].c_str());
+    for(size_t i = 0; i < disks.size(); i++) {
+        devref = disks[i].devref.c_str();
         tempDev = new DtaDevGeneric(devref);
         if (!tempDev->isPresent()) {
-            break;
+            delete tempDev;
+            continue;
         }
         if ((!tempDev->isOpal1()) && (!tempDev->isOpal2())) {
             printf("Drive %-10s %-40s not OPAL  \n", devref, tempDev->getModelNum());
@@ -0,0 +1,198 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <string>
+#include "DtaCollect.h"
+#include "DtaDiskCache.h"
+#include "DtaProbe.h"
+
+using namespace std;
+
+/** A label value with backslash, double quote and newline escaped */
+static string collectLabel(const string & value)
+{
+	string s;
+	for (size_t i = 0; i < value.length(); i++) {
+		if ('\\' == value[i]) s += "\\\\";
+		else if ('"' == value[i]) s += "\\\"";
+		else if ('\n' == value[i]) s += "\\n";
+		else s += value[i];
+	}
+	return s;
+}
+
+static void collectHelp(FILE * f, const char * name, const char * help)
+{
+	fprintf(f, "# HELP %s %s\n# TYPE %s gauge\n", name, help, name);
+}
+
+static bool collectSSC(const DtaProbeResult & r)
+{
+	return (0 == r.rc) && (r.opal1 || r.opal2 || r.enterprise);
+}
+
+/** One sample per drive of a flag, only drives with an SSC have them */
+static void collectFlag(FILE * f, const vector<DtaProbeResult> & drives,
+	const char * name, const char * help, bool DtaProbeResult::*flag)
+{
+	collectHelp(f, name, help);
+	for (size_t i = 0; i < drives.size(); i++)
+		if (collectSSC(drives[i]))
+			fprintf(f, "%s{device=\"%s\"} %d\n", name,
+				collectLabel(drives[i].device).c_str(), (drives[i].*flag) ? 1 : 0);
+}
+
+static bool collectWrite(const char * textfile, const vector<DtaProbeResult> & drives,
+	double seconds)
+{
+	/* a unique name next to the textfile, the exporter only reads *.prom
+	 * and two collectors never share a temporary file */
+	string tmp = string(textfile) + ".XXXXXX";
+	int fd = mkostemp(&tmp[0], O_CLOEXEC);
+	if (0 > fd) {
+		LOG(E) << "Unable to write " << tmp << " " << strerror(errno);
+		return false;
+	}
+	FILE * f = fdopen(fd, "w");
+	if (NULL == f) {
+		LOG(E) << "Unable to write " << tmp << " " << strerror(errno);
+		close(fd);
+		unlink(tmp.c_str());
+		return false;
+	}
+	collectHelp(f, "sedutil_drive_info", "Identity of a drive, the value is always 1.");
+	for (size_t i = 0; i < drives.size(); i++) {
+		const DtaProbeResult & r = drives[i];
+		if (r.rc) continue;
+		fprintf(f, "sedutil_drive_info{device=\"%s\",model=\"%s\",serial=\"%s\","
+			"firmware=\"%s\",ssc=\"%s\"} 1\n", collectLabel(r.device).c_str(),
+			collectLabel(r.model).c_str(), collectLabel(r.serial).c_str(),
+			collectLabel(r.firmware).c_str(), r.opal2 ? "opal2" : r.opal1 ? "opal1" :
+			r.enterprise ? "enterprise" : "none");
+	}
+	collectFlag(f, drives, "sedutil_locking_enabled",
+		"Locking SP enabled, from Level 0 Discovery.", &DtaProbeResult::lockingEnabled);
+	collectFlag(f, drives, "sedutil_locked",
+		"Some locking range is locked, from Level 0 Discovery.", &DtaProbeResult::locked);
+	collectFlag(f, drives, "sedutil_mbr_enabled",
+		"Shadow MBR enabled, from Level 0 Discovery.", &DtaProbeResult::mbrEnabled);
+	collectFlag(f, drives, "sedutil_mbr_done",
+		"Shadow MBR done (hidden), from Level 0 Discovery.", &DtaProbeResult::mbrDone);
+	collectHelp(f, "sedutil_probe_success", "Whether the drive could be opened and probed.");
+	for (size_t i = 0; i < drives.size(); i++)
+		fprintf(f, "sedutil_probe_success{device=\"%s\"} %d\n",
+			collectLabel(drives[i].device).c_str(), drives[i].rc ? 0 : 1);
+	collectHelp(f, "sedutil_probe_identify_cached",
+		"Whether the identity came from the cache instead of an identify command.");
+	for (size_t i = 0; i < drives.size(); i++)
+		fprintf(f, "sedutil_probe_identify_cached{device=\"%s\"} %d\n",
+			collectLabel(drives[i].device).c_str(), drives[i].cached ? 1 : 0);
+	collectHelp(f, "sedutil_probe_duration_seconds", "Time taken to open and probe the drive.");
+	for (size_t i = 0; i < drives.size(); i++)
+		fprintf(f, "sedutil_probe_duration_seconds{device=\"%s\"} %.6f\n",
+			collectLabel(drives[i].device).c_str(), drives[i].ms / 1000.0);
+	collectHelp(f, "sedutil_collect_drives", "Drives probed by the last collection.");
+	fprintf(f, "sedutil_collect_drives %u\n", (unsigned)drives.size());
+	collectHelp(f, "sedutil_collect_duration_seconds", "Time taken by the last collection.");
+	fprintf(f, "sedutil_collect_duration_seconds %.6f\n", seconds);
+	collectHelp(f, "sedutil_collect_timestamp_seconds", "When the last collection finished.");
+	fprintf(f, "sedutil_collect_timestamp_seconds %lld\n", (long long)time(NULL));
+	/* rename over the old file so the exporter never sees half of it */
+	bool written = (0 == fchmod(fileno(f), 0644));
+	written = (0 == fclose(f)) && written;
+	if (!written || rename(tmp.c_str(), textfile)) {
+		LOG(E) << "Unable to replace " << textfile << " " << strerror(errno);
+		unlink(tmp.c_str());
+		return false;
+	}
+	return true;
+}
+
+uint8_t DtaCollectDisks(const char * textfile, const vector<DtaDiskEntry> & disks)
+{
+	LOG(D1) << "Entering DtaCollectDisks " << textfile;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	DtaDiskCache cache;
+	vector<DtaProbeResult> drives(disks.size());
+	vector<string> keys(disks.size());
+	bool cacheChanged = false;
+	time_t now = time(NULL);
+	DtaDiskCacheLoad(cache);
+	for (size_t i = 0; i < disks.size(); i++) {
+		DtaProbeResult & r = drives[i];
+		r.device = disks[i].devref;
+		keys[i] = DtaDiskCacheKey(disks[i]);
+		DtaDiskCache::iterator c = keys[i].empty() ? cache.end() : cache.find(keys[i]);
+		if ((cache.end() != c) && (DEVICE_TYPE_OTHER != c->second.devType) &&
+			(now - c->second.probed < DTA_COLLECT_IDENTIFY_AGE)) {
+			r.cached = true;
+			r.devType = c->second.devType;
+			r.model = c->second.model;
+			r.serial = c->second.serial;
+			r.firmware = c->second.firmware;
+		}
+	}
+	DtaProbe(drives);
+	for (size_t i = 0; i < drives.size(); i++) {
+		DtaProbeResult & r = drives[i];
+		if (keys[i].empty()) continue;
+		if (r.rc || (DEVICE_TYPE_OTHER == r.devType)) {
+			/* identify again next time */
+			cacheChanged |= (0 != cache.erase(keys[i]));
+			continue;
+		}
+		uint8_t ssc = (r.opal1 ? DTA_CACHE_OPAL1 : 0) | (r.opal2 ? DTA_CACHE_OPAL2 : 0) |
+			(r.enterprise ? DTA_CACHE_EPRISE : 0) |
+			((r.opal1 || r.opal2 || r.enterprise) ? DTA_CACHE_ANYSSC : 0);
+		DtaDiskCacheEntry & e = cache[keys[i]];
+		if (r.cached && (e.ssc == ssc)) continue;
+		e.ssc = ssc;
+		if (!r.cached) {
+			e.probed = now;
+			e.model = r.model;
+			e.firmware = r.firmware;
+			e.serial = r.serial;
+			e.devType = r.devType;
+		}
+		cacheChanged = true;
+	}
+	if (cacheChanged && !DtaDiskCacheSave(cache)) {
+		LOG(W) << "Unable to update the scan cache " << DtaDiskCachePath();
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	return collectWrite(textfile, drives, seconds) ? 0 : DTAERROR_OPEN_ERR;
+}
+
+uint8_t DtaCollect(const char * textfile, const DtaDiskFilter * filter)
+{
+	LOG(D1) << "Entering DtaCollect " << textfile;
+	vector<DtaDiskEntry> disks;
+	DtaDiskEnum(disks, filter);
+	return DtaCollectDisks(textfile, disks);
+}
@@ -0,0 +1,49 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "DtaDiskEnum.h"
+
+/** Identify is sent again once the cached identity of a disk is this old, in seconds */
+#define DTA_COLLECT_IDENTIFY_AGE 3600
+
+/** Write the TCG state of the disks as a node_exporter textfile.
+ *
+ * Every disk matching the filter is probed with DtaProbe(), in parallel
+ * and without a session.  The identity of a disk (device type, model,
+ * serial, firmware) is kept in the scan cache, keyed like --scan
+ * --noSpinUp keys it, so a disk seen before only gets its Level 0
+ * Discovery; identify is sent again for new disks, disks whose probe
+ * failed and after DTA_COLLECT_IDENTIFY_AGE.  The metrics are written in
+ * the Prometheus text exposition format to a unique temporary file next
+ * to textfile, which is then renamed over it so the exporter never reads
+ * half a file.
+ * @param textfile file to write, it should end in .prom
+ * @param filter optional filter, NULL probes every disk
+ * @return 0, or DTAERROR_OPEN_ERR if the textfile could not be written
+ */
+uint8_t DtaCollect(const char * textfile, const DtaDiskFilter * filter);
+
+/** DtaCollect() for a list of disks instead of the disks in sysfs
+ * @param textfile file to write
+ * @param disks the disks, devref and the cache key fields are used
+ */
+uint8_t DtaCollectDisks(const char * textfile, const std::vector<DtaDiskEntry> & disks);
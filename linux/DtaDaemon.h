@@ -0,0 +1,91 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+/** The sedutild request/response protocol.
+ * A client connects to the daemon's UNIX stream socket, writes one
+ * DtaDaemonRequest and reads a DtaDaemonResponse followed by count
+ * DtaDaemonStatus records.  Both ends are the same build so the
+ * structures go over the socket as they are.
+ */
+#include <stdint.h>
+#include <vector>
+#include "libsedutil.h"
+#include "DtaOptions.h"
+
+/** Default socket, SEDUTILD_SOCKET in the environment overrides it */
+#define DTA_DAEMON_SOCKET "/run/sedutild.sock"
+/** Bumped when the structures change */
+#define DTA_DAEMON_VERSION 3
+/** DtaDaemonRequest flags: the client runs with -n, its password is not hashed */
+#define DTA_DAEMON_NO_HASH 0x01
+
+/** Requests served by sedutild */
+typedef enum _DTA_DAEMON_OP {
+	DTA_DAEMON_LIST = 1, /**< status of every drive */
+	DTA_DAEMON_STATUS, /**< status of one drive */
+	DTA_DAEMON_RESCAN, /**< rerun discovery on one drive, "" for all */
+	DTA_DAEMON_SETLR, /**< set locking range range to state */
+	DTA_DAEMON_MBRDONE, /**< set MBRDone to state */
+	DTA_DAEMON_MBRENABLE, /**< set MBREnable to state */
+	DTA_DAEMON_LOADPBA, /**< write file to the shadow MBR */
+	DTA_DAEMON_SETALL, /**< set every locking range and MBRDone to state */
+} DTA_DAEMON_OP;
+
+/** A request, strings are NUL terminated */
+typedef struct _DtaDaemonRequest {
+	uint8_t version; /**< DTA_DAEMON_VERSION */
+	uint8_t op; /**< DTA_DAEMON_OP */
+	uint8_t range; /**< locking range for DTA_DAEMON_SETLR */
+	uint8_t state; /**< SEDUTIL_LOCK_* or on/off */
+	uint8_t flags; /**< DTA_DAEMON_NO_HASH */
+	char device[64];
+	char password[128]; /**< Admin1 password, wiped after use */
+	char file[256]; /**< absolute path for DTA_DAEMON_LOADPBA */
+} DtaDaemonRequest;
+
+/** A drive as cached by the daemon */
+typedef struct _DtaDaemonStatus {
+	char device[64];
+	uint8_t rc; /**< sedutil_open() result, the info is empty unless 0 */
+	sedutil_info info;
+} DtaDaemonStatus;
+
+/** The reply header */
+typedef struct _DtaDaemonResponse {
+	uint8_t version; /**< DTA_DAEMON_VERSION */
+	uint8_t rc; /**< result of the operation, see sedutil_strerror() */
+	uint16_t count; /**< DtaDaemonStatus records that follow */
+	uint32_t elapsed_us; /**< DTA_DAEMON_SETALL time on the drive */
+} DtaDaemonResponse;
+
+/** Return the socket path clients and the daemon use */
+const char * DtaDaemonSocket();
+/** Send a request to sedutild
+ * @param req the request
+ * @param resp receives the reply header
+ * @param status receives the status records
+ */
+uint8_t DtaDaemonCall(DtaDaemonRequest * req, DtaDaemonResponse * resp,
+	std::vector<DtaDaemonStatus> &status);
+/** Run a sedutil-cli action through sedutild instead of opening the drive.
+ * Supports --scan, --query, --setLockingRange, --setAllLockingRanges, --setMBRDone,
+ * --setMBREnable and --loadPBAimage.
+ */
+uint8_t DtaDaemonForward(DTA_OPTIONS &opts, char * argv[]);
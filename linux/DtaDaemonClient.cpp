@@ -0,0 +1,206 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <limits.h>
+#include <iomanip>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "DtaDaemon.h"
+#include "DtaLexicon.h"
+
+using namespace std;
+
+const char * DtaDaemonSocket()
+{
+	const char * path = getenv("SEDUTILD_SOCKET");
+	return ((NULL != path) && (0 != path[0])) ? path : DTA_DAEMON_SOCKET;
+}
+
+/** read or write all of len bytes */
+static bool daemonIo(int fd, void * buffer, size_t len, bool out)
+{
+	uint8_t * p = (uint8_t *)buffer;
+	while (len) {
+		ssize_t n = out ? send(fd, p, len, MSG_NOSIGNAL) : recv(fd, p, len, 0);
+		if ((n < 0) && (EINTR == errno)) continue;
+		if (n <= 0) return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+uint8_t DtaDaemonCall(DtaDaemonRequest * req, DtaDaemonResponse * resp,
+	std::vector<DtaDaemonStatus> &status)
+{
+	LOG(D1) << "Entering DtaDaemonCall " << (uint16_t)req->op;
+	struct sockaddr_un addr;
+	const char * path = DtaDaemonSocket();
+	int fd;
+	status.clear();
+	req->version = DTA_DAEMON_VERSION;
+	memset(&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof (addr.sun_path)) {
+		LOG(E) << "Socket path too long " << path;
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	strcpy(addr.sun_path, path);
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		LOG(E) << "Unable to create a socket " << strerror(errno);
+		return DTAERROR_OPEN_ERR;
+	}
+	if (connect(fd, (struct sockaddr *)&addr, sizeof (addr))) {
+		LOG(E) << "Unable to reach sedutild at " << path << " " << strerror(errno);
+		close(fd);
+		return DTAERROR_OPEN_ERR;
+	}
+	bool ok = daemonIo(fd, req, sizeof (DtaDaemonRequest), true) &&
+		daemonIo(fd, resp, sizeof (DtaDaemonResponse), false);
+	if (ok && (DTA_DAEMON_VERSION != resp->version)) {
+		LOG(E) << "sedutild speaks protocol version " << (uint16_t)resp->version;
+		ok = false;
+	}
+	if (ok) {
+		status.resize(resp->count);
+		if (resp->count)
+			ok = daemonIo(fd, status.data(), resp->count * sizeof (DtaDaemonStatus), false);
+	}
+	close(fd);
+	if (!ok) {
+		LOG(E) << "sedutild request failed";
+		return DTAERROR_COMMAND_ERROR;
+	}
+	return resp->rc;
+}
+
+/** print a drive the way --scan does */
+static void daemonPrintScan(DtaDaemonStatus &s)
+{
+	printf("%-10s", s.device);
+	if (s.rc) {
+		printf("%s\n", " No  ");
+		return;
+	}
+	printf(" %s%s%s ", (s.info.ssc & SEDUTIL_SSC_OPAL1) ? "1" : " ",
+		(s.info.ssc & SEDUTIL_SSC_OPAL2) ? "2" : " ",
+		(s.info.ssc & SEDUTIL_SSC_ENTERPRISE) ? "E" : " ");
+	printf("%s %s\n", s.info.model, s.info.firmware);
+}
+
+static void daemonPrintQuery(DtaDaemonStatus &s)
+{
+	daemonPrintScan(s);
+	if (s.rc) return;
+	printf("Serial %s\n", s.info.serial);
+	printf("Locking enabled = %s, Locked = %s, MBR enabled = %s, MBR done = %s\n",
+		s.info.locking_enabled ? "Y" : "N", s.info.locked ? "Y" : "N",
+		s.info.mbr_enabled ? "Y" : "N", s.info.mbr_done ? "Y" : "N");
+}
+
+uint8_t DtaDaemonForward(DTA_OPTIONS &opts, char * argv[])
+{
+	LOG(D1) << "Entering DtaDaemonForward";
+	DtaDaemonRequest req;
+	DtaDaemonResponse resp;
+	vector<DtaDaemonStatus> status;
+	uint8_t rc;
+	memset(&req, 0, sizeof (req));
+	memset(&resp, 0, sizeof (resp));
+	/* a truncated password would be a different password, and a failed
+	 * authentication counts against the drive's tries */
+	if (opts.device && (strlen(argv[opts.device]) >= sizeof (req.device))) {
+		LOG(E) << "Device name longer than " << sizeof (req.device) - 1 << " bytes";
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	if (opts.password && (strlen(argv[opts.password]) >= sizeof (req.password))) {
+		LOG(E) << "Password longer than " << sizeof (req.password) - 1 << " bytes";
+		return DTAERROR_INVALID_PARAMETER;
+	}
+	if (opts.device)
+		strcpy(req.device, argv[opts.device]);
+	if (opts.no_hash_passwords)
+		req.flags |= DTA_DAEMON_NO_HASH;
+	switch (opts.action) {
+	case sedutiloption::scan:
+		req.op = DTA_DAEMON_LIST;
+		break;
+	case sedutiloption::query:
+		req.op = DTA_DAEMON_STATUS;
+		break;
+	case sedutiloption::setLockingRange:
+		req.op = DTA_DAEMON_SETLR;
+		req.range = opts.lockingrange;
+		req.state = opts.lockingstate;
+		break;
+	case sedutiloption::setAllLockingRanges:
+		req.op = DTA_DAEMON_SETALL;
+		req.state = opts.lockingstate;
+		break;
+	case sedutiloption::setMBRDone:
+		req.op = DTA_DAEMON_MBRDONE;
+		req.state = opts.mbrstate;
+		break;
+	case sedutiloption::setMBREnable:
+		req.op = DTA_DAEMON_MBRENABLE;
+		req.state = opts.mbrstate;
+		break;
+	case sedutiloption::loadPBAimage:
+		req.op = DTA_DAEMON_LOADPBA;
+		{
+			/* the daemon does not share our working directory */
+			char path[PATH_MAX];
+			if ((NULL == realpath(argv[opts.pbafile], path)) ||
+				(strlen(path) >= sizeof (req.file))) {
+				LOG(E) << "Unable to resolve " << argv[opts.pbafile];
+				return DTAERROR_INVALID_PARAMETER;
+			}
+			strcpy(req.file, path);
+		}
+		break;
+	default:
+		LOG(E) << "This command is not available through sedutild";
+		return DTAERROR_INVALID_COMMAND;
+	}
+	/* copied last so no error return above leaves it on the stack */
+	if (opts.password)
+		strcpy(req.password, argv[opts.password]);
+	rc = DtaDaemonCall(&req, &resp, status);
+	SECUREZERO(req.password, sizeof (req.password));
+	if (DTA_DAEMON_LIST == req.op) {
+		printf("Scanning for Opal compliant disks\n");
+		for (uint16_t i = 0; i < status.size(); i++)
+			daemonPrintScan(status[i]);
+		printf("No more disks present ending scan\n");
+	}
+	else if (DTA_DAEMON_STATUS == req.op) {
+		for (uint16_t i = 0; i < status.size(); i++)
+			daemonPrintQuery(status[i]);
+	}
+	else if ((DTA_DAEMON_SETALL == req.op) && !rc) {
+		LOG(I) << "sedutild set every locking range in " << (resp.elapsed_us / 1000) << "." <<
+			setw(3) << setfill('0') << (resp.elapsed_us % 1000) << setfill(' ') << " ms";
+	}
+	if (rc) {
+		LOG(E) << "sedutild returned " << (uint16_t)rc;
+	}
+	return rc;
+}
@@ -19,6 +19,7 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
  * C:E********************************************************************** */
 #pragma once
 #include "DtaStructures.h"
+#include "DtaIoLoop.h"
 
 /** virtual implementation for a disk interface-generic disk drive
  */
@@ -43,6 +44,25 @@ public:
      */
     virtual uint8_t sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
             void * buffer, uint32_t bufferlen) = 0;
+    /** Method to start a command and complete it from the calling
+     * thread's DtaIoLoop.  A drive with an asynchronous transport waits
+     * for its own commands through this, one at a time; drives without
+     * one run sendCmd and post its return code to the loop.
+     * @param cmd command to be sent to the device
+     * @param protocol security protocol to be used in the command
+     * @param comID communications ID to be used
+     * @param buffer input/output buffer, must stay valid until cb runs
+     * @param bufferlen length of the input/output buffer
+     * @param cb called from the DtaIoLoop with the sendCmd return code
+     * @param ctx passed to cb
+     */
+    virtual void submitCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+            void * buffer, uint32_t bufferlen, DtaIoCallback cb, void * ctx)
+    {
+        DtaIoLoop::get()->after(0, cb, ctx, sendCmd(cmd, protocol, comID, buffer, bufferlen));
+    }
     /** Routine to send an identify to the device */
     virtual void identify(OPAL_DiskInfo& disk_info) = 0;
+    /** Take the result of an earlier identify instead of sending one */
+    virtual void reuseIdentify(const OPAL_DiskInfo& disk_info) { (void)disk_info; }
 };
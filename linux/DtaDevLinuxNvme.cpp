@@ -28,9 +28,11 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include <unistd.h>
 #include <linux/hdreg.h>
 #include <errno.h>
+#include <limits.h>
 #include <vector>
 #include <fstream>
 #include "DtaDevLinuxNvme.h"
+#include "DtaDiskEnum.h"
 #include "DtaHexDump.h"
 
 #define  NVME_SECURITY_SEND 0x81
@@ -42,7 +44,11 @@ using namespace std;
 /** The Device class represents a single disk device.
  *  Linux specific implementation using the NVMe interface
  */
-DtaDevLinuxNvme::DtaDevLinuxNvme() {}
+DtaDevLinuxNvme::DtaDevLinuxNvme()
+{
+	fd = -1;
+	ctrlFd = -1;
+}
 
 bool DtaDevLinuxNvme::init(const char * devref)
 {
@@ -61,37 +67,83 @@ bool DtaDevLinuxNvme::init(const char * devref)
     }
     else {
         isOpen = TRUE;
+        openController(devref);
     }
 	return isOpen;
 }
 
-/** Send an ioctl to the device using nvme admin commands. */
-uint8_t DtaDevLinuxNvme::sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
-                         void * buffer, uint32_t bufferlen)
+void DtaDevLinuxNvme::openController(const char * devref)
 {
-    struct nvme_admin_cmd nvme_cmd;
-	int err;
+	unsigned int ctrl;
+	int end = 0;
+	char path[PATH_MAX];
+	DtaDiskEntry disk;
+	const char * uring = getenv("SEDUTIL_NVME_URING");
 
-    LOG(D1) << "Entering DtaDevLinuxNvme::sendCmd";
+	if ((NULL == uring) || strcmp(uring, "1") || !DtaIoLoop::get()->uring()) return;
+	/* security send/receive are admin commands, which the namespace
+	 * generic devices (/dev/ngXnY) refuse through io_uring, so they go to
+	 * the controller character device sysfs has the namespace under */
+	const char * name = realpath(devref, path) ? strrchr(path, '/') : NULL;
+	if ((NULL == name) || !DtaDiskLookup(name + 1, disk) ||
+		(1 != sscanf(disk.devref.c_str(), "/dev/nvme%u%n", &ctrl, &end)) ||
+		('\0' != disk.devref[end])) {
+		LOG(D1) << "No NVMe controller device for " << devref << ", using the ioctl";
+		return;
+	}
+	if (disk.devref == path)
+		ctrlFd = fd;
+	else if ((ctrlFd = open(disk.devref.c_str(), O_RDWR | O_CLOEXEC)) < 0) {
+		LOG(D1) << "Cannot open " << disk.devref << " " << errno << ", using the ioctl";
+		ctrlFd = -1;
+		return;
+	}
+	LOG(D1) << "Using io_uring passthrough on " << disk.devref << " for " << devref;
+}
 
-	memset(&nvme_cmd, 0, sizeof(nvme_cmd));
+void DtaDevLinuxNvme::closeController()
+{
+	if ((ctrlFd >= 0) && (ctrlFd != fd))
+		close(ctrlFd);
+	ctrlFd = -1;
+}
 
+/** Fill in a security send/receive admin command */
+static void nvmeSecurityCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+	void * buffer, uint32_t bufferlen, struct nvme_admin_cmd * nvme_cmd)
+{
+	memset(nvme_cmd, 0, sizeof(*nvme_cmd));
 	if (IF_RECV == cmd) {
 		LOG(D3) << "Security Receive Command";
-		nvme_cmd.opcode = NVME_SECURITY_RECV;
-		nvme_cmd.cdw10 = protocol << 24 | comID << 8;
-		nvme_cmd.cdw11 = bufferlen;
-		nvme_cmd.data_len = bufferlen;
-		nvme_cmd.addr = (__u64)buffer;
+		nvme_cmd->opcode = NVME_SECURITY_RECV;
 	}
 	else {
 		LOG(D3) << "Security Send Command";
-		nvme_cmd.opcode = NVME_SECURITY_SEND;
-		nvme_cmd.cdw10 = protocol << 24 | comID << 8;
-		nvme_cmd.cdw11 = bufferlen;
-		nvme_cmd.data_len = bufferlen;
-		nvme_cmd.addr = (__u64)buffer;
+		nvme_cmd->opcode = NVME_SECURITY_SEND;
 	}
+	nvme_cmd->cdw10 = protocol << 24 | comID << 8;
+	nvme_cmd->cdw11 = bufferlen;
+	nvme_cmd->data_len = bufferlen;
+	nvme_cmd->addr = (__u64)buffer;
+}
+
+/** Send an ioctl to the device using nvme admin commands. */
+uint8_t DtaDevLinuxNvme::sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+                         void * buffer, uint32_t bufferlen)
+{
+    struct nvme_admin_cmd nvme_cmd;
+	int err;
+
+    LOG(D1) << "Entering DtaDevLinuxNvme::sendCmd";
+
+	if (ctrlFd >= 0) {
+		/* run the loop until this command is done, other queued work proceeds meanwhile */
+		DtaIoWait w = { false, 0 };
+		submitCmd(cmd, protocol, comID, buffer, bufferlen, DtaIoLoop::waitDone, &w);
+		return (uint8_t)DtaIoLoop::get()->wait(&w);
+	}
+
+	nvmeSecurityCmd(cmd, protocol, comID, buffer, bufferlen, &nvme_cmd);
 
 	err = ioctl(fd, NVME_IOCTL_ADMIN_CMD, &nvme_cmd);
 	if (err < 0)
@@ -109,6 +161,81 @@ uint8_t DtaDevLinuxNvme::sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comI
 	return err;
 }
 
+/** A security command in flight through io_uring */
+typedef struct _DtaNvmeAsync {
+	DtaDevLinuxNvme * dev;
+	ATACOMMAND cmd;
+	uint8_t protocol;
+	uint16_t comID;
+	void * buffer;
+	uint32_t bufferlen;
+	DtaIoCallback cb;
+	void * ctx;
+} DtaNvmeAsync;
+
+void DtaDevLinuxNvme::submitCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+	void * buffer, uint32_t bufferlen, DtaIoCallback cb, void * ctx)
+{
+	struct nvme_admin_cmd admin;
+	struct nvme_uring_cmd nvme_cmd;
+
+	LOG(D1) << "Entering DtaDevLinuxNvme::submitCmd";
+	if (ctrlFd < 0) {
+		DtaDevLinuxDrive::submitCmd(cmd, protocol, comID, buffer, bufferlen, cb, ctx);
+		return;
+	}
+	nvmeSecurityCmd(cmd, protocol, comID, buffer, bufferlen, &admin);
+	memset(&nvme_cmd, 0, sizeof(nvme_cmd));
+	nvme_cmd.opcode = admin.opcode;
+	nvme_cmd.cdw10 = admin.cdw10;
+	nvme_cmd.cdw11 = admin.cdw11;
+	nvme_cmd.data_len = admin.data_len;
+	nvme_cmd.addr = admin.addr;
+
+	DtaNvmeAsync * op = new DtaNvmeAsync;
+	op->dev = this;
+	op->cmd = cmd;
+	op->protocol = protocol;
+	op->comID = comID;
+	op->buffer = buffer;
+	op->bufferlen = bufferlen;
+	op->cb = cb;
+	op->ctx = ctx;
+	int err = DtaIoLoop::get()->submitNvmeAdmin(ctrlFd, &nvme_cmd, uringDone, op);
+	if (err < 0) {
+		LOG(D1) << "io_uring submit failed " << -err << ", falling back to the ioctl";
+		delete op;
+		closeController();
+		DtaDevLinuxDrive::submitCmd(cmd, protocol, comID, buffer, bufferlen, cb, ctx);
+	}
+}
+
+void DtaDevLinuxNvme::uringDone(void * ctx, int32_t res)
+{
+	DtaNvmeAsync * op = (DtaNvmeAsync *)ctx;
+	uint8_t rc;
+
+	if ((-EOPNOTSUPP == res) || (-ENOTTY == res) || (-EINVAL == res)) {
+		/* the driver or kernel does not take passthrough on this device */
+		LOG(D1) << "io_uring passthrough rejected " << -res << ", falling back to the ioctl";
+		op->dev->closeController();
+		rc = op->dev->sendCmd(op->cmd, op->protocol, op->comID, op->buffer, op->bufferlen);
+	}
+	else if (res < 0)
+		rc = (uint8_t)-res;
+	else {
+		if (0 != res)
+			fprintf(stderr, "NVME Security Command Error:%d\n", res);
+		else
+			LOG(D3) << "NVME Security Command Success";
+		rc = (uint8_t)res;
+	}
+	DtaIoCallback cb = op->cb;
+	void * cbctx = op->ctx;
+	delete op;
+	cb(cbctx, rc);
+}
+
 void DtaDevLinuxNvme::identify(OPAL_DiskInfo& disk_info)
 {
 	LOG(D4) << "Entering DtaDevLinuxNvme::identify()";
@@ -150,5 +277,6 @@ void DtaDevLinuxNvme::identify(OPAL_DiskInfo& disk_info)
 DtaDevLinuxNvme::~DtaDevLinuxNvme()
 {
     LOG(D1) << "Destroying DtaDevLinuxNvme";
+    closeController();
     close(fd);
 }
@@ -30,6 +30,13 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 /** Linux specific implementation of DtaDevOS.
  * Uses the NVMe to send commands to the 
  * device 
+ *
+ * Security send/receive use the NVME_IOCTL_ADMIN_CMD ioctl.  With
+ * SEDUTIL_NVME_URING=1 in the environment, and a kernel that takes admin
+ * commands through io_uring on the controller character device
+ * (/dev/nvmeX), they are submitted with io_uring passthrough there
+ * instead.  sendCmd still waits for each command, so this changes the
+ * transport and not the number of commands in flight.
  */
 #define is_aligned(POINTER, BYTE_COUNT) \
     (((uintptr_t)(const void *)(POINTER)) % (BYTE_COUNT) == 0)
@@ -57,7 +64,26 @@ public:
      */
     uint8_t sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
             void * buffer, uint32_t bufferlen);
+    /** NVMe specific method to start a command through io_uring
+     * @param cmd command to be sent to the device
+     * @param protocol security protocol to be used in the command
+     * @param comID communications ID to be used
+     * @param buffer input/output buffer, must stay valid until cb runs
+     * @param bufferlen length of the input/output buffer
+     * @param cb called from the DtaIoLoop with the sendCmd return code
+     * @param ctx passed to cb
+     */
+    void submitCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+            void * buffer, uint32_t bufferlen, DtaIoCallback cb, void * ctx);
     /** NVMe specific routine to send an identify to the device */
     void identify(OPAL_DiskInfo& disk_info);
     int fd; /**< Linux handle for the device  */
+private:
+    /** Open the controller device for io_uring passthrough, if enabled */
+    void openController(const char * devref);
+    /** Stop using io_uring for this device */
+    void closeController();
+    /** DtaIoCallback for commands submitted through io_uring */
+    static void uringDone(void * ctx, int32_t res);
+    int ctrlFd; /**< controller device for io_uring passthrough, -1 to use the ioctl */
 };
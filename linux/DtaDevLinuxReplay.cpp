@@ -0,0 +1,175 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "DtaDevLinuxReplay.h"
+#include "DtaTrace.h"
+#include "DtaHexDump.h"
+
+using namespace std;
+
+/** A loaded trace and the position the devices playing it have reached */
+class DtaReplayTrace {
+public:
+	vector<DtaTraceEntry> entries;
+	size_t next; /**< index of the next record to play */
+	mutex lock;
+};
+
+static mutex replayRegistryLock;
+static map<string, DtaReplayTrace *> replayRegistry;
+
+/** trace file name part of a device reference */
+static string replayPath(const char * devref)
+{
+	string path = devref;
+	if (!path.compare(0, 7, "replay:")) path.erase(0, 7);
+	size_t colon = path.rfind(':');
+	if ((string::npos != colon) && (path.substr(colon + 1) == "realtime"))
+		path.erase(colon);
+	return path;
+}
+
+/** The Device class represents a drive played back from a trace.
+ */
+DtaDevLinuxReplay::DtaDevLinuxReplay()
+{
+	trace = NULL;
+	realtime = false;
+}
+
+bool DtaDevLinuxReplay::init(const char * devref)
+{
+	LOG(D1) << "Creating DtaDevLinuxReplay::DtaDev() " << devref;
+	string path = replayPath(devref);
+	string ref = devref;
+	realtime = ((ref.size() > 9) && (ref.substr(ref.size() - 9) == ":realtime"));
+	if (path.empty()) {
+		LOG(E) << "Replay device needs a trace file, e.g. replay:/tmp/sedutil.trace";
+		return FALSE;
+	}
+	lock_guard<mutex> guard(replayRegistryLock);
+	if (!replayRegistry.count(path)) {
+		DtaReplayTrace * t = new DtaReplayTrace;
+		if (DtaTraceRead(path.c_str(), t->entries)) {
+			delete t;
+			return FALSE;
+		}
+		t->next = 0;
+		replayRegistry[path] = t;
+	}
+	trace = replayRegistry[path];
+	return TRUE;
+}
+
+void DtaDevLinuxReplay::reset(const char * devref)
+{
+	string path = replayPath(devref);
+	lock_guard<mutex> guard(replayRegistryLock);
+	if (replayRegistry.count(path)) {
+		lock_guard<mutex> traceGuard(replayRegistry[path]->lock);
+		replayRegistry[path]->next = 0;
+	}
+}
+
+/** Check the command against the trace and play back the response. */
+uint8_t DtaDevLinuxReplay::sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+	void * buffer, uint32_t bufferlen)
+{
+	LOG(D1) << "Entering DtaDevLinuxReplay::sendCmd";
+	lock_guard<mutex> guard(trace->lock);
+	/* an IDENTIFY that was not asked for belongs to a device open we skipped */
+	while ((trace->next < trace->entries.size()) &&
+		(IDENTIFY == trace->entries[trace->next].rec.command))
+		trace->next++;
+	if (trace->next >= trace->entries.size()) {
+		LOG(E) << "Replay trace exhausted at " << ((IF_SEND == cmd) ? "IF_SEND" : "IF_RECV");
+		return DTAERROR_COMMAND_ERROR;
+	}
+	DtaTraceEntry & e = trace->entries[trace->next];
+	if ((e.rec.command != (uint8_t)cmd) || (e.rec.protocol != protocol) || (e.rec.comID != comID)) {
+		LOG(E) << "Replay mismatch at record " << trace->next << ": expected "
+			<< ((IF_SEND == e.rec.command) ? "IF_SEND" : "IF_RECV") << " protocol " << (uint16_t)e.rec.protocol
+			<< " comID " << hex << e.rec.comID << dec;
+		return DTAERROR_COMMAND_ERROR;
+	}
+	if (IF_SEND == cmd) {
+		uint32_t len = DtaTrace::captureLength(cmd, protocol, comID, buffer, bufferlen);
+		/* the recording has the credentials zeroed, compare like with like */
+		vector<uint8_t> sent((uint8_t *)buffer, (uint8_t *)buffer + len);
+		DtaTrace::redact(cmd, protocol, sent.data(), len);
+		uint32_t diff = 0;
+		while ((diff < len) && (diff < e.rec.dataLength) && (sent[diff] == e.data[diff]))
+			diff++;
+		if ((len != e.rec.dataLength) || (diff != len)) {
+			LOG(E) << "Replay mismatch at record " << trace->next << ": command differs at byte "
+				<< diff << " (length " << len << ", recorded " << e.rec.dataLength << ")";
+			IFLOG(D1) {
+				DtaHexDump(e.data.data(), e.rec.dataLength);
+				DtaHexDump(sent.data(), len);
+			}
+			return DTAERROR_COMMAND_ERROR;
+		}
+	}
+	else {
+		memset(buffer, 0, bufferlen);
+		memcpy(buffer, e.data.data(), (e.rec.dataLength < bufferlen) ? e.rec.dataLength : bufferlen);
+	}
+	trace->next++;
+	if (realtime) usleep((useconds_t)(e.rec.duration / 1000));
+	return e.rec.status;
+}
+
+void DtaDevLinuxReplay::identify(OPAL_DiskInfo& disk_info)
+{
+	LOG(D4) << "Entering DtaDevLinuxReplay::identify()";
+	lock_guard<mutex> guard(trace->lock);
+	if ((trace->next < trace->entries.size()) &&
+		(IDENTIFY == trace->entries[trace->next].rec.command) &&
+		(trace->entries[trace->next].rec.dataLength >= sizeof(DTA_TRACE_IDENTITY))) {
+		DTA_TRACE_IDENTITY * id = (DTA_TRACE_IDENTITY *)trace->entries[trace->next].data.data();
+		disk_info.devType = (DTA_DEVICE_TYPE)id->devType;
+		memcpy(disk_info.serialNum, id->serialNum, sizeof(disk_info.serialNum));
+		memcpy(disk_info.firmwareRev, id->firmwareRev, sizeof(disk_info.firmwareRev));
+		memcpy(disk_info.modelNum, id->modelNum, sizeof(disk_info.modelNum));
+		trace->next++;
+		return;
+	}
+	/* traces without an identity still replay, hashed passwords will not match */
+	LOG(W) << "Replay trace has no IDENTIFY record at " << trace->next;
+	disk_info.devType = DEVICE_TYPE_ATA;
+	memset(disk_info.serialNum, ' ', sizeof(disk_info.serialNum));
+	memcpy(disk_info.firmwareRev, "REPLAY  ", sizeof(disk_info.firmwareRev));
+	memset(disk_info.modelNum, ' ', sizeof(disk_info.modelNum));
+	memcpy(disk_info.modelNum, "sedutil trace replay", 20);
+	return;
+}
+
+/** Close the device reference so this object can be delete. */
+DtaDevLinuxReplay::~DtaDevLinuxReplay()
+{
+	LOG(D1) << "Destroying DtaDevLinuxReplay";
+}
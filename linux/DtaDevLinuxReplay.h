@@ -0,0 +1,68 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include "DtaStructures.h"
+#include "DtaDevLinuxDrive.h"
+
+class DtaReplayTrace;
+
+/** Linux specific implementation of DtaDevOS.
+ * Plays back a trace recorded with -t instead of talking to a drive.
+ * Each IF_SEND is checked against the recorded command and each IF_RECV
+ * returns the recorded response, so a session captured on a real drive
+ * can be rerun against the session, command and exec layers without it.
+ *
+ * The device reference is of the form replay:tracefile[:realtime]; with
+ * realtime every command takes as long as it did when it was recorded,
+ * otherwise responses are returned immediately. All devices opened on
+ * the same trace file share one position in it, as the devices opened
+ * by one sedutil run shared the drive when it was recorded.
+ */
+class DtaDevLinuxReplay: public DtaDevLinuxDrive{
+public:
+    /** Default constructor */
+    DtaDevLinuxReplay();
+    /** Destructor */
+    ~DtaDevLinuxReplay();
+    /** Replay specific initialization.
+     * Loads the trace file, the first device to use a trace reads it
+     * @param devref replay:tracefile[:realtime]
+     */
+    bool init(const char * devref);
+    /** Replay specific method to send a command to the device
+     * @param cmd command to be sent to the device
+     * @param protocol security protocol to be used in the command
+     * @param comID communications ID to be used
+     * @param buffer input/output buffer
+     * @param bufferlen length of the input/output buffer
+     */
+    uint8_t sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+            void * buffer, uint32_t bufferlen);
+    /** Replay specific routine to fill in the identify information
+     * from the next recorded IDENTIFY */
+    void identify(OPAL_DiskInfo& disk_info);
+    /** Start a trace over from its first record
+     * @param devref replay:tracefile[...] or just the trace file name
+     */
+    static void reset(const char * devref);
+private:
+    DtaReplayTrace * trace; /**< the trace this device plays back */
+    bool realtime; /**< reproduce the recorded command durations */
+};
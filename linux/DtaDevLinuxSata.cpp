@@ -19,6 +19,7 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
  * C:E********************************************************************** */
 #include "os.h"
 #include <malloc.h>
+#include <limits.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
@@ -32,7 +33,9 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include <errno.h>
 #include <vector>
 #include <fstream>
+#include <iomanip>
 #include "DtaDevLinuxSata.h"
+#include "DtaDiskEnum.h"
 #include "DtaHexDump.h"
 //
 // taken from <scsi/scsi.h> to avoid SCSI/ATA name collision
@@ -60,6 +63,10 @@ using namespace std;
  */
 DtaDevLinuxSata::DtaDevLinuxSata() {
 isSAS = 0;
+pt16 = 1;
+useDMA = 0;
+dmaVerified = 0;
+fd = -1;
 }
 
 bool DtaDevLinuxSata::init(const char * devref)
@@ -83,6 +90,15 @@ bool DtaDevLinuxSata::init(const char * devref)
     }
     else {
         isOpen = TRUE;
+        /* USB bridges are the SATLs most likely to mishandle the 16 byte
+         * CDB, they start with ATA PASS-THROUGH(12) */
+        char path[PATH_MAX];
+        DtaDiskEntry disk;
+        const char * name = realpath(devref, path) ? strrchr(path, '/') : NULL;
+        if ((NULL != name) && DtaDiskLookup(name + 1, disk) && ("usb" == disk.transport)) {
+            LOG(D1) << devref << " is behind a USB bridge, using ATA PASS-THROUGH(12)";
+            pt16 = 0;
+        }
     }
 	return isOpen;
 }
@@ -91,26 +107,85 @@ bool DtaDevLinuxSata::init(const char * devref)
 uint8_t DtaDevLinuxSata::sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
                          void * buffer, uint32_t bufferlen)
 {
-    if(isSAS) {
-        return(sendCmd_SAS(cmd, protocol, comID, buffer, bufferlen));
-    }
-    sg_io_hdr_t sg;
-    uint8_t sense[32]; // how big should this be??
-    uint8_t cdb[12];
+    DtaSgCmd s;
+    uint8_t rc;
 
     LOG(D1) << "Entering DtaDevLinuxSata::sendCmd";
-    memset(&cdb, 0, sizeof (cdb));
-    memset(&sense, 0, sizeof (sense));
-    memset(&sg, 0, sizeof (sg));
+    do {
+        if (!prepare(cmd, protocol, comID, buffer, bufferlen, &s)) {
+            rc = 0xff;
+            break;
+        }
+        /*
+         * Do the IO
+         */
+        if (ioctl(fd, SG_IO, &s.sg) < 0) {
+            LOG(D4) << "cdb after ";
+            IFLOG(D4) DtaHexDump(s.cdb, sizeof (s.cdb));
+            LOG(D4) << "sense after ";
+            IFLOG(D4) DtaHexDump(s.sense, sizeof (s.sense));
+            rc = 0xff;
+            break;
+        }
+        rc = result(&s);
+    } while (fallback(&s, rc));
+    return rc;
+}
+
+/** Build an ATA PASS-THROUGH(16)/(12) or SCSI SECURITY PROTOCOL IN/OUT command */
+bool DtaDevLinuxSata::prepare(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+                         void * buffer, uint32_t bufferlen, DtaSgCmd * s)
+{
+    sg_io_hdr_t &sg = s->sg;
+    uint8_t * cdb = s->cdb;
+    uint8_t cdbLen = 12;
+
+    memset(s, 0, sizeof (*s));
+    if (isSAS) {
+        // initialize SCSI CDB
+        switch(cmd)
+        {
+        default:
+        {
+            return false;
+        }
+        case IF_RECV:
+        {
+            auto * p = (CScsiCmdSecurityProtocolIn *) cdb;
+            p->m_Opcode = p->OPCODE;
+            p->m_SecurityProtocol = protocol;
+            p->m_SecurityProtocolSpecific = htons(comID);
+            p->m_INC_512 = 1;
+            p->m_AllocationLength = htonl(bufferlen/512);
+            break;
+        }
+        case IF_SEND:
+        {
+            auto * p = (CScsiCmdSecurityProtocolOut *) cdb;
+            p->m_Opcode = p->OPCODE;
+            p->m_SecurityProtocol = protocol;
+            p->m_SecurityProtocolSpecific = htons(comID);
+            p->m_INC_512 = 1;
+            p->m_TransferLength = htonl(bufferlen/512);
+            break;
+        }
+        }
+        sg.dxfer_direction = cmd == IF_RECV ? SG_DXFER_FROM_DEV : SG_DXFER_TO_DEV;
+    }
+    else {
     /*
      * Initialize the CDB as described in SAT-2 and the
      * ATA Command set reference (protocol and commID placement)
      * We need a few more standards bodies --NOT--
+     *
+     * TRUSTED SEND/RECEIVE carry the transfer length (in 512b blocks) in
+     * COUNT (7:0) and LBA (7:0), and the comID in LBA (23:8).  The 16 bit
+     * length is not reached today: MAX_BUFFER_LENGTH is 60 KiB, 120
+     * blocks, so no ComPacket is larger than the 12 byte CDB carries.
      */
-
-    cdb[0] = 0xa1; // ata pass through(12)
+    uint16_t count = bufferlen / 512;
     /*
-     * Byte 1 is the protocol 4 = PIO IN and 5 = PIO OUT
+     * Byte 1 is the protocol 4 = PIO IN, 5 = PIO OUT and 6 = DMA
      * Byte 2 is:
      * bits 7-6 OFFLINE - Amount of time the command can take the bus offline
      * bit 5    CK_COND - If set the command will always return a condition check
@@ -119,67 +194,123 @@ uint8_t DtaDevLinuxSata::sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comI
      * bit 2    BYTE_BLock  1 = transfer in blocks, 0 transfer in bytes
      * bits 1-0 T_LENGTH -  10 = the length id in sector count
      */
-    if (IF_RECV == cmd) {
-        cdb[1] = 4 << 1; // PIO DATA IN
-        cdb[2] = 0x0E; // T_DIR = 1, BYTE_BLOCK = 1, Length in Sector Count
-        sg.dxfer_direction = SG_DXFER_FROM_DEV;
+    uint8_t ataProtocol = useDMA ? 6 : ((IF_RECV == cmd) ? 4 : 5);
+    uint8_t flags = (IF_RECV == cmd) ? 0x0E : 0x06;
+    uint8_t command = useDMA ? (cmd | 0x01) : cmd; // TRUSTED SEND/RECEIVE (DMA)
+    sg.dxfer_direction = (IF_RECV == cmd) ? SG_DXFER_FROM_DEV : SG_DXFER_TO_DEV;
+    if (pt16) {
+        cdb[0] = 0x85; // ata pass through(16)
+        // EXTEND = 1 so the SATL passes the 16 bit COUNT and LBA fields
+        // whole; the upper bytes are 0 and a 28 bit command ignores them
+        cdb[1] = (ataProtocol << 1) | 0x01;
+        cdb[2] = flags;
+        cdb[4] = protocol; // FEATURES (7:0) / TRUSTED S/R security protocol
+        cdb[6] = (count & 0x00ff); // COUNT (7:0) / transfer length (7:0)
+        cdb[8] = ((count & 0xff00) >> 8); // LBA (7:0) / transfer length (15:8)
+        cdb[10] = (comID & 0x00ff); // LBA (15:8)
+        cdb[12] = ((comID & 0xff00) >> 8); // LBA (23:16)
+        //      cdb[13] = 0x00;              // device
+        cdb[14] = command;
+        //      cdb[15] = 0x00;              // control
+        cdbLen = 16;
     }
     else {
-        cdb[1] = 5 << 1; // PIO DATA OUT
-        cdb[2] = 0x06; // T_DIR = 0, BYTE_BLOCK = 1, Length in Sector Count
-        sg.dxfer_direction = SG_DXFER_TO_DEV;
-    }
+    cdb[0] = 0xa1; // ata pass through(12)
+    cdb[1] = ataProtocol << 1;
+    cdb[2] = flags;
     cdb[3] = protocol; // ATA features / TRUSTED S/R security protocol
-    cdb[4] = bufferlen / 512; // Sector count / transfer length (512b blocks)
-    //      cdb[5] = reserved;
+    cdb[4] = (count & 0x00ff); // Sector count / transfer length (7:0)
+    cdb[5] = ((count & 0xff00) >> 8); // LBA low / transfer length (15:8)
     cdb[7] = ((comID & 0xff00) >> 8);
     cdb[6] = (comID & 0x00ff);
     //      cdb[8] = 0x00;              // device
-    cdb[9] = cmd; // IF_SEND/IF_RECV
+    cdb[9] = command; // IF_SEND/IF_RECV
     //      cdb[10] = 0x00;              // reserved
     //      cdb[11] = 0x00;              // control
+    }
+    }
     /*
      * Set up the SCSI Generic structure
      * see the SG HOWTO for the best info I could find
      */
     sg.interface_id = 'S';
-    //      sg.dxfer_direction = Set in if above
-    sg.cmd_len = sizeof (cdb);
-    sg.mx_sb_len = sizeof (sense);
+    //      sg.dxfer_direction = Set above
+    sg.cmd_len = cdbLen;
+    sg.mx_sb_len = sizeof (s->sense);
     sg.iovec_count = 0;
     sg.dxfer_len = bufferlen;
     sg.dxferp = buffer;
-    sg.cmdp = cdb;
-    sg.sbp = sense;
+    sg.cmdp = s->cdb;
+    sg.sbp = s->sense;
     sg.timeout = 60000;
     sg.flags = 0;
     sg.pack_id = 0;
     sg.usr_ptr = NULL;
-    //    LOG(D4) << "cdb before ";
-    //    IFLOG(D4) hexDump(cdb, sizeof (cdb));
-    //    LOG(D4) << "sg before ";
-    //    IFLOG(D4) hexDump(&sg, sizeof (sg));
-    /*
-     * Do the IO
-     */
-    if (ioctl(fd, SG_IO, &sg) < 0) {
-        LOG(D4) << "cdb after ";
-        IFLOG(D4) DtaHexDump(cdb, sizeof (cdb));
-        LOG(D4) << "sense after ";
-        IFLOG(D4) DtaHexDump(sense, sizeof (sense));
-        return 0xff;
+    return true;
+}
+
+/** Turn a completed pass-through command into a sendCmd return code */
+uint8_t DtaDevLinuxSata::result(DtaSgCmd * s)
+{
+    uint8_t * sense = s->sense;
+    if (isSAS) {
+        // check for successful target completion
+        if (s->sg.masked_status != GOOD)
+        {
+            LOG(D4) << "cdb after ";
+            IFLOG(D4) DtaHexDump(s->cdb, sizeof (s->cdb));
+            LOG(D4) << "sense after ";
+            IFLOG(D4) DtaHexDump(sense, sizeof (s->sense));
+            return 0xff;
+        }
+        // success
+        return 0x00;
     }
-    //    LOG(D4) << "cdb after ";
-    //    IFLOG(D4) hexDump(cdb, sizeof (cdb));
-    //    LOG(D4) << "sg after ";
-    //    IFLOG(D4) hexDump(&sg, sizeof (sg));
-    //    LOG(D4) << "sense after ";
-    //    IFLOG(D4) hexDump(sense, sizeof (sense));
     if (!((0x00 == sense[0]) && (0x00 == sense[1])))
         if (!((0x72 == sense[0]) && (0x0b == sense[1]))) return 0xff; // not ATA response
     return (sense[11]);
 }
 
+/** Check a failed ATA command for a pass-through variant the device or
+ * SATL does not support and drop back to the next one down: ATA
+ * PASS-THROUGH(16) to (12), then TRUSTED SEND/RECEIVE DMA to PIO.
+ * @return true if the command should be sent again
+ */
+bool DtaDevLinuxSata::fallback(DtaSgCmd * s, uint8_t rc)
+{
+    uint8_t * sense = s->sense;
+    uint8_t key, asc;
+
+    if (isSAS) return false;
+    uint8_t ataProtocol = (s->cdb[1] >> 1) & 0x0f;
+    if ((0 == rc) && (6 == ataProtocol)) dmaVerified = 1;
+    if (0 == rc) return false;
+    if (((sense[0] & 0x7f) == 0x72) || ((sense[0] & 0x7f) == 0x73)) {
+        key = sense[1] & 0x0f;
+        asc = sense[2];
+    }
+    else {
+        key = sense[2] & 0x0f;
+        asc = sense[12];
+    }
+    if ((0x85 == s->cdb[0]) && (0x05 == key) && ((0x20 == asc) || (0x24 == asc))) {
+        // ILLEGAL REQUEST, INVALID COMMAND OPERATION CODE or INVALID
+        // FIELD IN CDB from a SATL that does not take EXTEND
+        LOG(D1) << "ATA PASS-THROUGH(16) rejected, using ATA PASS-THROUGH(12)";
+        pt16 = 0;
+        return true;
+    }
+    if ((6 == ataProtocol) && !dmaVerified &&
+        (((0xff != rc) && (rc & 0x04)) || (0x05 == key))) {
+        // ABRT or ILLEGAL REQUEST on the first DMA command, the drive
+        // or SATL does not take them
+        LOG(D1) << "TRUSTED SEND/RECEIVE DMA aborted, using PIO";
+        useDMA = 0;
+        return true;
+    }
+    return false;
+}
+
 void DtaDevLinuxSata::identify(OPAL_DiskInfo& disk_info)
 {
      sg_io_hdr_t sg;
@@ -295,91 +426,110 @@ for (unsigned int i = 0; i < sizeof (disk_info.modelNum); i += 2) {
     disk_info.modelNum[i] = id->modelNum[i + 1];
     disk_info.modelNum[i + 1] = id->modelNum[i];
 }
+    // word 48 bit 0: Trusted Computing feature set (TRUSTED SEND/RECEIVE DMA)
+    // word 49 bit 8: DMA supported
+    uint16_t tcg = buffer[96] | (buffer[97] << 8);
+    uint16_t caps = buffer[98] | (buffer[99] << 8);
+    if ((0x4000 == (tcg & 0xc000)) && (tcg & 0x0001) && (caps & 0x0100)) {
+        LOG(D1) << "Using TRUSTED SEND/RECEIVE DMA";
+        useDMA = 1;
+    }
 
     free(buffer);
     return;
 }
-/** Send an ioctl to the device using pass through. */
-uint8_t DtaDevLinuxSata::sendCmd_SAS(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
-                         void * buffer, uint32_t bufferlen)
+void DtaDevLinuxSata::reuseIdentify(const OPAL_DiskInfo& disk_info)
 {
-    sg_io_hdr_t sg;
-    uint8_t sense[32]; // how big should this be??
-    uint8_t cdb[12];
-
-    LOG(D1) << "Entering DtaDevLinuxSara::sendCmd_SAS";
-    memset(&cdb, 0, sizeof (cdb));
-    memset(&sense, 0, sizeof (sense));
-    memset(&sg, 0, sizeof (sg));
-
-  
-        // initialize SCSI CDB
-        switch(cmd)
-        {
-        default:
-        {
-            return 0xff;
-        }
-        case IF_RECV:
-        {
-            auto * p = (CScsiCmdSecurityProtocolIn *) cdb;
-            p->m_Opcode = p->OPCODE;
-            p->m_SecurityProtocol = protocol;
-            p->m_SecurityProtocolSpecific = htons(comID);
-            p->m_INC_512 = 1;
-            p->m_AllocationLength = htonl(bufferlen/512);
-            break;
-        }
-        case IF_SEND:
-        {
-            auto * p = (CScsiCmdSecurityProtocolOut *) cdb;
-            p->m_Opcode = p->OPCODE;
-            p->m_SecurityProtocol = protocol;
-            p->m_SecurityProtocolSpecific = htons(comID);
-            p->m_INC_512 = 1;
-            p->m_TransferLength = htonl(bufferlen/512);
-            break;
-        }
-        }
-
-        // fill out SCSI Generic structure
-        sg.interface_id = 'S';
-        sg.dxfer_direction = cmd == IF_RECV ? SG_DXFER_FROM_DEV : SG_DXFER_TO_DEV;
-        sg.cmd_len = sizeof (cdb);
-        sg.mx_sb_len = sizeof (sense);
-        sg.iovec_count = 0;
-        sg.dxfer_len = bufferlen;
-        sg.dxferp = buffer;
-        sg.cmdp = cdb;
-        sg.sbp = sense;
-        sg.timeout = 60000;
-        sg.flags = 0;
-        sg.pack_id = 0;
-        sg.usr_ptr = NULL;
-
-        // execute I/O
-        if (ioctl(fd, SG_IO, &sg) < 0) {
-            LOG(D4) << "cdb after ";
-            IFLOG(D4) DtaHexDump(cdb, sizeof (cdb));
-            LOG(D4) << "sense after ";
-            IFLOG(D4) DtaHexDump(sense, sizeof (sense));
-            return 0xff;
+    LOG(D4) << "Entering DtaDevLinuxSata::reuseIdentify()";
+    isSAS = (DEVICE_TYPE_SAS == disk_info.devType) ? 1 : 0;
+    useDMA = 0;
+}
+DTA_POWER_MODE DtaDevLinuxSata::powerMode(bool scsi)
+{
+    DtaSgCmd s;
+    uint8_t buffer[252];
+    uint8_t key, asc, ascq, count;
+
+    LOG(D1) << "Entering DtaDevLinuxSata::powerMode()";
+    memset(&s, 0, sizeof (s));
+    memset(buffer, 0, sizeof (buffer));
+    s.sg.interface_id = 'S';
+    s.sg.mx_sb_len = sizeof (s.sense);
+    s.sg.cmdp = s.cdb;
+    s.sg.sbp = s.sense;
+    s.sg.timeout = 10000;
+    if (scsi) {
+        /* REQUEST SENSE reports the power condition and does not end it */
+        s.cdb[0] = 0x03;
+        s.cdb[4] = sizeof (buffer);
+        s.sg.cmd_len = 6;
+        s.sg.dxfer_direction = SG_DXFER_FROM_DEV;
+        s.sg.dxfer_len = sizeof (buffer);
+        s.sg.dxferp = buffer;
+        if ((ioctl(fd, SG_IO, &s.sg) < 0) || (s.sg.masked_status != GOOD))
+            return DTA_POWER_UNKNOWN;
+        if (((buffer[0] & 0x7f) == 0x72) || ((buffer[0] & 0x7f) == 0x73)) {
+            key = buffer[1] & 0x0f;
+            asc = buffer[2];
+            ascq = buffer[3];
         }
-    
-        // check for successful target completion
-        if (sg.masked_status != GOOD)
-        {
-            LOG(D4) << "cdb after ";
-            IFLOG(D4) DtaHexDump(cdb, sizeof (cdb));
-            LOG(D4) << "sense after ";
-            IFLOG(D4) DtaHexDump(sense, sizeof (sense));
-            return 0xff;
+        else {
+            key = buffer[2] & 0x0f;
+            asc = buffer[12];
+            ascq = buffer[13];
         }
-
-        // success
-        return 0x00;
+        if ((0 != key) || (0x5e != asc)) return DTA_POWER_ACTIVE;
+        // LOW POWER CONDITION ON, the STANDBY and STANDBY_Y qualifiers
+        if ((0x02 == ascq) || (0x04 == ascq) || (0x09 == ascq) || (0x0a == ascq))
+            return DTA_POWER_STANDBY;
+        return DTA_POWER_IDLE;
+    }
+    /*
+     * CHECK POWER MODE is non-data, CK_COND = 1 returns the ATA
+     * registers in the sense data with the power mode in COUNT
+     */
+    s.sg.dxfer_direction = SG_DXFER_NONE;
+    if (pt16) {
+        s.cdb[0] = 0x85; // ata pass through(16)
+        s.cdb[1] = 3 << 1; // non-data
+        s.cdb[2] = 0x20; // CK_COND
+        s.cdb[14] = 0xe5;
+        s.sg.cmd_len = 16;
+    }
+    else {
+        s.cdb[0] = 0xa1; // ata pass through(12)
+        s.cdb[1] = 3 << 1;
+        s.cdb[2] = 0x20;
+        s.cdb[9] = 0xe5;
+        s.sg.cmd_len = 12;
+    }
+    if (ioctl(fd, SG_IO, &s.sg) < 0) return DTA_POWER_UNKNOWN;
+    if ((0x72 == (s.sense[0] & 0x7f)) && (0x09 == s.sense[8]))
+        count = s.sense[13]; // ATA Status Return descriptor
+    else if ((0x70 == (s.sense[0] & 0x7f)) && (0x00 == s.sense[12]) && (0x1d == s.sense[13]))
+        count = s.sense[6]; // fixed format ATA PASS THROUGH INFORMATION AVAILABLE
+    else {
+        IFLOG(D4) DtaHexDump(s.sense, sizeof (s.sense));
+        return DTA_POWER_UNKNOWN;
     }
-    
+    LOG(D1) << "CHECK POWER MODE count " << HEXON(2) << (uint16_t)count << HEXOFF;
+    switch (count) {
+    case 0x00: // standby
+    case 0x01: // standby_y
+    case 0x40: // NV cache power mode, spun down
+    case 0x41:
+        return DTA_POWER_STANDBY;
+    case 0x80: // idle
+    case 0x81: // idle_a
+    case 0x82: // idle_b
+    case 0x83: // idle_c
+        return DTA_POWER_IDLE;
+    case 0xff:
+        return DTA_POWER_ACTIVE;
+    default:
+        return DTA_POWER_UNKNOWN;
+    }
+}
 static void safecopy(uint8_t * dst, size_t dstsize, uint8_t * src, size_t srcsize)
 {
     const size_t size = min(dstsize, srcsize);
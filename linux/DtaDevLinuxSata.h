@@ -18,12 +18,32 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 
  * C:E********************************************************************** */
 #pragma once
+#include <scsi/sg.h>
 #include "DtaStructures.h"
 #include "DtaDevLinuxDrive.h"
 
+/** A SCSI generic command with its CDB and sense buffer */
+typedef struct _DtaSgCmd {
+    sg_io_hdr_t sg;
+    uint8_t cdb[16];
+    uint8_t sense[32]; // how big should this be??
+} DtaSgCmd;
+
+/** Power condition of a disk, see DtaDevLinuxSata::powerMode */
+typedef enum _DTA_POWER_MODE {
+    DTA_POWER_UNKNOWN, /**< the disk did not say */
+    DTA_POWER_ACTIVE, /**< active or idle with the media spinning */
+    DTA_POWER_IDLE, /**< in an idle condition, commands may have to wait */
+    DTA_POWER_STANDBY, /**< spun down, media access will spin it up */
+} DTA_POWER_MODE;
+
 /** Linux specific implementation of DtaDevOS.
  * Uses the SCSI generic ioctls to send commands to the 
  * device 
+ *
+ * ATA security commands use ATA PASS-THROUGH(16), or (12) if the SATL
+ * rejects it, and TRUSTED SEND/RECEIVE DMA when IDENTIFY reports the
+ * Trusted Computing feature set and DMA.
  */
 class DtaDevLinuxSata: public DtaDevLinuxDrive {
 public:
@@ -51,10 +71,33 @@ public:
             void * buffer, uint32_t bufferlen);
     /** Linux specific routine to send an ATA identify to the device */
     void identify(OPAL_DiskInfo& disk_info);
-    uint8_t sendCmd_SAS(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
-            void * buffer, uint32_t bufferlen);
     /** Linux specific routine to send an ATA identify to the device */
     void identify_SAS(OPAL_DiskInfo *disk_info);
+    /** Pick ATA or SCSI security commands from a cached identify,
+     * DMA is not known without identify so PIO is used */
+    void reuseIdentify(const OPAL_DiskInfo& disk_info);
+    /** Ask for the power condition without changing it.
+     * ATA disks get CHECK POWER MODE, SCSI disks REQUEST SENSE, neither
+     * touches the media so a disk in standby stays spun down.  Only
+     * needs init(), not identify().
+     * @param scsi the disk is SCSI (SAS) rather than ATA behind a SATL
+     */
+    DTA_POWER_MODE powerMode(bool scsi);
     int fd; /**< Linux handle for the device  */
     int isSAS; /* The device is sas */
+private:
+    /** Fill in the ATA PASS-THROUGH(12) or SECURITY PROTOCOL IN/OUT command
+     * @return false if cmd cannot be sent to this device
+     */
+    bool prepare(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+            void * buffer, uint32_t bufferlen, DtaSgCmd * s);
+    /** sendCmd return code of a completed command */
+    uint8_t result(DtaSgCmd * s);
+    /** Drop to a pass-through variant the device supports after a failure
+     * @return true if the command should be sent again
+     */
+    bool fallback(DtaSgCmd * s, uint8_t rc);
+    int pt16; /**< use ATA PASS-THROUGH(16) */
+    int useDMA; /**< use TRUSTED SEND/RECEIVE DMA */
+    int dmaVerified; /**< a DMA command has completed successfully */
 };
@@ -0,0 +1,891 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "DtaDevLinuxSim.h"
+#include "DtaEndianFixup.h"
+#include "DtaLexicon.h"
+#include "DtaResponse.h"
+#include "DtaHexDump.h"
+
+using namespace std;
+
+/* UIDs the simulator needs that are not in DtaLexicon.h */
+#define SIM_SYNCSESSION     0x000000000000ff03ULL
+#define SIM_SP_TABLE        0x0000020500000000ULL
+#define SIM_AUTHORITY_TABLE 0x0000000900000000ULL
+#define SIM_C_PIN_TABLE     0x0000000b00000000ULL
+#define SIM_C_PIN_PSID      0x0000000b0001ff01ULL
+#define SIM_ACE_TABLE       0x0000000800000000ULL
+#define SIM_ADMIN_AUTH      0x0000000900010000ULL
+#define SIM_USER_AUTH       0x0000000900030000ULL
+#define SIM_LOCKING_RANGE   0x0000080200030000ULL
+#define SIM_K_AES_GLOBAL    0x0000080600000001ULL
+#define SIM_K_AES_RANGE     0x0000080600030000ULL
+#define SIM_TABLE_MASK      0xffffffff00000000ULL
+
+#define SIM_BASECOMID  0x1000
+#define SIM_NUMCOMIDS  4
+#define SIM_MAXRANGES  8
+#define SIM_NUMADMINS  4
+#define SIM_NUMUSERS   9
+#define SIM_MAXMETHODS 8
+#define SIM_MBRSIZE    (128 * 1024 * 1024)
+/* Life cycle states from the SP table */
+#define SIM_MANUFACTURED_INACTIVE 0x08
+#define SIM_MANUFACTURED          0x09
+
+typedef map<uint32_t, vector<uint8_t> > SimRow; /**< column -> encoded value */
+
+/** A session open on one of the simulated TPer's comIDs */
+typedef struct _SimSession {
+	uint32_t TSN;
+	uint32_t HSN;
+	uint64_t SP;
+	uint64_t authority;
+} SimSession;
+
+/** The state of a simulated Opal 2.0 TPer.
+ * Tables are modeled as rows of encoded column values keyed by the object
+ * UID, which is all the sedutil methods need. Access control is reduced to
+ * "authenticated sessions may Set, PINs other than MSID cannot be read".
+ */
+class DtaSimTPer {
+public:
+	DtaSimTPer(string simname);
+	/** reset everything but the MSID and PSID */
+	void factory();
+	/** IF_SEND on protocol 1 */
+	void submit(uint16_t comID, uint8_t * buffer, uint32_t bufferlen, uint32_t busyPolls);
+	/** IF_RECV on protocol 1 */
+	void receive(uint16_t comID, uint8_t * buffer, uint32_t bufferlen);
+	/** Level 0 discovery */
+	void discovery0(uint8_t * buffer, uint32_t bufferlen);
+	/** IF_SEND on protocol 2, VERIFY_COMID_VALID and STACK_RESET */
+	void comIDRequest(uint16_t comID, uint8_t * buffer, uint32_t bufferlen);
+	/** IF_RECV on protocol 2 */
+	void comIDResponse(uint16_t comID, uint8_t * buffer, uint32_t bufferlen);
+	mutex lock; /**< serializes the devices attached to this TPer */
+	string name; /**< the name the TPer is registered under */
+private:
+	void resetLockingSP();
+	void setRow(uint64_t uid, uint64_t sp, uint32_t col, uint64_t value);
+	void setRow(uint64_t uid, uint64_t sp, uint32_t col, const string &value);
+	uint64_t getRow(uint64_t uid, uint32_t col);
+	uint8_t checkAuth(uint64_t sp, uint64_t authority, DtaResponse &cmd, uint32_t challenge);
+	uint8_t properties(DtaResponse &cmd, vector<uint8_t> &reply);
+	uint8_t startSession(uint16_t comID, DtaResponse &cmd, vector<uint8_t> &reply);
+	uint8_t method(SimSession &s, uint64_t invoker, uint64_t method,
+		DtaResponse &cmd, vector<uint8_t> &reply, uint8_t &endSession);
+	uint8_t get(SimSession &s, uint64_t invoker, DtaResponse &cmd, vector<uint8_t> &reply);
+	uint8_t set(SimSession &s, uint64_t invoker, DtaResponse &cmd, vector<uint8_t> &reply);
+	string msid; /**< manufacturer assigned SID credential */
+	string psid; /**< physical presence SID credential */
+	map<uint64_t, SimRow> rows; /**< table rows keyed by object UID */
+	map<uint64_t, uint64_t> rowSP; /**< the SP each row belongs to */
+	vector<uint8_t> mbr; /**< shadow MBR table, grown as it is written */
+	map<uint16_t, SimSession> sessions; /**< open session per comID */
+	map<uint16_t, vector<uint8_t> > pending; /**< ComPacket waiting for IF_RECV */
+	map<uint16_t, uint32_t> polls; /**< IF_RECVs left to answer with outstanding data */
+	map<uint16_t, vector<uint8_t> > comIDPending; /**< protocol 2 response waiting for IF_RECV */
+	uint32_t nextTSN;
+};
+
+static mutex simRegistryLock;
+static map<string, DtaSimTPer *> simRegistry;
+
+/* token encoding, mirrors DtaCommand::addToken() */
+static void simAtom(vector<uint8_t> &buf, uint64_t number)
+{
+	int startat = 0;
+	if (number < 64) {
+		buf.push_back((uint8_t)number & 0x3f);
+		return;
+	}
+	if (number < 0x100) {
+		buf.push_back(0x81);
+		startat = 0;
+	}
+	else if (number < 0x10000) {
+		buf.push_back(0x82);
+		startat = 1;
+	}
+	else if (number < 0x100000000) {
+		buf.push_back(0x84);
+		startat = 3;
+	}
+	else {
+		buf.push_back(0x88);
+		startat = 7;
+	}
+	for (int i = startat; i > -1; i--)
+		buf.push_back((uint8_t)((number >> (i * 8)) & 0xff));
+}
+static void simBytes(vector<uint8_t> &buf, const void * data, uint32_t len)
+{
+	if (len < 16) {
+		buf.push_back(0xa0 | (uint8_t)len);
+	}
+	else if (len < 2048) {
+		buf.push_back(0xd0 | (uint8_t)((len >> 8) & 0x07));
+		buf.push_back((uint8_t)(len & 0xff));
+	}
+	else {
+		buf.push_back(0xe2);
+		buf.push_back((uint8_t)((len >> 16) & 0xff));
+		buf.push_back((uint8_t)((len >> 8) & 0xff));
+		buf.push_back((uint8_t)(len & 0xff));
+	}
+	buf.insert(buf.end(), (const uint8_t *)data, (const uint8_t *)data + len);
+}
+static void simUid(vector<uint8_t> &buf, uint64_t uid)
+{
+	buf.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
+	for (int i = 7; i > -1; i--)
+		buf.push_back((uint8_t)((uid >> (i * 8)) & 0xff));
+}
+static uint64_t simUidValue(const uint8_t * uid)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < 8; i++)
+		value = (value << 8) | uid[i];
+	return value;
+}
+static void simStatus(vector<uint8_t> &buf, uint8_t status)
+{
+	if (status) {
+		/* failed methods return an empty result list */
+		buf.clear();
+		buf.push_back(OPAL_TOKEN::STARTLIST);
+		buf.push_back(OPAL_TOKEN::ENDLIST);
+	}
+	buf.push_back(OPAL_TOKEN::ENDOFDATA);
+	buf.push_back(OPAL_TOKEN::STARTLIST);
+	buf.push_back(status);
+	buf.push_back(0x00);
+	buf.push_back(0x00);
+	buf.push_back(OPAL_TOKEN::ENDLIST);
+}
+
+/* token decoding on top of DtaResponse, bounds checked so a malformed
+ * command can't take the simulator down */
+static uint8_t simIs(DtaResponse &cmd, uint32_t i, OPAL_TOKEN t)
+{
+	return ((i < cmd.getTokenCount()) && (t == cmd.tokenIs(i)));
+}
+static uint64_t simUidOf(DtaResponse &cmd, uint32_t i)
+{
+	if (!simIs(cmd, i, OPAL_TOKEN::DTA_TOKENID_BYTESTRING) || (9 != cmd.getLength(i)))
+		return 0;
+	return simUidValue(cmd.getRawToken(i).data() + 1);
+}
+static uint64_t simUintOf(DtaResponse &cmd, uint32_t i)
+{
+	if (!simIs(cmd, i, OPAL_TOKEN::DTA_TOKENID_UINT) || (cmd.getLength(i) > 9))
+		return 0;
+	return cmd.getUint64(i);
+}
+static string simStringOf(DtaResponse &cmd, uint32_t i)
+{
+	if (!simIs(cmd, i, OPAL_TOKEN::DTA_TOKENID_BYTESTRING))
+		return string();
+	return cmd.getString(i);
+}
+/* index of the token following the value (atom, list or name) at i */
+static uint32_t simSkip(DtaResponse &cmd, uint32_t i)
+{
+	int depth = 0;
+	do {
+		if (i >= cmd.getTokenCount()) return i;
+		OPAL_TOKEN t = cmd.tokenIs(i);
+		if ((OPAL_TOKEN::STARTLIST == t) || (OPAL_TOKEN::STARTNAME == t)) depth++;
+		if ((OPAL_TOKEN::ENDLIST == t) || (OPAL_TOKEN::ENDNAME == t)) depth--;
+		i++;
+	} while (depth > 0);
+	return i;
+}
+/* the encoded value at i, lists are kept whole */
+static vector<uint8_t> simValueOf(DtaResponse &cmd, uint32_t i)
+{
+	vector<uint8_t> value, token;
+	uint32_t end = simSkip(cmd, i);
+	for (; i < end; i++) {
+		token = cmd.getRawToken(i);
+		value.insert(value.end(), token.begin(), token.end());
+	}
+	return value;
+}
+/* decode a stored uinteger column */
+static uint64_t simValueUint(const vector<uint8_t> &value)
+{
+	uint64_t number = 0;
+	if (value.empty()) return 0;
+	if (!(value[0] & 0x80)) return value[0] & 0x3f;
+	if ((value[0] & 0xc0) != 0x80) return 0;
+	for (uint32_t i = 1; i < value.size(); i++)
+		number = (number << 8) | value[i];
+	return number;
+}
+/* payload of a stored bytestring column */
+static string simValueString(const vector<uint8_t> &value)
+{
+	uint32_t overhead;
+	if (value.empty() || !(value[0] & 0x80)) return string();
+	if (!(value[0] & 0x40)) overhead = 1;
+	else if (!(value[0] & 0x20)) overhead = 2;
+	else overhead = 4;
+	if (value.size() < overhead) return string();
+	return string(value.begin() + overhead, value.end());
+}
+
+DtaSimTPer::DtaSimTPer(string simname)
+{
+	name = simname;
+	msid = "MSID" + simname;
+	psid = "PSID" + simname;
+	nextTSN = 0x1000;
+	factory();
+}
+void DtaSimTPer::setRow(uint64_t uid, uint64_t sp, uint32_t col, uint64_t value)
+{
+	vector<uint8_t> encoded;
+	simAtom(encoded, value);
+	rows[uid][col] = encoded;
+	rowSP[uid] = sp;
+}
+void DtaSimTPer::setRow(uint64_t uid, uint64_t sp, uint32_t col, const string &value)
+{
+	vector<uint8_t> encoded;
+	simBytes(encoded, value.data(), (uint32_t)value.size());
+	rows[uid][col] = encoded;
+	rowSP[uid] = sp;
+}
+uint64_t DtaSimTPer::getRow(uint64_t uid, uint32_t col)
+{
+	if (!rows.count(uid) || !rows[uid].count(col)) return 0;
+	return simValueUint(rows[uid][col]);
+}
+void DtaSimTPer::factory()
+{
+	LOG(D1) << "Entering DtaSimTPer::factory() " << name;
+	uint64_t adminSP = simUidValue(OPALUID[OPAL_UID::OPAL_ADMINSP_UID]);
+	rows.clear();
+	rowSP.clear();
+	sessions.clear();
+	pending.clear();
+	polls.clear();
+	// Admin SP: the SP table, SID/PSID authorities and their credentials
+	setRow(adminSP, adminSP, 0x06, SIM_MANUFACTURED);
+	setRow(simUidValue(OPALUID[OPAL_UID::OPAL_LOCKINGSP_UID]), adminSP, 0x06, SIM_MANUFACTURED_INACTIVE);
+	setRow(simUidValue(OPALUID[OPAL_UID::OPAL_SID_UID]), adminSP, 0x05, OPAL_TOKEN::OPAL_TRUE);
+	setRow(simUidValue(OPALUID[OPAL_UID::OPAL_PSID_UID]), adminSP, 0x05, OPAL_TOKEN::OPAL_TRUE);
+	setRow(simUidValue(OPALUID[OPAL_UID::OPAL_C_PIN_MSID]), adminSP, OPAL_TOKEN::PIN, msid);
+	setRow(simUidValue(OPALUID[OPAL_UID::OPAL_C_PIN_SID]), adminSP, OPAL_TOKEN::PIN, msid);
+	setRow(SIM_C_PIN_PSID, adminSP, OPAL_TOKEN::PIN, psid);
+	resetLockingSP();
+}
+void DtaSimTPer::resetLockingSP()
+{
+	LOG(D1) << "Entering DtaSimTPer::resetLockingSP() " << name;
+	uint64_t sp = simUidValue(OPALUID[OPAL_UID::OPAL_LOCKINGSP_UID]);
+	uint64_t global = simUidValue(OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL]);
+	uint64_t uid;
+	vector<uint8_t> key;
+	// drop everything belonging to the Locking SP
+	for (map<uint64_t, uint64_t>::iterator it = rowSP.begin(); it != rowSP.end();) {
+		if (it->second == sp) {
+			rows.erase(it->first);
+			rowSP.erase(it++);
+		}
+		else
+			++it;
+	}
+	mbr.clear();
+	for (uint32_t i = 1; i <= SIM_NUMADMINS; i++) {
+		setRow(SIM_ADMIN_AUTH | i, sp, 0x05, (1 == i) ? OPAL_TOKEN::OPAL_TRUE : OPAL_TOKEN::OPAL_FALSE);
+		setRow((SIM_ADMIN_AUTH | i) - SIM_AUTHORITY_TABLE + SIM_C_PIN_TABLE, sp, OPAL_TOKEN::PIN, string());
+	}
+	for (uint32_t i = 1; i <= SIM_NUMUSERS; i++) {
+		setRow(SIM_USER_AUTH | i, sp, 0x05, OPAL_TOKEN::OPAL_FALSE);
+		setRow((SIM_USER_AUTH | i) - SIM_AUTHORITY_TABLE + SIM_C_PIN_TABLE, sp, OPAL_TOKEN::PIN, string());
+	}
+	setRow(simUidValue(OPALUID[OPAL_UID::OPAL_LOCKING_INFO_TABLE]), sp, OPAL_TOKEN::MAXRANGES, SIM_MAXRANGES);
+	setRow(simUidValue(OPALUID[OPAL_UID::OPAL_MBRCONTROL]), sp, OPAL_TOKEN::MBRENABLE, OPAL_TOKEN::OPAL_FALSE);
+	setRow(simUidValue(OPALUID[OPAL_UID::OPAL_MBRCONTROL]), sp, OPAL_TOKEN::MBRDONE, OPAL_TOKEN::OPAL_FALSE);
+	for (uint32_t i = 0; i <= SIM_MAXRANGES; i++) {
+		uid = i ? (SIM_LOCKING_RANGE | i) : global;
+		setRow(uid, sp, OPAL_TOKEN::RANGESTART, 0);
+		setRow(uid, sp, OPAL_TOKEN::RANGELENGTH, 0);
+		setRow(uid, sp, OPAL_TOKEN::READLOCKENABLED, OPAL_TOKEN::OPAL_FALSE);
+		setRow(uid, sp, OPAL_TOKEN::WRITELOCKENABLED, OPAL_TOKEN::OPAL_FALSE);
+		setRow(uid, sp, OPAL_TOKEN::READLOCKED, OPAL_TOKEN::OPAL_FALSE);
+		setRow(uid, sp, OPAL_TOKEN::WRITELOCKED, OPAL_TOKEN::OPAL_FALSE);
+		key.clear();
+		simUid(key, i ? (SIM_K_AES_RANGE | i) : SIM_K_AES_GLOBAL);
+		rows[uid][OPAL_TOKEN::ACTIVEKEY] = key;
+		setRow(i ? (SIM_K_AES_RANGE | i) : SIM_K_AES_GLOBAL, sp, 0x03, 0); // key generation
+	}
+}
+void DtaSimTPer::discovery0(uint8_t * buffer, uint32_t bufferlen)
+{
+	LOG(D1) << "Entering DtaSimTPer::discovery0() " << name;
+	uint8_t d0[MIN_BUFFER_LENGTH];
+	uint32_t len = 48;
+	Discovery0Header * hdr = (Discovery0Header *)d0;
+	Discovery0Features * body;
+	uint64_t lockingSP = simUidValue(OPALUID[OPAL_UID::OPAL_LOCKINGSP_UID]);
+	uint64_t uid, mbrcontrol = simUidValue(OPALUID[OPAL_UID::OPAL_MBRCONTROL]);
+	uint64_t granularity = 8;
+	uint8_t locked = 0;
+	for (uint32_t i = 0; i <= SIM_MAXRANGES; i++) {
+		uid = i ? (SIM_LOCKING_RANGE | i) : simUidValue(OPALUID[OPAL_UID::OPAL_LOCKINGRANGE_GLOBAL]);
+		if ((getRow(uid, OPAL_TOKEN::READLOCKENABLED) && getRow(uid, OPAL_TOKEN::READLOCKED)) ||
+			(getRow(uid, OPAL_TOKEN::WRITELOCKENABLED) && getRow(uid, OPAL_TOKEN::WRITELOCKED)))
+			locked = 1;
+	}
+	memset(d0, 0, sizeof(d0));
+	body = (Discovery0Features *)&d0[len];
+	body->TPer.featureCode = SWAP16(FC_TPER);
+	body->TPer.version = 1;
+	body->TPer.length = sizeof(Discovery0TPerFeatures) - 4;
+	body->TPer.sync = 1;
+	body->TPer.streaming = 1;
+	len += sizeof(Discovery0TPerFeatures);
+	body = (Discovery0Features *)&d0[len];
+	body->locking.featureCode = SWAP16(FC_LOCKING);
+	body->locking.version = 1;
+	body->locking.length = sizeof(Discovery0LockingFeatures) - 4;
+	body->locking.lockingSupported = 1;
+	body->locking.lockingEnabled = (SIM_MANUFACTURED == getRow(lockingSP, 0x06));
+	body->locking.locked = locked;
+	body->locking.mediaEncryption = 1;
+	body->locking.MBREnabled = getRow(mbrcontrol, OPAL_TOKEN::MBRENABLE) ? 1 : 0;
+	body->locking.MBRDone = getRow(mbrcontrol, OPAL_TOKEN::MBRDONE) ? 1 : 0;
+	len += sizeof(Discovery0LockingFeatures);
+	body = (Discovery0Features *)&d0[len];
+	body->geometry.featureCode = SWAP16(FC_GEOMETRY);
+	body->geometry.version = 1;
+	body->geometry.length = sizeof(Discovery0GeometryFeatures) - 4;
+	body->geometry.align = 1;
+	body->geometry.logicalBlockSize = SWAP32(512);
+	body->geometry.alignmentGranularity = SWAP64(granularity);
+	len += sizeof(Discovery0GeometryFeatures);
+	body = (Discovery0Features *)&d0[len];
+	body->opalv200.featureCode = SWAP16(FC_OPALV200);
+	body->opalv200.version = 1;
+	body->opalv200.length = sizeof(Discovery0OPALV200) - 4;
+	body->opalv200.baseCommID = SWAP16(SIM_BASECOMID);
+	body->opalv200.numCommIDs = SWAP16(SIM_NUMCOMIDS);
+	body->opalv200.numlockingAdminAuth = SWAP16(SIM_NUMADMINS);
+	body->opalv200.numlockingUserAuth = SWAP16(SIM_NUMUSERS);
+	len += sizeof(Discovery0OPALV200);
+	hdr->length = SWAP32(len - 4);
+	hdr->revision = SWAP32(1);
+	memset(buffer, 0, bufferlen);
+	memcpy(buffer, d0, (len < bufferlen) ? len : bufferlen);
+}
+void DtaSimTPer::comIDRequest(uint16_t comID, uint8_t * buffer, uint32_t bufferlen)
+{
+	LOG(D1) << "Entering DtaSimTPer::comIDRequest() " << name;
+	vector<uint8_t> &out = comIDPending[comID];
+	out.clear();
+	if (bufferlen < 8) return;
+	uint32_t code = (buffer[4] << 24) | (buffer[5] << 16) | (buffer[6] << 8) | buffer[7];
+	/* ComID, extension and request code are echoed, then reserved and the length */
+	out.assign(buffer, buffer + 8);
+	out.push_back(0x00);
+	out.push_back(0x00);
+	if (0x00000001 == code) { // VERIFY_COMID_VALID
+		out.push_back(0x00);
+		out.push_back(34);
+		bool valid = (comID >= SIM_BASECOMID) && (comID < SIM_BASECOMID + SIM_NUMCOMIDS);
+		uint8_t state[34] = { 0x00, 0x00, 0x00, (uint8_t)(valid ? 0x03 : 0x00) }; // associated
+		out.insert(out.end(), state, state + sizeof(state));
+	}
+	else if (0x00000002 == code) { // STACK_RESET
+		sessions.erase(comID);
+		pending.erase(comID);
+		polls.erase(comID);
+		out.push_back(0x00);
+		out.push_back(0x04);
+		out.insert(out.end(), 4, 0x00); // success
+	}
+	else
+		out.clear();
+}
+void DtaSimTPer::comIDResponse(uint16_t comID, uint8_t * buffer, uint32_t bufferlen)
+{
+	LOG(D1) << "Entering DtaSimTPer::comIDResponse() " << name;
+	memset(buffer, 0, bufferlen);
+	vector<uint8_t> &out = comIDPending[comID];
+	memcpy(buffer, out.data(), (out.size() < bufferlen) ? out.size() : bufferlen);
+	out.clear();
+}
+void DtaSimTPer::submit(uint16_t comID, uint8_t * buffer, uint32_t bufferlen, uint32_t busyPolls)
+{
+	LOG(D1) << "Entering DtaSimTPer::submit() " << name;
+	OPALHeader * hdr = (OPALHeader *)buffer;
+	vector<uint8_t> reply;
+	vector<uint8_t> &out = pending[comID];
+	uint8_t status, endSession = 0;
+	uint32_t TSN;
+	out.clear();
+	polls[comID] = busyPolls;
+	if ((bufferlen < sizeof(OPALHeader)) ||
+		(SWAP32(hdr->subpkt.length) > bufferlen - sizeof(OPALHeader))) {
+		LOG(D1) << "Simulated TPer dropped a malformed ComPacket";
+		return;
+	}
+	DtaResponse cmd(buffer, bufferlen);
+	TSN = SWAP32(hdr->pkt.TSN);
+	if (0 == cmd.getTokenCount()) return;
+	if (simIs(cmd, 0, OPAL_TOKEN::ENDOFSESSION)) {
+		if (sessions.count(comID) && (sessions[comID].TSN == TSN))
+			sessions.erase(comID);
+		reply.push_back(OPAL_TOKEN::ENDOFSESSION);
+	}
+	else {
+		if (!simIs(cmd, 0, OPAL_TOKEN::CALL)) return;
+		uint64_t invoker = simUidOf(cmd, 1);
+		uint64_t call = simUidOf(cmd, 2);
+		if (0 == TSN) {
+			if (simUidValue(OPALUID[OPAL_UID::OPAL_SMUID_UID]) != invoker) return;
+			if (simUidValue(OPALMETHOD[OPAL_METHOD::PROPERTIES]) == call)
+				status = properties(cmd, reply);
+			else if (simUidValue(OPALMETHOD[OPAL_METHOD::STARTSESSION]) == call)
+				status = startSession(comID, cmd, reply);
+			else
+				status = OPALSTATUSCODE::INVALID_FUNCTION;
+			simStatus(reply, status);
+		}
+		else {
+			/* packets for a session that isn't open are dropped */
+			if (!sessions.count(comID) || (sessions[comID].TSN != TSN)) return;
+			/* up to SIM_MAXMETHODS calls, each ends with EOD and its status
+			 * list, processing stops at the first that fails */
+			uint32_t first = 0, calls = 0;
+			for (;;) {
+				uint32_t eod = first;
+				while ((eod < cmd.getTokenCount()) && !simIs(cmd, eod, OPAL_TOKEN::ENDOFDATA)) eod++;
+				vector<uint8_t> one(sizeof(OPALHeader), 0x00);
+				for (uint32_t i = first; (i < eod + 6) && (i < cmd.getTokenCount()); i++) {
+					vector<uint8_t> token = cmd.getRawToken(i);
+					one.insert(one.end(), token.begin(), token.end());
+				}
+				((OPALHeader *)one.data())->subpkt.length = SWAP32((uint32_t)(one.size() - sizeof(OPALHeader)));
+				DtaResponse call1(one.data(), (uint32_t)one.size());
+				vector<uint8_t> result;
+				if (SIM_MAXMETHODS < ++calls)
+					status = OPALSTATUSCODE::INVALID_PARAMETER;
+				else
+					status = method(sessions[comID], simUidOf(call1, 1), simUidOf(call1, 2),
+						call1, result, endSession);
+				if (endSession) sessions.erase(comID);
+				simStatus(result, status);
+				reply.insert(reply.end(), result.begin(), result.end());
+				first = eod + 6;
+				if (status || endSession || !simIs(cmd, first, OPAL_TOKEN::CALL)) break;
+			}
+		}
+	}
+	out.resize(sizeof(OPALHeader));
+	out.insert(out.end(), reply.begin(), reply.end());
+	while (out.size() % 4) out.push_back(0x00);
+	OPALHeader * rhdr = (OPALHeader *)out.data();
+	memcpy(rhdr->cp.extendedComID, hdr->cp.extendedComID, sizeof(rhdr->cp.extendedComID));
+	rhdr->cp.length = SWAP32((uint32_t)(out.size() - sizeof(OPALComPacket)));
+	rhdr->pkt.TSN = hdr->pkt.TSN;
+	rhdr->pkt.HSN = hdr->pkt.HSN;
+	rhdr->pkt.length = SWAP32((uint32_t)(out.size() - sizeof(OPALComPacket) - sizeof(OPALPacket)));
+	rhdr->subpkt.length = SWAP32((uint32_t)reply.size());
+}
+void DtaSimTPer::receive(uint16_t comID, uint8_t * buffer, uint32_t bufferlen)
+{
+	LOG(D1) << "Entering DtaSimTPer::receive() " << name;
+	OPALComPacket * cp = (OPALComPacket *)buffer;
+	vector<uint8_t> &out = pending[comID];
+	memset(buffer, 0, bufferlen);
+	if (bufferlen < sizeof(OPALComPacket)) return;
+	cp->extendedComID[0] = (uint8_t)((comID >> 8) & 0xff);
+	cp->extendedComID[1] = (uint8_t)(comID & 0xff);
+	if (out.empty()) return;
+	if (polls[comID]) {
+		/* still "processing" the command */
+		polls[comID]--;
+		cp->outstandingData = SWAP32(1);
+		return;
+	}
+	if (out.size() > bufferlen) {
+		cp->outstandingData = SWAP32((uint32_t)(out.size() - sizeof(OPALComPacket)));
+		cp->minTransfer = cp->outstandingData;
+		return;
+	}
+	memcpy(buffer, out.data(), out.size());
+	out.clear();
+}
+uint8_t DtaSimTPer::checkAuth(uint64_t sp, uint64_t authority, DtaResponse &cmd, uint32_t challenge)
+{
+	uint64_t cpin;
+	if ((0 == authority) || (simUidValue(OPALUID[OPAL_UID::OPAL_ANYBODY_UID]) == authority))
+		return OPALSTATUSCODE::SUCCESS;
+	if (!rowSP.count(authority) || (rowSP[authority] != sp) || !getRow(authority, 0x05))
+		return OPALSTATUSCODE::NOT_AUTHORIZED;
+	if (simUidValue(OPALUID[OPAL_UID::OPAL_SID_UID]) == authority)
+		cpin = simUidValue(OPALUID[OPAL_UID::OPAL_C_PIN_SID]);
+	else
+		cpin = authority - SIM_AUTHORITY_TABLE + SIM_C_PIN_TABLE;
+	if (!simIs(cmd, challenge, OPAL_TOKEN::DTA_TOKENID_BYTESTRING) || !rows.count(cpin) ||
+		(simValueString(rows[cpin][OPAL_TOKEN::PIN]) != simStringOf(cmd, challenge)))
+		return OPALSTATUSCODE::NOT_AUTHORIZED;
+	return OPALSTATUSCODE::SUCCESS;
+}
+uint8_t DtaSimTPer::properties(DtaResponse &cmd, vector<uint8_t> &reply)
+{
+	LOG(D1) << "Entering DtaSimTPer::properties() " << name;
+	static const char * tperName[] = { "MaxComPacketSize", "MaxResponseComPacketSize",
+		"MaxPacketSize", "MaxIndTokenSize", "MaxPackets", "MaxSubpackets", "MaxMethods",
+		"MaxSessions" };
+	static const uint32_t tperValue[] = { MAX_BUFFER_LENGTH, MAX_BUFFER_LENGTH,
+		MAX_BUFFER_LENGTH - 20, MAX_BUFFER_LENGTH - 56, 1, 1, SIM_MAXMETHODS, SIM_NUMCOMIDS };
+	reply.push_back(OPAL_TOKEN::CALL);
+	simUid(reply, simUidValue(OPALUID[OPAL_UID::OPAL_SMUID_UID]));
+	simUid(reply, simUidValue(OPALMETHOD[OPAL_METHOD::PROPERTIES]));
+	reply.push_back(OPAL_TOKEN::STARTLIST);
+	reply.push_back(OPAL_TOKEN::STARTLIST);
+	for (uint32_t i = 0; i < sizeof(tperValue) / sizeof(tperValue[0]); i++) {
+		reply.push_back(OPAL_TOKEN::STARTNAME);
+		simBytes(reply, tperName[i], (uint32_t)strlen(tperName[i]));
+		simAtom(reply, tperValue[i]);
+		reply.push_back(OPAL_TOKEN::ENDNAME);
+	}
+	reply.push_back(OPAL_TOKEN::ENDLIST);
+	/* echo the host properties back as accepted */
+	reply.push_back(OPAL_TOKEN::STARTNAME);
+	reply.push_back(OPAL_TOKEN::HOSTPROPERTIES);
+	reply.push_back(OPAL_TOKEN::STARTLIST);
+	for (uint32_t i = 3; i + 3 < cmd.getTokenCount(); i++) {
+		if (simIs(cmd, i, OPAL_TOKEN::STARTNAME) &&
+			simIs(cmd, i + 1, OPAL_TOKEN::DTA_TOKENID_BYTESTRING) &&
+			simIs(cmd, i + 2, OPAL_TOKEN::DTA_TOKENID_UINT)) {
+			vector<uint8_t> value = simValueOf(cmd, i);
+			reply.insert(reply.end(), value.begin(), value.end());
+			i += 3;
+		}
+	}
+	reply.push_back(OPAL_TOKEN::ENDLIST);
+	reply.push_back(OPAL_TOKEN::ENDNAME);
+	reply.push_back(OPAL_TOKEN::ENDLIST);
+	return OPALSTATUSCODE::SUCCESS;
+}
+uint8_t DtaSimTPer::startSession(uint16_t comID, DtaResponse &cmd, vector<uint8_t> &reply)
+{
+	LOG(D1) << "Entering DtaSimTPer::startSession() " << name;
+	SimSession s;
+	uint32_t challenge = 0, i;
+	uint8_t status;
+	if (!simIs(cmd, 3, OPAL_TOKEN::STARTLIST) || !simIs(cmd, 4, OPAL_TOKEN::DTA_TOKENID_UINT))
+		return OPALSTATUSCODE::INVALID_PARAMETER;
+	s.HSN = (uint32_t)simUintOf(cmd, 4);
+	s.SP = simUidOf(cmd, 5);
+	s.authority = 0;
+	for (i = 7; simIs(cmd, i, OPAL_TOKEN::STARTNAME); i = simSkip(cmd, i)) {
+		if (simIs(cmd, i + 1, OPAL_TOKEN::DTA_TOKENID_UINT)) {
+			if (0 == simUintOf(cmd, i + 1)) challenge = i + 2;
+			if (3 == simUintOf(cmd, i + 1)) s.authority = simUidOf(cmd, i + 2);
+		}
+	}
+	if ((simUidValue(OPALUID[OPAL_UID::OPAL_ADMINSP_UID]) != s.SP) &&
+		(simUidValue(OPALUID[OPAL_UID::OPAL_LOCKINGSP_UID]) != s.SP))
+		return OPALSTATUSCODE::INVALID_PARAMETER;
+	if (SIM_MANUFACTURED != getRow(s.SP, 0x06))
+		return OPALSTATUSCODE::INVALID_PARAMETER;
+	if (sessions.count(comID))
+		return OPALSTATUSCODE::NO_SESSIONS_AVAILABLE;
+	if ((status = checkAuth(s.SP, s.authority, cmd, challenge)) != 0)
+		return status;
+	s.TSN = nextTSN++;
+	sessions[comID] = s;
+	reply.push_back(OPAL_TOKEN::CALL);
+	simUid(reply, simUidValue(OPALUID[OPAL_UID::OPAL_SMUID_UID]));
+	simUid(reply, SIM_SYNCSESSION);
+	reply.push_back(OPAL_TOKEN::STARTLIST);
+	simAtom(reply, s.HSN);
+	simAtom(reply, s.TSN);
+	reply.push_back(OPAL_TOKEN::ENDLIST);
+	return OPALSTATUSCODE::SUCCESS;
+}
+uint8_t DtaSimTPer::get(SimSession &s, uint64_t invoker, DtaResponse &cmd, vector<uint8_t> &reply)
+{
+	uint64_t startcol = 0, endcol = 0xffffffff;
+	if (!rows.count(invoker) || (rowSP[invoker] != s.SP))
+		return OPALSTATUSCODE::INVALID_PARAMETER;
+	/* [ [ startcolumn = n endcolumn = n ] ] */
+	for (uint32_t i = 5; simIs(cmd, i, OPAL_TOKEN::STARTNAME); i = simSkip(cmd, i)) {
+		if (OPAL_TOKEN::STARTCOLUMN == simUintOf(cmd, i + 1)) startcol = simUintOf(cmd, i + 2);
+		if (OPAL_TOKEN::ENDCOLUMN == simUintOf(cmd, i + 1)) endcol = simUintOf(cmd, i + 2);
+	}
+	reply.push_back(OPAL_TOKEN::STARTLIST);
+	reply.push_back(OPAL_TOKEN::STARTLIST);
+	SimRow &row = rows[invoker];
+	for (SimRow::iterator col = row.begin(); col != row.end(); ++col) {
+		if ((col->first < startcol) || (col->first > endcol)) continue;
+		/* credentials other than the MSID can't be read */
+		if (((invoker & SIM_TABLE_MASK) == SIM_C_PIN_TABLE) && (OPAL_TOKEN::PIN == col->first) &&
+			(simUidValue(OPALUID[OPAL_UID::OPAL_C_PIN_MSID]) != invoker))
+			continue;
+		reply.push_back(OPAL_TOKEN::STARTNAME);
+		simAtom(reply, col->first);
+		reply.insert(reply.end(), col->second.begin(), col->second.end());
+		reply.push_back(OPAL_TOKEN::ENDNAME);
+	}
+	reply.push_back(OPAL_TOKEN::ENDLIST);
+	reply.push_back(OPAL_TOKEN::ENDLIST);
+	return OPALSTATUSCODE::SUCCESS;
+}
+uint8_t DtaSimTPer::set(SimSession &s, uint64_t invoker, DtaResponse &cmd, vector<uint8_t> &reply)
+{
+	uint64_t where = 0;
+	uint32_t i;
+	if (0 == s.authority)
+		return OPALSTATUSCODE::NOT_AUTHORIZED;
+	if (simUidValue(OPALUID[OPAL_UID::OPAL_MBR]) == invoker) {
+		/* [ where = offset values = bytes ] */
+		for (i = 4; simIs(cmd, i, OPAL_TOKEN::STARTNAME); i = simSkip(cmd, i)) {
+			if (OPAL_TOKEN::WHERE == simUintOf(cmd, i + 1))
+				where = simUintOf(cmd, i + 2);
+			if ((OPAL_TOKEN::VALUES == simUintOf(cmd, i + 1)) &&
+				simIs(cmd, i + 2, OPAL_TOKEN::DTA_TOKENID_BYTESTRING)) {
+				string bytes = cmd.getString(i + 2);
+				if (where + bytes.size() > SIM_MBRSIZE)
+					return OPALSTATUSCODE::INVALID_PARAMETER;
+				if (mbr.size() < where + bytes.size()) mbr.resize(where + bytes.size());
+				memcpy(mbr.data() + where, bytes.data(), bytes.size());
+			}
+		}
+	}
+	else {
+		/* ACE rows are created on first use, everything else must exist */
+		if ((invoker & SIM_TABLE_MASK) == SIM_ACE_TABLE)
+			rowSP[invoker] = s.SP;
+		if (!rowSP.count(invoker) || (rowSP[invoker] != s.SP))
+			return OPALSTATUSCODE::INVALID_PARAMETER;
+		/* [ values = [ col = value ... ] ] */
+		if (!simIs(cmd, 4, OPAL_TOKEN::STARTNAME) || (OPAL_TOKEN::VALUES != simUintOf(cmd, 5)) ||
+			!simIs(cmd, 6, OPAL_TOKEN::STARTLIST))
+			return OPALSTATUSCODE::INVALID_PARAMETER;
+		for (i = 7; simIs(cmd, i, OPAL_TOKEN::STARTNAME); i = simSkip(cmd, i)) {
+			if (!simIs(cmd, i + 1, OPAL_TOKEN::DTA_TOKENID_UINT))
+				return OPALSTATUSCODE::INVALID_PARAMETER;
+			rows[invoker][(uint32_t)simUintOf(cmd, i + 1)] = simValueOf(cmd, i + 2);
+		}
+	}
+	reply.push_back(OPAL_TOKEN::STARTLIST);
+	reply.push_back(OPAL_TOKEN::ENDLIST);
+	return OPALSTATUSCODE::SUCCESS;
+}
+uint8_t DtaSimTPer::method(SimSession &s, uint64_t invoker, uint64_t call,
+	DtaResponse &cmd, vector<uint8_t> &reply, uint8_t &endSession)
+{
+	LOG(D1) << "Entering DtaSimTPer::method() " << name;
+	uint64_t adminSP = simUidValue(OPALUID[OPAL_UID::OPAL_ADMINSP_UID]);
+	uint64_t lockingSP = simUidValue(OPALUID[OPAL_UID::OPAL_LOCKINGSP_UID]);
+	uint8_t status;
+	if (simUidValue(OPALMETHOD[OPAL_METHOD::GET]) == call)
+		return get(s, invoker, cmd, reply);
+	if (simUidValue(OPALMETHOD[OPAL_METHOD::SET]) == call)
+		return set(s, invoker, cmd, reply);
+	if (simUidValue(OPALMETHOD[OPAL_METHOD::AUTHENTICATE]) == call) {
+		uint64_t authority = simUidOf(cmd, 4);
+		uint32_t challenge = simIs(cmd, 5, OPAL_TOKEN::STARTNAME) ? 7 : 0;
+		status = checkAuth(s.SP, authority, cmd, challenge);
+		if (0 == status) s.authority = authority;
+		reply.push_back(OPAL_TOKEN::STARTLIST);
+		reply.push_back(status ? OPAL_TOKEN::OPAL_FALSE : OPAL_TOKEN::OPAL_TRUE);
+		reply.push_back(OPAL_TOKEN::ENDLIST);
+		return OPALSTATUSCODE::SUCCESS;
+	}
+	if (0 == s.authority)
+		return OPALSTATUSCODE::NOT_AUTHORIZED;
+	reply.push_back(OPAL_TOKEN::STARTLIST);
+	reply.push_back(OPAL_TOKEN::ENDLIST);
+	if (simUidValue(OPALMETHOD[OPAL_METHOD::GENKEY]) == call) {
+		if (!rows.count(invoker) || (rowSP[invoker] != s.SP) ||
+			(((invoker & SIM_TABLE_MASK) != (SIM_K_AES_GLOBAL & SIM_TABLE_MASK))))
+			return OPALSTATUSCODE::INVALID_PARAMETER;
+		setRow(invoker, s.SP, 0x03, getRow(invoker, 0x03) + 1);
+		return OPALSTATUSCODE::SUCCESS;
+	}
+	if (simUidValue(OPALMETHOD[OPAL_METHOD::ERASE]) == call)
+		return OPALSTATUSCODE::SUCCESS;
+	if (simUidValue(OPALMETHOD[OPAL_METHOD::ACTIVATE]) == call) {
+		if ((adminSP != s.SP) || (lockingSP != invoker))
+			return OPALSTATUSCODE::INVALID_PARAMETER;
+		if (SIM_MANUFACTURED == getRow(lockingSP, 0x06))
+			return OPALSTATUSCODE::SUCCESS;
+		setRow(lockingSP, adminSP, 0x06, SIM_MANUFACTURED);
+		/* Admin1 starts out with the SID credential */
+		rows[SIM_ADMIN_AUTH - SIM_AUTHORITY_TABLE + SIM_C_PIN_TABLE + 1][OPAL_TOKEN::PIN] =
+			rows[simUidValue(OPALUID[OPAL_UID::OPAL_C_PIN_SID])][OPAL_TOKEN::PIN];
+		return OPALSTATUSCODE::SUCCESS;
+	}
+	if (simUidValue(OPALMETHOD[OPAL_METHOD::REVERT]) == call) {
+		if (adminSP != s.SP)
+			return OPALSTATUSCODE::INVALID_PARAMETER;
+		if (adminSP == invoker)
+			factory();
+		else if (lockingSP == invoker) {
+			resetLockingSP();
+			setRow(lockingSP, adminSP, 0x06, SIM_MANUFACTURED_INACTIVE);
+		}
+		else
+			return OPALSTATUSCODE::INVALID_PARAMETER;
+		endSession = 1;
+		return OPALSTATUSCODE::SUCCESS;
+	}
+	if (simUidValue(OPALMETHOD[OPAL_METHOD::REVERTSP]) == call) {
+		if (lockingSP != s.SP)
+			return OPALSTATUSCODE::INVALID_PARAMETER;
+		resetLockingSP();
+		setRow(lockingSP, adminSP, 0x06, SIM_MANUFACTURED_INACTIVE);
+		endSession = 1;
+		return OPALSTATUSCODE::SUCCESS;
+	}
+	return OPALSTATUSCODE::INVALID_FUNCTION;
+}
+
+/** The Device class represents a simulated Opal 2.0 drive.
+ */
+DtaDevLinuxSim::DtaDevLinuxSim()
+{
+	tper = NULL;
+	latency = 0;
+	busyPolls = 0;
+}
+
+bool DtaDevLinuxSim::init(const char * devref)
+{
+	LOG(D1) << "Creating DtaDevLinuxSim::DtaDev() " << devref;
+	string name = devref;
+	char * endp;
+	if (!name.compare(0, 4, "sim:")) name.erase(0, 4);
+	size_t colon = name.find(':');
+	if (string::npos != colon) {
+		latency = (uint32_t)strtoul(name.c_str() + colon + 1, &endp, 10);
+		if (':' == *endp) busyPolls = (uint32_t)strtoul(endp + 1, NULL, 10);
+		name.erase(colon);
+	}
+	if (name.empty()) {
+		LOG(E) << "Simulated device needs a name, e.g. sim:drive0";
+		return FALSE;
+	}
+	lock_guard<mutex> guard(simRegistryLock);
+	if (!simRegistry.count(name))
+		simRegistry[name] = new DtaSimTPer(name);
+	tper = simRegistry[name];
+	return TRUE;
+}
+
+void DtaDevLinuxSim::reset(const char * devref)
+{
+	string name = devref;
+	if (!name.compare(0, 4, "sim:")) name.erase(0, 4);
+	name = name.substr(0, name.find(':'));
+	lock_guard<mutex> guard(simRegistryLock);
+	if (simRegistry.count(name)) {
+		lock_guard<mutex> tperGuard(simRegistry[name]->lock);
+		simRegistry[name]->factory();
+	}
+}
+
+uint8_t DtaDevLinuxSim::sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+	void * buffer, uint32_t bufferlen)
+{
+	LOG(D1) << "Entering DtaDevLinuxSim::sendCmd";
+	if (latency) usleep(latency);
+	return process(cmd, protocol, comID, buffer, bufferlen);
+}
+
+void DtaDevLinuxSim::submitCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+	void * buffer, uint32_t bufferlen, DtaIoCallback cb, void * ctx)
+{
+	LOG(D1) << "Entering DtaDevLinuxSim::submitCmd";
+	DtaIoLoop::get()->after(latency, cb, ctx, process(cmd, protocol, comID, buffer, bufferlen));
+}
+
+/** Hand the command to the simulated TPer. */
+uint8_t DtaDevLinuxSim::process(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+	void * buffer, uint32_t bufferlen)
+{
+	uint8_t * buf = (uint8_t *)buffer;
+	lock_guard<mutex> guard(tper->lock);
+	if (IF_SEND == cmd) {
+		LOG(D3) << "Security Send Command";
+		if (0x01 == protocol)
+			tper->submit(comID, buf, bufferlen, busyPolls);
+		else if (0x02 == protocol)
+			tper->comIDRequest(comID, buf, bufferlen);
+		return 0;
+	}
+	LOG(D3) << "Security Receive Command";
+	if (0x00 == protocol) {
+		/* supported security protocol list */
+		memset(buf, 0, bufferlen);
+		if (bufferlen < 11) return 0;
+		buf[7] = 3;
+		buf[8] = 0x00;
+		buf[9] = 0x01;
+		buf[10] = 0x02;
+	}
+	else if ((0x01 == protocol) && (0x0001 == comID))
+		tper->discovery0(buf, bufferlen);
+	else if (0x01 == protocol)
+		tper->receive(comID, buf, bufferlen);
+	else if ((0x02 == protocol) && comID)
+		tper->comIDResponse(comID, buf, bufferlen);
+	else
+		memset(buf, 0, bufferlen);
+	return 0;
+}
+
+void DtaDevLinuxSim::identify(OPAL_DiskInfo& disk_info)
+{
+	LOG(D4) << "Entering DtaDevLinuxSim::identify()";
+	char field[41];
+	disk_info.devType = DEVICE_TYPE_SIM;
+	snprintf(field, sizeof(field), "%-20.20s", ("SIM" + tper->name).c_str());
+	memcpy(disk_info.serialNum, field, sizeof(disk_info.serialNum));
+	snprintf(field, sizeof(field), "%-8.8s", "SIM1.0");
+	memcpy(disk_info.firmwareRev, field, sizeof(disk_info.firmwareRev));
+	snprintf(field, sizeof(field), "%-40.40s", "sedutil simulated Opal 2.0 TPer");
+	memcpy(disk_info.modelNum, field, sizeof(disk_info.modelNum));
+	return;
+}
+
+/** Detach from the simulated TPer, its state stays registered. */
+DtaDevLinuxSim::~DtaDevLinuxSim()
+{
+	LOG(D1) << "Destroying DtaDevLinuxSim";
+}
@@ -0,0 +1,83 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include "DtaStructures.h"
+#include "DtaDevLinuxDrive.h"
+
+class DtaSimTPer;
+
+/** Linux specific implementation of DtaDevOS.
+ * Talks to an in-process simulation of an Opal 2.0 TPer instead of a
+ * real drive so the session, command and exec layers can be exercised
+ * (and benchmarked) on machines without a SED.
+ *
+ * The device reference is of the form sim:name[:latency_us[:busy_polls]]
+ * where latency_us is added to every IF_SEND/IF_RECV and busy_polls is the
+ * number of IF_RECV polls answered with outstanding data before the
+ * response is returned.  The TPer state is kept per name for the life of
+ * the process.
+ */
+class DtaDevLinuxSim: public DtaDevLinuxDrive{
+public:
+    /** Default constructor */
+    DtaDevLinuxSim();
+    /** Destructor */
+    ~DtaDevLinuxSim();
+    /** Simulator specific initialization.
+     * Parses the device reference and attaches to (or creates) the
+     * named simulated TPer
+     * @param devref sim:name[:latency_us[:busy_polls]]
+     */
+    bool init(const char * devref);
+    /** Simulator specific method to send a command to the device
+     * @param cmd command to be sent to the device
+     * @param protocol security protocol to be used in the command
+     * @param comID communications ID to be used
+     * @param buffer input/output buffer
+     * @param bufferlen length of the input/output buffer
+     */
+    uint8_t sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+            void * buffer, uint32_t bufferlen);
+    /** Simulator specific method to start a command, the latency is
+     * spent on the DtaIoLoop instead of blocking the thread
+     * @param cmd command to be sent to the device
+     * @param protocol security protocol to be used in the command
+     * @param comID communications ID to be used
+     * @param buffer input/output buffer
+     * @param bufferlen length of the input/output buffer
+     * @param cb called from the DtaIoLoop with the return code
+     * @param ctx passed to cb
+     */
+    void submitCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+            void * buffer, uint32_t bufferlen, DtaIoCallback cb, void * ctx);
+    /** Simulator specific routine to fill in the identify information */
+    void identify(OPAL_DiskInfo& disk_info);
+    /** Return a named simulated TPer to its factory state
+     * @param devref sim:name[...] or just the name of the simulated TPer
+     */
+    static void reset(const char * devref);
+private:
+    /** Run a command on the simulated TPer */
+    uint8_t process(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+            void * buffer, uint32_t bufferlen);
+    DtaSimTPer * tper; /**< the simulated TPer this device talks to */
+    uint32_t latency; /**< microseconds added to every command */
+    uint32_t busyPolls; /**< IF_RECV polls that report outstanding data */
+};
@@ -0,0 +1,175 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+#include "DtaDevLock.h"
+
+using namespace std;
+
+/** The lock this process holds on one drive */
+typedef struct _DtaDevLockFile {
+	int fd;            /**< open lock file, -1 when it could not be created */
+	DTA_LOCK held;     /**< flock mode held on fd */
+	uint32_t shared;   /**< DTA_LOCK_SHARED holders */
+	uint32_t exclusive; /**< DTA_LOCK_EXCLUSIVE holders */
+} DtaDevLockFile;
+
+static mutex DtaDevLockMutex;
+static map<string, DtaDevLockFile> DtaDevLocks;
+
+/** lock file of a drive, the padded model and serial number with anything
+ * but letters, digits, '-' and '.' turned into '_' */
+static string lockPath(const string & key)
+{
+	const char * dir = getenv("SEDUTIL_LOCK_DIR");
+	string path = ((NULL != dir) && (0 != dir[0])) ? dir : DTA_LOCK_DIR;
+	string name;
+	bool blank = false;
+	for (size_t i = 0; i < key.length(); i++) {
+		char c = key[i];
+		if ((' ' == c) || (0 == c)) {
+			blank = true;
+			continue;
+		}
+		if (blank && !name.empty()) name += '_';
+		blank = false;
+		name += (isalnum((unsigned char)c) || ('-' == c) || ('.' == c)) ? c : '_';
+	}
+	if (name.empty()) name = "unknown";
+	return path + "/" + name + ".lock";
+}
+
+/** a lock directory or file is only trusted when it is ours and closed
+ * to everybody else */
+static bool lockTrusted(const struct stat & st, mode_t type)
+{
+	return ((st.st_mode & S_IFMT) == type) && (st.st_uid == geteuid()) &&
+		(0 == (st.st_mode & (S_IWGRP | S_IWOTH)));
+}
+
+static int lockOpen(const string & key)
+{
+	string path = lockPath(key);
+	string dir = path.substr(0, path.rfind('/'));
+	struct stat st;
+	if (mkdir(dir.c_str(), 0700) && (EEXIST != errno)) {
+		LOG(D1) << "Unable to create lock directory " << dir << " " << strerror(errno) <<
+			", the drive is not locked";
+		return -1;
+	}
+	if (lstat(dir.c_str(), &st) || !lockTrusted(st, S_IFDIR)) {
+		LOG(W) << "Lock directory " << dir << " is not a directory owned by this user and "
+			"closed to others, the drive is not locked";
+		return -1;
+	}
+	int fd = open(path.c_str(), O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		LOG(D1) << "Unable to open lock file " << path << " " << strerror(errno) <<
+			", the drive is not locked";
+		return -1;
+	}
+	if (fstat(fd, &st) || !lockTrusted(st, S_IFREG)) {
+		LOG(W) << "Lock file " << path << " is not a file owned by this user and "
+			"closed to others, the drive is not locked";
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+uint8_t DtaDevLock(const string & key, DTA_LOCK mode)
+{
+	LOG(D1) << "Entering DtaDevLock " << (int)mode;
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::now() +
+		chrono::milliseconds(DTA_LOCK_TIMEOUT);
+	uint32_t wait = 1;
+	bool logged = false;
+	for (;;) {
+		{
+			lock_guard<mutex> guard(DtaDevLockMutex);
+			map<string, DtaDevLockFile>::iterator it = DtaDevLocks.find(key);
+			if (DtaDevLocks.end() == it) {
+				DtaDevLockFile f = { lockOpen(key), DTA_LOCK_NONE, 0, 0 };
+				it = DtaDevLocks.insert(make_pair(key, f)).first;
+			}
+			DtaDevLockFile & f = it->second;
+			if ((f.fd < 0) || (f.held >= mode)) {
+				(DTA_LOCK_EXCLUSIVE == mode) ? f.exclusive++ : f.shared++;
+				return 0;
+			}
+			if (0 == flock(f.fd, ((DTA_LOCK_EXCLUSIVE == mode) ? LOCK_EX : LOCK_SH) | LOCK_NB)) {
+				f.held = mode;
+				(DTA_LOCK_EXCLUSIVE == mode) ? f.exclusive++ : f.shared++;
+				return 0;
+			}
+			/* a failed conversion may have dropped the shared lock */
+			if ((DTA_LOCK_SHARED == f.held) && flock(f.fd, LOCK_SH | LOCK_NB))
+				f.held = DTA_LOCK_NONE;
+			if (!f.shared && !f.exclusive) {
+				close(f.fd);
+				DtaDevLocks.erase(it);
+			}
+		}
+		if (!logged) {
+			LOG(I) << "Waiting for another process to release " << lockPath(key);
+			logged = true;
+		}
+		if (chrono::steady_clock::now() >= deadline) {
+			LOG(E) << "Drive is still locked by another process " << lockPath(key);
+			return DTAERROR_DEVICE_LOCKED;
+		}
+		this_thread::sleep_for(chrono::milliseconds(wait));
+		if (wait < 100) wait *= 2;
+	}
+}
+
+void DtaDevUnlock(const string & key, DTA_LOCK mode)
+{
+	LOG(D1) << "Entering DtaDevUnlock " << (int)mode;
+	lock_guard<mutex> guard(DtaDevLockMutex);
+	map<string, DtaDevLockFile>::iterator it = DtaDevLocks.find(key);
+	if (DtaDevLocks.end() == it) return;
+	DtaDevLockFile & f = it->second;
+	if ((DTA_LOCK_EXCLUSIVE == mode) && f.exclusive) f.exclusive--;
+	else if ((DTA_LOCK_SHARED == mode) && f.shared) f.shared--;
+	if (f.exclusive) return;
+	if (f.shared) {
+		/* only readers left, let other processes read too */
+		if ((DTA_LOCK_EXCLUSIVE == f.held) && (0 == flock(f.fd, LOCK_SH)))
+			f.held = DTA_LOCK_SHARED;
+		return;
+	}
+	if (f.fd >= 0) {
+		flock(f.fd, LOCK_UN);
+		close(f.fd);
+	}
+	DtaDevLocks.erase(it);
+}
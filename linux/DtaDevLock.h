@@ -0,0 +1,53 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include <stdint.h>
+#include <string>
+#include "DtaStructures.h"
+
+/** default directory of the lock files, SEDUTIL_LOCK_DIR overrides it,
+ * it must be owned by the user sedutil runs as and not be open to others */
+#define DTA_LOCK_DIR "/run/sedutil"
+/** how long DtaDevLock waits for another process, in ms */
+#define DTA_LOCK_TIMEOUT 600000
+
+/** Take an advisory lock on a drive for this process.
+ *
+ * The lock is an flock() on a file named after the drive's model and
+ * serial number, so every process that reaches the drive, through any
+ * device name, agrees on it.  Locks are counted per process: threads
+ * share the process's lock and the file is unlocked when the last holder
+ * lets go.  A shared holder asking for an exclusive lock converts the
+ * process's lock.  A lock file that cannot be created leaves the drive
+ * unlocked, the lock is advisory.  So that other users cannot plant or
+ * hold the lock files, the directory and the files must be owned by the
+ * effective user and be closed to group and others, and symbolic links
+ * are not followed; anything else leaves the drive unlocked.
+ * @param key DtaDev::driveKey() of the drive
+ * @param mode DTA_LOCK_SHARED or DTA_LOCK_EXCLUSIVE
+ * @return 0 or DTAERROR_DEVICE_LOCKED when another process kept it
+ *         longer than DTA_LOCK_TIMEOUT
+ */
+uint8_t DtaDevLock(const std::string & key, DTA_LOCK mode);
+/** Give back a lock taken by DtaDevLock
+ * @param key DtaDev::driveKey() of the drive
+ * @param mode the mode passed to DtaDevLock
+ */
+void DtaDevUnlock(const std::string & key, DTA_LOCK mode);
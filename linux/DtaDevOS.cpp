@@ -20,8 +20,6 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include "os.h"
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <dirent.h>
-#include <fnmatch.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <scsi/sg.h>
@@ -34,10 +32,16 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #include <vector>
 #include <fstream>
 #include "DtaDevOS.h"
+#include "DtaDiskEnum.h"
+#include "DtaDiskCache.h"
+#include "DtaDevLock.h"
 #include "DtaHexDump.h"
 #include "DtaDevLinuxSata.h"
 #include "DtaDevLinuxNvme.h"
+#include "DtaDevLinuxSim.h"
+#include "DtaDevLinuxReplay.h"
 #include "DtaDevGeneric.h"
+#include "DtaTrace.h"
 
 using namespace std;
 
@@ -50,10 +54,17 @@ unsigned long long DtaDevOS::getSize()
 DtaDevOS::DtaDevOS()
 {
 	drive = NULL;
+	sendCount = 0;
+	recvCount = 0;
 }
 
 /* Determine which type of drive we're using and instantiate a derived class of that type */
 void DtaDevOS::init(const char * devref)
+{
+	init(devref, NULL);
+}
+
+void DtaDevOS::init(const char * devref, const OPAL_DiskInfo * identity)
 {
 	LOG(D1) << "DtaDevOS::init " << devref;
 
@@ -70,6 +81,14 @@ void DtaDevOS::init(const char * devref)
 //		DtaDevLinuxSata *SataDrive = new DtaDevLinuxSata();
 		drive = new DtaDevLinuxSata();
 	}
+	else if (!strncmp(devref, "sim:", 4))
+	{
+		drive = new DtaDevLinuxSim();
+	}
+	else if (!strncmp(devref, "replay:", 7))
+	{
+		drive = new DtaDevLinuxReplay();
+	}
 	else 
         {
 		LOG(E) << "DtaDevOS::init ERROR - unknown drive type";
@@ -80,7 +99,18 @@ void DtaDevOS::init(const char * devref)
 	if (drive->init(devref))
 	{
 		isOpen = TRUE;
-		drive->identify(disk_info);
+		if (NULL != identity) {
+			disk_info.devType = identity->devType;
+			memcpy(disk_info.serialNum, identity->serialNum, sizeof(disk_info.serialNum));
+			memcpy(disk_info.firmwareRev, identity->firmwareRev, sizeof(disk_info.firmwareRev));
+			memcpy(disk_info.modelNum, identity->modelNum, sizeof(disk_info.modelNum));
+			drive->reuseIdentify(disk_info);
+		}
+		else {
+			uint64_t start = DtaTrace::now();
+			drive->identify(disk_info);
+			DtaTrace::identity(start, disk_info);
+		}
 		if (disk_info.devType != DEVICE_TYPE_OTHER)
 			discovery0();
 	}
@@ -101,7 +131,22 @@ uint8_t DtaDevOS::sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
 		return 0xff;
 	}
 
-	return drive->sendCmd(cmd, protocol, comID, buffer, bufferlen);
+	if (IF_SEND == cmd) sendCount++;
+	else recvCount++;
+	uint64_t start = DtaTrace::now();
+	uint8_t rc = drive->sendCmd(cmd, protocol, comID, buffer, bufferlen);
+	DtaTrace::record(cmd, protocol, comID, rc, start, buffer, bufferlen);
+	return rc;
+}
+
+uint8_t DtaDevOS::lockDrive(DTA_LOCK mode)
+{
+	return DtaDevLock(driveKey(), mode);
+}
+
+void DtaDevOS::unlockDrive(DTA_LOCK mode)
+{
+	DtaDevUnlock(driveKey(), mode);
 }
 
 void DtaDevOS::identify(OPAL_DiskInfo& disk_info)
@@ -121,36 +166,51 @@ void DtaDevOS::osmsSleep(uint32_t ms)
 	usleep(ms * 1000); //convert to microseconds
     return;
 }
-int  DtaDevOS::diskScan()
+/** true if the disk reports a standby power condition. NVMe media
+ * does not spin, only SCSI and ATA disks are asked. */
+static bool diskStandby(const DtaDiskEntry & disk)
+{
+    if (0 != disk.devref.compare(0, 7, "/dev/sd")) return false;
+    DtaDevLinuxSata sata;
+    if (!sata.init(disk.devref.c_str())) return false;
+    return DTA_POWER_STANDBY ==
+        sata.powerMode(("sas" == disk.transport) || ("scsi" == disk.transport));
+}
+
+int  DtaDevOS::diskScan(const char * filter, bool noSpinUp)
 {
-    DIR *dir;
-    struct dirent *dirent;
     DtaDev * d;
-    char devname[25];
-    vector<string> devices;
-    string tempstring;
+    vector<DtaDiskEntry> disks;
+    DtaDiskFilter diskfilter;
+    DtaDiskCache cache;
+    bool cacheChanged = false;
     
     LOG(D1) << "Entering DtaDevOS:diskScan ";
-    dir = opendir("/dev");
-    if(dir!=NULL)
-    {
-        while((dirent=readdir(dir))!=NULL) {
-            if((!fnmatch("sd[a-z]",dirent->d_name,0)) || 
-                    (!fnmatch("nvme[0-9]",dirent->d_name,0)) ||
-                    (!fnmatch("nvme[0-9][0-9]",dirent->d_name,0))
-                    ) {
-                tempstring = dirent->d_name;
-                devices.push_back(tempstring);
-            }
-        }
-        closedir(dir);
-    }
-    std::sort(devices.begin(),devices.end());
+    if ((NULL != filter) && !DtaDiskFilterParse(filter, diskfilter))
+        return DTAERROR_INVALID_PARAMETER;
+    DtaDiskEnum(disks, (NULL == filter) ? NULL : &diskfilter);
+    if (noSpinUp) DtaDiskCacheLoad(cache);
     printf("Scanning for Opal compliant disks\n");
-    for(uint16_t i = 0; i < devices.size(); i++) {
-                snprintf(devname,23,"/dev/%s",devices[i].c_str());
-                printf("%-10s", devname);
-                d = new DtaDevGeneric(devname);
+    for(size_t i = 0; i < disks.size(); i++) {
+                printf("%-10s", disks[i].devref.c_str());
+                string key = DtaDiskCacheKey(disks[i]);
+                if (noSpinUp && diskStandby(disks[i])) {
+                    DtaDiskCache::iterator c = key.empty() ? cache.end() : cache.find(key);
+                    if (cache.end() == c) {
+                        printf(" ?   %s (standby, not probed)\n", disks[i].model.c_str());
+                        continue;
+                    }
+                    if (c->second.ssc & DTA_CACHE_ANYSSC)
+                        printf(" %s%s%s ", ((c->second.ssc & DTA_CACHE_OPAL1) ? "1" : " "),
+                            ((c->second.ssc & DTA_CACHE_OPAL2) ? "2" : " "),
+                            ((c->second.ssc & DTA_CACHE_EPRISE) ? "E" : " "));
+                    else
+                        printf("%s", " No  ");
+                    printf("%s %s (standby, cached)\n", c->second.model.c_str(),
+                        c->second.firmware.c_str());
+                    continue;
+                }
+                d = new DtaDevGeneric(disks[i].devref.c_str());
 		if (d->isAnySSC())
                     printf(" %s%s%s ", (d->isOpal1() ? "1" : " "),
 			(d->isOpal2() ? "2" : " "), (d->isEprise() ? "E" : " "));
@@ -158,9 +218,25 @@ int  DtaDevOS::diskScan()
                     printf("%s", " No  ");
                 
                 printf("%s %s\n",d->getModelNum(),d->getFirmwareRev());
+                if (noSpinUp && !key.empty() && d->isPresent()) {
+                    DtaDiskCacheEntry & e = cache[key];
+                    e.ssc = (d->isOpal1() ? DTA_CACHE_OPAL1 : 0) |
+                        (d->isOpal2() ? DTA_CACHE_OPAL2 : 0) |
+                        (d->isEprise() ? DTA_CACHE_EPRISE : 0) |
+                        (d->isAnySSC() ? DTA_CACHE_ANYSSC : 0);
+                    e.probed = time(NULL);
+                    e.model = d->getModelNum();
+                    e.firmware = d->getFirmwareRev();
+                    e.serial = d->getSerialNum();
+                    e.devType = d->getDevType();
+                    cacheChanged = true;
+                }
                 delete d;
           }
 	printf("No more disks present ending scan\n");
+    if (cacheChanged && !DtaDiskCacheSave(cache)) {
+        LOG(W) << "Unable to update the scan cache " << DtaDiskCachePath();
+    }
         LOG(D1) << "Exiting DtaDevOS::scanDisk ";
 	return 0;
 }
@@ -38,6 +38,13 @@ public:
      * @param devref character representation of the device is standard OS lexicon
      */
     void init(const char * devref);
+    /** init() for a drive whose identify results are already known: the
+     * device type, serial number, firmware revision and model number are
+     * taken from identity and only Level 0 Discovery is sent.
+     * @param devref character representation of the device is standard OS lexicon
+     * @param identity results of an earlier identify, NULL to send one
+     */
+    void init(const char * devref, const OPAL_DiskInfo * identity);
     /** OS specific method to send an ATA command to the device
      * @param cmd ATA command to be sent to the device
      * @param protocol security protocol to be used in the command
@@ -47,8 +54,18 @@ public:
      */
     uint8_t sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
             void * buffer, uint32_t bufferlen);
-    /** A static class to scan for supported drives */
-    static int diskScan();
+    /** flock() the drive's lock file, see DtaDevLock */
+    uint8_t lockDrive(DTA_LOCK mode);
+    /** release a lock taken with lockDrive */
+    void unlockDrive(DTA_LOCK mode);
+    /** A static class to scan for supported drives
+     * @param filter optional transport/vendor/model filter, see DtaDiskFilterParse
+     * @param noSpinUp report disks in standby from the scan cache instead of
+     *        probing them, and refresh the cache from the disks that are probed
+     */
+    static int diskScan(const char * filter = NULL, bool noSpinUp = false);
+    uint64_t sendCount; /**< IF_SEND commands issued to the device */
+    uint64_t recvCount; /**< IF_RECV commands issued to the device */
 protected:
     /** OS specific command to Wait for specified number of milliseconds 
      * @param ms  number of milliseconds to wait
@@ -0,0 +1,127 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "DtaDiskCache.h"
+
+using namespace std;
+
+const char * DtaDiskCachePath()
+{
+	const char * path = getenv("SEDUTIL_SCAN_CACHE");
+	return ((NULL != path) && (0 != path[0])) ? path : DTA_DISK_CACHE;
+}
+
+string DtaDiskCacheKey(const DtaDiskEntry & disk)
+{
+	if (!disk.wwid.empty()) return disk.wwid;
+	if (!disk.serial.empty()) return disk.transport + ":" + disk.serial;
+	return "";
+}
+
+/** Keep a field on its line, tabs and newlines become blanks */
+static string cacheField(const string & value)
+{
+	string s(value);
+	for (size_t i = 0; i < s.length(); i++)
+		if (('\t' == s[i]) || ('\n' == s[i]) || ('\r' == s[i])) s[i] = ' ';
+	return s;
+}
+
+/* one line per disk: key, ssc bits, probe time, model, firmware, serial and
+ * device type, tab separated; older files stop after firmware */
+void DtaDiskCacheLoad(DtaDiskCache & cache)
+{
+	LOG(D1) << "Entering DtaDiskCacheLoad " << DtaDiskCachePath();
+	cache.clear();
+	FILE * f = fopen(DtaDiskCachePath(), "re");
+	if (NULL == f) {
+		LOG(D1) << "No scan cache " << strerror(errno);
+		return;
+	}
+	char line[1024];
+	while (NULL != fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\n")] = 0;
+		char * field[7];
+		char * p = line;
+		int n;
+		for (n = 0; n < 7; n++) {
+			field[n] = p;
+			p = strchr(p, '\t');
+			if (NULL == p) break;
+			*p++ = 0;
+		}
+		if ((4 != n) && (6 != n)) continue;
+		DtaDiskCacheEntry & e = cache[field[0]];
+		e.ssc = (uint8_t)strtoul(field[1], NULL, 16);
+		e.probed = (time_t)strtoll(field[2], NULL, 10);
+		e.model = field[3];
+		e.firmware = field[4];
+		if (6 == n) {
+			e.serial = field[5];
+			e.devType = (DTA_DEVICE_TYPE)strtoul(field[6], NULL, 10);
+			if (e.devType > DEVICE_TYPE_OTHER) e.devType = DEVICE_TYPE_OTHER;
+		}
+	}
+	fclose(f);
+}
+
+bool DtaDiskCacheSave(const DtaDiskCache & cache)
+{
+	LOG(D1) << "Entering DtaDiskCacheSave " << DtaDiskCachePath();
+	string path(DtaDiskCachePath());
+	size_t slash = path.rfind('/');
+	if ((string::npos != slash) && (0 != slash))
+		mkdir(path.substr(0, slash).c_str(), 0755);
+	/* a unique name in the same directory, concurrent scans each write
+	 * their own file and the last rename wins */
+	string tmp = path + ".XXXXXX";
+	int fd = mkostemp(&tmp[0], O_CLOEXEC);
+	if (0 > fd) {
+		LOG(D1) << "Unable to write " << tmp << " " << strerror(errno);
+		return false;
+	}
+	fchmod(fd, 0644);
+	FILE * f = fdopen(fd, "w");
+	if (NULL == f) {
+		LOG(D1) << "Unable to write " << tmp << " " << strerror(errno);
+		close(fd);
+		unlink(tmp.c_str());
+		return false;
+	}
+	for (DtaDiskCache::const_iterator it = cache.begin(); it != cache.end(); it++)
+		fprintf(f, "%s\t%02x\t%lld\t%s\t%s\t%s\t%u\n", cacheField(it->first).c_str(),
+			it->second.ssc, (long long)it->second.probed,
+			cacheField(it->second.model).c_str(), cacheField(it->second.firmware).c_str(),
+			cacheField(it->second.serial).c_str(), (unsigned)it->second.devType);
+	/* rename over the old file so a reader never sees half of it */
+	if (fclose(f) || rename(tmp.c_str(), path.c_str())) {
+		LOG(D1) << "Unable to replace " << path << " " << strerror(errno);
+		unlink(tmp.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,61 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include <stdint.h>
+#include <time.h>
+#include <map>
+#include <string>
+#include "DtaDiskEnum.h"
+#include "DtaStructures.h"
+
+/** default location of the scan cache, SEDUTIL_SCAN_CACHE overrides it */
+#define DTA_DISK_CACHE "/var/cache/sedutil/scan"
+
+/** DtaDiskCacheEntry::ssc bits */
+#define DTA_CACHE_OPAL1 0x01
+#define DTA_CACHE_OPAL2 0x02
+#define DTA_CACHE_EPRISE 0x04
+#define DTA_CACHE_ANYSSC 0x08
+
+/** Identity and Level 0 Discovery summary of a disk from its last probe */
+typedef struct _DtaDiskCacheEntry {
+	uint8_t ssc; /**< DTA_CACHE_ bits */
+	time_t probed; /**< when the disk was last probed */
+	std::string model; /**< model number from identify */
+	std::string firmware; /**< firmware revision from identify */
+	std::string serial; /**< serial number from identify */
+	DTA_DEVICE_TYPE devType = DEVICE_TYPE_OTHER; /**< from identify, OTHER if not recorded */
+} DtaDiskCacheEntry;
+
+/** Cache of scan results, so a disk in standby can be reported without
+ * spinning it up.  Entries are keyed by the wwid or serial number sysfs
+ * gives for the disk, which stay the same when device names move.
+ */
+typedef std::map<std::string, DtaDiskCacheEntry> DtaDiskCache;
+
+/** Path of the cache file */
+const char * DtaDiskCachePath();
+/** Cache key of a disk, empty if sysfs has neither wwid nor serial */
+std::string DtaDiskCacheKey(const DtaDiskEntry & disk);
+/** Read the cache, a missing or unreadable file gives an empty cache */
+void DtaDiskCacheLoad(DtaDiskCache & cache);
+/** Replace the cache file
+ * @return false if it could not be written */
+bool DtaDiskCacheSave(const DtaDiskCache & cache);
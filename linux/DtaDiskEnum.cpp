@@ -0,0 +1,305 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <dirent.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <algorithm>
+#include "DtaDiskEnum.h"
+
+using namespace std;
+
+/** Read a small sysfs attribute with trailing white space removed.
+ * sysfs attributes are generated by the kernel from what it already
+ * knows about the device, reading them does not issue any I/O to it.
+ */
+static string sysfsRead(const string & path)
+{
+	char buf[256];
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (0 > fd) return "";
+	ssize_t len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (0 >= len) return "";
+	while ((0 < len) && isspace((unsigned char)buf[len - 1])) len--;
+	buf[len] = 0;
+	return string(buf);
+}
+
+/** Last path component of a sysfs symlink target */
+static string sysfsLinkName(const string & path)
+{
+	char buf[PATH_MAX];
+	ssize_t len = readlink(path.c_str(), buf, sizeof(buf) - 1);
+	if (0 >= len) return "";
+	buf[len] = 0;
+	char * name = strrchr(buf, '/');
+	return string(name ? name + 1 : buf);
+}
+
+/** Resolved sysfs path */
+static string sysfsRealPath(const string & path)
+{
+	char buf[PATH_MAX];
+	if (NULL == realpath(path.c_str(), buf)) return "";
+	return string(buf);
+}
+
+/** Fill in where a disk sits from its resolved sysfs path: the last PCI
+ * function on the way down is the adapter, the last expander-H:N is the
+ * SAS expander.
+ */
+static void sysfsTopology(const string & real, DtaDiskEntry & disk)
+{
+	disk.hba = "";
+	disk.expander = "";
+	size_t start = 0;
+	while (start < real.length()) {
+		size_t end = real.find('/', start);
+		if (string::npos == end) end = real.length();
+		string part = real.substr(start, end - start);
+		start = end + 1;
+		if (!fnmatch("[0-9a-f][0-9a-f][0-9a-f][0-9a-f]:[0-9a-f][0-9a-f]:[0-9a-f][0-9a-f].[0-7]",
+			part.c_str(), 0)) disk.hba = part;
+		else if (!fnmatch("expander-*", part.c_str(), 0)) disk.expander = part;
+	}
+}
+
+/** SCSI unit serial number from the cached VPD page 0x80 */
+static string sysfsVpdSerial(const string & path)
+{
+	unsigned char buf[256];
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (0 > fd) return "";
+	ssize_t len = read(fd, buf, sizeof(buf));
+	close(fd);
+	if (4 > len) return "";
+	ssize_t end = 4 + buf[3];
+	if (end > len) end = len;
+	string serial((char *)buf + 4, end - 4);
+	serial.erase(0, serial.find_first_not_of(" \t"));
+	serial.erase(serial.find_last_not_of(" \t\n") + 1);
+	return serial;
+}
+
+/** Kernel order for device names: runs of digits compare as numbers and
+ * runs of letters compare shorter first, so sdz < sdaa and nvme9 < nvme10.
+ */
+static bool diskNameLess(const DtaDiskEntry & a, const DtaDiskEntry & b)
+{
+	const char * p = a.name.c_str();
+	const char * q = b.name.c_str();
+	while (*p && *q) {
+		bool pd = (0 != isdigit((unsigned char)*p));
+		bool qd = (0 != isdigit((unsigned char)*q));
+		if (pd != qd) return pd;
+		size_t pl = 0, ql = 0;
+		while (p[pl] && (0 != isdigit((unsigned char)p[pl])) == pd) pl++;
+		while (q[ql] && (0 != isdigit((unsigned char)q[ql])) == qd) ql++;
+		if (pd) {
+			unsigned long pn = strtoul(p, NULL, 10), qn = strtoul(q, NULL, 10);
+			if (pn != qn) return pn < qn;
+		}
+		else {
+			if (pl != ql) return pl < ql;
+			int c = strncmp(p, q, pl);
+			if (c) return c < 0;
+		}
+		p += pl;
+		q += ql;
+	}
+	return (0 == *p) && (0 != *q);
+}
+
+static bool diskFilterMatch(const string & pattern, const string & value)
+{
+	if (pattern.empty()) return true;
+	return 0 == fnmatch(pattern.c_str(), value.c_str(), FNM_CASEFOLD);
+}
+
+bool DtaDiskFilterMatch(const DtaDiskFilter * filter, const DtaDiskEntry & disk)
+{
+	if (NULL == filter) return true;
+	return diskFilterMatch(filter->transport, disk.transport) &&
+		diskFilterMatch(filter->vendor, disk.vendor) &&
+		diskFilterMatch(filter->model, disk.model);
+}
+
+bool DtaDiskFilterParse(const char * spec, DtaDiskFilter & filter)
+{
+	LOG(D1) << "Entering DtaDiskFilterParse " << spec;
+	string s(spec);
+	size_t start = 0;
+	while (start <= s.length()) {
+		size_t end = s.find(',', start);
+		if (string::npos == end) end = s.length();
+		string item = s.substr(start, end - start);
+		start = end + 1;
+		if (item.empty()) continue;
+		size_t eq = item.find('=');
+		if (string::npos == eq) {
+			LOG(E) << "Filter item " << item << " is not key=pattern";
+			return false;
+		}
+		string key = item.substr(0, eq);
+		string value = item.substr(eq + 1);
+		if ("transport" == key) filter.transport = value;
+		else if ("vendor" == key) filter.vendor = value;
+		else if ("model" == key) filter.model = value;
+		else {
+			LOG(E) << "Unknown filter key " << key << ", use transport, vendor or model";
+			return false;
+		}
+	}
+	return true;
+}
+
+/** Fill in a SCSI disk (sd) from /sys/class/block
+ * @return false for partitions, virtual devices and anything sd does not drive
+ */
+static bool diskBlockEntry(const char * name, DtaDiskEntry & disk)
+{
+	string sys = string("/sys/class/block/") + name;
+	if (0 == access((sys + "/partition").c_str(), F_OK)) return false;
+	string real = sysfsRealPath(sys);
+	if (real.empty() || (string::npos != real.find("/devices/virtual/"))) return false;
+	/* nvme namespaces are covered by their controller */
+	if ("scsi" != sysfsLinkName(sys + "/device/subsystem")) return false;
+	/* direct access, simplified direct access and optical memory
+	 * are the types sd binds to, sr and friends are skipped */
+	string type = sysfsRead(sys + "/device/type");
+	if (("0" != type) && ("7" != type) && ("14" != type)) return false;
+	disk.name = name;
+	disk.devref = string("/dev/") + name;
+	if (string::npos != real.find("/usb")) disk.transport = "usb";
+	else if (string::npos != real.find("/ata")) disk.transport = "ata";
+	else if ((string::npos != real.find("/end_device-")) ||
+		(string::npos != real.find("/sas_"))) disk.transport = "sas";
+	else disk.transport = "scsi";
+	disk.vendor = sysfsRead(sys + "/device/vendor");
+	disk.model = sysfsRead(sys + "/device/model");
+	disk.serial = sysfsVpdSerial(sys + "/device/vpd_pg80");
+	disk.wwid = sysfsRead(sys + "/device/wwid");
+	disk.namespaces = 0;
+	sysfsTopology(real, disk);
+	return true;
+}
+
+/** Fill in an NVMe controller from /sys/class/nvme.  Fabrics controllers
+ * live under /sys/devices/virtual so the virtual check does not apply here.
+ * @param count count the namespaces behind the controller
+ */
+static bool diskNvmeEntry(const char * name, DtaDiskEntry & disk, bool count)
+{
+	if (fnmatch("nvme[0-9]*", name, 0)) return false;
+	string sys = string("/sys/class/nvme/") + name;
+	if (0 != access(sys.c_str(), F_OK)) return false;
+	disk.name = name;
+	disk.devref = string("/dev/") + name;
+	disk.transport = sysfsRead(sys + "/transport");
+	if (disk.transport.empty()) disk.transport = "pcie";
+	disk.vendor = sysfsRead(sys + "/device/vendor");
+	disk.model = sysfsRead(sys + "/model");
+	disk.serial = sysfsRead(sys + "/serial");
+	disk.namespaces = 0;
+	sysfsTopology(sysfsRealPath(sys), disk);
+	if (!count) return true;
+	DIR * nsdir = opendir(sys.c_str());
+	if (NULL != nsdir) {
+		struct dirent * ns;
+		while (NULL != (ns = readdir(nsdir)))
+			if (!fnmatch("nvme*n[0-9]*", ns->d_name, 0)) disk.namespaces++;
+		closedir(nsdir);
+	}
+	return true;
+}
+
+static void diskEnumBlock(vector<DtaDiskEntry> & disks, const DtaDiskFilter * filter)
+{
+	DIR * dir = opendir("/sys/class/block");
+	if (NULL == dir) {
+		LOG(D1) << "No /sys/class/block";
+		return;
+	}
+	struct dirent * dirent;
+	while (NULL != (dirent = readdir(dir))) {
+		if ('.' == dirent->d_name[0]) continue;
+		DtaDiskEntry disk;
+		if (!diskBlockEntry(dirent->d_name, disk)) continue;
+		if (!DtaDiskFilterMatch(filter, disk)) {
+			LOG(D2) << disk.name << " filtered out";
+			continue;
+		}
+		disks.push_back(disk);
+	}
+	closedir(dir);
+}
+
+static void diskEnumNvme(vector<DtaDiskEntry> & disks, const DtaDiskFilter * filter)
+{
+	DIR * dir = opendir("/sys/class/nvme");
+	if (NULL == dir) {
+		LOG(D1) << "No /sys/class/nvme";
+		return;
+	}
+	struct dirent * dirent;
+	while (NULL != (dirent = readdir(dir))) {
+		DtaDiskEntry disk;
+		if (!diskNvmeEntry(dirent->d_name, disk, false)) continue;
+		if (!DtaDiskFilterMatch(filter, disk)) {
+			LOG(D2) << disk.name << " filtered out";
+			continue;
+		}
+		diskNvmeEntry(dirent->d_name, disk, true);
+		disks.push_back(disk);
+	}
+	closedir(dir);
+}
+
+size_t DtaDiskEnum(vector<DtaDiskEntry> & disks, const DtaDiskFilter * filter)
+{
+	LOG(D1) << "Entering DtaDiskEnum";
+	disks.clear();
+	diskEnumNvme(disks, filter);
+	size_t nvme = disks.size();
+	diskEnumBlock(disks, filter);
+	std::sort(disks.begin(), disks.begin() + nvme, diskNameLess);
+	std::sort(disks.begin() + nvme, disks.end(), diskNameLess);
+	LOG(D1) << "DtaDiskEnum found " << disks.size() << " disks";
+	return disks.size();
+}
+
+bool DtaDiskLookup(const char * name, DtaDiskEntry & disk)
+{
+	LOG(D1) << "Entering DtaDiskLookup " << name;
+	if (diskNvmeEntry(name, disk, true)) return true;
+	/* an nvme namespace maps to the controller that owns the TPer */
+	string sys = string("/sys/class/block/") + name;
+	if ("nvme" == sysfsLinkName(sys + "/device/subsystem")) {
+		string ctrl = sysfsLinkName(sys + "/device");
+		return diskNvmeEntry(ctrl.c_str(), disk, true);
+	}
+	return diskBlockEntry(name, disk);
+}
@@ -0,0 +1,83 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/** One whole disk found in sysfs.  Everything here comes from attributes
+ * the kernel cached when the device was probed, so building the list does
+ * not touch the drives.
+ */
+typedef struct _DtaDiskEntry {
+	std::string name; /**< kernel name, sda or nvme0 */
+	std::string devref; /**< device node handed to DtaDevOS, /dev/sda or /dev/nvme0 */
+	std::string transport; /**< ata, sas, usb, scsi, pcie, tcp, rdma, fc, loop */
+	std::string vendor; /**< SCSI vendor, or PCI vendor id for NVMe */
+	std::string model; /**< model string, trailing blanks removed */
+	std::string serial; /**< serial number if sysfs has one */
+	std::string wwid; /**< SCSI world wide identifier if sysfs has one */
+	uint32_t namespaces; /**< NVMe namespaces behind the controller, 0 otherwise */
+	std::string hba; /**< PCI address of the host adapter, an NVMe controller is its own */
+	std::string expander; /**< SAS expander the disk hangs off, empty if none */
+} DtaDiskEntry;
+
+/** Filter applied to the sysfs attributes before a device is opened.
+ * Each field is an fnmatch(3) pattern matched without regard to case,
+ * an empty pattern matches everything.
+ */
+typedef struct _DtaDiskFilter {
+	std::string transport; /**< pattern for DtaDiskEntry::transport */
+	std::string vendor; /**< pattern for DtaDiskEntry::vendor */
+	std::string model; /**< pattern for DtaDiskEntry::model */
+} DtaDiskFilter;
+
+/** Parse a filter specification
+ * @param spec comma separated key=pattern list, keys are transport, vendor and model
+ * @param filter filled in from spec
+ * @return true if spec was valid
+ */
+bool DtaDiskFilterParse(const char * spec, DtaDiskFilter & filter);
+
+/** Check a disk against a filter
+ * @param filter the filter, NULL matches every disk
+ * @param disk disk to check
+ */
+bool DtaDiskFilterMatch(const DtaDiskFilter * filter, const DtaDiskEntry & disk);
+
+/** List the disks sedutil can talk to.
+ * SCSI disks (SATA, SAS, USB) come from /sys/class/block, partitions and
+ * anything under /sys/devices/virtual are skipped.  NVMe is listed once per
+ * controller from /sys/class/nvme since the TPer belongs to the controller,
+ * not to each namespace.  NVMe controllers come first, then SCSI disks,
+ * each in kernel order (sdz before sdaa, nvme9 before nvme10).
+ * @param disks cleared and filled with the disks found
+ * @param filter optional filter, NULL lists everything
+ * @return number of disks in the list
+ */
+size_t DtaDiskEnum(std::vector<DtaDiskEntry> & disks, const DtaDiskFilter * filter = NULL);
+
+/** Look up one disk in sysfs, without touching the drive
+ * @param name kernel name, sda, nvme0 or an nvme namespace such as nvme0n1
+ *        which resolves to its controller
+ * @param disk filled in when the name is a disk sedutil can talk to
+ * @return false for partitions, virtual devices and anything unknown
+ */
+bool DtaDiskLookup(const char * name, DtaDiskEntry & disk);
@@ -0,0 +1,295 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "DtaDiskWatch.h"
+#include "DtaProbe.h"
+#include "DtaExecutor.h"
+#include "DtaJson.h"
+
+using namespace std;
+
+/** What the watch knows about one disk */
+typedef struct _DtaWatchDisk {
+	DtaDiskEntry disk; /**< sysfs description */
+	DtaProbeResult probe; /**< identify and Level 0 Discovery */
+} DtaWatchDisk;
+
+void DtaWatchQuiet::probed(const string & name, uint64_t now)
+{
+	expect[name] = now + DTA_WATCH_QUIET_MS;
+}
+
+bool DtaWatchQuiet::ignore(const string & name, const string & action, uint64_t now)
+{
+	map<string, uint64_t>::iterator it = expect.find(name);
+	if (expect.end() == it) return false;
+	/* whatever comes first closes the window, an add or remove means the
+	 * disk is probed again or gone */
+	bool quiet = ("change" == action) && (now <= it->second);
+	expect.erase(it);
+	return quiet;
+}
+
+static uint64_t watchNow()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static const char * watchSSC(const DtaProbeResult & p)
+{
+	if (p.opal2) return "opal2";
+	if (p.opal1) return "opal1";
+	if (p.enterprise) return "enterprise";
+	return "none";
+}
+
+static bool watchSame(const DtaWatchDisk & a, const DtaWatchDisk & b)
+{
+	const DtaProbeResult & x = a.probe;
+	const DtaProbeResult & y = b.probe;
+	return (x.rc == y.rc) && !strcmp(watchSSC(x), watchSSC(y)) &&
+		(a.disk.serial == b.disk.serial) && (x.firmware == y.firmware) &&
+		(x.lockingEnabled == y.lockingEnabled) && (x.locked == y.locked) &&
+		(x.mbrEnabled == y.mbrEnabled) && (x.mbrDone == y.mbrDone);
+}
+
+/** Write one NDJSON event */
+static void watchEvent(const char * event, const DtaWatchDisk & w)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	printf("{\"event\":\"%s\",\"time\":%lld.%03ld", event,
+		(long long)now.tv_sec, now.tv_nsec / 1000000);
+	DtaJsonString("device", w.disk.devref);
+	if (strcmp("remove", event)) {
+		DtaJsonString("transport", w.disk.transport);
+		DtaJsonString("vendor", w.disk.vendor);
+		DtaJsonString("model", w.disk.model);
+		DtaJsonString("serial", w.disk.serial);
+		const DtaProbeResult & p = w.probe;
+		bool present = (0 == p.rc);
+		printf(",\"present\":%s", present ? "true" : "false");
+		if (present) {
+			DtaJsonString("firmware", p.firmware);
+			DtaJsonString("ssc", watchSSC(p));
+		}
+		if (present && strcmp("none", watchSSC(p)))
+			printf(",\"locking_enabled\":%s,\"locked\":%s,\"mbr_enabled\":%s,\"mbr_done\":%s",
+				p.lockingEnabled ? "true" : "false", p.locked ? "true" : "false",
+				p.mbrEnabled ? "true" : "false", p.mbrDone ? "true" : "false");
+	}
+	printf("}\n");
+	fflush(stdout);
+}
+
+/** Probe a batch of disks, each on its own queue so they run in parallel */
+static void watchProbeAll(DtaExecutor & pool, DtaWatchQuiet & quiet, vector<DtaWatchDisk> & probe)
+{
+	for (size_t i = 0; i < probe.size(); i++) {
+		DtaWatchDisk * w = &probe[i];
+		w->probe = DtaProbeResult();
+		w->probe.device = w->disk.devref;
+		pool.submit(w, [w] { DtaProbeDrive(w->probe); return (uint8_t)0; },
+			[w](uint8_t rc, exception_ptr error) {
+				if (!error) return;
+				LOG(E) << "Probe of " << w->disk.devref << " failed";
+				w->probe.rc = rc;
+			});
+	}
+	pool.wait();
+	/* the disks that could be opened were closed just now */
+	uint64_t now = watchNow();
+	for (size_t i = 0; i < probe.size(); i++)
+		if (0 == probe[i].probe.rc) quiet.probed(probe[i].disk.name, now);
+}
+
+/** Merge probe results into the inventory and report the differences
+ * @param event event name for disks not in the inventory yet
+ */
+static void watchMerge(map<string, DtaWatchDisk> & inventory, vector<DtaWatchDisk> & probe,
+	const char * event)
+{
+	for (size_t i = 0; i < probe.size(); i++) {
+		map<string, DtaWatchDisk>::iterator it = inventory.find(probe[i].disk.name);
+		if (inventory.end() == it) {
+			inventory[probe[i].disk.name] = probe[i];
+			watchEvent(event, probe[i]);
+		}
+		else if (!watchSame(it->second, probe[i])) {
+			it->second = probe[i];
+			watchEvent("change", probe[i]);
+		}
+		else
+			it->second.disk = probe[i].disk;
+	}
+}
+
+/** Full scan, used at startup and to resynchronise after lost uevents */
+static void watchScan(DtaExecutor & pool, DtaWatchQuiet & quiet,
+	map<string, DtaWatchDisk> & inventory, const DtaDiskFilter * filter, const char * event)
+{
+	vector<DtaDiskEntry> disks;
+	vector<DtaWatchDisk> probe;
+	DtaDiskEnum(disks, filter);
+	map<string, bool> seen;
+	for (size_t i = 0; i < disks.size(); i++) {
+		DtaWatchDisk w;
+		w.disk = disks[i];
+		probe.push_back(w);
+		seen[disks[i].name] = true;
+	}
+	for (map<string, DtaWatchDisk>::iterator it = inventory.begin(); it != inventory.end(); ) {
+		if (seen.count(it->first)) {
+			it++;
+			continue;
+		}
+		watchEvent("remove", it->second);
+		inventory.erase(it++);
+	}
+	watchProbeAll(pool, quiet, probe);
+	watchMerge(inventory, probe, event);
+}
+
+/** Pull ACTION, SUBSYSTEM, DEVTYPE and DEVNAME out of a kernel uevent,
+ * "action@devpath" followed by NUL separated KEY=value pairs */
+static bool watchParse(const char * buf, size_t len, string & action, string & name)
+{
+	string subsystem, devtype;
+	action.clear();
+	name.clear();
+	for (size_t off = strnlen(buf, len) + 1; off < len; off += strnlen(buf + off, len - off) + 1) {
+		const char * kv = buf + off;
+		if (!strncmp(kv, "ACTION=", 7)) action = kv + 7;
+		else if (!strncmp(kv, "SUBSYSTEM=", 10)) subsystem = kv + 10;
+		else if (!strncmp(kv, "DEVTYPE=", 8)) devtype = kv + 8;
+		else if (!strncmp(kv, "DEVNAME=", 8)) name = kv + 8;
+	}
+	if (name.empty() || action.empty()) return false;
+	if (0 == name.compare(0, 5, "/dev/")) name.erase(0, 5);
+	if ("block" == subsystem) return "disk" == devtype;
+	return "nvme" == subsystem;
+}
+
+uint8_t DtaDiskWatch(const DtaDiskFilter * filter)
+{
+	LOG(D1) << "Entering DtaDiskWatch";
+	map<string, DtaWatchDisk> inventory;
+	DtaWatchQuiet quiet;
+	DtaExecutor pool;
+	char buf[8192];
+
+	/* subscribe before the first scan so nothing is missed in between,
+	 * devtmpfs has created the device node by the time the kernel sends
+	 * the uevent so there is no need to wait for udev */
+	int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+	if (0 > fd) {
+		LOG(E) << "Unable to open uevent socket " << strerror(errno);
+		return DTAERROR_OPEN_ERR;
+	}
+	int rcvbuf = 4 * 1024 * 1024;
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)))
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	struct sockaddr_nl addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1; /* kernel uevents */
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		LOG(E) << "Unable to bind uevent socket " << strerror(errno);
+		close(fd);
+		return DTAERROR_OPEN_ERR;
+	}
+	watchScan(pool, quiet, inventory, filter, "present");
+
+	while (true) {
+		struct pollfd pfd = { fd, POLLIN, 0 };
+		if ((0 > poll(&pfd, 1, -1)) && (EINTR != errno)) {
+			LOG(E) << "poll failed " << strerror(errno);
+			break;
+		}
+		/* drain everything queued so a burst (a new enclosure, a
+		 * partition table rescan) costs one probe per disk */
+		map<string, string> pending;
+		bool overflow = false;
+		while (true) {
+			struct sockaddr_nl from;
+			socklen_t fromlen = sizeof(from);
+			ssize_t len = recvfrom(fd, buf, sizeof(buf) - 1, 0, (struct sockaddr *)&from, &fromlen);
+			if (0 > len) {
+				if (ENOBUFS == errno) {
+					overflow = true;
+					continue;
+				}
+				if (EINTR == errno) continue;
+				break;
+			}
+			/* only the kernel sends on group 1 */
+			if (0 != from.nl_pid) continue;
+			buf[len] = 0;
+			string action, name;
+			if (!watchParse(buf, len, action, name)) continue;
+			LOG(D2) << "uevent " << action << " " << name;
+			if (quiet.ignore(name, action, watchNow())) continue;
+			if (("add" == action) || ("change" == action) || ("remove" == action) ||
+				("online" == action) || ("offline" == action))
+				pending[name] = action;
+		}
+		if (overflow) {
+			LOG(W) << "uevents were lost, rescanning";
+			watchScan(pool, quiet, inventory, filter, "add");
+			continue;
+		}
+		vector<DtaWatchDisk> probe;
+		map<string, bool> queued;
+		for (map<string, string>::iterator it = pending.begin(); it != pending.end(); it++) {
+			if ("remove" == it->second) {
+				map<string, DtaWatchDisk>::iterator inv = inventory.find(it->first);
+				if (inventory.end() != inv) {
+					watchEvent("remove", inv->second);
+					inventory.erase(inv);
+				}
+				continue;
+			}
+			DtaWatchDisk w;
+			if (!DtaDiskLookup(it->first.c_str(), w.disk)) continue;
+			if (queued.count(w.disk.name)) continue;
+			if (!inventory.count(w.disk.name) && !DtaDiskFilterMatch(filter, w.disk)) continue;
+			queued[w.disk.name] = true;
+			probe.push_back(w);
+		}
+		if (probe.empty()) continue;
+		watchProbeAll(pool, quiet, probe);
+		watchMerge(inventory, probe, "add");
+	}
+	close(fd);
+	return DTAERROR_COMMAND_ERROR;
+}
@@ -0,0 +1,67 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include <stdint.h>
+#include <map>
+#include <string>
+#include "DtaDiskEnum.h"
+
+/** How long after a probe the change uevent it causes may arrive, in ms */
+#define DTA_WATCH_QUIET_MS 2000
+
+/** The watch probes a disk through a descriptor opened for writing, and
+ * when that is closed udev's watch rule has the kernel send a change
+ * uevent for the disk.  Probing on that event would repeat forever, so
+ * after every probe the first change for the disk within
+ * DTA_WATCH_QUIET_MS is dropped.  Only the one event is absorbed, a later
+ * change (another tool unlocking the drive) is still probed.
+ */
+class DtaWatchQuiet {
+public:
+	/** A probe of the disk finished
+	 * @param name kernel name of the disk
+	 * @param now monotonic time in ms
+	 */
+	void probed(const std::string & name, uint64_t now);
+	/** Should this uevent be dropped
+	 * @param name kernel name of the disk
+	 * @param action uevent ACTION
+	 * @param now monotonic time in ms
+	 */
+	bool ignore(const std::string & name, const std::string & action, uint64_t now);
+private:
+	std::map<std::string, uint64_t> expect; /**< disk, end of its window */
+};
+
+/** Follow disks as they come and go and report their TCG state.
+ *
+ * All disks matching the filter are probed once and reported as
+ * "present", after that only kernel block and nvme uevents cause work:
+ * a disk that is added or changed is looked up in sysfs and probed with
+ * Level 0 Discovery, and an event is written only if its SSC or Locking
+ * state differs from the inventory.  Removed disks are dropped without
+ * any I/O.  The change uevent a probe itself causes is dropped, see
+ * DtaWatchQuiet.  Events are written to stdout as one JSON object per line.
+ * If the kernel drops uevents (the socket overflowed) the inventory is
+ * rebuilt with a full scan and the differences are reported.
+ * @param filter optional filter, NULL watches every disk
+ * @return only on error, a DTAERROR code
+ */
+uint8_t DtaDiskWatch(const DtaDiskFilter * filter);
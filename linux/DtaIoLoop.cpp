@@ -0,0 +1,313 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <errno.h>
+#include <signal.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/version.h>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 4, 0)
+#include <linux/nvme_ioctl.h>
+#endif
+#include "DtaIoLoop.h"
+
+/* NVMe passthrough needs 128 byte SQEs and 32 byte CQEs (5.19 headers) */
+#if defined(IORING_SETUP_SQE128) && defined(NVME_URING_CMD_ADMIN) && defined(__NR_io_uring_setup)
+#define DTA_IOURING 1
+#define DTA_SQE_SIZE 128
+#define DTA_CQE_SIZE 32
+#endif
+
+using namespace std;
+
+static uint64_t ioLoopNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+DtaIoLoop * DtaIoLoop::get()
+{
+	static thread_local DtaIoLoop loop;
+	return &loop;
+}
+
+DtaIoLoop::DtaIoLoop()
+{
+	ringFd = -1;
+	sqRing = sqes = cqes = NULL;
+	sqRingSize = sqesSize = 0;
+	sqHead = sqTail = sqMask = sqArray = NULL;
+	cqHead = cqTail = cqMask = NULL;
+	if (!setup(256)) {
+		LOG(D1) << "io_uring passthrough not available, using synchronous I/O";
+	}
+}
+
+bool DtaIoLoop::setup(uint32_t entries)
+{
+#ifdef DTA_IOURING
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_SQE128 | IORING_SETUP_CQE32;
+	int fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+	if (fd < 0) {
+		LOG(D1) << "io_uring_setup failed " << errno;
+		return false;
+	}
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG)) {
+		LOG(D1) << "io_uring too old for passthrough, features " << std::hex << p.features << std::dec;
+		close(fd);
+		return false;
+	}
+	sqRingSize = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+	if (p.cq_off.cqes + p.cq_entries * DTA_CQE_SIZE > sqRingSize)
+		sqRingSize = p.cq_off.cqes + p.cq_entries * DTA_CQE_SIZE;
+	sqesSize = p.sq_entries * DTA_SQE_SIZE;
+	void * ring = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		fd, IORING_OFF_SQ_RING);
+	void * entry = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		fd, IORING_OFF_SQES);
+	if ((MAP_FAILED == ring) || (MAP_FAILED == entry)) {
+		LOG(D1) << "io_uring mmap failed " << errno;
+		if (MAP_FAILED != ring) munmap(ring, sqRingSize);
+		if (MAP_FAILED != entry) munmap(entry, sqesSize);
+		sqRingSize = sqesSize = 0;
+		close(fd);
+		return false;
+	}
+	ringFd = fd;
+	sqRing = (uint8_t *)ring;
+	sqes = (uint8_t *)entry;
+	sqHead = (uint32_t *)(sqRing + p.sq_off.head);
+	sqTail = (uint32_t *)(sqRing + p.sq_off.tail);
+	sqMask = (uint32_t *)(sqRing + p.sq_off.ring_mask);
+	sqArray = (uint32_t *)(sqRing + p.sq_off.array);
+	cqHead = (uint32_t *)(sqRing + p.cq_off.head);
+	cqTail = (uint32_t *)(sqRing + p.cq_off.tail);
+	cqMask = (uint32_t *)(sqRing + p.cq_off.ring_mask);
+	cqes = sqRing + p.cq_off.cqes;
+	/* never more in flight than the completion ring can hold */
+	slots.resize(p.sq_entries);
+	for (uint32_t i = p.sq_entries; i > 0; i--)
+		freeSlots.push_back(i - 1);
+	LOG(D1) << "io_uring passthrough ready, " << p.sq_entries << " entries";
+	return true;
+#else
+	(void)entries;
+	return false;
+#endif
+}
+
+bool DtaIoLoop::uring()
+{
+	return (ringFd >= 0);
+}
+
+int DtaIoLoop::submit(const void * entry, DtaIoCallback cb, void * ctx)
+{
+#ifdef DTA_IOURING
+	if (ringFd < 0) return -EOPNOTSUPP;
+	while (freeSlots.empty())
+		reap(true, 0);
+	uint32_t tail = *sqTail;
+	uint32_t idx = tail & *sqMask;
+	struct io_uring_sqe * sqe = (struct io_uring_sqe *)(sqes + idx * DTA_SQE_SIZE);
+	memcpy(sqe, entry, DTA_SQE_SIZE);
+	uint32_t slot = freeSlots.back();
+	sqe->user_data = slot;
+	sqArray[idx] = idx;
+	__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+	int rc = (int)syscall(__NR_io_uring_enter, ringFd, 1, 0, 0, NULL, 0);
+	if (rc < 1) {
+		int err = (rc < 0) ? errno : EAGAIN;
+		/* the kernel only reads the queue inside io_uring_enter, take the entry back */
+		if (__atomic_load_n(sqHead, __ATOMIC_ACQUIRE) == tail)
+			__atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+		LOG(D1) << "io_uring_enter failed " << err;
+		return -err;
+	}
+	freeSlots.pop_back();
+	slots[slot].cb = cb;
+	slots[slot].ctx = ctx;
+	slots[slot].res = 0;
+	return 0;
+#else
+	(void)entry; (void)cb; (void)ctx;
+	return -EOPNOTSUPP;
+#endif
+}
+
+int DtaIoLoop::submitNvmeAdmin(int fd, const struct nvme_uring_cmd * cmd, DtaIoCallback cb, void * ctx)
+{
+	LOG(D1) << "Entering DtaIoLoop::submitNvmeAdmin";
+#ifdef DTA_IOURING
+	uint8_t entry[DTA_SQE_SIZE];
+	struct io_uring_sqe * sqe = (struct io_uring_sqe *)entry;
+	memset(entry, 0, sizeof(entry));
+	sqe->opcode = IORING_OP_URING_CMD;
+	sqe->fd = fd;
+	sqe->cmd_op = NVME_URING_CMD_ADMIN;
+	memcpy(entry + offsetof(struct io_uring_sqe, cmd), cmd, sizeof(*cmd));
+	return submit(entry, cb, ctx);
+#else
+	(void)fd; (void)cmd; (void)cb; (void)ctx;
+	return -EOPNOTSUPP;
+#endif
+}
+
+void DtaIoLoop::after(uint32_t us, DtaIoCallback cb, void * ctx, int32_t res)
+{
+	DtaIoEvent ev;
+	ev.cb = cb;
+	ev.ctx = ctx;
+	ev.res = res;
+	if (0 == us)
+		ready.push_back(ev);
+	else
+		timers.insert(make_pair(ioLoopNow() + (uint64_t)us * 1000, ev));
+}
+
+uint32_t DtaIoLoop::pending()
+{
+	return (uint32_t)(ready.size() + timers.size() + slots.size() - freeSlots.size());
+}
+
+void DtaIoLoop::reap(bool wait, uint64_t timeoutNs)
+{
+#ifdef DTA_IOURING
+	if (ringFd < 0) return;
+	uint32_t head = *cqHead;
+	if (wait && (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))) {
+		struct __kernel_timespec ts;
+		struct io_uring_getevents_arg arg;
+		uint32_t flags = IORING_ENTER_GETEVENTS;
+		memset(&arg, 0, sizeof(arg));
+		arg.sigmask_sz = _NSIG / 8;
+		if (timeoutNs) {
+			ts.tv_sec = timeoutNs / 1000000000ULL;
+			ts.tv_nsec = timeoutNs % 1000000000ULL;
+			arg.ts = (uint64_t)(uintptr_t)&ts;
+		}
+		flags |= IORING_ENTER_EXT_ARG;
+		if ((syscall(__NR_io_uring_enter, ringFd, 0, 1, flags, &arg, sizeof(arg)) < 0) &&
+			(ETIME != errno) && (EINTR != errno)) {
+			LOG(D1) << "io_uring_enter wait failed " << errno;
+		}
+	}
+	uint32_t tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+	while (head != tail) {
+		struct io_uring_cqe * cqe = (struct io_uring_cqe *)(cqes + (head & *cqMask) * DTA_CQE_SIZE);
+		uint32_t slot = (uint32_t)cqe->user_data;
+		slots[slot].res = cqe->res;
+		ready.push_back(slots[slot]);
+		freeSlots.push_back(slot);
+		head++;
+	}
+	__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+#else
+	(void)wait; (void)timeoutNs;
+#endif
+}
+
+void DtaIoLoop::expire()
+{
+	uint64_t now = ioLoopNow();
+	while (!timers.empty() && (timers.begin()->first <= now)) {
+		ready.push_back(timers.begin()->second);
+		timers.erase(timers.begin());
+	}
+}
+
+bool DtaIoLoop::runOnce()
+{
+	reap(false, 0);
+	expire();
+	if (ready.empty()) {
+		bool inflight = (slots.size() != freeSlots.size());
+		if (!inflight && timers.empty()) return false;
+		uint64_t timeout = 0;
+		if (!timers.empty()) {
+			uint64_t now = ioLoopNow();
+			/* a timeout of 0 means wait forever to reap(), never pass it for a timer */
+			timeout = (timers.begin()->first > now) ? timers.begin()->first - now : 1;
+		}
+		if (inflight)
+			reap(true, timeout);
+		else {
+			struct timespec ts;
+			ts.tv_sec = timeout / 1000000000ULL;
+			ts.tv_nsec = timeout % 1000000000ULL;
+			nanosleep(&ts, NULL);
+		}
+		expire();
+	}
+	/* callbacks may queue more work, only run what is due now */
+	deque<DtaIoEvent> due;
+	due.swap(ready);
+	while (!due.empty()) {
+		DtaIoEvent ev = due.front();
+		due.pop_front();
+		ev.cb(ev.ctx, ev.res);
+	}
+	return true;
+}
+
+void DtaIoLoop::run()
+{
+	while (runOnce());
+}
+
+int32_t DtaIoLoop::wait(DtaIoWait * w)
+{
+	while (!w->done) {
+		if (!runOnce()) {
+			LOG(E) << "DtaIoLoop::wait with nothing in flight";
+			return -EINVAL;
+		}
+	}
+	return w->res;
+}
+
+void DtaIoLoop::waitDone(void * ctx, int32_t res)
+{
+	DtaIoWait * w = (DtaIoWait *)ctx;
+	w->res = res;
+	w->done = true;
+}
+
+DtaIoLoop::~DtaIoLoop()
+{
+	if (ringFd < 0) return;
+	/* the buffers of anything still in flight belong to callers that are gone */
+	while (slots.size() != freeSlots.size())
+		reap(true, 0);
+	munmap(sqes, sqesSize);
+	munmap(sqRing, sqRingSize);
+	close(ringFd);
+}
@@ -0,0 +1,117 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <vector>
+
+struct nvme_uring_cmd;
+
+/** Completion callback for work handed to a DtaIoLoop
+ * @param ctx context pointer given when the work was submitted
+ * @param res result of the work, 0 or a status for commands, -errno on failure
+ */
+typedef void (*DtaIoCallback)(void * ctx, int32_t res);
+
+/** Synchronous wait on one piece of asynchronous work */
+typedef struct _DtaIoWait {
+	bool done; /**< set when the work completes */
+	int32_t res; /**< result passed to the callback */
+} DtaIoWait;
+
+/** Single threaded completion loop for asynchronous device I/O.
+ * NVMe security commands are submitted through io_uring passthrough
+ * (IORING_OP_URING_CMD) when the kernel supports it; timers and work
+ * that completed synchronously are queued in user space.  Every thread gets its own loop.  The transports wait on it
+ * for one command at a time, nothing keeps several in flight yet.
+ * Callbacks only ever run from runOnce() on the owning thread, never from
+ * inside the submitting call.
+ */
+class DtaIoLoop {
+public:
+	/** The loop belonging to the calling thread */
+	static DtaIoLoop * get();
+	/** Destructor */
+	~DtaIoLoop();
+	/** true if io_uring passthrough submission is available */
+	bool uring();
+	/** Submit an NVMe admin command through io_uring
+	 * @param fd NVMe controller character device, the namespace generic
+	 *        devices (ngXnY) only take I/O commands
+	 * @param cmd the command, copied into the submission queue
+	 * @param cb called with the NVMe status or -errno
+	 * @param ctx passed to cb
+	 * @return 0 if the command was queued, -errno otherwise (cb is not called)
+	 */
+	int submitNvmeAdmin(int fd, const struct nvme_uring_cmd * cmd, DtaIoCallback cb, void * ctx);
+	/** Complete work after a delay
+	 * @param us microseconds to wait, 0 completes on the next turn of the loop
+	 * @param cb callback
+	 * @param ctx passed to cb
+	 * @param res passed to cb
+	 */
+	void after(uint32_t us, DtaIoCallback cb, void * ctx, int32_t res = 0);
+	/** Number of callbacks that have not run yet */
+	uint32_t pending();
+	/** Wait for at least one completion and run the callbacks that are due
+	 * @return false if there was nothing to wait for
+	 */
+	bool runOnce();
+	/** Run the loop until no work is pending */
+	void run();
+	/** Run the loop until the work behind w completes, return its result */
+	int32_t wait(DtaIoWait * w);
+	/** DtaIoCallback that fills in a DtaIoWait */
+	static void waitDone(void * ctx, int32_t res);
+private:
+	/** A callback waiting to run */
+	typedef struct _DtaIoEvent {
+		DtaIoCallback cb;
+		void * ctx;
+		int32_t res;
+	} DtaIoEvent;
+	DtaIoLoop();
+	/** Set up the io_uring instance, false leaves the loop without one */
+	bool setup(uint32_t entries);
+	/** Copy a prepared submission queue entry into the ring and submit it
+	 * @return 0 or -errno
+	 */
+	int submit(const void * sqe, DtaIoCallback cb, void * ctx);
+	/** Move completed io_uring commands to the ready queue
+	 * @param wait wait for at least one completion
+	 * @param timeoutNs upper bound on the wait, 0 for none
+	 */
+	void reap(bool wait, uint64_t timeoutNs);
+	/** Move expired timers to the ready queue */
+	void expire();
+	int ringFd; /**< io_uring instance, -1 if unavailable */
+	uint8_t * sqRing; /**< mapped submission and completion rings */
+	size_t sqRingSize; /**< size of the mapping at sqRing */
+	uint8_t * sqes; /**< mapped submission queue entries */
+	size_t sqesSize; /**< size of the mapping at sqes */
+	uint32_t * sqHead, * sqTail, * sqMask, * sqArray;
+	uint32_t * cqHead, * cqTail, * cqMask;
+	uint8_t * cqes; /**< first completion queue entry */
+	std::vector<DtaIoEvent> slots; /**< in flight io_uring commands, indexed by user_data */
+	std::vector<uint32_t> freeSlots; /**< unused entries of slots */
+	std::deque<DtaIoEvent> ready; /**< callbacks ready to run */
+	std::multimap<uint64_t, DtaIoEvent> timers; /**< callbacks waiting for their deadline */
+};
@@ -31,5 +31,7 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 #define FALSE 0
 // a few OS specific methods that need to be worked out
 #define SNPRINTF snprintf
+/** zero a secret, the compiler may not drop it as a dead store */
+#define SECUREZERO(p, len) explicit_bzero((p), (len))
 #define DEVICEMASK snprintf(devname,23,"/dev/sd%c",(char) 0x61+i)
 #define DEVICEEXAMPLE "/dev/sdc"
@@ -0,0 +1,110 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "DtaTest.h"
+#include "DtaDevGeneric.h"
+#include "DtaDevOpal1.h"
+#include "DtaDevOpal2.h"
+#include "DtaDevEnterprise.h"
+#include "DtaCommand.h"
+#include "DtaResponse.h"
+#include "DtaLexicon.h"
+
+using namespace std;
+
+static int checks = 0;
+static int failures = 0;
+
+void DtaTestCheck(bool ok, const char * what, const char * file, int line)
+{
+	checks++;
+	if (ok) return;
+	failures++;
+	fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, what);
+}
+
+const string & DtaTestDir()
+{
+	static string dir;
+	if (!dir.empty()) return dir;
+	char path[] = "/tmp/sedutil-test.XXXXXX";
+	if (NULL == mkdtemp(path)) {
+		perror("mkdtemp");
+		exit(99);
+	}
+	dir = path;
+	setenv("SEDUTIL_LOCK_DIR", (dir + "/lock").c_str(), 1);
+	setenv("SEDUTIL_SCAN_CACHE", (dir + "/scan").c_str(), 1);
+	return dir;
+}
+
+DtaDev * DtaTestOpen(const char * devref)
+{
+	DtaDev * tempDev, *d = NULL;
+	tempDev = new DtaDevGeneric(devref);
+	if ((!tempDev->isPresent()) || (!tempDev->isAnySSC())) {
+		delete tempDev;
+		return NULL;
+	}
+	if (tempDev->isOpal2())
+		d = new DtaDevOpal2(devref);
+	else if (tempDev->isOpal1())
+		d = new DtaDevOpal1(devref);
+	else if (tempDev->isEprise())
+		d = new DtaDevEnterprise(devref);
+	delete tempDev;
+	if (NULL != d) d->no_hash_passwords = false;
+	return d;
+}
+
+uint8_t DtaTestStrand(DtaDev * d)
+{
+	DtaCommand cmd;
+	DtaResponse resp;
+	cmd.reset(OPAL_UID::OPAL_SMUID_UID, OPAL_METHOD::STARTSESSION);
+	cmd.addToken(OPAL_TOKEN::STARTLIST);
+	cmd.addToken(105);
+	cmd.addToken(OPAL_UID::OPAL_ADMINSP_UID);
+	cmd.addToken(OPAL_TINY_ATOM::UINT_01);
+	cmd.addToken(OPAL_TOKEN::ENDLIST);
+	cmd.complete();
+	cmd.setcomID(d->comID(), d->comIDExtension());
+	return d->exec(&cmd, resp);
+}
+
+static int testRemove(const char * path, const struct stat * st, int flag, struct FTW * ftw)
+{
+	(void)st;
+	(void)flag;
+	(void)ftw;
+	remove(path);
+	return 0;
+}
+
+int DtaTestResult(const char * name)
+{
+	if (!DtaTestDir().empty())
+		nftw(DtaTestDir().c_str(), testRemove, 16, FTW_DEPTH | FTW_PHYS);
+	printf("%s: %d checks, %d failed\n", name, checks, failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,58 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#pragma once
+/** Helpers for the checks under tests/, run by make check.
+ * The checks drive simulated TPers (sim:name devices) so they need no
+ * SED and no root; each program exits 0 when every CHECK held.
+ */
+#include <stdint.h>
+#include <string>
+#include "DtaDev.h"
+
+/** count a failed condition and say where it was */
+#define CHECK(cond) DtaTestCheck((cond), #cond, __FILE__, __LINE__)
+
+/** Record the outcome of one CHECK
+ * @param ok the condition held
+ * @param what the condition as written
+ * @param file source file of the CHECK
+ * @param line source line of the CHECK
+ */
+void DtaTestCheck(bool ok, const char * what, const char * file, int line);
+/** Private scratch directory of this run, created on the first call.
+ * SEDUTIL_LOCK_DIR and SEDUTIL_SCAN_CACHE are pointed into it so the
+ * checks leave /run and /var alone; call it before anything else.
+ */
+const std::string & DtaTestDir();
+/** Open a device the way sedutil-cli does, probe then pick the SSC
+ * @param devref sim:name
+ * @return the device or NULL if it is not a TCG drive
+ */
+DtaDev * DtaTestOpen(const char * devref);
+/** Start a session on the device's comID behind DtaSession's back, the
+ * way a crashed process leaves one, until a STACK_RESET
+ * @param d the device
+ */
+uint8_t DtaTestStrand(DtaDev * d);
+/** Remove the scratch directory and print a summary
+ * @param name the check program
+ * @return exit status for main
+ */
+int DtaTestResult(const char * name);
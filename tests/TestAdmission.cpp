@@ -0,0 +1,186 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <dirent.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "DtaTest.h"
+#include "DtaSession.h"
+#include "DtaStats.h"
+#include "DtaLexicon.h"
+#include "DtaDevLock.h"
+
+using namespace std;
+
+/** sessions of one process on the same comID wait for each other
+ * instead of colliding on the TPer */
+static void testAdmission()
+{
+	char devref[] = "sim:admit";
+	DtaDev * a = DtaTestOpen(devref);
+	DtaDev * b = DtaTestOpen(devref);
+	CHECK((NULL != a) && (NULL != b));
+	if ((NULL == a) || (NULL == b)) {
+		delete a;
+		delete b;
+		return;
+	}
+	CHECK(a->comID() == b->comID());
+	DtaStats::enabled() = true;
+	DtaStats::reset();
+	atomic<bool> started(false), ending(false);
+	uint8_t rcA = 0xff, rcB = 0xff;
+	bool waited = false;
+	thread first([&] {
+		DtaSession * s = new DtaSession(a);
+		rcA = s->start(OPAL_UID::OPAL_ADMINSP_UID);
+		started = true;
+		this_thread::sleep_for(chrono::milliseconds(300));
+		ending = true;
+		delete s;
+	});
+	while (!started)
+		this_thread::sleep_for(chrono::milliseconds(1));
+	thread second([&] {
+		DtaSession s(b);
+		rcB = s.start(OPAL_UID::OPAL_ADMINSP_UID);
+		waited = ending;
+	});
+	first.join();
+	second.join();
+	CHECK(0 == rcA);
+	CHECK(0 == rcB);
+	CHECK(waited);
+	/* the wait was admission's, the TPer never saw the second start early */
+	CHECK(0 == DtaStats::counted(DTASTATS_NO_SESSIONS));
+	DtaStats::enabled() = false;
+	delete a;
+	delete b;
+}
+
+/** a comID busy on the TPer is retried with backoff, then given up on */
+static void testRetry()
+{
+	char devref[] = "sim:retry";
+	DtaDev * d = DtaTestOpen(devref);
+	CHECK(NULL != d);
+	if (NULL == d) return;
+	DtaStats::enabled() = true;
+	DtaStats::reset();
+	CHECK(0 == DtaTestStrand(d));
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	{
+		DtaSession s(d);
+		CHECK(OPALSTATUSCODE::NO_SESSIONS_AVAILABLE == s.start(OPAL_UID::OPAL_ADMINSP_UID));
+		s.expectAbort();
+	}
+	/* eight attempts, the backoff doubles from 2ms and half of it is fixed */
+	CHECK(chrono::steady_clock::now() - start >= chrono::milliseconds(127));
+	CHECK(8 == DtaStats::counted(DTASTATS_NO_SESSIONS));
+	CHECK(7 == DtaStats::counted(DTASTATS_RETRIES));
+	CHECK(1 == DtaStats::counted(DTASTATS_EXHAUSTED));
+	CHECK(0 == DtaStats::counted(DTASTATS_STACK_RESETS));
+	DtaStats::enabled() = false;
+	d->stackReset();
+	{
+		DtaSession s(d);
+		CHECK(0 == s.start(OPAL_UID::OPAL_ADMINSP_UID));
+	}
+	delete d;
+}
+
+/** regular files in a directory and their modes */
+static size_t lockFiles(const string & dir, bool & private_)
+{
+	size_t n = 0;
+	private_ = true;
+	DIR * d = opendir(dir.c_str());
+	if (NULL == d) return 0;
+	struct dirent * e;
+	while (NULL != (e = readdir(d))) {
+		struct stat st;
+		if (lstat((dir + "/" + e->d_name).c_str(), &st) || !S_ISREG(st.st_mode)) continue;
+		n++;
+		if ((st.st_mode & 0777) != 0600) private_ = false;
+	}
+	closedir(d);
+	return n;
+}
+
+/** the drive lock keeps other processes out and lives in a private directory */
+static void testDevLock()
+{
+	const string key = "sedutil test lock";
+	string dir = DtaTestDir() + "/lock";
+	struct stat st;
+	bool private_;
+	CHECK(0 == DtaDevLock(key, DTA_LOCK_EXCLUSIVE));
+	CHECK((0 == stat(dir.c_str(), &st)) && ((st.st_mode & 0777) == 0700));
+	CHECK(lockFiles(dir, private_) > 0);
+	CHECK(private_);
+	DtaDevUnlock(key, DTA_LOCK_EXCLUSIVE);
+
+	/* another process holds the drive for 300ms */
+	int ready[2];
+	CHECK(0 == pipe(ready));
+	pid_t child = fork();
+	if (0 == child) {
+		char c = (0 == DtaDevLock(key, DTA_LOCK_EXCLUSIVE)) ? 'y' : 'n';
+		if (1 != write(ready[1], &c, 1)) _exit(1);
+		usleep(300000);
+		_exit(0);
+	}
+	CHECK(child > 0);
+	char c = 0;
+	CHECK((1 == read(ready[0], &c, 1)) && ('y' == c));
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	CHECK(0 == DtaDevLock(key, DTA_LOCK_SHARED));
+	CHECK(chrono::steady_clock::now() - start >= chrono::milliseconds(200));
+	DtaDevUnlock(key, DTA_LOCK_SHARED);
+	int status = -1;
+	waitpid(child, &status, 0);
+	CHECK(0 == status);
+	close(ready[0]);
+	close(ready[1]);
+
+	/* a directory others can write to is not used */
+	string open = DtaTestDir() + "/open";
+	CHECK(0 == mkdir(open.c_str(), 0700));
+	CHECK(0 == chmod(open.c_str(), 0777));
+	setenv("SEDUTIL_LOCK_DIR", open.c_str(), 1);
+	CHECK(0 == DtaDevLock(key, DTA_LOCK_EXCLUSIVE));
+	CHECK(0 == lockFiles(open, private_));
+	DtaDevUnlock(key, DTA_LOCK_EXCLUSIVE);
+	setenv("SEDUTIL_LOCK_DIR", dir.c_str(), 1);
+}
+
+int main()
+{
+	DtaTestDir();
+	testAdmission();
+	testRetry();
+	testDevLock();
+	return DtaTestResult("TestAdmission");
+}
@@ -0,0 +1,126 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+#include "DtaTest.h"
+#include "DtaCollect.h"
+#include "DtaDiskCache.h"
+
+using namespace std;
+
+/** Whole contents of a file, empty if it cannot be read */
+static string readFile(const string & path)
+{
+	string s;
+	FILE * f = fopen(path.c_str(), "r");
+	if (NULL == f) return s;
+	char buf[4096];
+	size_t n;
+	while (0 < (n = fread(buf, 1, sizeof(buf), f)))
+		s.append(buf, n);
+	fclose(f);
+	return s;
+}
+
+/** Entries of a directory other than . and .. */
+static int dirEntries(const string & dir)
+{
+	int n = 0;
+	DIR * d = opendir(dir.c_str());
+	if (NULL == d) return -1;
+	struct dirent * e;
+	while (NULL != (e = readdir(d)))
+		if ('.' != e->d_name[0]) n++;
+	closedir(d);
+	return n;
+}
+
+static bool has(const string & text, const char * sample)
+{
+	return string::npos != text.find(sample);
+}
+
+/** the textfile has a sample per drive, is readable by the exporter and
+ * the second collection takes the identity from the scan cache */
+static void testCollect(const string & textfile, vector<DtaDiskEntry> & disks)
+{
+	CHECK(0 == DtaCollectDisks(textfile.c_str(), disks));
+	string prom = readFile(textfile);
+	CHECK(has(prom, "sedutil_probe_success{device=\"sim:K1\"} 1\n"));
+	CHECK(has(prom, "sedutil_probe_success{device=\"/dev/sedutil-test-missing\"} 0\n"));
+	CHECK(has(prom, "sedutil_probe_identify_cached{device=\"sim:K1\"} 0\n"));
+	CHECK(has(prom, "sedutil_locking_enabled{device=\"sim:K1\"} 0\n"));
+	CHECK(has(prom, "sedutil_collect_drives 2\n"));
+	struct stat st;
+	CHECK((0 == stat(textfile.c_str(), &st)) && (0644 == (st.st_mode & 0777)));
+
+	DtaDiskCache cache;
+	DtaDiskCacheLoad(cache);
+	CHECK(cache.count(DtaDiskCacheKey(disks[0])));
+	CHECK(!cache.count(DtaDiskCacheKey(disks[1])));
+
+	CHECK(0 == DtaCollectDisks(textfile.c_str(), disks));
+	prom = readFile(textfile);
+	CHECK(has(prom, "sedutil_probe_identify_cached{device=\"sim:K1\"} 1\n"));
+	CHECK(has(prom, "sedutil_probe_identify_cached{device=\"/dev/sedutil-test-missing\"} 0\n"));
+}
+
+/** collectors writing the same textfile at once leave it whole and no
+ * temporary files next to it */
+static void testConcurrentCollect(const string & textfile, vector<DtaDiskEntry> & disks)
+{
+	vector<thread> threads;
+	vector<int> rc(4, 0xff);
+	for (size_t i = 0; i < rc.size(); i++)
+		threads.push_back(thread([i, &rc, &textfile, &disks] {
+			rc[i] = DtaCollectDisks(textfile.c_str(), disks);
+		}));
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	for (size_t i = 0; i < rc.size(); i++)
+		CHECK(0 == rc[i]);
+	string prom = readFile(textfile);
+	CHECK(has(prom, "sedutil_probe_success{device=\"sim:K1\"} 1\n"));
+	CHECK(has(prom, "sedutil_collect_timestamp_seconds "));
+}
+
+int main()
+{
+	string dir = DtaTestDir() + "/textfile";
+	mkdir(dir.c_str(), 0755);
+	string textfile = dir + "/sedutil.prom";
+	vector<DtaDiskEntry> disks(2);
+	disks[0].devref = "sim:K1";
+	disks[0].transport = "sim";
+	disks[0].serial = "K1";
+	disks[1].devref = "/dev/sedutil-test-missing";
+	disks[1].transport = "sim";
+	disks[1].serial = "K2";
+
+	testCollect(textfile, disks);
+	CHECK(1 == dirEntries(dir));
+	testConcurrentCollect(textfile, disks);
+	CHECK(1 == dirEntries(dir));
+	return DtaTestResult("TestCollect");
+}
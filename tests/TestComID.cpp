@@ -0,0 +1,112 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <set>
+#include <vector>
+#include "DtaTest.h"
+#include "DtaSession.h"
+#include "DtaLexicon.h"
+
+using namespace std;
+
+/** comIDs of one drive are handed out once each, sessions on them
+ * run side by side */
+static void testAllocation()
+{
+	char devref[] = "sim:comid";
+	vector<DtaDev *> devs;
+	set<uint16_t> comIDs;
+	uint8_t rc = 0;
+	while (devs.size() < 16) {
+		DtaDev * d = DtaTestOpen(devref);
+		CHECK(NULL != d);
+		if (NULL == d) return;
+		if ((rc = d->acquireComID()) != 0) {
+			delete d;
+			break;
+		}
+		comIDs.insert(d->comID());
+		devs.push_back(d);
+	}
+	CHECK(DTAERROR_NO_COMID == rc);
+	CHECK(devs.size() > 1);
+	CHECK(comIDs.size() == devs.size());
+
+	/* every comID is busy, all sessions at once */
+	vector<DtaSession *> sessions;
+	for (size_t i = 0; i < devs.size(); i++) {
+		DtaSession * s = new DtaSession(devs[i]);
+		CHECK(0 == s->start(OPAL_UID::OPAL_ADMINSP_UID));
+		sessions.push_back(s);
+	}
+	for (size_t i = 0; i < sessions.size(); i++)
+		delete sessions[i];
+
+	/* a released comID is the one the next object gets */
+	uint16_t released = devs.back()->comID();
+	devs.back()->releaseComID();
+	DtaDev * d = DtaTestOpen(devref);
+	CHECK(NULL != d);
+	if (NULL != d) {
+		CHECK(0 == d->acquireComID());
+		CHECK(released == d->comID());
+		DtaSession s(d);
+		CHECK(0 == s.start(OPAL_UID::OPAL_ADMINSP_UID));
+	}
+	delete d;
+	for (size_t i = 0; i < devs.size(); i++)
+		delete devs[i];
+}
+
+/** a comID wedged by a stranded session is only reset on request */
+static void testReset()
+{
+	char devref[] = "sim:reset";
+	DtaDev * d = DtaTestOpen(devref);
+	CHECK(NULL != d);
+	if (NULL == d) return;
+	CHECK(0 == d->acquireComID());
+	CHECK(0 == DtaTestStrand(d));
+	uint32_t state = 0;
+	CHECK(0 == d->verifyComID(state));
+	CHECK(state >= 2);
+
+	DtaDev::resetComID() = false;
+	{
+		DtaSession s(d);
+		CHECK(OPALSTATUSCODE::NO_SESSIONS_AVAILABLE == s.start(OPAL_UID::OPAL_ADMINSP_UID));
+		s.expectAbort();
+	}
+	DtaDev::resetComID() = true;
+	{
+		DtaSession s(d);
+		CHECK(0 == s.start(OPAL_UID::OPAL_ADMINSP_UID));
+	}
+	DtaDev::resetComID() = false;
+	delete d;
+}
+
+int main()
+{
+	DtaTestDir();
+	testAllocation();
+	testReset();
+	return DtaTestResult("TestComID");
+}
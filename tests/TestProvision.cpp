@@ -0,0 +1,157 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <stdio.h>
+#include "DtaTest.h"
+#include "DtaProvision.h"
+#include "libsedutil.h"
+
+using namespace std;
+
+static char password[] = "provision";
+
+/** Level 0 Discovery state of a simulated drive */
+static bool driveInfo(const char * devref, sedutil_info & info)
+{
+	sedutil_dev * dev;
+	if (sedutil_open(devref, 0, &dev)) return false;
+	int rc = sedutil_get_info(dev, &info);
+	sedutil_close(dev);
+	return 0 == rc;
+}
+
+/** a manifest takes fresh drives to locking with their ranges and MBR
+ * set up, a drive that fails does not hold up the others */
+static void testProvision()
+{
+	string pba = DtaTestDir() + "/pba.img";
+	FILE * f = fopen(pba.c_str(), "w");
+	CHECK(NULL != f);
+	if (NULL == f) return;
+	for (int i = 0; i < 8192; i++)
+		fputc(i & 0xff, f);
+	fclose(f);
+
+	/* sim:prov3 already belongs to someone else */
+	char owned[] = "sim:prov3";
+	char other[] = "someone else";
+	DtaDev * d = DtaTestOpen(owned);
+	CHECK(NULL != d);
+	if (NULL != d) CHECK(0 == d->initialSetup(other));
+	delete d;
+
+	string manifest = DtaTestDir() + "/manifest";
+	f = fopen(manifest.c_str(), "w");
+	CHECK(NULL != f);
+	if (NULL == f) return;
+	fprintf(f, "# sim drives\n"
+		"limits total=2\n"
+		"defaults password=%s takeOwnership activate mbrEnable=on\n"
+		"sim:prov1 range=1:0:2048 range=2:4096:2048 pba=%s\n"
+		"sim:prov2 range=1:8192:2048 mbrEnable=off\n"
+		"sim:prov3\n", password, pba.c_str());
+	fclose(f);
+	CHECK(0 != DtaProvision(manifest.c_str(), false));
+
+	sedutil_info info;
+	CHECK(driveInfo("sim:prov1", info));
+	CHECK(info.locking_enabled && info.mbr_enabled && !info.locked);
+	CHECK(driveInfo("sim:prov2", info));
+	CHECK(info.locking_enabled && !info.mbr_enabled && !info.locked);
+
+	/* the manifest password is Admin1's now, set up ranges start with
+	 * their locks disabled */
+	char prov1[] = "sim:prov1";
+	d = DtaTestOpen(prov1);
+	CHECK(NULL != d);
+	if (NULL != d) CHECK(0 == d->configureLockingRange(1,
+		DTA_READLOCKINGENABLED | DTA_WRITELOCKINGENABLED, password));
+	delete d;
+	sedutil_dev * dev;
+	CHECK(0 == sedutil_open(prov1, 0, &dev));
+	CHECK(SEDUTIL_E_NOT_AUTHORIZED == sedutil_set_locking_range(dev, 1, SEDUTIL_LOCK_LK, other));
+	CHECK(0 == sedutil_set_locking_range(dev, 1, SEDUTIL_LOCK_LK, password));
+	CHECK((0 == sedutil_get_info(dev, &info)) && info.locked);
+	CHECK(0 == sedutil_set_locking_range(dev, 1, SEDUTIL_LOCK_RW, password));
+	CHECK((0 == sedutil_get_info(dev, &info)) && !info.locked);
+	sedutil_close(dev);
+
+	/* and sim:prov3 still belongs to its owner */
+	CHECK(0 == sedutil_open("sim:prov3", 0, &dev));
+	CHECK(SEDUTIL_E_NOT_AUTHORIZED == sedutil_set_locking_range(dev, 0, SEDUTIL_LOCK_LK, password));
+	sedutil_close(dev);
+}
+
+/** rekeying every range of a provisioned drive needs Admin1 and leaves
+ * the lock states alone */
+static void testRekey()
+{
+	sedutil_dev * dev;
+	sedutil_info info;
+	char wrong[] = "wrong";
+	CHECK(0 == sedutil_open("sim:prov1", 0, &dev));
+	CHECK(0 == sedutil_set_locking_range(dev, 1, SEDUTIL_LOCK_LK, password));
+	CHECK(SEDUTIL_E_NOT_AUTHORIZED == sedutil_rekey_all_ranges(dev, wrong));
+	CHECK(0 == sedutil_rekey_all_ranges(dev, password));
+	CHECK((0 == sedutil_get_info(dev, &info)) && info.locked);
+	CHECK(0 == sedutil_set_locking_range(dev, 1, SEDUTIL_LOCK_RW, password));
+	CHECK((0 == sedutil_get_info(dev, &info)) && !info.locked);
+	sedutil_close(dev);
+}
+
+/** setAll locks and unlocks every range of a provisioned drive in one
+ * session and reports how long that took */
+static void testSetAll()
+{
+	char prov1[] = "sim:prov1";
+	DtaDev * d = DtaTestOpen(prov1);
+	CHECK(NULL != d);
+	if (NULL != d) CHECK(0 == d->configureLockingRange(2,
+		DTA_READLOCKINGENABLED | DTA_WRITELOCKINGENABLED, password));
+	delete d;
+
+	sedutil_dev * dev;
+	sedutil_info info;
+	uint32_t us = 0;
+	char wrong[] = "wrong";
+	CHECK(0 == sedutil_open(prov1, 0, &dev));
+	CHECK(SEDUTIL_E_NOT_AUTHORIZED == sedutil_set_all_ranges(dev, SEDUTIL_LOCK_LK, wrong, NULL));
+	CHECK((0 == sedutil_get_info(dev, &info)) && !info.locked);
+	CHECK(0 == sedutil_set_all_ranges(dev, SEDUTIL_LOCK_LK, password, &us));
+	CHECK(0 < us);
+	CHECK((0 == sedutil_get_info(dev, &info)) && info.locked);
+	/* range 1 alone still leaves range 2 locked */
+	CHECK(0 == sedutil_set_locking_range(dev, 1, SEDUTIL_LOCK_RW, password));
+	CHECK((0 == sedutil_get_info(dev, &info)) && info.locked);
+	us = 0;
+	CHECK(0 == sedutil_set_all_ranges(dev, SEDUTIL_LOCK_RW, password, &us));
+	CHECK(0 < us);
+	CHECK((0 == sedutil_get_info(dev, &info)) && !info.locked && info.mbr_done);
+	sedutil_close(dev);
+}
+
+int main()
+{
+	DtaTestDir();
+	testProvision();
+	testRekey();
+	testSetAll();
+	return DtaTestResult("TestProvision");
+}
@@ -0,0 +1,173 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <string.h>
+#include <functional>
+#include <vector>
+#include "DtaTest.h"
+#include "DtaDevOpal2.h"
+#include "DtaSession.h"
+#include "DtaCommand.h"
+#include "DtaResponse.h"
+#include "DtaEndianFixup.h"
+
+using namespace std;
+
+/** A ComPacket with one subpacket holding payload, the lengths can be
+ * made to disagree with the buffer afterwards */
+static vector<uint8_t> comPacket(const vector<uint8_t> & payload)
+{
+	vector<uint8_t> buf(sizeof (OPALHeader) + payload.size());
+	OPALHeader * h = (OPALHeader *)buf.data();
+	h->subpkt.length = SWAP32((uint32_t)payload.size());
+	h->pkt.length = SWAP32((uint32_t)(sizeof (OPALDataSubPacket) + payload.size()));
+	h->cp.length = SWAP32((uint32_t)(buf.size() - sizeof (OPALComPacket)));
+	memcpy(buf.data() + sizeof (OPALHeader), payload.data(), payload.size());
+	return buf;
+}
+
+/** a response only yields what is inside its buffer and subpacket, and
+ * says so instead of reading on or exiting */
+static void testParse()
+{
+	/* [ 5 "ab" ] EOD [ 0 0 0 ] */
+	vector<uint8_t> ok = { 0xf0, 0x05, 0xa2, 'a', 'b', 0xf1, 0xf9, 0xf0, 0x00, 0x00, 0x00, 0xf1 };
+	vector<uint8_t> buf = comPacket(ok);
+	DtaResponse r(buf.data(), (uint32_t)buf.size());
+	CHECK(!r.failed());
+	CHECK(10 == r.getTokenCount());
+	CHECK(5 == r.getUint8(1));
+	CHECK("ab" == r.getString(2));
+	CHECK(!r.failed());
+
+	/* a getter past the end or of the wrong type */
+	CHECK(0 == r.getUint32(10));
+	CHECK(r.failed());
+	r.init(buf.data(), (uint32_t)buf.size());
+	CHECK(!r.failed());
+	CHECK(0 == r.getUint64(0));
+	CHECK(r.failed());
+
+	/* shorter than the header */
+	r.init(buf.data(), sizeof (OPALHeader) - 1);
+	CHECK(r.failed() && (0 == r.getTokenCount()));
+
+	/* a subpacket longer than the buffer */
+	((OPALHeader *)buf.data())->subpkt.length = SWAP32(0x7fffffff);
+	r.init(buf.data(), (uint32_t)buf.size());
+	CHECK(r.failed());
+	CHECK(10 == r.getTokenCount());
+
+	/* a short atom cut off by the subpacket */
+	vector<uint8_t> cut = { 0xf0, 0xaf, 'a', 'b' };
+	buf = comPacket(cut);
+	r.init(buf.data(), (uint32_t)buf.size());
+	CHECK(r.failed() && (1 == r.getTokenCount()));
+
+	/* medium and long atoms whose length bytes are past the end */
+	vector<uint8_t> medium = { 0xf0, 0xd0 };
+	buf = comPacket(medium);
+	r.init(buf.data(), (uint32_t)buf.size());
+	CHECK(r.failed() && (1 == r.getTokenCount()));
+	vector<uint8_t> longAtom = { 0xe2, 0xff, 0xff };
+	buf = comPacket(longAtom);
+	r.init(buf.data(), (uint32_t)buf.size());
+	CHECK(r.failed() && (0 == r.getTokenCount()));
+	vector<uint8_t> huge = { 0xe2, 0xff, 0xff, 0xff, 'x' };
+	buf = comPacket(huge);
+	r.init(buf.data(), (uint32_t)buf.size());
+	CHECK(r.failed() && (0 == r.getTokenCount()));
+}
+
+/** A sim drive whose IF_RECV replies can be damaged on their way up */
+class DtaDevMangled : public DtaDevOpal2 {
+public:
+	DtaDevMangled(const char * devref) : DtaDevOpal2(devref) {}
+	uint8_t sendCmd(ATACOMMAND cmd, uint8_t protocol, uint16_t comID,
+		void * buffer, uint32_t bufferlen)
+	{
+		uint8_t rc = DtaDevOpal2::sendCmd(cmd, protocol, comID, buffer, bufferlen);
+		if ((0 == rc) && (IF_RECV == cmd) && mangle && (0 != ((OPALHeader *)buffer)->cp.length))
+			mangle((OPALHeader *)buffer);
+		return rc;
+	}
+	function<void(OPALHeader *)> mangle;
+};
+
+/** Start a session on a drive of its own with the reply damaged */
+static uint8_t startMangled(const char * devref, function<void(OPALHeader *)> mangle)
+{
+	DtaDevMangled d(devref);
+	d.mangle = mangle;
+	DtaSession s(&d);
+	uint8_t rc = s.start(OPAL_UID::OPAL_ADMINSP_UID);
+	return rc;
+}
+
+/** a damaged reply to StartSession fails the call, it does not crash it */
+static void testSession()
+{
+	CHECK(0 == startMangled("sim:resp0", NULL));
+	CHECK(DTAERROR_BAD_RESPONSE == startMangled("sim:resp1", [](OPALHeader * h) {
+		h->subpkt.length = SWAP32(0x7fffffff);
+		h->cp.length = SWAP32(0x7fffffff);
+	}));
+	CHECK(DTAERROR_BAD_RESPONSE == startMangled("sim:resp2", [](OPALHeader * h) {
+		/* cut inside the invoking UID */
+		h->subpkt.length = SWAP32(5);
+	}));
+	CHECK(DTAERROR_BAD_RESPONSE == startMangled("sim:resp3", [](OPALHeader * h) {
+		uint8_t * p = (uint8_t *)(h + 1);
+		p[0] = 0xd7;
+		p[1] = 0xff;
+	}));
+}
+
+/** a command that does not fit is refused before anything is sent */
+static void testOverrun()
+{
+	char devref[] = "sim:resp4";
+	DtaDev * d = DtaTestOpen(devref);
+	CHECK(NULL != d);
+	if (NULL == d) return;
+	DtaSession * s = new DtaSession(d);
+	CHECK(0 == s->start(OPAL_UID::OPAL_ADMINSP_UID));
+	DtaCommand * cmd = new DtaCommand(OPAL_UID::OPAL_C_PIN_MSID, OPAL_METHOD::GET);
+	vector<uint8_t> big(MAX_BUFFER_LENGTH, 0);
+	cmd->addToken(OPAL_TOKEN::STARTLIST);
+	cmd->addToken(big);
+	cmd->addToken(OPAL_TOKEN::ENDLIST);
+	cmd->complete();
+	CHECK(cmd->isOverrun());
+	DtaResponse response;
+	CHECK(DTAERROR_COMMAND_ERROR == s->sendCommand(cmd, response));
+	delete cmd;
+	delete s;
+	delete d;
+}
+
+int main()
+{
+	DtaTestDir();
+	testParse();
+	testSession();
+	testOverrun();
+	return DtaTestResult("TestResponse");
+}
@@ -0,0 +1,125 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <dirent.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+#include "DtaTest.h"
+#include "DtaDiskCache.h"
+
+using namespace std;
+
+/** Files of the scratch directory named like the cache, the cache
+ * itself and any temporary copy */
+static int cacheFiles(const string & dir)
+{
+	int n = 0;
+	DIR * d = opendir(dir.c_str());
+	if (NULL == d) return 0;
+	struct dirent * e;
+	while (NULL != (e = readdir(d)))
+		if (!strncmp("scan", e->d_name, 4)) n++;
+	closedir(d);
+	return n;
+}
+
+/** a cache comes back the way it was saved, tabs and newlines in the
+ * identify strings cannot break its lines */
+static void testRoundTrip()
+{
+	DtaDiskCache cache, loaded;
+	DtaDiskCacheLoad(loaded);
+	CHECK(loaded.empty());
+	DtaDiskCacheEntry & a = cache["naa.5000c500a1b2c3d4"];
+	a.ssc = DTA_CACHE_OPAL2 | DTA_CACHE_ANYSSC;
+	a.probed = 1700000000;
+	a.model = "Model\twith\ttabs";
+	a.firmware = "FW\n01";
+	a.serial = "S1";
+	a.devType = DEVICE_TYPE_NVME;
+	DtaDiskCacheEntry & b = cache["sata:S2"];
+	b.ssc = 0;
+	b.probed = 1700000001;
+	b.model = "Other";
+	b.firmware = "02";
+	CHECK(DtaDiskCacheSave(cache));
+
+	struct stat st;
+	CHECK((0 == stat(DtaDiskCachePath(), &st)) && (0644 == (st.st_mode & 0777)));
+	DtaDiskCacheLoad(loaded);
+	CHECK(2 == loaded.size());
+	const DtaDiskCacheEntry & x = loaded["naa.5000c500a1b2c3d4"];
+	CHECK((DTA_CACHE_OPAL2 | DTA_CACHE_ANYSSC) == x.ssc);
+	CHECK(1700000000 == x.probed);
+	CHECK("Model with tabs" == x.model);
+	CHECK("FW 01" == x.firmware);
+	CHECK("S1" == x.serial);
+	CHECK(DEVICE_TYPE_NVME == x.devType);
+	const DtaDiskCacheEntry & y = loaded["sata:S2"];
+	CHECK((0 == y.ssc) && ("Other" == y.model) && ("02" == y.firmware));
+	CHECK(y.serial.empty() && (DEVICE_TYPE_OTHER == y.devType));
+	CHECK(1 == cacheFiles(DtaTestDir()));
+}
+
+/** scans saving at the same time each leave a whole cache and no
+ * temporary files behind */
+static void testConcurrentSave()
+{
+	const int writers = 8, saves = 25, disks = 50;
+	vector<thread> threads;
+	vector<int> saved(writers, 1);
+	for (int w = 0; w < writers; w++)
+		threads.push_back(thread([w, &saved] {
+			DtaDiskCache cache;
+			for (int i = 0; i < disks; i++) {
+				DtaDiskCacheEntry & e = cache["disk" + to_string(i)];
+				e.ssc = DTA_CACHE_OPAL2;
+				e.probed = w;
+				e.model = "writer" + to_string(w);
+			}
+			for (int i = 0; i < saves; i++)
+				if (!DtaDiskCacheSave(cache)) saved[w] = 0;
+		}));
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	for (int w = 0; w < writers; w++)
+		CHECK(saved[w]);
+	CHECK(1 == cacheFiles(DtaTestDir()));
+
+	/* the last rename won, every line is from the same writer */
+	DtaDiskCache loaded;
+	DtaDiskCacheLoad(loaded);
+	CHECK(disks == (int)loaded.size());
+	bool whole = !loaded.empty();
+	for (DtaDiskCache::iterator it = loaded.begin(); it != loaded.end(); it++)
+		if (("writer" + to_string(loaded.begin()->second.probed)) != it->second.model)
+			whole = false;
+	CHECK(whole);
+}
+
+int main()
+{
+	DtaTestDir();
+	testRoundTrip();
+	testConcurrentSave();
+	return DtaTestResult("TestScanCache");
+}
@@ -0,0 +1,145 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "DtaTest.h"
+#include "DtaTrace.h"
+#include "DtaSession.h"
+#include "DtaHashPwd.h"
+
+using namespace std;
+
+/** Whole contents of a file, empty if it cannot be read */
+static vector<uint8_t> readFile(const string & path)
+{
+	vector<uint8_t> data;
+	FILE * f = fopen(path.c_str(), "r");
+	if (NULL == f) return data;
+	uint8_t buf[65536];
+	size_t n;
+	while (0 < (n = fread(buf, 1, sizeof(buf), f)))
+		data.insert(data.end(), buf, buf + n);
+	fclose(f);
+	return data;
+}
+
+static bool contains(const vector<uint8_t> & data, const void * secret, size_t len)
+{
+	return NULL != memmem(data.data(), data.size(), secret, len);
+}
+
+/** C_PIN Set, StartSession with a HostChallenge and Authenticate reach
+ * the trace file with their credentials zeroed, hashed or not */
+static void testRecord()
+{
+	string path = DtaTestDir() + "/trace";
+	CHECK(DtaTrace::open(path.c_str(), 1));
+
+	char plain[] = "sim:trace1";
+	char sid[] = "plain-sid-secret";
+	char auth[] = "plain-auth-secret";
+	DtaDev * d = DtaTestOpen(plain);
+	CHECK(NULL != d);
+	if (NULL == d) return;
+	d->no_hash_passwords = true;
+	CHECK(0 == d->initialSetup(sid));
+	DtaSession * s = new DtaSession(d);
+	s->dontHashPwd();
+	CHECK(0 == s->start(OPAL_UID::OPAL_LOCKINGSP_UID));
+	vector<uint8_t> admin1(1, OPAL_SHORT_ATOM::BYTESTRING8);
+	admin1.insert(admin1.end(), OPALUID[OPAL_UID::OPAL_ADMIN1_UID], OPALUID[OPAL_UID::OPAL_ADMIN1_UID] + 8);
+	s->authenticate(admin1, auth);
+	delete s;
+	delete d;
+
+	char hashed[] = "sim:trace2";
+	char pw[] = "hashed-secret";
+	vector<uint8_t> hash;
+	d = DtaTestOpen(hashed);
+	CHECK(NULL != d);
+	if (NULL == d) return;
+	CHECK(0 == d->initialSetup(pw));
+	DtaHashPwd(hash, pw, d);
+	delete d;
+	DtaTrace::close();
+
+	DTA_TRACE_HEADER h;
+	vector<DtaTraceEntry> entries;
+	CHECK(0 == DtaTraceRead(path.c_str(), entries, &h));
+	CHECK(20 < entries.size());
+	vector<uint8_t> file = readFile(path);
+	CHECK(!file.empty());
+	CHECK(!contains(file, sid, strlen(sid)));
+	CHECK(!contains(file, auth, strlen(auth)));
+	CHECK(!contains(file, pw, strlen(pw)));
+	CHECK(34 == hash.size());
+	CHECK(!contains(file, hash.data() + 2, hash.size() - 2));
+	/* the rest of the traffic is still there */
+	CHECK(contains(file, OPALMETHOD[OPAL_METHOD::AUTHENTICATE], 8));
+}
+
+/** a challenge cut off at the end of the captured bytes is zeroed too */
+static void testCut()
+{
+	/* CALL SMUID.StartSession [ 105 AdminSP 1 ( 0 = challenge ) ],
+	 * the challenge a medium atom */
+	char challenge[] = "cut-secret-challenge";
+	vector<uint8_t> whole(sizeof(OPALHeader), 0);
+	whole.push_back(OPAL_TOKEN::CALL);
+	whole.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
+	whole.insert(whole.end(), OPALUID[OPAL_UID::OPAL_SMUID_UID], OPALUID[OPAL_UID::OPAL_SMUID_UID] + 8);
+	whole.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
+	whole.insert(whole.end(), OPALMETHOD[OPAL_METHOD::STARTSESSION], OPALMETHOD[OPAL_METHOD::STARTSESSION] + 8);
+	whole.push_back(OPAL_TOKEN::STARTLIST);
+	whole.push_back(0x81);
+	whole.push_back(105);
+	whole.push_back(OPAL_SHORT_ATOM::BYTESTRING8);
+	whole.insert(whole.end(), OPALUID[OPAL_UID::OPAL_ADMINSP_UID], OPALUID[OPAL_UID::OPAL_ADMINSP_UID] + 8);
+	whole.push_back(OPAL_TINY_ATOM::UINT_01);
+	whole.push_back(OPAL_TOKEN::STARTNAME);
+	whole.push_back(OPAL_TINY_ATOM::UINT_00);
+	whole.push_back(0xd0);
+	whole.push_back((uint8_t)strlen(challenge));
+	whole.insert(whole.end(), challenge, challenge + strlen(challenge));
+	whole.push_back(OPAL_TOKEN::ENDNAME);
+	whole.push_back(OPAL_TOKEN::ENDLIST);
+	uint8_t * at = (uint8_t *)memmem(whole.data(), whole.size(), challenge, strlen(challenge));
+	CHECK(NULL != at);
+	if (NULL == at) return;
+	uint32_t len = (uint32_t)(at - whole.data()) + 6;
+
+	vector<uint8_t> cut(whole.begin(), whole.begin() + len);
+	DtaTrace::redact(IF_SEND, 0x01, cut.data(), len);
+	CHECK(!contains(cut, challenge, 6));
+	CHECK(!memcmp(cut.data(), whole.data(), sizeof(OPALHeader)));
+	DtaTrace::redact(IF_SEND, 0x01, whole.data(), (uint32_t)whole.size());
+	CHECK(!contains(whole, challenge, strlen(challenge)));
+	CHECK(contains(whole, OPALMETHOD[OPAL_METHOD::STARTSESSION], 8));
+}
+
+int main()
+{
+	DtaTestDir();
+	testRecord();
+	testCut();
+	return DtaTestResult("TestTrace");
+}
@@ -0,0 +1,93 @@
+/* C:B**************************************************************************
+This software is Copyright 2014-2017 Bright Plaza Inc. <drivetrust@drivetrust.com>
+
+This file is part of sedutil.
+
+sedutil is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+sedutil is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
+
+ * C:E********************************************************************** */
+#include "os.h"
+#include "DtaTest.h"
+#include "DtaDiskWatch.h"
+#include "DtaProbe.h"
+
+using namespace std;
+
+/** the change uevent a probe causes is dropped, nothing else is */
+static void testQuiet()
+{
+	DtaWatchQuiet quiet;
+	uint64_t t = 1000000;
+	CHECK(!quiet.ignore("sda", "change", t));
+
+	/* the first change inside the window, once */
+	quiet.probed("sda", t);
+	CHECK(!quiet.ignore("sdb", "change", t + 1));
+	CHECK(quiet.ignore("sda", "change", t + 1));
+	CHECK(!quiet.ignore("sda", "change", t + 2));
+
+	/* the window ends */
+	quiet.probed("sda", t);
+	CHECK(quiet.ignore("sda", "change", t + DTA_WATCH_QUIET_MS));
+	quiet.probed("sda", t);
+	CHECK(!quiet.ignore("sda", "change", t + DTA_WATCH_QUIET_MS + 1));
+	CHECK(!quiet.ignore("sda", "change", t + 1));
+
+	/* an add or remove is never dropped and closes the window */
+	quiet.probed("sda", t);
+	CHECK(!quiet.ignore("sda", "add", t + 1));
+	CHECK(!quiet.ignore("sda", "change", t + 2));
+	quiet.probed("sda", t);
+	CHECK(!quiet.ignore("sda", "remove", t + 1));
+	CHECK(!quiet.ignore("sda", "change", t + 2));
+
+	/* disks have their own windows */
+	quiet.probed("sda", t);
+	quiet.probed("nvme0", t);
+	CHECK(quiet.ignore("nvme0", "change", t + 1));
+	CHECK(quiet.ignore("sda", "change", t + 1));
+}
+
+/** the probe the watch reports from sees a lock change on the drive */
+static void testProbe()
+{
+	DtaProbeResult r;
+	r.device = "sim:watch";
+	DtaProbeDrive(r);
+	CHECK(0 == r.rc);
+	CHECK(r.opal2 && !r.lockingEnabled && !r.locked);
+
+	char devref[] = "sim:watch";
+	char password[] = "watch";
+	DtaDev * d = DtaTestOpen(devref);
+	CHECK(NULL != d);
+	if (NULL == d) return;
+	CHECK(0 == d->initialSetup(password));
+	CHECK(0 == d->configureLockingRange(0,
+		DTA_READLOCKINGENABLED | DTA_WRITELOCKINGENABLED, password));
+	CHECK(0 == d->setLockingRange(0, OPAL_LOCKINGSTATE::READONLY, password));
+	delete d;
+	r = DtaProbeResult();
+	r.device = "sim:watch";
+	DtaProbeDrive(r);
+	CHECK((0 == r.rc) && r.lockingEnabled && r.locked);
+}
+
+int main()
+{
+	DtaTestDir();
+	testQuiet();
+	testProbe();
+	return DtaTestResult("TestWatch");
+}
@@ -37,6 +37,11 @@ along with sedutil.  If not, see <http://www.gnu.org/licenses/>.
 
 using namespace std;
 DtaDevOS::DtaDevOS() {};
+void DtaDevOS::init(const char * devref, const OPAL_DiskInfo * identity)
+{
+	(void)identity;
+	init(devref);
+}
 void DtaDevOS::init(const char * devref)
 {
     LOG(D1) << "Creating DtaDevOS::DtaDevOS() " << devref;
@@ -140,12 +145,16 @@ void DtaDevOS::identify(OPAL_DiskInfo& di)
 	return(disk->identify(di));
 }
 /** Static member to scann for supported drives */
-int DtaDevOS::diskScan()
+int DtaDevOS::diskScan(const char * filter, bool noSpinUp)
 {
 	char devname[25];
 	int i = 0;
 	DtaDev * d;
 	LOG(D1) << "Creating diskList";
+	if ((NULL != filter) || noSpinUp) {
+		LOG(E) << "Scan filters and --noSpinUp are not supported on Windows";
+		return DTAERROR_INVALID_PARAMETER;
+	}
 	printf("\nScanning for Opal compliant disks\n");
 	while (TRUE) {
 		sprintf_s(devname, 23, "\\\\.\\PhysicalDrive%i", i);
@@ -37,6 +37,10 @@ public:
      * @param devref character representation of the device is standard OS lexicon
      */
 	void init(const char * devref);
+	/** init() with the results of an earlier identify, see the Linux
+	 * DtaDevOS. Identify is always sent here, identity is not used.
+	 */
+	void init(const char * devref, const OPAL_DiskInfo * identity);
 	/** OS specific method to send an ATA command to the device
      * @param cmd ATA command to be sent to the device
      * @param protocol security protocol to be used in the command
@@ -54,8 +58,11 @@ public:
 	* @param bufferlen length of the input/output buffer
 	*/
 	unsigned long long	getSize();
-	/** A static class to scan for supported drives */
-	static int diskScan();
+	/** A static class to scan for supported drives
+	 * @param filter transport/vendor/model filter, not supported on Windows
+	 * @param noSpinUp power state aware scan, not supported on Windows
+	 */
+	static int diskScan(const char * filter = NULL, bool noSpinUp = false);
 protected:
      /** OS specific command to Wait for specified number of milliseconds 
      * @param milliseconds  number of milliseconds to wait
@@ -31,6 +31,8 @@ along with sedutil.If not, see <http://www.gnu.org/licenses/>.
 #include "log.h"
 /** OS specific implementation of the "safe" snprintf function */
 #define SNPRINTF sprintf_s
+/** zero a secret, the compiler may not drop it as a dead store */
+#define SECUREZERO(p, len) SecureZeroMemory((p), (len))
 #define strcasecmp _stricmp 
 /** OS specific example device to be used in help output*/
 #define DEVICEEXAMPLE "\\\\.\\PhysicalDrive3"